@@ -41,6 +41,11 @@ private:
   void append( const Amplitude&              ampl );
   void append( const Operation::Op&          oper );
 
+  // Parse the expression, taking the value of the i-th resonance from
+  //    reso( i ) and the one of the i-th F vector component from fvec( i ).
+  template< class R, class F >
+  std::complex< double > parse( const R& reso, const F& fvec ) const throw( PdfException );
+
   // Constructor to be called by binary operators.
   template< class L, class R >
   Amplitude( const L& left, const R& right, const Operation::Op& oper )
@@ -110,6 +115,43 @@ public:
 				   const double&     mSq13,
 				   const double&     mSq23 ) const throw( PdfException );
 
+  // Values at n points, with the resonances evaluated by their array kernels.
+  void evaluate( const PhaseSpace& ps,
+                 const double*     mSq12,
+                 const double*     mSq13,
+                 const double*     mSq23,
+                 std::complex< double >* values, const std::size_t& n ) const throw( PdfException );
+
+  // Decomposition of the amplitude as a0 + sum_k c_k A_k, with A_k the terms
+  //    of the resonances, see Resonance::terms, followed by the F vector
+  //    components. It is only possible if the expression is linear in them,
+  //    e.g. a sum of coefficients times resonances. The components do not
+  //    depend on the coefficients, so their values can be kept while their
+  //    own parameters are fixed.
+  const bool        isLinear()        const;
+  const bool        componentsFixed() const;
+  const std::size_t nComponents()     const;
+
+  // Values of the components at the given point, zero outside the phase space.
+  void components( const PhaseSpace& ps,
+                   const double&     mSq12,
+                   const double&     mSq13,
+                   const double&     mSq23,
+                   std::complex< double >* values ) const;
+
+  // Value of the amplitude with the given values of the components.
+  std::complex< double > combine( const std::vector< std::complex< double > >& values ) const throw( PdfException );
+
+  // Coefficients a0, c_1, ..., c_n of a linear amplitude, with the current
+  //    values of the parameters.
+  const std::vector< std::complex< double > > coefficients() const throw( PdfException );
+
+  // Source of the functions of the resonances and of an inline function
+  //    amplitude( par, s12, s13, s23 ), zero outside the phase space, for the
+  //    code generation backend. pars maps the names of the parameters to their
+  //    code, as in Resonance::code. F vector components are not supported.
+  const std::string code( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException );
+
   // Assignment operations.
   const Amplitude& operator= ( const double&                 ctnt );
   const Amplitude& operator= ( const std::complex< double >& ctnt );
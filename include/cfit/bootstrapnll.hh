@@ -0,0 +1,96 @@
+#ifndef __BOOTSTRAPNLL_HH__
+#define __BOOTSTRAPNLL_HH__
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include <Minuit/FunctionMinimum.h>
+
+#include <cfit/minimizer.hh>
+#include <cfit/pdfbase.hh>
+#include <cfit/dataset.hh>
+#include <cfit/exceptions.hh>
+
+class PdfModel;
+class PdfExpr;
+
+// Negative log-likelihoods of bootstrap replicas of a dataset. Instead of
+//    resampling the events, each replica weights every event by a Poisson( 1 )
+//    integer, drawn from a counter-based stream of the seed, the replica and
+//    the event. The weights are drawn once for each dataset and kept as one
+//    byte per replica and event, so all the replicas share the single copy of
+//    the dataset and its per-event caches.
+//
+// As a minimizer, the object fits the replica selected with setReplica. The
+//    evaluate function computes the nlls of all the replicas at once in a
+//    single pass over the data, with one evaluation of the pdf per event and
+//    distinct set of parameters, summed by the threads in chunks of events.
+//    The minimizeAll function fits the replicas in parallel, each with its own
+//    Migrad, so their fits do not share the passes over the data; evaluate is
+//    meant for minimizers that step all the replicas together.
+class BootstrapNll : public Minimizer
+{
+private:
+  unsigned _nReplicas;
+  uint64_t _seed;
+  unsigned _replica;
+
+  // Weights of each replica and event, shared by the copies.
+  std::shared_ptr< const std::vector< std::vector< uint8_t > > > _weights;
+
+  // Name of the field with the weight of each event, if any, and its values,
+  //    which multiply the weights of the replicas.
+  std::string                                    _weightField;
+  std::shared_ptr< const std::vector< double > > _weightValues;
+
+  // Pdfs of each distinct set of parameters of the batch evaluation.
+  mutable std::vector< PdfBase* > _pdfs;
+
+  void clear() const;
+
+  // Draw the weights of the replicas for the current dataset, and read the
+  //    weights of its events.
+  void dataChanged();
+
+  // Nlls of the given replicas, each one at its own set of parameters.
+  const std::vector< double > nlls( const std::vector< std::vector< double > >& pars    ,
+                                    const std::vector< unsigned >&              replicas ) const throw( PdfException );
+
+public:
+  BootstrapNll( const PdfModel& pdf, const Dataset& data, const unsigned& nReplicas, const uint64_t& seed = 0 );
+  BootstrapNll( const PdfExpr&  pdf, const Dataset& data, const unsigned& nReplicas, const uint64_t& seed = 0 );
+
+  BootstrapNll( const BootstrapNll& right );
+
+  BootstrapNll* copy() const { return new BootstrapNll( *this ); }
+
+  ~BootstrapNll();
+
+  // Getters.
+  const unsigned& nReplicas() const { return _nReplicas; }
+  const unsigned& replica()   const { return _replica;   }
+
+  // Weight of an event in a replica.
+  const unsigned weight( const unsigned& replica, const std::size_t& event ) const { return ( *_weights )[ replica ][ event ]; }
+
+  // Select the replica to be fitted by minimize.
+  void setReplica( const unsigned& replica ) throw( PdfException );
+
+  // Weight each event by the value of a field of the dataset, as in Nll.
+  void               setWeights( const std::string& field ) throw( DataException );
+  const std::string& weights() const { return _weightField; }
+
+  double operator()( const std::vector< double >& pars ) const throw( PdfException );
+
+  // Nlls of all the replicas, each one at its own set of parameters. The nll
+  //    of the selected replica alone is given by operator().
+  const std::vector< double > evaluate( const std::vector< std::vector< double > >& pars ) const throw( PdfException );
+
+  // Fit all the replicas in parallel, each one on its own, starting from the
+  //    current values of the parameters.
+  const std::vector< FunctionMinimum > minimizeAll() const;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __CACHEMANAGER_HH__
+#define __CACHEMANAGER_HH__
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <complex>
+#include <ostream>
+
+#include <cfit/dataset.hh>
+#include <cfit/pdfbase.hh>
+#include <cfit/exceptions.hh>
+
+
+// Storage of the per-event caches of a pdf under a memory budget. The caches
+//    are computed separately for each source of the pdf, i.e. for each model of
+//    an expression, with the relative cost per event given by its cacheCost.
+//    Each cached column is then either materialized at full precision, stored
+//    as floats if allowed, or dropped and recomputed for each block of events
+//    when it is read, favouring the columns that are most expensive to compute
+//    for the memory they take. The plan only depends on the pdf, the number
+//    of events and the budget, so fits are reproducible. Dropped columns are
+//    recomputed with copies of the pdf kept by the manager, so blocks can be
+//    recomputed by several threads at once.
+//
+// The budget is shared by all the managers alive in the process, i.e. by the
+//    minimizers and the categories of simultaneous fits, and each new manager
+//    is given what the others leave. It defaults to half the physical memory
+//    of the node. When all the columns fit in it, they are all materialized,
+//    as without a manager.
+class CacheManager
+{
+public:
+  enum Policy { Materialize, Reduce, Recompute };
+
+  struct Column
+  {
+    unsigned    index;   // Cache index assigned by the pdf.
+    bool        complex;
+    unsigned    source;  // Source of the pdf that computes the column.
+    std::size_t bytes;   // Size of the column at full precision.
+    double      cost;    // Relative cost per event to compute it.
+    Policy      policy;
+  };
+
+  // Values of the columns that are not materialized at full precision for a
+  //    block of events, owned by the caller that reads them.
+  class Block
+  {
+    friend class CacheManager;
+
+  private:
+    std::size_t _first;
+    std::size_t _last;
+
+    std::map< unsigned, std::vector< double >                 > _real;
+    std::map< unsigned, std::vector< std::complex< double > > > _complex;
+
+  public:
+    Block() : _first( 0 ), _last( 0 ) {}
+
+    const std::size_t& last() const { return _last; }
+
+    // Add the values that the pdf computes for each block of events at the
+    //    current parameters, see PdfBase::cacheBlock. Called after each load,
+    //    with the pdf that is evaluated on the block.
+    void evaluate( const PdfBase& pdf, const Dataset& data ) { pdf.cacheBlock( data, _first, _last, _complex ); }
+
+    // Copy the values of event n, which must belong to the block.
+    void fill( const std::size_t&                     n     ,
+               std::vector< double >&                 cacheR,
+               std::vector< std::complex< double > >& cacheC ) const;
+  };
+
+private:
+  // Copies of the pdf that recompute the dropped columns. Each load takes one
+  //    that no other thread is using and gives it back when done, so there
+  //    are as many copies as threads that ever recomputed at the same time.
+  class Copies
+  {
+  private:
+    std::mutex                                _lock;
+    std::unique_ptr< const PdfBase >          _pdf;
+    std::vector< std::unique_ptr< PdfBase > > _idle;
+
+  public:
+    Copies( const PdfBase& pdf ) : _pdf( pdf.copy() ) {}
+
+    std::unique_ptr< PdfBase > acquire();
+    void                       release( std::unique_ptr< PdfBase > copy );
+  };
+
+  static std::size_t _budget;
+  static bool        _reduce;
+
+  // Bytes kept in memory by all the live managers.
+  static std::atomic< std::size_t > _held;
+
+  std::size_t           _size;
+  std::size_t           _limit;
+  std::size_t           _memory;
+  std::vector< Column > _columns;
+
+  // First real and complex cache index of each source.
+  std::vector< std::pair< unsigned, unsigned > > _firsts;
+
+  std::map< unsigned, std::vector< float >                 > _real;
+  std::map< unsigned, std::vector< std::complex< float > > > _complex;
+
+  // Sources with dropped columns, and the copies that recompute them, shared
+  //    with the subsets of the manager.
+  std::vector< unsigned >   _recompute;
+  std::shared_ptr< Copies > _copies;
+
+  // Events read through the manager, to report the number of passes.
+  mutable std::atomic< unsigned long > _reads;
+
+  void plan( const std::size_t& budget );
+
+  // Bytes of the columns kept in memory, materialized or reduced.
+  const std::size_t memory() const;
+
+  // Compute the caches of a source for a dataset, with the cache indices it
+  //    was first assigned, starting at first.
+  static void compute( PdfBase&                                                     source,
+                       const std::pair< unsigned, unsigned >&                       first ,
+                       const Dataset&                                               data  ,
+                       std::map< unsigned, std::vector< double >                 >& real  ,
+                       std::map< unsigned, std::vector< std::complex< double > > >& complex );
+
+  CacheManager( const CacheManager& );
+  CacheManager& operator=( const CacheManager& );
+
+public:
+  // Manager of a pdf without per-event caches, or whose caches were all
+  //    materialized elsewhere.
+  CacheManager() : _size( 0 ), _limit( std::size_t( -1 ) ), _memory( 0 ), _reads( 0 ) {}
+
+  // Compute the caches of a pdf for a dataset. The materialized columns are
+  //    returned in cacheR and cacheC, as the pdf would have returned them.
+  CacheManager( PdfBase&                                                     pdf   ,
+                const Dataset&                                               data  ,
+                std::map< unsigned, std::vector< double >                 >& cacheR,
+                std::map< unsigned, std::vector< std::complex< double > > >& cacheC,
+                const std::size_t&                                           budget = CacheManager::available() );
+
+  ~CacheManager() { _held -= _memory; }
+
+  // Manager of a subsample of the events of another one, or of all of them.
+  const std::shared_ptr< CacheManager > subset( const std::vector< std::size_t >& events ) const;
+  const std::shared_ptr< CacheManager > copy() const;
+
+  // Extend the manager to events appended to the dataset, keeping the plan of
+  //    each column. The materialized columns of the new events are returned in
+  //    cacheR and cacheC, as by the constructor, and the rest are kept by the
+  //    manager. The pdf must be the one the manager was made with.
+  void append( PdfBase&                                                     pdf   ,
+               const Dataset&                                               events,
+               std::map< unsigned, std::vector< double >                 >& cacheR,
+               std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) throw( PdfException );
+
+  // Memory budget in bytes for the caches of all the minimizers, the part of
+  //    it not kept by any live manager, and whether columns can be stored in
+  //    single precision to fit in it, which changes the nll slightly and is
+  //    disabled by default.
+  static const std::size_t budget();
+  static const std::size_t available();
+  static void              setBudget          ( const std::size_t& bytes )  { _budget = bytes; }
+  static void              setReducedPrecision( const bool&        reduce ) { _reduce = reduce; }
+
+  // True if all the columns are materialized at full precision.
+  const bool complete()   const { return _real.empty() && _complex.empty() && _recompute.empty(); }
+  const bool recomputes() const { return ! _recompute.empty(); }
+
+  const std::vector< Column >& columns() const { return _columns; }
+
+  // Fill a block with the values of the events [first, last) of the columns
+  //    that are not materialized, computing those dropped from the given data.
+  //    It can be called from several threads at once.
+  void load( const Dataset& data, const std::size_t& first, const std::size_t& last, Block& block ) const;
+
+  // Table with the size, cost and policy of each column.
+  void report( std::ostream& os ) const;
+};
+
+#endif
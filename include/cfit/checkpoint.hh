@@ -0,0 +1,79 @@
+#ifndef __CHECKPOINT_HH__
+#define __CHECKPOINT_HH__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <complex>
+#include <cstdint>
+#include <iostream>
+
+#include <Minuit/MnUserParameterState.h>
+
+#include <cfit/exceptions.hh>
+#include <cfit/dataset.hh>
+
+
+// Files to checkpoint a long minimization and resume it after the process
+//    has been killed. The checkpoint holds the Minuit state (parameters,
+//    covariance and EDM) and the number of function calls so far, and
+//    refers to a file with the per-event caches of the minimizer.
+class Checkpoint
+{
+private:
+  std::string _path;
+  unsigned    _calls;
+
+  template< class T >
+  static void write( std::ostream& file, const std::map< unsigned, std::vector< T > >& cache, const unsigned& first );
+
+  template< class T >
+  static void read ( std::istream& file,       std::map< unsigned, std::vector< T > >& cache, const unsigned& first,
+                     const unsigned& nCached, const std::size_t& nEvents ) throw( MinimizerException );
+
+public:
+  // Save the state every given number of function calls.
+  Checkpoint( const std::string& path, const unsigned& calls = 1000 )
+    : _path( path ), _calls( calls )
+  {}
+
+  // Getters.
+  const std::string& path()      const { return _path;            }
+  const std::string  cachePath() const { return _path + ".cache"; }
+  const unsigned&    calls()     const { return _calls;           }
+
+  const bool exists()      const;
+  const bool cacheExists() const;
+
+  // Hash of the names of the variables of a pdf and of the values of their
+  //    columns in a dataset, which identifies the events that the caches of
+  //    a minimizer were computed on.
+  static const std::uint64_t hash( const std::vector< std::string >& varNames, const Dataset& data ) throw( DataException );
+
+  // Save or load the state of the minimization. The state is first written to
+  //    a temporary file and then moved, so a killed process never leaves a
+  //    truncated checkpoint behind. The state can be loaded together with the
+  //    number of calls, function value and EDM of the last save.
+  void                       save( const MnUserParameterState& state, const unsigned& nCalls ) const throw( MinimizerException );
+  const MnUserParameterState load( unsigned& nCalls )                                         const throw( MinimizerException );
+  const MnUserParameterState load( unsigned& nCalls, double& fval, double& edm )              const throw( MinimizerException );
+
+  // Save or load the per-event caches. Indices are stored relative to the first
+  //    index assigned to the minimizer, so that they can be mapped to the ones
+  //    assigned to the same model in a new process. The number of indices
+  //    assigned to the minimizer is stored too, and must be the same when the
+  //    caches are loaded, as must the hash of the pdf variables and the data.
+  void saveCache( const std::map< unsigned, std::vector< double >                 >& cacheR ,
+                  const std::map< unsigned, std::vector< std::complex< double > > >& cacheC ,
+                  const unsigned& firstR, const unsigned& nCachedR,
+                  const unsigned& firstC, const unsigned& nCachedC,
+                  const std::size_t& nEvents, const std::uint64_t& hash ) const throw( MinimizerException );
+
+  void loadCache( std::map< unsigned, std::vector< double >                 >& cacheR ,
+                  std::map< unsigned, std::vector< std::complex< double > > >& cacheC ,
+                  const unsigned& firstR, const unsigned& nCachedR,
+                  const unsigned& firstC, const unsigned& nCachedC,
+                  const std::size_t& nEvents, const std::uint64_t& hash ) const throw( MinimizerException );
+};
+
+#endif
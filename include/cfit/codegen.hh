@@ -0,0 +1,74 @@
+#ifndef __CODEGEN_HH__
+#define __CODEGEN_HH__
+
+#include <string>
+
+#include <cfit/exceptions.hh>
+
+
+// Compiled kernel of an nll. The source of a self-contained translation unit,
+//    emitted by a pdf for its current configuration, is compiled with the
+//    system compiler into a shared object, which is loaded and kept open while
+//    the kernel is alive. Shared objects are cached in a directory under the
+//    hash of the source and the compilation command, so the same model is
+//    only compiled once. Each one is kept next to the source it was compiled
+//    from, which must match the requested one before it is loaded.
+//
+// The compiler is taken from the CFIT_CXX environment variable, then from
+//    CXX, and defaults to c++. Its flags can be replaced with CFIT_CXXFLAGS.
+//    Both are split at spaces and run directly, without a shell. The cache
+//    directory defaults to CFIT_CODEGEN_DIR, then $XDG_CACHE_HOME/cfit or
+//    ~/.cache/cfit, and to a new private directory in /tmp without a home. It
+//    must belong to the user and not be writable by anybody else, since any
+//    library found in it is loaded into the process.
+class Codegen
+{
+public:
+  // Signatures of the generated functions. cfit_norm sums the integrand of
+  //    the norm over the points in [ first, last ), and cfit_nll sums -2 w
+  //    log( pdf ) over the events in [ first, last ), given the norm. Each
+  //    event and each norm point is given by the columns of the variables the
+  //    pdf reads, and the weights of the events can be null. Ranges let the
+  //    callers split the sums in chunks, one per thread.
+  typedef double ( *NormKernel )( const double*        pars   ,
+                                  const double* const* norm   , const unsigned long first, const unsigned long last );
+  typedef double ( *Kernel     )( const double*        pars   , const double         integral,
+                                  const double* const* events , const double* weights, const unsigned long first, const unsigned long last );
+
+private:
+  void*       _handle;
+  NormKernel  _norm;
+  Kernel      _kernel;
+  std::string _library;
+
+  // The shared object stays open while the kernel exists, so it cannot be copied.
+  Codegen( const Codegen& );
+  Codegen& operator=( const Codegen& );
+
+public:
+  Codegen( const std::string& source, const std::string& cacheDir = "" ) throw( PdfException );
+  ~Codegen();
+
+  double norm( const double*        pars,
+               const double* const* norm, const unsigned long& first, const unsigned long& last ) const
+  {
+    return _norm( pars, norm, first, last );
+  }
+
+  double operator()( const double*        pars  , const double&        integral,
+                     const double* const* events, const double* weights, const unsigned long& first, const unsigned long& last ) const
+  {
+    return _kernel( pars, integral, events, weights, first, last );
+  }
+
+  // Path of the shared object.
+  const std::string& library() const { return _library; }
+
+  // Literal that reads back as exactly the same double.
+  static const std::string literal( const double& value );
+
+  // Headers and helper functions common to all the generated sources.
+  static const std::string prelude();
+};
+
+#endif
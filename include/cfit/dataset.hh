@@ -13,6 +13,9 @@ class Dataset
 private:
   std::map< std::string, std::vector< std::pair< double, double > > > _data;
 
+  // Name of the field with the category index of each event, if any.
+  std::string _category;
+
 public:
   Dataset()  {};
   ~Dataset() {};
@@ -20,6 +23,16 @@ public:
   void push( const std::string& field, const double& value, const double& error = 0. );
   void push( const std::map< std::string, double >& event ); // Map of fields and values.
 
+  // Add a block of n values of a field, with no errors.
+  void push( const std::string& field, const double* values, const std::size_t& n );
+
+  // Add all the events of another dataset, which must have the same fields.
+  void append( const Dataset& events ) throw( DataException );
+
+  // Copy each column in parallel chunks with Threads::fill. With pinned
+  //    threads, the events of each chunk are then on the node of its thread.
+  void distribute();
+
   // Getters.
   std::size_t                size  ()                                      const;
   double                     value ( const std::string& field, int entry ) const throw( DataException );
@@ -27,6 +40,20 @@ public:
   std::vector< double >      values( const std::string& field )            const throw( DataException );
   std::vector< double >      errors( const std::string& field )            const throw( DataException );
   std::vector< std::string > fields()                                      const;
+
+  // Values and errors of a field, to be read entry by entry without looking
+  //    the field up each time.
+  const std::vector< std::pair< double, double > >& column( const std::string& field ) const throw( DataException );
+
+  // Use one of the fields as the category of each event, e.g. the charge or
+  //    the run period. Its values must be non-negative integers.
+  void                       setCategory( const std::string& field )         throw( DataException );
+  const bool                 hasCategory()                                 const { return ! _category.empty(); }
+  const std::string&         category   ()                                 const { return _category;           }
+  std::vector< unsigned >    categories ()                                 const throw( DataException );
+
+  // Dataset with only the given entries, in the given order.
+  const Dataset              subset( const std::vector< std::size_t >& entries ) const throw( DataException );
 //void                       dump  ()                                      const;
 
 #ifdef MPI_ON
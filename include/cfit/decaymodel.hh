@@ -1,12 +1,22 @@
 #ifndef __DECAYMODEL_HH__
 #define __DECAYMODEL_HH__
 
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+
 #include <cfit/pdfmodel.hh>
+#include <cfit/dataset.hh>
+#include <cfit/threads.hh>
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 #include <cfit/amplitude.hh>
 #include <cfit/binnedamplitude.hh>
 #include <cfit/phasespace.hh>
+#include <cfit/randomstream.hh>
+#include <cfit/vegas.hh>
 
 
 #include <cfit/function.hh>
@@ -23,13 +33,102 @@ protected:
   // One or more functions to define the efficiency.
   std::vector< Function > _funcs;
 
+  // Number of bins per dimension of the grid used to compute the norm.
+  unsigned _normBins;
+
+  // Whether the norm grid is uniform in the square Dalitz plot coordinates
+  //    instead of in ( mSq12, mSq13 ).
+  bool     _squareNorm;
+
+  // Center and weight of a cell of the norm grid. The weight includes the
+  //    Jacobian of the square Dalitz plot transformation when it is used.
+  void normPoint( const unsigned& binX, const unsigned& binY, double& mSq12, double& mSq13, double& weight ) const;
+
+  // Amplitudes on the cells of the norm grid, kept while the amplitude is fixed.
+  std::vector< std::complex< double > > _gridAmps;
+
+  // Points and weights of a Monte Carlo integration of the norm. When there
+  //    are any, they are used instead of the grid.
+  std::vector< double > _normMSq12;
+  std::vector< double > _normMSq13;
+  std::vector< double > _normWeight;
+
+  // Integrals on the norm grid of |A|^2, |Abar|^2 and A* Abar times the
+  //    efficiency, and maxima of the first two integrands, with Abar( mSq12,
+  //    mSq13 ) = A( mSq13, mSq12 ). On the uniform grid, the cell mirrored by
+  //    mSq12 <-> mSq13 is also a cell, and its direct and conjugated amplitudes
+  //    are the swapped ones. Both cells are then done with the same pair of
+  //    amplitude evaluations. For self-conjugate final states the Dalitz plot
+  //    is symmetric, so only half of it has to be evaluated.
+  void normIntegrals( double& nDir, double& nCnj, std::complex< double >& nXed, double& maxDir, double& maxCnj );
+
+  // Sums over the norm points of the products of pairs of components of the
+  //    amplitude, times the efficiency and the weight of each point, with the
+  //    constant term as component 0: phi_k phi_l*, phibar_k phibar_l* and
+  //    phi_k* phibar_l, with phibar_k( mSq12, mSq13 ) = phi_k( mSq13, mSq12 ).
+  //    Also the maxima over the points of sqrt( eff ) |phi_k| and |phibar_k|.
+  std::vector< std::complex< double > > _prodDir;
+  std::vector< std::complex< double > > _prodCnj;
+  std::vector< std::complex< double > > _prodXed;
+  std::vector< double >                 _compMaxDir;
+  std::vector< double >                 _compMaxCnj;
+
+  // Whether the integrals can be obtained from the sums of products, which
+  //    requires an amplitude linear in fixed components and fixed efficiency
+  //    functions. The sums are built on the first call, in parallel over the
+  //    points. On the grid they are only used when the amplitude floats, e.g.
+  //    with floating coefficients or knots of a SplineResonance, since the
+  //    amplitudes of a fixed one are kept on the cells, which gives exact maxima.
+  const bool normProducts();
+
+  // Integrals from the sums of products, in a time quadratic in the number
+  //    of components and independent of the number of points. The maxima are
+  //    upper bounds, from the maxima of the components.
+  void productIntegrals( double& nDir, double& nCnj, std::complex< double >& nXed, double& maxDir, double& maxCnj ) const;
+
+  // Direct and conjugated amplitudes, and product of the efficiency functions,
+  //    at every event of a dataset. The events are swept in parallel chunks,
+  //    each thread writing its own part of the pre-sized caches.
+  void cacheAmps ( const Dataset& data, std::vector< std::complex< double > >& ampDir,
+                                        std::vector< std::complex< double > >& ampCnj ) const throw( DataException );
+  void cacheFuncs( const Dataset& data, std::vector< double >&                 funcs  ) const throw( DataException );
+
+  // Direct and conjugated amplitudes of the events [first, last) of a
+  //    dataset, for the models whose amplitudes are computed for each block
+  //    of events of a fit, see PdfBase::cacheBlock.
+  void cacheAmps ( const Dataset& data, const std::size_t& first, const std::size_t& last,
+                   std::vector< std::complex< double > >& ampDir,
+                   std::vector< std::complex< double > >& ampCnj ) const throw( DataException )
+  {
+    ampDir.resize( last - first );
+    ampCnj.resize( last - first );
+    evaluateAmps( data, first, last, ampDir.data(), ampCnj.data() );
+  }
+
+  // Direct and, unless ampCnj is null, conjugated amplitudes of the events
+  //    [first, last) of a dataset, through the array kernels of the
+  //    resonances on blocks of contiguous values. Used by cacheAmps, and by
+  //    the models with floating amplitudes for each block of events of a fit.
+  void evaluateAmps( const Dataset& data, const std::size_t& first, const std::size_t& last,
+                     std::complex< double >* ampDir, std::complex< double >* ampCnj ) const throw( DataException );
+
+  // The points of the norm have changed.
+  void clearProducts()
+  {
+    _prodDir   .clear();
+    _prodCnj   .clear();
+    _prodXed   .clear();
+    _compMaxDir.clear();
+    _compMaxCnj.clear();
+  }
+
 public:
   DecayModel< AmplitudeClass >( const Variable&       mSq12,
                                 const Variable&       mSq13,
                                 const Variable&       mSq23,
                                 const AmplitudeClass& amp  ,
                                 const PhaseSpace&     ps    )
-    : _amp( amp ), _ps( ps )
+    : _amp( amp ), _ps( ps ), _normBins( 400 ), _squareNorm( false )
   {
     push( mSq12 );
     push( mSq13 );
@@ -44,6 +143,54 @@ public:
   void setPars( const std::map< std::string, Parameter >& pars ) throw( PdfException );
   void setPars( const FunctionMinimum&                    pars ) throw( PdfException );
 
+  virtual void setNormBins( const unsigned& nBins )
+  {
+    _normBins = nBins;
+    _gridAmps.clear();
+
+    if ( _normWeight.empty() )
+      clearProducts();
+  }
+
+  // Integrate on a grid in the square Dalitz plot, where no cells fall outside
+  //    the kinematically allowed region. Resetting the grid size invalidates
+  //    the norm components kept by the models with a fixed amplitude.
+  void setSquareNorm( const bool& square = true )
+  {
+    _squareNorm = square;
+    setNormBins( _normBins );
+  }
+
+  const bool& squareNorm() const { return _squareNorm; }
+
+  // Integrate the norm by Monte Carlo instead of on the grid. A VEGAS grid
+  //    in the square Dalitz plot is adapted to the current amplitude over
+  //    nIter iterations, and then a stratified sample large enough for the
+  //    requested relative precision is drawn from it and frozen, so that the
+  //    norm stays a smooth function of the parameters during the fit.
+  void setVegasNorm( const double& precision = 1e-3, const unsigned& nIter = 5, const uint64_t& seed = 0 );
+
+  // Integrate the norm on a phase space Monte Carlo sample, e.g. a fully
+  //    simulated and selected one, which carries the efficiency without having
+  //    to parametrize it. Each event counts with the value of the weight field,
+  //    if one is given, over the sum of the weights, times the area of the
+  //    phase space, so that the norm estimates the same integral as the grid
+  //    and the pdf can be combined with others. The efficiency functions of
+  //    the model, if any, are still applied on top.
+  void setNormSample( const Dataset& sample, const std::string& weight = "" ) throw( DataException );
+
+  // Go back to the integration on the grid.
+  void setGridNorm()
+  {
+    _normMSq12 .clear();
+    _normMSq13 .clear();
+    _normWeight.clear();
+    clearProducts();
+    setNormBins( _normBins );
+  }
+
+  const std::size_t nNormPoints() const { return _normWeight.size(); }
+
   const std::string mSq12name() const { return getVar( 0 ).name(); }
   const std::string mSq13name() const { return getVar( 1 ).name(); }
   const std::string mSq23name() const { return getVar( 2 ).name(); }
@@ -108,6 +255,525 @@ void DecayModel< AmplitudeClass >::setPars( const FunctionMinimum& min ) throw(
 }
 
 
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::normPoint( const unsigned& binX, const unsigned& binY,
+                                              double& mSq12, double& mSq13, double& weight ) const
+{
+  if ( _squareNorm )
+  {
+    const double& step    = 1.0 / double( _normBins );
+    const double& mPrime  = step * ( binX + 0.5 );
+    const double& thPrime = step * ( binY + 0.5 );
+
+    _ps.fromSquare( mPrime, thPrime, mSq12, mSq13 );
+    weight = _ps.squareJacobian( mPrime, thPrime ) * step * step;
+    return;
+  }
+
+  const double& min  = _ps.mSq12min();
+  const double& max  = _ps.mSq12max();
+  const double& step = ( max - min ) / double( _normBins );
+
+  mSq12  = min + step * ( binX + 0.5 );
+  mSq13  = min + step * ( binY + 0.5 );
+  weight = step * step;
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::normIntegrals( double& nDir, double& nCnj, std::complex< double >& nXed,
+                                                  double& maxDir, double& maxCnj )
+{
+  nDir   = 0.0;
+  nCnj   = 0.0;
+  nXed   = 0.0;
+  maxDir = 0.0;
+  maxCnj = 0.0;
+
+  if ( normProducts() )
+  {
+    productIntegrals( nDir, nCnj, nXed, maxDir, maxCnj );
+    return;
+  }
+
+  const unsigned nBins  = _normBins;
+  const unsigned nCells = nBins * nBins;
+  const double   mSqSum = _ps.mSqSum();
+
+  // The square Dalitz plot grid has no mirrored cells.
+  const bool mirror = ! _squareNorm;
+
+  // Keep the amplitudes on the grid while the amplitude is fixed. Without
+  //    mirrored cells, the conjugated amplitudes go after the direct ones.
+  const bool fixedAmp = _amp.isFixed();
+  if ( ! fixedAmp )
+    _gridAmps.clear();
+
+  // With Monte Carlo points, the conjugated amplitudes also go after the direct ones.
+  const std::size_t nPoints = _normWeight.size();
+  const std::size_t nAmps   = nPoints ? 2 * nPoints : ( mirror ? nCells : 2 * nCells );
+
+  const bool cached = ! _gridAmps.empty();
+  if ( fixedAmp && ! cached )
+    _gridAmps.resize( nAmps );
+
+  // Add the contribution of a cell inside the Dalitz plot.
+  // std::norm returns the squared modulus of the complex number, not its norm.
+  const auto add = [ & ]( const double& mSq12, const double& mSq13, const double& mSq23, const double& weight,
+                          const std::complex< double >& ampDir, const std::complex< double >& ampCnj )
+  {
+    const double& funcs = evaluateFuncs( mSq12, mSq13, mSq23 );
+    const double& dirSq = std::norm( ampDir ) * funcs;
+    const double& cnjSq = std::norm( ampCnj ) * funcs;
+
+    nDir += dirSq * weight;
+    nCnj += cnjSq * weight;
+    nXed += std::conj( ampDir ) * ampCnj * funcs * weight;
+
+    maxDir = std::max( maxDir, dirSq );
+    maxCnj = std::max( maxCnj, cnjSq );
+  };
+
+  double mSq12;
+  double mSq13;
+  double mSq23;
+  double weight;
+
+  std::complex< double > ampDir;
+  std::complex< double > ampCnj;
+
+  // The Monte Carlo points are split in chunks, whose partial sums are added
+  //    in their order, as in normProducts.
+  if ( nPoints )
+  {
+    const unsigned nChunks = Threads::nThreads();
+
+    std::vector< double >                 chunkDir   ( nChunks, 0.0 );
+    std::vector< double >                 chunkCnj   ( nChunks, 0.0 );
+    std::vector< std::complex< double > > chunkXed   ( nChunks, 0.0 );
+    std::vector< double >                 chunkMaxDir( nChunks, 0.0 );
+    std::vector< double >                 chunkMaxCnj( nChunks, 0.0 );
+
+    Threads::chunks( nPoints, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& chunk )
+    {
+      std::complex< double > dir;
+      std::complex< double > cnj;
+
+      for ( std::size_t point = first; point < last; ++point )
+      {
+        const double& mSq12 = _normMSq12[ point ];
+        const double& mSq13 = _normMSq13[ point ];
+        const double& mSq23 = mSqSum - mSq12 - mSq13;
+
+        if ( cached )
+        {
+          dir = _gridAmps[ point           ];
+          cnj = _gridAmps[ nPoints + point ];
+        }
+        else
+        {
+          dir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
+          cnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
+
+          if ( fixedAmp )
+          {
+            _gridAmps[ point           ] = dir;
+            _gridAmps[ nPoints + point ] = cnj;
+          }
+        }
+
+        const double& funcs  = evaluateFuncs( mSq12, mSq13, mSq23 );
+        const double& dirSq  = std::norm( dir ) * funcs;
+        const double& cnjSq  = std::norm( cnj ) * funcs;
+        const double& weight = _normWeight[ point ];
+
+        chunkDir   [ chunk ] += dirSq * weight;
+        chunkCnj   [ chunk ] += cnjSq * weight;
+        chunkXed   [ chunk ] += std::conj( dir ) * cnj * funcs * weight;
+        chunkMaxDir[ chunk ]  = std::max( chunkMaxDir[ chunk ], dirSq );
+        chunkMaxCnj[ chunk ]  = std::max( chunkMaxCnj[ chunk ], cnjSq );
+      }
+    }, nChunks );
+
+    for ( unsigned chunk = 0; chunk < nChunks; ++chunk )
+    {
+      nDir  += chunkDir[ chunk ];
+      nCnj  += chunkCnj[ chunk ];
+      nXed  += chunkXed[ chunk ];
+      maxDir = std::max( maxDir, chunkMaxDir[ chunk ] );
+      maxCnj = std::max( maxCnj, chunkMaxCnj[ chunk ] );
+    }
+
+    return;
+  }
+
+  for ( unsigned binX = 0; binX < nBins; ++binX )
+    for ( unsigned binY = mirror ? binX : 0; binY < nBins; ++binY )
+    {
+      normPoint( binX, binY, mSq12, mSq13, weight );
+      mSq23 = mSqSum - mSq12 - mSq13;
+
+      // Proceed only if the cell or its mirror lie inside the kinematically allowed region.
+      const bool inside       = _ps.contains( mSq12, mSq13, mSq23 );
+      const bool mirrorInside = mirror && ( binY != binX ) && _ps.contains( mSq13, mSq12, mSq23 );
+      if ( ! inside && ! mirrorInside )
+        continue;
+
+      const unsigned cell    = nBins * binX + binY;
+      const unsigned cnjCell = mirror ? nBins * binY + binX : nCells + cell;
+
+      if ( cached )
+      {
+        ampDir = _gridAmps[ cell    ];
+        ampCnj = _gridAmps[ cnjCell ];
+      }
+      else
+      {
+        ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
+        ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
+
+        if ( fixedAmp )
+        {
+          _gridAmps[ cell    ] = ampDir;
+          _gridAmps[ cnjCell ] = ampCnj;
+        }
+      }
+
+      if ( inside )
+        add( mSq12, mSq13, mSq23, weight, ampDir, ampCnj );
+
+      // The mirrored cell has the same weight on the uniform grid.
+      if ( mirrorInside )
+        add( mSq13, mSq12, mSq23, weight, ampCnj, ampDir );
+    }
+}
+
+
+// The integrand of the adaptation is the sum of the direct and conjugated
+//    squared amplitudes, so the points resolve the structures of both.
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::setVegasNorm( const double& precision, const unsigned& nIter, const uint64_t& seed )
+{
+  const double mSqSum = _ps.mSqSum();
+
+  const Vegas::Integrand func = [ & ]( const std::vector< double >& point )
+  {
+    double mSq12;
+    double mSq13;
+    _ps.fromSquare( point[ 0 ], point[ 1 ], mSq12, mSq13 );
+
+    const double& mSq23 = mSqSum - mSq12 - mSq13;
+
+    return ( std::norm( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) ) + std::norm( _amp.evaluate( _ps, mSq13, mSq12, mSq23 ) ) ) *
+           evaluateFuncs( mSq12, mSq13, mSq23 ) * _ps.squareJacobian( point[ 0 ], point[ 1 ] );
+  };
+
+  RandomStream stream( seed );
+
+  Vegas vegas( 2 );
+  vegas.adapt( func, 10000, nIter, stream );
+
+  std::vector< std::vector< double > > points;
+  std::vector< double >                weights;
+  std::vector< unsigned >              strata;
+  std::vector< double >                values;
+
+  // Enlarge the sample until the error estimated from the spread within the
+  //    strata is below the requested precision.
+  double nPoints = 10000.0;
+  while ( true )
+  {
+    vegas.sample( unsigned( nPoints ), stream, points, weights, strata );
+    Vegas::evaluate( func, points, weights, values );
+
+    const double& integral = std::accumulate( values.begin(), values.end(), 0.0 );
+    const double& relError = Vegas::error( values, strata ) / integral;
+    if ( ! ( relError > precision ) || ( nPoints >= 1e7 ) )
+      break;
+
+    nPoints = std::min( nPoints * std::min( std::pow( relError / precision, 2 ), 100.0 ), 1e7 );
+  }
+
+  _normMSq12 .resize( weights.size() );
+  _normMSq13 .resize( weights.size() );
+  _normWeight.resize( weights.size() );
+  Threads::chunks( weights.size(), [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& )
+  {
+    for ( std::size_t point = first; point < last; ++point )
+    {
+      _ps.fromSquare( points[ 0 ][ point ], points[ 1 ][ point ], _normMSq12[ point ], _normMSq13[ point ] );
+      _normWeight[ point ] = weights[ point ] * _ps.squareJacobian( points[ 0 ][ point ], points[ 1 ][ point ] );
+    }
+  } );
+
+  // Invalidate the amplitudes and norm components kept for the grid.
+  clearProducts();
+  setNormBins( _normBins );
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::setNormSample( const Dataset& sample, const std::string& weight ) throw( DataException )
+{
+  const std::size_t size = sample.size();
+  if ( ! size )
+    throw DataException( "DecayModel: the sample to compute the norm is empty." );
+
+  _normMSq12 = sample.values( mSq12name() );
+  _normMSq13 = sample.values( mSq13name() );
+
+  const double& area = _ps.area();
+
+  if ( weight.empty() )
+    _normWeight.assign( size, area / size );
+  else
+  {
+    _normWeight = sample.values( weight );
+
+    const double& sum = std::accumulate( _normWeight.begin(), _normWeight.end(), 0.0 );
+    if ( ! ( sum > 0.0 ) )
+      throw DataException( "DecayModel: the weights of the sample to compute the norm do not add up to a positive value." );
+
+    for ( std::vector< double >::iterator wgt = _normWeight.begin(); wgt != _normWeight.end(); ++wgt )
+      *wgt *= area / sum;
+  }
+
+  // Invalidate the amplitudes and norm components kept for the grid.
+  clearProducts();
+  setNormBins( _normBins );
+}
+
+
+// Each thread sums the products on a contiguous chunk of the points, and the
+//    partial sums are added in the order of the chunks, so that the result
+//    does not depend on the scheduling.
+template < class AmplitudeClass >
+inline
+const bool DecayModel< AmplitudeClass >::normProducts()
+{
+  if ( ( _normWeight.empty() && _amp.isFixed() ) || ! _amp.isLinear() || ! _amp.componentsFixed() )
+    return false;
+
+  typedef std::vector< Function >::const_iterator fIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    if ( ! func->isFixed() )
+      return false;
+
+  if ( ! _prodDir.empty() )
+    return true;
+
+  const std::size_t nComps  = _amp.nComponents() + 1;
+  const std::size_t nProds  = nComps * nComps;
+  const unsigned    nChunks = Threads::nThreads();
+  const double      mSqSum  = _ps.mSqSum();
+
+  // Without Monte Carlo points, the points are the cells of the grid inside
+  //    the phase space, row after row.
+  const bool        grid    = _normWeight.empty();
+  const std::size_t nPoints = grid ? std::size_t( _normBins ) * _normBins : _normWeight.size();
+
+  typedef std::vector< std::complex< double > > cVector;
+
+  std::vector< cVector >                 prodDir( nChunks, cVector( nProds, 0.0 ) );
+  std::vector< cVector >                 prodCnj( nChunks, cVector( nProds, 0.0 ) );
+  std::vector< cVector >                 prodXed( nChunks, cVector( nProds, 0.0 ) );
+  std::vector< std::vector< double > >   maxDir ( nChunks, std::vector< double >( nComps, 0.0 ) );
+  std::vector< std::vector< double > >   maxCnj ( nChunks, std::vector< double >( nComps, 0.0 ) );
+
+  Threads::chunks( nPoints, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& chunk )
+  {
+    cVector dir( nComps );
+    cVector cnj( nComps );
+
+    double mSq12;
+    double mSq13;
+    double weight;
+
+    for ( std::size_t point = first; point < last; ++point )
+    {
+      if ( grid )
+        normPoint( point / _normBins, point % _normBins, mSq12, mSq13, weight );
+      else
+      {
+        mSq12  = _normMSq12 [ point ];
+        mSq13  = _normMSq13 [ point ];
+        weight = _normWeight[ point ];
+      }
+
+      const double& mSq23 = mSqSum - mSq12 - mSq13;
+      if ( grid && ! _ps.contains( mSq12, mSq13, mSq23 ) )
+        continue;
+
+      // The constant term vanishes outside the phase space, as the amplitude does.
+      dir[ 0 ] = _ps.contains( mSq12, mSq13, mSq23 ) ? 1.0 : 0.0;
+      cnj[ 0 ] = _ps.contains( mSq13, mSq12, mSq23 ) ? 1.0 : 0.0;
+      _amp.components( _ps, mSq12, mSq13, mSq23, &dir[ 1 ] );
+      _amp.components( _ps, mSq13, mSq12, mSq23, &cnj[ 1 ] );
+
+      const double& funcs  = evaluateFuncs( mSq12, mSq13, mSq23 );
+      const double& wgtFn  = funcs * weight;
+      const double& sqrtFn = std::sqrt( funcs );
+
+      for ( std::size_t k = 0; k < nComps; ++k )
+      {
+        maxDir[ chunk ][ k ] = std::max( maxDir[ chunk ][ k ], sqrtFn * std::abs( dir[ k ] ) );
+        maxCnj[ chunk ][ k ] = std::max( maxCnj[ chunk ][ k ], sqrtFn * std::abs( cnj[ k ] ) );
+
+        for ( std::size_t l = 0; l < nComps; ++l )
+        {
+          prodDir[ chunk ][ nComps * k + l ] += dir[ k ] * std::conj( dir[ l ] ) * wgtFn;
+          prodCnj[ chunk ][ nComps * k + l ] += cnj[ k ] * std::conj( cnj[ l ] ) * wgtFn;
+          prodXed[ chunk ][ nComps * k + l ] += std::conj( dir[ k ] ) * cnj[ l ] * wgtFn;
+        }
+      }
+    }
+  }, nChunks );
+
+  _prodDir   .assign( nProds, 0.0 );
+  _prodCnj   .assign( nProds, 0.0 );
+  _prodXed   .assign( nProds, 0.0 );
+  _compMaxDir.assign( nComps, 0.0 );
+  _compMaxCnj.assign( nComps, 0.0 );
+
+  for ( unsigned chunk = 0; chunk < nChunks; ++chunk )
+  {
+    for ( std::size_t prod = 0; prod < nProds; ++prod )
+    {
+      _prodDir[ prod ] += prodDir[ chunk ][ prod ];
+      _prodCnj[ prod ] += prodCnj[ chunk ][ prod ];
+      _prodXed[ prod ] += prodXed[ chunk ][ prod ];
+    }
+
+    for ( std::size_t k = 0; k < nComps; ++k )
+    {
+      _compMaxDir[ k ] = std::max( _compMaxDir[ k ], maxDir[ chunk ][ k ] );
+      _compMaxCnj[ k ] = std::max( _compMaxCnj[ k ], maxCnj[ chunk ][ k ] );
+    }
+  }
+
+  return true;
+}
+
+
+// With A = sum_k c_k phi_k, |A|^2 = sum_kl c_k c_l* phi_k phi_l*, and
+//    A* Abar = sum_kl c_k* c_l phi_k* phibar_l.
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::productIntegrals( double& nDir, double& nCnj, std::complex< double >& nXed,
+                                                     double& maxDir, double& maxCnj ) const
+{
+  const std::vector< std::complex< double > >& coefs  = _amp.coefficients();
+  const std::size_t                            nComps = coefs.size();
+
+  std::complex< double > sumDir = 0.0;
+  std::complex< double > sumCnj = 0.0;
+  std::complex< double > sumXed = 0.0;
+
+  double boundDir = 0.0;
+  double boundCnj = 0.0;
+
+  for ( std::size_t k = 0; k < nComps; ++k )
+  {
+    for ( std::size_t l = 0; l < nComps; ++l )
+    {
+      const std::complex< double >& dirProd = coefs[ k ] * std::conj( coefs[ l ] );
+
+      sumDir += dirProd * _prodDir[ nComps * k + l ];
+      sumCnj += dirProd * _prodCnj[ nComps * k + l ];
+      sumXed += std::conj( dirProd ) * _prodXed[ nComps * k + l ];
+    }
+
+    boundDir += std::abs( coefs[ k ] ) * _compMaxDir[ k ];
+    boundCnj += std::abs( coefs[ k ] ) * _compMaxCnj[ k ];
+  }
+
+  nDir   = sumDir.real();
+  nCnj   = sumCnj.real();
+  nXed   = sumXed;
+  maxDir = boundDir * boundDir;
+  maxCnj = boundCnj * boundCnj;
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::cacheAmps( const Dataset& data, std::vector< std::complex< double > >& ampDir,
+                                                                   std::vector< std::complex< double > >& ampCnj ) const throw( DataException )
+{
+  const std::size_t size = data.size();
+
+  ampDir.resize( size );
+  ampCnj.resize( size );
+  if ( ! size )
+    return;
+
+  Threads::chunks( size, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+  {
+    evaluateAmps( data, first, last, &ampDir[ first ], &ampCnj[ first ] );
+  } );
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::evaluateAmps( const Dataset& data, const std::size_t& first, const std::size_t& last,
+                                                 std::complex< double >* ampDir, std::complex< double >* ampCnj ) const throw( DataException )
+{
+  if ( first >= last )
+    return;
+
+  const std::vector< std::pair< double, double > >& mSq12 = data.column( mSq12name() );
+  const std::vector< std::pair< double, double > >& mSq13 = data.column( mSq13name() );
+  const std::vector< std::pair< double, double > >& mSq23 = data.column( mSq23name() );
+
+  // The events are copied into contiguous arrays, for the array kernels of
+  //    the resonances.
+  const std::size_t blockSize = 256;
+
+  std::vector< double > m12( std::min( blockSize, last - first ) );
+  std::vector< double > m13( m12.size() );
+  std::vector< double > m23( m12.size() );
+
+  for ( std::size_t block = first; block < last; block += blockSize )
+  {
+    const std::size_t n = std::min( blockSize, last - block );
+    for ( std::size_t entry = 0; entry < n; ++entry )
+    {
+      m12[ entry ] = mSq12[ block + entry ].first;
+      m13[ entry ] = mSq13[ block + entry ].first;
+      m23[ entry ] = mSq23[ block + entry ].first;
+    }
+
+    _amp.evaluate( _ps, &m12[ 0 ], &m13[ 0 ], &m23[ 0 ], ampDir + ( block - first ), n );
+    if ( ampCnj )
+      _amp.evaluate( _ps, &m13[ 0 ], &m12[ 0 ], &m23[ 0 ], ampCnj + ( block - first ), n );
+  }
+}
+
+
+template < class AmplitudeClass >
+inline
+void DecayModel< AmplitudeClass >::cacheFuncs( const Dataset& data, std::vector< double >& funcs ) const throw( DataException )
+{
+  funcs.resize( data.size() );
+  if ( funcs.empty() )
+    return;
+
+  const std::vector< std::pair< double, double > >& mSq12 = data.column( mSq12name() );
+  const std::vector< std::pair< double, double > >& mSq13 = data.column( mSq13name() );
+  const std::vector< std::pair< double, double > >& mSq23 = data.column( mSq23name() );
+
+  Threads::fill( funcs, [ & ]( const std::size_t& entry )
+  {
+    return evaluateFuncs( mSq12[ entry ].first, mSq13[ entry ].first, mSq23[ entry ].first );
+  } );
+}
+
+
 template < class AmplitudeClass >
 inline
 const double DecayModel< AmplitudeClass >::evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const
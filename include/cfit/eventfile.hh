@@ -0,0 +1,127 @@
+#ifndef __EVENTFILE_HH__
+#define __EVENTFILE_HH__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+#include <cfit/dataset.hh>
+#include <cfit/exceptions.hh>
+
+class PdfBase;
+
+
+// Binary column files of generated events. The header records the model, the
+//    seed and the values of the parameters used to generate them, and the
+//    names of the fields. The events follow in chunks, each one with its
+//    number of events and then the values of each field, one column after
+//    the other. All the values are native doubles, aligned to 8 bytes, so
+//    the file can be mapped in memory and its columns read in place.
+//
+// Events are written as they are generated, so the size of a sample is not
+//    limited by the memory of the node. The file is written under a temporary
+//    name and moved at the end, so an interrupted generation never leaves a
+//    truncated file behind.
+class EventWriter
+{
+private:
+  std::string                _path;
+  std::ofstream              _file;
+  std::vector< std::string > _fields;
+
+  std::uint64_t              _nEvents;
+  std::uint64_t              _nChunks;
+
+  // Position of the counters in the header, filled when the file is closed.
+  std::streampos             _counters;
+
+  void open( const std::string& model, const std::uint64_t& seed,
+             const std::map< std::string, double >& pars ) throw( DataException );
+
+  EventWriter( const EventWriter& );
+  EventWriter& operator=( const EventWriter& );
+
+public:
+  EventWriter( const std::string&                     path  ,
+               const std::string&                     model ,
+               const std::uint64_t&                   seed  ,
+               const std::map< std::string, double >& pars  ,
+               const std::vector< std::string >&      fields ) throw( DataException );
+
+  // Header from a pdf: its variables are the fields, and the model defaults
+  //    to the name of its type.
+  EventWriter( const std::string&   path        ,
+               const PdfBase&       pdf         ,
+               const std::uint64_t& seed        ,
+               const std::string&   model  = "" ) throw( DataException );
+
+  ~EventWriter();
+
+  // Write a chunk with one column per field, in the order of the fields.
+  void write( const std::vector< std::vector< double > >& columns ) throw( DataException );
+
+  void close() throw( DataException );
+
+  const std::vector< std::string >& fields()  const { return _fields;  }
+  const std::uint64_t&              nEvents() const { return _nEvents; }
+
+  // Generate nEvents events of a pdf into a file, in parallel. The events are
+  //    generated in chunks of chunkSize, each one from its own stream of the
+  //    seed, by one of the threads with its own copy of the pdf, and written
+  //    in order while the next chunks are generated. The file is then the same
+  //    for any number of threads.
+  static void generate( const PdfBase&       pdf       ,
+                        const std::size_t&   nEvents   ,
+                        const std::string&   path      ,
+                        const std::uint64_t& seed      ,
+                        const std::size_t&   chunkSize = 65536,
+                        const std::string&   model     = "" ) throw( PdfException, DataException );
+};
+
+
+// Read-only view of an event file mapped in memory. The columns of each chunk
+//    are read in place, without copying the file.
+class EventFile
+{
+private:
+  int                  _fd;
+  const char*          _map;
+  std::size_t          _length;
+
+  std::string                     _model;
+  std::uint64_t                   _seed;
+  std::map< std::string, double > _pars;
+  std::vector< std::string >      _fields;
+  std::uint64_t                   _nEvents;
+
+  // Number of events and first value of each chunk.
+  std::vector< std::uint64_t > _chunkSizes;
+  std::vector< const double* > _chunkData;
+
+  EventFile( const EventFile& );
+  EventFile& operator=( const EventFile& );
+
+public:
+  EventFile( const std::string& path ) throw( DataException );
+  ~EventFile();
+
+  // Getters.
+  const std::string&                     model()  const { return _model;    }
+  const std::uint64_t&                   seed()   const { return _seed;     }
+  const std::map< std::string, double >& pars()   const { return _pars;     }
+  const std::vector< std::string >&      fields() const { return _fields;   }
+  const std::uint64_t&                   size()   const { return _nEvents;  }
+
+  const std::size_t                      nChunks()                          const { return _chunkSizes.size(); }
+  const std::uint64_t&                   chunkSize( const std::size_t& chunk ) const { return _chunkSizes[ chunk ]; }
+
+  // Values of a field in a chunk.
+  const double* column( const std::size_t& chunk, const std::string& field ) const throw( DataException );
+
+  // All the events, as a dataset in memory.
+  const Dataset dataset() const;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __FITSERVER_HH__
+#define __FITSERVER_HH__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+
+#include <Minuit/FunctionMinimum.h>
+
+#include <cfit/parameter.hh>
+#include <cfit/minimizer.hh>
+#include <cfit/exceptions.hh>
+
+
+// Long-running server that keeps a minimizer, with its dataset and per-event
+//    caches, resident in memory and serves requests over a Unix-domain socket.
+//
+// Each request is a single line of whitespace-separated words:
+//
+//    fit                                  Minimize the function.
+//    scan <par> <min> <max> <nPoints>     Profile the function along a parameter.
+//    toy  <nEvents> <nToys> [<seed>]      Generate and fit pseudo-experiments.
+//    pars                                 List the parameters of the server.
+//    quit                                 Stop the server.
+//
+// followed by any number of modifiers, which only apply to that request:
+//
+//    fix <par>, release <par>, set <par> <value>, limits <par> <lower> <upper>
+//
+// Requests longer than 64 kB close the connection.
+//
+// Each response is a sequence of lines, the last of which is "end".
+class FitServer
+{
+private:
+  Minimizer*                         _minimizer;
+  std::map< std::string, Parameter > _initial;
+  std::string                        _path;
+  int                                _socket;
+  bool                               _running;
+
+  // Parameters of the minimizer when the server was made, after applying the
+  //    modifiers of a request. Every request starts from the same values, since
+  //    evaluating the minimizer moves the parameters of its pdf.
+  const std::map< std::string, Parameter > parameters( std::istringstream& request ) const throw( MinimizerException );
+
+  const std::string process( const std::string& request );
+
+  const std::string fit ( std::istringstream& request ) const;
+  const std::string scan( std::istringstream& request ) const;
+  const std::string toy ( std::istringstream& request ) const;
+  const std::string pars()                              const;
+
+  void serve( const int& connection );
+
+  static const std::string format( const FunctionMinimum& min );
+
+public:
+  FitServer( const Minimizer& minimizer, const std::string& path );
+
+  ~FitServer();
+
+  // Listen to the socket and serve requests until a quit request arrives.
+  void run() throw( MinimizerException );
+};
+
+
+// Client to send requests to a running fit server.
+class FitClient
+{
+private:
+  int         _socket;
+  std::string _buffer;
+
+public:
+  FitClient( const std::string& path ) throw( MinimizerException );
+
+  ~FitClient();
+
+  // Send a request line and return the lines of the response, without the final "end".
+  const std::vector< std::string > request( const std::string& line ) throw( MinimizerException );
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __LBFGS_HH__
+#define __LBFGS_HH__
+
+#include <vector>
+
+#include <Minuit/FCNBase.h>
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameters.h>
+#include <Minuit/MnUserParameterState.h>
+
+#include <cfit/exceptions.hh>
+
+
+// Result of an L-BFGS-B minimization.
+class LbfgsMinimum
+{
+  friend class Lbfgs;
+
+private:
+  MnUserParameters _pars;
+  double           _fval;
+  double           _edm;
+  unsigned         _nfcn;
+  unsigned         _nIter;
+  bool             _isValid;
+
+public:
+  LbfgsMinimum( const MnUserParameters& pars )
+    : _pars( pars ), _fval( 0.0 ), _edm( 0.0 ), _nfcn( 0 ), _nIter( 0 ), _isValid( false )
+  {}
+
+  // Getters.
+  const MnUserParameters&    userParameters() const { return _pars;    }
+  const MnUserParameterState userState()      const { return MnUserParameterState( _pars ); }
+  const double&              fval()           const { return _fval;    }
+  const double&              edm()            const { return _edm;     }
+  const unsigned&            nfcn()           const { return _nfcn;    }
+  const unsigned&            nIter()          const { return _nIter;   }
+  const bool&                isValid()        const { return _isValid; }
+
+  // Compute the covariance at the minimum with Hesse.
+  const MnUserParameterState hesse( const FCNBase& fcn ) const;
+
+  // Finish with Hesse and Migrad at the minimum, where Migrad converges right
+  //    away, for the usual Minuit result with its covariance. It costs the
+  //    Hesse matrix and a few more calls, so it is only done on request.
+  FunctionMinimum migrad( const FCNBase& fcn ) const;
+};
+
+
+// Limited-memory BFGS minimizer with box constraints, for problems with many
+//    parameters where Migrad's dense covariance updates are too expensive.
+//    Parameter limits are the boxes; fixed parameters are left untouched.
+//    The gradient is taken from the function if it provides one, and computed
+//    by central differences otherwise.
+class Lbfgs
+{
+private:
+  unsigned _memory;
+  unsigned _maxCalls;
+  double   _tolerance;
+
+  // Gradient of the function with respect to the floating parameters. The
+  //    components of the fixed parameters are set to zero.
+  static void gradient( const FCNBase&                 fcn  ,
+                        const std::vector< double >&   x    ,
+                        const std::vector< unsigned >& free ,
+                        const std::vector< double >&   steps,
+                        const std::vector< double >&   lower,
+                        const std::vector< double >&   upper,
+                        std::vector< double >&         grad ,
+                        unsigned&                      nfcn  );
+
+  // Project a point onto the box.
+  static void project( std::vector< double >& x, const std::vector< double >& lower, const std::vector< double >& upper );
+
+public:
+  // Defaults follow Migrad: tolerance 0.1, and convergence when the estimated
+  //    distance to the minimum is below 0.002 * tolerance * up.
+  Lbfgs( const unsigned& memory = 10, const unsigned& maxCalls = 0, const double& tolerance = 0.1 )
+    : _memory( memory ), _maxCalls( maxCalls ), _tolerance( tolerance )
+  {}
+
+  void setMemory   ( const unsigned& memory    ) { _memory    = memory;    }
+  void setMaxCalls ( const unsigned& maxCalls  ) { _maxCalls  = maxCalls;  }
+  void setTolerance( const double&   tolerance ) { _tolerance = tolerance; }
+
+  // Minimize from the given parameters. This is what the minimize( Lbfgs )
+  //    overloads of the minimizers do.
+  const LbfgsMinimum minimize( const FCNBase& fcn, const MnUserParameters& upar, const bool& verbose = false ) const throw( MinimizerException );
+};
+
+#endif
@@ -2,23 +2,50 @@
 #define __MINIMIZER_HH__
 
 #include <vector>
+#include <memory>
 
 #include <Minuit/FCNBase.h>
 #include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameters.h>
 
 #include <cfit/variable.hh>
 #include <cfit/dataset.hh>
 #include <cfit/pdfbase.hh>
+#include <cfit/cachemanager.hh>
 
+class MultiStart;
+class Progressive;
+class Checkpoint;
+class Lbfgs;
+class LbfgsMinimum;
 
 class Minimizer : public FCNBase
 {
 private:
-  void cache();
+  // Compute the per-event caches, keeping them within the given memory budget.
+  void cache( const std::size_t& budget = CacheManager::available() );
+
+  // Load the per-event caches from a checkpoint, instead of computing them.
+  void restore( const Checkpoint& checkpoint );
+
+  // Select the given entries of each of the cached vectors.
+  template< class T >
+  static const std::map< unsigned, std::vector< T > > subset( const std::map< unsigned, std::vector< T > >& cache ,
+                                                              const std::vector< std::size_t >&             events );
+
+  // Copy of the minimizer restricted to the given subsample of events.
+  Minimizer* subsample( const std::vector< std::size_t >& events ) const;
+
+  // Copy of a dataset, distributed over the NUMA nodes if the threads are pinned.
+  static const std::shared_ptr< Dataset > place( const Dataset& data );
 
 protected:
-  PdfBase*      _pdf;
-  const Dataset _data;
+  PdfBase*                         _pdf;
+
+  // Copies of the minimizer share the dataset and the cached expressions, and
+  //    only own their pdf. Appending events grows them in place when no copy
+  //    shares them, and copies them first otherwise.
+  std::shared_ptr< Dataset > _data;
 
   // Minimizer variation to produce uncertaities at a given number of sigmas.
   //    Notice that, if the user wants n-sigma uncertainties, up = n^2.
@@ -26,39 +53,72 @@ protected:
 
   bool   _verbose;
 
-  // Maps of cached expressions.
-  std::map< unsigned, std::vector< double >                 > _cacheR;
-  std::map< unsigned, std::vector< std::complex< double > > > _cacheC;
+  // Factor applied to the sum of the data terms. A fit to a subsample of a
+  //    fraction f of the events uses 1/f, to approximate the full function.
+  double _scale;
+
+  // Maps of cached expressions materialized at full precision, and manager of
+  //    those stored in reduced precision or recomputed when they are read.
+  std::shared_ptr< std::map< unsigned, std::vector< double >                 > > _cacheR;
+  std::shared_ptr< std::map< unsigned, std::vector< std::complex< double > > > > _cacheC;
+  std::shared_ptr< CacheManager                                                > _caches;
+
+  // First cache indices assigned to the pdf of this minimizer.
+  unsigned _firstCacheR;
+  unsigned _firstCacheC;
+
+  // Use the per-event caches persisted with the given checkpoint, if any, or
+  //    compute and persist them otherwise.
+  Minimizer( const PdfBase& pdf, const Dataset& data, const Checkpoint& checkpoint );
+
+  // Called whenever the dataset is replaced, so that derived classes can
+  //    refresh what they keep from it.
+  virtual void dataChanged() {}
 
 public:
   Minimizer( const PdfBase& pdf, const Dataset& data )
-    : _pdf    ( pdf.copy() ),
-      _data   ( data       ),
-      _up     ( -1.0       ),
-      _verbose( false      )
+    : _pdf    ( pdf.copy()                                ),
+      _data   ( place( data )                             ),
+      _up     ( -1.0                                      ),
+      _verbose( false                                     ),
+      _scale  ( 1.0                                       )
   {
     cache();
   }
 
   // Copy constructor.
   Minimizer( const Minimizer& minimizer )
-    : _pdf    ( minimizer._pdf->copy() ),
-      _data   ( minimizer._data        ),
-      _up     ( minimizer._up          ),
-      _verbose( minimizer._verbose     ),
-      _cacheR ( minimizer._cacheR      ),
-      _cacheC ( minimizer._cacheC      )
+    : _pdf        ( minimizer._pdf->copy() ),
+      _data       ( minimizer._data        ),
+      _up         ( minimizer._up          ),
+      _verbose    ( minimizer._verbose     ),
+      _scale      ( minimizer._scale       ),
+      _cacheR     ( minimizer._cacheR      ),
+      _cacheC     ( minimizer._cacheC      ),
+      _caches     ( minimizer._caches      ),
+      _firstCacheR( minimizer._firstCacheR ),
+      _firstCacheC( minimizer._firstCacheC )
     {}
 
   virtual Minimizer* copy() const = 0;
 
+  // Copy of the minimizer that uses a different dataset. The per-event
+  //    caches are computed again for the new dataset.
+  Minimizer* rebind( const Dataset& data ) const;
+
+  // Add new events to the dataset. The per-event caches are only computed
+  //    for the new events, and appended to those of the previous ones, with
+  //    the same plan of the cache manager.
+  void append( const Dataset& events ) throw( PdfException, DataException );
+
   virtual ~Minimizer()
   {
     delete _pdf;
   }
 
-  const PdfBase& pdf()  const { return *_pdf; }
-  const Dataset& data() const { return _data; }
+  const PdfBase&      pdf()    const { return *_pdf;    }
+  const Dataset&      data()   const { return *_data;   }
+  const CacheManager& caches() const { return *_caches; }
 
   // Should be const double, but minuit declares these functions as double.
   double up() const throw( MinimizerException );
@@ -68,7 +128,32 @@ public:
   void setUp  ( const double& up         ) { _up      = up;  }
   void verbose( const bool&   val = true ) { _verbose = val; }
 
+  // Minuit parameters corresponding to a map of parameters.
+  static MnUserParameters userParameters( const std::map< std::string, Parameter >& pars );
+
   FunctionMinimum minimize() const;
+
+  // Minimize starting from the parameters and covariance of a previous
+  //    minimum, e.g. to refit after appending new events.
+  FunctionMinimum minimize( const FunctionMinimum& previous ) const;
+
+  // Minimize from several starting points in parallel, and return the distinct
+  //    minima found, sorted by increasing function value.
+  const std::vector< FunctionMinimum > minimize( const MultiStart& multiStart ) const;
+
+  // Minimize in stages of increasing sample size and norm precision, ending
+  //    with the full dataset at full precision.
+  FunctionMinimum minimize( const Progressive& progressive ) const;
+
+  // Minimize saving the state to the checkpoint at regular intervals. If the
+  //    checkpoint already exists, resume from the state stored in it. The
+  //    returned minimum only counts the calls of the last segment, since Minuit
+  //    does not allow setting them; the total is stored in the checkpoint.
+  FunctionMinimum minimize( const Checkpoint& checkpoint ) const;
+
+  // Minimize with L-BFGS-B. Call migrad on the result to finish with Hesse
+  //    and Migrad at the minimum, for the usual Minuit result with its covariance.
+  const LbfgsMinimum minimize( const Lbfgs& lbfgs ) const;
 };
 
 #endif
@@ -9,20 +9,25 @@
 
 #include <cfit/minimizer.hh>
 
+class MultiStart;
+class Lbfgs;
+class LbfgsMinimum;
+
 class MinimizerExpr : public FCNBase
 {
 private:
   double _up;
   bool   _verbose;
 
-  std::vector< const Minimizer* > _minimizers;
+  std::vector< Minimizer* >          _minimizers;
   std::map< std::string, Parameter > _parMap;
 
   void clear()
   {
-    for ( std::vector< const Minimizer* >::iterator mmzr = _minimizers.begin(); mmzr != _minimizers.end(); ++mmzr )
+    for ( std::vector< Minimizer* >::iterator mmzr = _minimizers.begin(); mmzr != _minimizers.end(); ++mmzr )
       delete *mmzr;
 
+    _minimizers.clear();
     _parMap.clear();
   }
 
@@ -31,6 +36,11 @@ public:
     : _up( -1.0 ), _verbose( false )
     {}
 
+  // Copy constructor. Each expression owns its own copies of the minimizers.
+  MinimizerExpr( const MinimizerExpr& right );
+
+  MinimizerExpr* copy() const { return new MinimizerExpr( *this ); }
+
   ~MinimizerExpr()
   {
     clear();
@@ -43,12 +53,23 @@ public:
   void setUp  ( const double& up  ) { _up      = up;  }
   void verbose( const bool&   val ) { _verbose = val; }
 
+  // Add new events to the data of the term-th minimizer of the expression, in
+  //    the order they were added, as with Minimizer::append.
+  void append( const std::size_t& term, const Dataset& events ) throw( MinimizerException, PdfException, DataException );
+
   double operator()( const std::vector< double >& par ) const throw( PdfException );
 
   FunctionMinimum minimize() const;
 
-  // Assignment operators. No need to define operator=( const MinimizerExpr& ) because
-  //    the default one is just fine.
+  // Minimize from several starting points in parallel, and return the distinct
+  //    minima found, sorted by increasing function value.
+  const std::vector< FunctionMinimum > minimize( const MultiStart& multiStart ) const;
+
+  // Minimize with L-BFGS-B, as in Minimizer.
+  const LbfgsMinimum minimize( const Lbfgs& lbfgs ) const;
+
+  // Assignment operators.
+  MinimizerExpr& operator= ( const MinimizerExpr& right );
   MinimizerExpr& operator= ( const Minimizer&     right );
   MinimizerExpr& operator+=( const Minimizer&     right );
   MinimizerExpr& operator+=( const MinimizerExpr& right );
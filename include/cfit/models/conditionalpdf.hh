@@ -0,0 +1,110 @@
+#ifndef __CONDITIONALPDF_HH__
+#define __CONDITIONALPDF_HH__
+
+#include <vector>
+#include <string>
+#include <complex>
+#include <map>
+#include <atomic>
+#include <memory>
+
+#include <cfit/variable.hh>
+#include <cfit/parameter.hh>
+#include <cfit/pdfmodel.hh>
+
+class Dataset;
+
+// Pdf of a single observable conditional on one or more per-event variables,
+//    such as the decay time given its per-event resolution. Each conditioning
+//    variable replaces a parameter of the wrapped pdf, which takes the value
+//    of the variable at every event. The conditioning variables are not
+//    integrated over: the pdf is normalized per event on the range of the
+//    observable, with the area() of the wrapped pdf, which is analytical for
+//    most models.
+//
+// Events with the same conditioning values share their norm. The norms of all
+//    the distinct conditioning values of the cached events are computed by
+//    cache, and reused in later calls while the shape parameters of the
+//    wrapped pdf do not change, e.g. when only the yields or parameters of
+//    other components of a PdfExpr move.
+//
+// Evaluating the pdf does not modify it: each thread sets the conditioning
+//    values on a copy of its own of the wrapped pdf, so the same instance can
+//    be evaluated from several threads at once.
+class ConditionalPdf : public PdfModel
+{
+private:
+  PdfModel* _pdf;
+
+  // Range of the observable.
+  double _lower;
+  double _upper;
+
+  // Conditioning variables and the names of the parameters they replace.
+  std::vector< std::string > _conds;
+  std::vector< std::string > _targets;
+  std::vector< double      > _refs;    // Values of the targets when caching.
+  std::vector< unsigned    > _condIdx; // Indices in the vector of variables.
+  unsigned                   _obsIdx;
+
+  // Index of the cached group of conditioning values of each event. The
+  //    groups are kept, so appended events continue the same numbering.
+  bool                                        _doCache;
+  unsigned                                    _cacheIdx;
+  std::map< std::vector< double >, unsigned > _groups;
+
+  // Norms of each group, and the shape parameters they were computed with.
+  std::vector< double > _norms;
+  std::vector< double > _shape;
+
+  // Copies of the wrapped pdf of the calling thread for each instance, with
+  //    the version of the wrapped pdf they were made from. The version changes
+  //    whenever the wrapped pdf does.
+  typedef std::map< const ConditionalPdf*, std::pair< unsigned long, std::unique_ptr< PdfModel > > > Copies;
+
+  static thread_local Copies          _copies;
+  static std::atomic< unsigned long > _versions;
+  unsigned long                       _version;
+
+  void bind( const Variable& cond, const Parameter& target ) throw( PdfException );
+  void setIndices();
+
+  // Compute the norms of the groups from first on.
+  void normalize( const unsigned& first );
+
+  // Copy of the wrapped pdf of the calling thread, with the targets set to
+  //    the conditioning values of an event, or to the values of a group.
+  PdfModel& local()                                     const;
+  PdfModel& condition( const std::vector< double >& vars  ) const;
+  PdfModel& group    ( const std::vector< double >& value ) const;
+
+  void setParExpr();
+
+public:
+  ConditionalPdf( const PdfModel& pdf, const Variable& cond, const Parameter& target,
+                  const double& lower, const double& upper ) throw( PdfException );
+
+  ConditionalPdf( const ConditionalPdf& right );
+
+  ~ConditionalPdf();
+
+  ConditionalPdf* copy() const;
+
+  // Make another variable replace another parameter of the wrapped pdf.
+  void addCondition( const Variable& cond, const Parameter& target ) throw( PdfException );
+
+  // Getters.
+  const std::vector< std::string >& conditions() const { return _conds; }
+  const unsigned                    nGroups()    const { return _norms.size(); }
+
+  void cache();
+
+  const std::map< unsigned, std::vector< double > > cacheReal( const Dataset& data );
+
+  const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
+  const double evaluate( const std::vector< double >&                 vars  ,
+                         const std::vector< double >&                 cacheR,
+                         const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
+};
+
+#endif
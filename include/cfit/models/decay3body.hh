@@ -20,14 +20,36 @@ private:
   // Maximum value of the pdf.
   double _maxPdf;
 
+  // Maximum value of the pdf times the Jacobian in the square Dalitz plot.
+  //    It is found while computing the norm on the grid, and on the first
+  //    generated event for the other norms.
+  mutable double _maxSquare;
+
+  // Index of the amplitude, cached once if it is fixed and computed for each
+  //    block of events otherwise.
+  bool     _cacheAmps;
+  bool     _blockAmps;
+  unsigned _ampCache;
+
   const double evaluateFuncs( const double& mSq12, const double& mSq13, const double& mSq23 ) const;
 
+  void cacheMaxSquare() const;
+
   // Auxiliary function to compute the center of a bin.
   static const double binCenter( const unsigned& bin, const unsigned& nbins, const double& min, const double& max )
   {
     return ( max - min ) / double( nbins ) * ( bin + 0.5 ) + min;
   }
 
+  const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
+  void cacheBlock( const Dataset&                                               data  ,
+                   const std::size_t&                                           first ,
+                   const std::size_t&                                           last  ,
+                   std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const;
+
+  // The amplitude evaluates every resonance at each event.
+  const double cacheCost() const { return _amp.nComponents(); }
+
   void setParExpr() {}
 
 public:
@@ -43,12 +65,24 @@ public:
   const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException );
   const double evaluate( const double& mSq12, const double& mSq13                      ) const throw( PdfException );
   const double evaluate( const std::vector< double >& vars                             ) const throw( PdfException );
+  const double evaluate( const std::vector< double >&                 vars  ,
+                         const std::vector< double >&                 cacheR,
+                         const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
 
   const double project ( const std::string& varName, const double& value ) const throw( PdfException );
 
   void setMaxPdf( const double& max ) { _maxPdf = max; }
   const std::map< std::string, double > generate() const throw( PdfException );
 
+  // Code generation: the kernel evaluates the amplitude with the fixed
+  //    parameters folded, on the events and on the points of the norm, which
+  //    carry the efficiency computed beforehand. The efficiency functions must
+  //    then have all their parameters fixed.
+  const std::string kernelCode( const std::map< std::string, std::string >& pars ) const throw( PdfException );
+  void kernelColumns( const Dataset&                        data  ,
+                      std::vector< std::vector< double > >& events,
+                      std::vector< std::vector< double > >& norm   ) const throw( PdfException );
+
   friend const Decay3Body  operator* (       Decay3Body left, const Function&  right );
   friend const Decay3Body  operator* ( const Function&  left,       Decay3Body right );
   const        Decay3Body& operator*=( const Function& right ) throw( PdfException );
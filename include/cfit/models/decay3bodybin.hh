@@ -10,11 +10,11 @@
 #include <cfit/phasespace.hh>
 #include <cfit/function.hh>
 #include <cfit/binnedamplitude.hh>
+#include <cfit/dataset.hh>
+#include <cfit/randomstream.hh>
 
 #include <Minuit/FunctionMinimum.h>
 
-class Dataset;
-
 class Decay3BodyBin : public DecayModel< BinnedAmplitude >
 {
 private:
@@ -32,13 +32,31 @@ private:
 
   bool   _fixedAmp;
 
-  // // Maximum value of the pdf.
-  // double _maxPdf;
-
   // Index of the cached bins.
   unsigned _binIndex;
 
-  std::vector< unsigned > _binCache;
+  // Cells per dimension of the grid to integrate the efficiency, bin of
+  //    each cell, integrated efficiency in each positive bin, for the norm,
+  //    and cells that may hold points of each bin, used by the generator.
+  static const unsigned                          _gridBins = 100;
+  mutable std::vector< unsigned >                _binCache;
+  mutable std::vector< double >                  _effs;
+  mutable std::vector< std::vector< unsigned > > _binCells;
+
+  // Used by the generator: integrated and maximum efficiency in each signed
+  //    bin, and fraction of events in it, for the parameters they were last
+  //    computed with.
+  mutable std::map< int, double > _signedEffs;
+  mutable std::map< int, double > _maxEffs;
+  mutable std::map< int, double > _fractions;
+  mutable std::vector< double >   _fractionPars;
+
+  void integrateEffs() const;
+  void cacheBinCells() const;
+  void cacheFractions() const throw( PdfException );
+
+  // Point in a bin, distributed as the efficiency.
+  void generatePoint( const int& bin, RandomStream& stream, double& mSq12, double& mSq13 ) const throw( PdfException );
 
   // const double evaluateUnnorm( const int& bin ) const throw( PdfException );
   const double evaluateUnnorm( const double& mSq12, const double& mSq13 ) const throw( PdfException );
@@ -47,9 +65,6 @@ private:
 
   void setParExpr();
 
-  // One or more functions to define the efficiency.
-  std::vector< Function > _funcs;
-
 public:
   Decay3BodyBin( const Variable&        mSq12         ,
                  const Variable&        mSq13         ,
@@ -115,6 +130,20 @@ public:
                          const std::vector< double >&                 cacheR,
                          const std::vector< std::complex< double > >& cacheC ) const throw( PdfException );
 
+  // Expected fraction of events in each bin, by signed bin number.
+  const std::map< int, double > binFractions() const;
+
+  // Counts-only toys, without positions: the numbers of events in each bin,
+  //    either multinomial for a fixed total or independent Poisson numbers
+  //    for an expected total.
+  const std::map< int, unsigned > generateCounts       ( const unsigned& nEvents   ) const;
+  const std::map< int, unsigned > generateCountsPoisson( const double&   nExpected ) const;
+
+  // A single event, or a dataset with the given numbers of events in each
+  //    bin, distributed as the efficiency within the bins.
+  const std::map< std::string, double > generate() const throw( PdfException );
+  const Dataset generate( const std::map< int, unsigned >& counts ) const throw( PdfException );
+
   friend const Decay3BodyBin  operator* (       Decay3BodyBin left, const Function&     right );
   friend const Decay3BodyBin  operator* ( const Function&     left,       Decay3BodyBin right );
   const        Decay3BodyBin& operator*=( const Function&     right                           ) throw( PdfException );
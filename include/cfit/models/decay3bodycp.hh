@@ -34,14 +34,13 @@ private:
   // Maximum value of the pdf.
   double _maxPdf;
 
-  // Indices of the cached direct and conjugated amplitudes.
+  // Indices of the direct and conjugated amplitudes, cached once if they are
+  //    fixed and computed for each block of events otherwise.
   bool     _cacheAmps;
+  bool     _blockAmps;
   unsigned _ampDirCache;
   unsigned _ampCnjCache;
 
-  // Vector to cache values of the amplitude for the norm evaluation.
-  std::vector< std::complex< double > > _ampCache;
-
   // Auxiliary function to compute the center of a bin.
   static const double binCenter( const unsigned& bin, const unsigned& nbins, const double& min, const double& max )
   {
@@ -51,6 +50,13 @@ private:
   const double evaluateUnnorm( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException );
 
   const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
+  void cacheBlock( const Dataset&                                               data  ,
+                   const std::size_t&                                           first ,
+                   const std::size_t&                                           last  ,
+                   std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const;
+
+  // The amplitudes evaluate every resonance at each event.
+  const double cacheCost() const { return _amp.nComponents(); }
 
   void setParExpr();
 
@@ -126,6 +132,12 @@ public:
     }
   }
 
+  // Changing the grid invalidates the cached amplitudes and norm components.
+  void setNormBins( const unsigned& nBins )
+  {
+    DecayModel::setNormBins( nBins );
+    _fixed = false;
+  }
 
   void cache();
   const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException );
@@ -42,11 +42,18 @@ private:
 
   bool                   _fixedAmp;
 
-  // Maximum value of the pdf.
-  double _maxPdf;
-
-  // Indices of the cached direct and conjugated amplitudes.
+  // Generator: number of cells per dimension of the Dalitz plot grid, maximum
+  //    of the time-integrated pdf in each cell, their cumulative sum, and the
+  //    parameters they were computed with.
+  unsigned                      _genBins;
+  mutable std::vector< double > _genMax;
+  mutable std::vector< double > _genCdf;
+  mutable std::vector< double > _genPars;
+
+  // Indices of the direct and conjugated amplitudes, cached once if they are
+  //    fixed and computed for each block of events otherwise.
   bool     _cacheAmps;
+  bool     _blockAmps;
   unsigned _ampDirCache;
   unsigned _ampCnjCache;
 
@@ -65,11 +72,33 @@ private:
   void cacheNormComponents();
 
   const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
+  void cacheBlock( const Dataset&                                               data  ,
+                   const std::size_t&                                           first ,
+                   const std::size_t&                                           last  ,
+                   std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const;
+
+  // The amplitudes evaluate every resonance at each event.
+  const double cacheCost() const { return _amp.nComponents(); }
 
   const double                 psip( const double& t ) const;
   const double                 psim( const double& t ) const;
   const std::complex< double > psii( const double& t ) const;
 
+  // Coefficients ( A + Abar ) / 2 and ( A* - Abar* ) / 2 of the time evolution at a point.
+  void coefficients( const double& mSq12, const double& mSq13, const double& mSq23,
+                     std::complex< double >& apb2, std::complex< double >& amb2 ) const;
+
+  // Integral over all times of the time dependence at a point, with
+  //    a = | apb2 |^2, b = | amb2 |^2 and c = apb2 * amb2.
+  const double timeIntegral( const double& a, const double& b, const std::complex< double >& c ) const;
+
+  // Time distributed as the time dependence at a point, by inversion of its
+  //    cumulative distribution.
+  const double generateTime( const double& a, const double& b, const std::complex< double >& c ) const;
+
+  // Compute the maxima of the time-integrated pdf in the cells of the generator.
+  void cacheGenerator() const;
+
   void setParExpr();
 
 public:
@@ -143,6 +172,12 @@ public:
     cache();
   }
 
+  // Changing the grid invalidates the norm components.
+  void setNormBins( const unsigned& nBins )
+  {
+    DecayModel::setNormBins( nBins );
+    _fixedAmp = false;
+  }
 
   void cache();
   const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const;
@@ -155,7 +190,13 @@ public:
 
   const double project ( const std::string& varName, const double& value ) const throw( PdfException );
 
-  void setMaxPdf( const double& max ) { _maxPdf = max; }
+  // Generate the Dalitz plot point from the time-integrated pdf, by
+  //    accept-reject in the cells of a grid with their own maxima, and the
+  //    time from its exact distribution at that point. The maxima are found
+  //    on points refined in each cell until they converge. If the pdf still
+  //    exceeds the maximum of a cell, it is raised and the event is drawn
+  //    again.
+  void setGenBins( const unsigned& nBins ) { _genBins = nBins; _genPars.clear(); }
   const std::map< std::string, double > generate() const throw( PdfException );
 
   friend const Decay3BodyMix  operator* (       Decay3BodyMix left, const Function&     right );
@@ -2,35 +2,163 @@
 #define __DECAYMIXING3BODY_HH__
 
 #include <vector>
+#include <map>
+#include <complex>
 
 #include <cfit/decaymodel.hh>
 #include <cfit/variable.hh>
+#include <cfit/parameterexpr.hh>
+#include <cfit/coefexpr.hh>
 #include <cfit/amplitude.hh>
 #include <cfit/phasespace.hh>
+#include <cfit/function.hh>
 
-class DecayMixing3Body : public DecayModel
+#include <Minuit/FunctionMinimum.h>
+
+
+class Dataset;
+
+// Time dependent Dalitz plot model of a mixing neutral meson, in terms of
+//    the e_1 and e_2 time evolution functions:
+//
+//    < f | H | P(t) > = 1/2 * [ ( A_f + q/p Abar_f ) e_1(t) + ( A_f - q/p Abar_f ) e_2(t) ]
+//
+//    e_1(t) = exp[ - ( 1 + y + i x ) t / 2 tau ]
+//    e_2(t) = exp[ - ( 1 - y - i x ) t / 2 tau ]
+//
+// The norm is computed analytically from the Dalitz plot integrals of |A|^2,
+//    |Abar|^2 and A* Abar, which are only recomputed when the amplitude or
+//    the efficiency functions change.
+class DecayMixing3Body : public DecayModel< Amplitude >
 {
 private:
-  const Variable  _t;
-  const Parameter _tau;
-  const Parameter _x;
-  const Parameter _y;
+  // Names of the squared invariant mass and decay time variables.
+  std::string _mSq12;
+  std::string _mSq13;
+  std::string _mSq23;
+  std::string _t;
+
+  // Positions of the variables in the vector of values passed to evaluate.
+  unsigned _idx12;
+  unsigned _idx13;
+  unsigned _idx23;
+  unsigned _idxT;
+
+  ParameterExpr _tau;
+  ParameterExpr _x;
+  ParameterExpr _y;
+  CoefExpr      _qoverp;
+
+  bool          _hasCPV;
+
+  // Values of the parameters, updated every time the parameters are set.
+  double                 _tauVal;
+  double                 _xVal;
+  double                 _yVal;
+  std::complex< double > _qoverpVal;
+
+  // Dalitz plot integrals of |A|^2, |Abar|^2 and A* Abar, times the efficiency.
+  double                 _iDir;
+  double                 _iCnj;
+  std::complex< double > _iXed;
+  double                 _norm;
+
+  // Keep track of whether the amplitude and functions are all fixed.
+  bool                   _fixed;
+
+  // Maxima of |A|^2 and |Abar|^2 times the efficiency on the grid, to bound
+  //    the pdf in the generation if no maximum has been set by the user.
+  double _maxDir;
+  double _maxCnj;
+  double _maxPdf;
+
+  // Indices of the cached direct and conjugated amplitudes, and of the product
+  //    of efficiency functions.
+  bool     _cacheAmps;
+  bool     _blockAmps;
+  unsigned _ampDirCache;
+  unsigned _ampCnjCache;
+  bool     _cacheFuncs;
+  unsigned _funcsCache;
+
+  // Squared modulus of the time dependent amplitude.
+  const double ampSq( const std::complex< double >& ampDir, const std::complex< double >& ampCnj, const double& t ) const;
+
+  const double evaluateUnnorm( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const;
+
+  void cacheIntegrals();
+
+  const std::map< unsigned, std::vector< double >                 > cacheReal   ( const Dataset& data );
+  const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
+  void cacheBlock( const Dataset&                                               data  ,
+                   const std::size_t&                                           first ,
+                   const std::size_t&                                           last  ,
+                   std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const;
+
+  // The amplitudes evaluate every resonance at each event.
+  const double cacheCost() const { return _amp.nComponents(); }
+
+  void setParExpr();
 
-  std::complex< double > e1( const double& gt ) const;
-  std::complex< double > e2( const double& gt ) const;
 public:
-  DecayMixing3Body( const Variable&   mSq12,
-		    const Variable&   mSq13,
-		    const Variable&   mSq23,
-		    const Variable&   t    ,
-		    const Amplitude&  amp  ,
-		    const Parameter&  tau  ,
-		    const Parameter&  x    ,
-		    const Parameter&  y    ,
-		    const PhaseSpace& ps     );
-
-  double evaluate(                                   ) const throw( PdfException );
-  double evaluate( const std::vector< double >& vars ) const throw( PdfException );
+  DecayMixing3Body( const Variable&      mSq12,
+                    const Variable&      mSq13,
+                    const Variable&      mSq23,
+                    const Variable&      t    ,
+                    const Amplitude&     amp  ,
+                    const ParameterExpr& tau  ,
+                    const ParameterExpr& x    ,
+                    const ParameterExpr& y    ,
+                    const PhaseSpace&    ps     );
+
+  DecayMixing3Body( const Variable&      mSq12 ,
+                    const Variable&      mSq13 ,
+                    const Variable&      mSq23 ,
+                    const Variable&      t     ,
+                    const Amplitude&     amp   ,
+                    const ParameterExpr& tau   ,
+                    const ParameterExpr& x     ,
+                    const ParameterExpr& y     ,
+                    const CoefExpr&      qoverp,
+                    const PhaseSpace&    ps      );
+
+  DecayMixing3Body* copy() const;
+
+  // Getters.
+  const double                 tau()    const { return _tauVal;    }
+  const double                 x()      const { return _xVal;      }
+  const double                 y()      const { return _yVal;      }
+  const std::complex< double > qoverp() const { return _qoverpVal; }
+
+  // Getters of the Dalitz plot integrals.
+  const double&                 iDir() const { return _iDir; }
+  const double&                 iCnj() const { return _iCnj; }
+  const std::complex< double >& iXed() const { return _iXed; }
+
+  // Changing the grid invalidates the Dalitz plot integrals.
+  void setNormBins( const unsigned& nBins )
+  {
+    DecayModel::setNormBins( nBins );
+    _fixed = false;
+  }
+
+  void cache();
+  const double evaluate( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const;
+  const double evaluate( const double& mSq12, const double& mSq13                     , const double& t ) const;
+
+  const double evaluate( const std::vector< double >&                 vars    ) const throw( PdfException );
+  const double evaluate( const std::vector< double >&                 vars  ,
+                         const std::vector< double >&                 cacheR,
+                         const std::vector< std::complex< double > >& cacheC  ) const throw( PdfException );
+
+  const double project ( const std::string& varName, const double& value ) const throw( PdfException );
+
+  void setMaxPdf( const double& max ) { _maxPdf = max; }
+  const std::map< std::string, double > generate() const throw( PdfException );
+
+  friend const DecayMixing3Body  operator* (       DecayMixing3Body left, const Function&        right );
+  friend const DecayMixing3Body  operator* ( const Function&        left,       DecayMixing3Body right );
+  const        DecayMixing3Body& operator*=( const Function& right );
 };
 
 #endif
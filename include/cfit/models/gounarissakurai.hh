@@ -30,6 +30,10 @@ public:
     {}
 
   std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const;
+  void                   propagators( const PhaseSpace& ps, const double* mSqAB,
+                                      double* re, double* im, const std::size_t& n ) const;
+  const std::string      propagatorCode( const PhaseSpace& ps,
+                                         const std::map< std::string, std::string >& pars ) const throw( PdfException );
   GounarisSakurai*       copy()                                                  const;
 };
 
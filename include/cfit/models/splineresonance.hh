@@ -0,0 +1,80 @@
+#ifndef __SPLINERESONANCE_HH__
+#define __SPLINERESONANCE_HH__
+
+#include <vector>
+#include <string>
+#include <complex>
+
+#include <cfit/parameter.hh>
+#include <cfit/coef.hh>
+#include <cfit/resonance.hh>
+
+class PhaseSpace;
+
+// Model-independent S-wave lineshape, given by complex values at a set of
+//    knots in the squared invariant mass of the resonant pair, and
+//    interpolated by cubic Hermite polynomials with Catmull-Rom slopes.
+//    Each point only depends on the four closest knots, with weights that
+//    do not depend on the knot values. The lineshape is therefore linear in
+//    the knot coefficients, with one term per knot, and the models keep the
+//    values of the terms on the points of the norm, whose integrals are then
+//    quadratic forms of the knot values that do not need the points again
+//    when the knots float. The lineshape vanishes outside the range of the
+//    knots.
+class SplineResonance : public Resonance
+{
+private:
+  std::vector< double >                                 _knots;  // Positions of the knots.
+  std::vector< std::pair< std::string, std::string > > _coefs;  // Names of real and imag parts.
+  std::vector< std::complex< double > >                 _values; // Current values at the knots.
+
+  void pushKnots( const std::vector< double >& knots, const std::vector< Coef >& coefs ) throw( PdfException );
+
+  // Read the values at the knots from the parameter map.
+  void update();
+
+public:
+  template <class T>
+  SplineResonance( const T&                     resoA, const T& resoB,
+                   const std::vector< double >& knots,
+                   const std::vector< Coef >&   coefs  )
+    : Resonance( resoA, resoB )
+  {
+    pushKnots( knots, coefs );
+  }
+
+  SplineResonance( const SplineResonance& right )
+    : Resonance( right ), _knots( right._knots ), _coefs( right._coefs ), _values( right._values )
+    {}
+
+  // Getters.
+  const unsigned                               nKnots() const { return _knots.size(); }
+  const std::vector< double >&                 knots()  const { return _knots;        }
+  const std::vector< std::complex< double > >& values() const { return _values;       }
+
+  // Index of the first contributing knot and the weights of up to four knots
+  //    at a given mSqAB. Returns false outside the range of the knots.
+  const bool basis( const double& mSqAB, unsigned& first, double weights[ 4 ] ) const;
+
+  // Weights of all the knots at a given mSqAB.
+  const std::vector< double > basis( const double& mSqAB ) const;
+
+  // One term per knot, with the knot value as coefficient. The terms only
+  //    depend on the positions of the knots, so they are always fixed.
+  const unsigned                              nTerms()     const { return _knots.size(); }
+  const bool                                  termsFixed() const { return true;          }
+  const std::vector< std::complex< double > > termCoefs()  const { return _values;       }
+
+  void terms( const PhaseSpace& ps,
+              const double&     mSq12,
+              const double&     mSq13,
+              const double&     mSq23,
+              std::complex< double >* values ) const;
+
+  void setPars( const std::map< std::string, Parameter >& pars );
+
+  std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const;
+  SplineResonance*       copy()                                                  const;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef __MULTISTART_HH__
+#define __MULTISTART_HH__
+
+#include <vector>
+#include <map>
+#include <string>
+
+#include <Minuit/FCNBase.h>
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameters.h>
+
+#include <cfit/parameter.hh>
+#include <cfit/exceptions.hh>
+
+
+// Driver to run several minimizations of the same function from randomized
+//    starting points, to explore likelihoods with many local minima.
+class MultiStart
+{
+private:
+  unsigned _nStarts;
+  unsigned _nThreads;
+
+  // Spread of the random starting points, in units of the parameter errors,
+  //    for parameters without limits. Parameters with limits are drawn flat.
+  double   _spread;
+
+  // Pruning of the starts: after _pruneCalls function calls, only those starts
+  //    whose function value is within _pruneDelta of the best one are continued.
+  unsigned _pruneCalls;
+  double   _pruneDelta;
+
+  // Tolerances to decide whether two minima are the same.
+  double   _fvalTolerance;
+  double   _parTolerance;
+
+  const std::vector< MnUserParameters > startPoints( const std::map< std::string, Parameter >& pars ) const;
+
+  const bool sameMinimum( const FunctionMinimum& left, const FunctionMinimum& right ) const;
+
+  // Run all the starts, with one private function object per thread.
+  const std::vector< FunctionMinimum > run( const std::vector< FCNBase* >&             fcns,
+                                            const std::map< std::string, Parameter >& pars ) const;
+
+public:
+  MultiStart( const unsigned& nStarts, const unsigned& nThreads = 0 )
+    : _nStarts( nStarts ), _nThreads( nThreads ), _spread( 3.0 ),
+      _pruneCalls( 0 ), _pruneDelta( 0.0 ),
+      _fvalTolerance( 1.0e-3 ), _parTolerance( 0.1 )
+  {}
+
+  // Getters.
+  const unsigned& nStarts()  const { return _nStarts;  }
+  const unsigned  nThreads() const;
+
+  // Setters.
+  void setSpread    ( const double&   spread                    ) { _spread     = spread;                        }
+  void prune        ( const unsigned& calls, const double& delta ) { _pruneCalls = calls; _pruneDelta = delta;    }
+  void setTolerances( const double&   fval , const double& pars  ) { _fvalTolerance = fval; _parTolerance = pars; }
+
+  // Run all the starts of the given function, which must provide a copy() function
+  //    returning a newly allocated, independent function object. Return the
+  //    distinct minima found, sorted by increasing function value.
+  template< class Fcn >
+  const std::vector< FunctionMinimum > minimize( const Fcn&                                fcn ,
+                                                 const std::map< std::string, Parameter >& pars ) const;
+};
+
+
+
+template< class Fcn >
+inline const std::vector< FunctionMinimum > MultiStart::minimize( const Fcn&                                fcn ,
+                                                                  const std::map< std::string, Parameter >& pars ) const
+{
+  // Each thread works on its own copy of the function, so that parameter values and
+  //    norms are private to it. Copies share the dataset and the per-event caches.
+  std::vector< FCNBase* > fcns;
+  for ( unsigned thread = 0; thread < nThreads(); ++thread )
+    fcns.push_back( fcn.copy() );
+
+  try
+  {
+    const std::vector< FunctionMinimum >& minima = run( fcns, pars );
+
+    for ( std::vector< FCNBase* >::iterator copy = fcns.begin(); copy != fcns.end(); ++copy )
+      delete *copy;
+
+    return minima;
+  }
+  catch ( ... )
+  {
+    for ( std::vector< FCNBase* >::iterator copy = fcns.begin(); copy != fcns.end(); ++copy )
+      delete *copy;
+
+    throw;
+  }
+}
+
+#endif
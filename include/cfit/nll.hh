@@ -2,23 +2,92 @@
 #define __NLL_HH__
 
 #include <vector>
+#include <string>
+#include <memory>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserCovariance.h>
 
 #include <cfit/minimizer.hh>
 #include <cfit/pdfbase.hh>
 #include <cfit/dataset.hh>
 #include <cfit/exceptions.hh>
+#include <cfit/checkpoint.hh>
+#include <cfit/codegen.hh>
 
 class Nll : public Minimizer
 {
+private:
+  // Name of the field with the weight of each event, if any, and its values,
+  //    read once for each dataset and shared by the copies.
+  std::string                                    _weights;
+  std::shared_ptr< const std::vector< double > > _weightValues;
+
+  const std::vector< double >& weightValues() const;
+
+  void dataChanged();
+
+  // Sum of the data terms at the last set of parameters, and number of events
+  //    it spans. When events are appended, the nll at the same parameters
+  //    only needs the terms of the new events.
+  mutable std::vector< double > _memoPars;
+  mutable double                _memoSum;
+  mutable std::size_t           _memoSize;
+
+  // Compiled kernel of the nll, if any, shared by the copies, with the columns
+  //    it reads, and the positions and values of the parameters folded into
+  //    it as literals.
+  std::shared_ptr< const Codegen >                              _kernel;
+  std::shared_ptr< const std::vector< std::vector< double > > > _kernelEvents;
+  std::shared_ptr< const std::vector< std::vector< double > > > _kernelNorm;
+  std::vector< std::pair< unsigned, double > >                  _kernelFolded;
+
+  // Sum of the data terms with the interpreted pdf, or with the kernel.
+  const double dataTerms  ( const std::vector< double >& pars ) const throw( PdfException );
+  const double kernelTerms( const std::vector< double >& pars ) const throw( PdfException );
+
+  // Whether the kernel can evaluate the nll at the given parameters: it has
+  //    been compiled for the current data, and the folded parameters have not
+  //    changed.
+  const bool usesKernel( const std::vector< double >& pars ) const;
+
 public:
   Nll( const PdfModel& pdf, const Dataset& data );
   Nll( const PdfExpr&  pdf, const Dataset& data );
 
+  // Reuse the per-event caches persisted with a checkpoint, to restart a fit.
+  Nll( const PdfModel& pdf, const Dataset& data, const Checkpoint& checkpoint );
+  Nll( const PdfExpr&  pdf, const Dataset& data, const Checkpoint& checkpoint );
+
   Nll( const Nll& nll );
 
   Nll* copy() const { return new Nll( *this ); }
 
+  // Weight each event by the value of a field of the dataset, e.g. sWeights
+  //    or efficiency weights.
+  void               setWeights( const std::string& field ) throw( DataException );
+  const std::string& weights() const { return _weights; }
+
+  // Generate, compile and load a kernel of the nll for the pdf as currently
+  //    set up, with the fixed parameters folded as constants, and use it from
+  //    then on instead of evaluating the pdf. The compiled libraries are cached
+  //    in cacheDir, see Codegen. Whenever the data or a folded parameter change,
+  //    the nll goes back to the interpreted pdf, which gives the same values
+  //    up to rounding. Only some pdfs support code generation.
+  void compile( const std::string& cacheDir = "" ) throw( PdfException );
+  void interpret();
+
+  const bool compiled() const { return bool( _kernel ); }
+
   double operator()( const std::vector<double>& par ) const throw( PdfException );
+
+  // Covariance of the floating parameters at a minimum of a weighted fit,
+  //    corrected with the sandwich estimator V ( sum_i w_i^2 g_i g_i^T ) V,
+  //    where V is the covariance found by Minuit and g_i is the gradient of
+  //    the logarithm of the pdf at event i. The gradients are computed in
+  //    parallel, analytically if the pdf provides them, and the sum is done
+  //    in a fixed order, so the result does not depend on the number of threads.
+  const MnUserCovariance sandwich( const FunctionMinimum& min ) const throw( PdfException );
 };
 
 #endif
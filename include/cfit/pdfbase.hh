@@ -16,12 +16,16 @@
 class Dataset;
 class Region;
 class Minimizer;
+class SimultaneousNll;
+class CacheManager;
 
 class FunctionMinimum;
 
 class PdfBase
 {
   friend Minimizer;
+  friend SimultaneousNll;
+  friend CacheManager;
 
 protected:
   // Make a dataset available to a pdf such that it can compute values to be cached.
@@ -35,9 +39,39 @@ protected:
     return std::map< unsigned, std::vector< std::complex< double > > >();
   }
 
+  // Values that depend on floating parameters but are cheaper to compute for
+  //    many events at once, such as the amplitudes of the decay models, are
+  //    given cache indices by cacheComplex without returning any column, and
+  //    computed here for the events [first, last) at the current parameters.
+  //    The values of event n go to position n - first of their column.
+  virtual void cacheBlock( const Dataset&                                               data  ,
+                           const std::size_t&                                           first ,
+                           const std::size_t&                                           last  ,
+                           std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const {}
+
+  // Parts of the pdf whose caches are computed independently, in the order in
+  //    which they are assigned their cache indices.
+  virtual const std::vector< PdfBase* > cacheSources()
+  {
+    return std::vector< PdfBase* >( 1, this );
+  }
+
+  // Cost per event of computing the caches of the pdf, relative to that of a
+  //    simple function of the variables. It decides which columns are kept
+  //    when they do not all fit in memory, see CacheManager.
+  virtual const double cacheCost() const { return 1.0; }
+
   std::map< std::string, Variable  > _varMap;
   std::map< std::string, Parameter > _parMap;
 
+private:
+  // While a thread replays the cache indices of a part of a pdf, the indices
+  //    it assigns are taken from these counters instead of the shared ones,
+  //    which are left untouched. See CacheManager.
+  static thread_local bool     _replay;
+  static thread_local unsigned _replayReal;
+  static thread_local unsigned _replayComplex;
+
 public:
   static unsigned _cacheIdxReal;
   static unsigned _cacheIdxComplex;
@@ -71,14 +105,19 @@ public:
   const unsigned& nCachedReal()    const { return _cacheIdxReal;    }
   const unsigned& nCachedComplex() const { return _cacheIdxComplex; }
 
-  virtual const unsigned assignCacheIdxReal()    { return _cacheIdxReal++;    }
-  virtual const unsigned assignCacheIdxComplex() { return _cacheIdxComplex++; }
+  virtual const unsigned assignCacheIdxReal()    { return _replay ? _replayReal++    : _cacheIdxReal++;    }
+  virtual const unsigned assignCacheIdxComplex() { return _replay ? _replayComplex++ : _cacheIdxComplex++; }
 
   // Before evaluating the pdf at all data points, cache anything common to
   //    all points (usually compute the norm).
   virtual void cache() = 0;
 
-  // Evaluate functions.
+  // Set the number of bins per dimension of the grids used to numerically
+  //    compute norms. Pdfs with analytical norms just ignore it.
+  virtual void setNormBins( const unsigned& nBins ) {}
+
+  // Evaluate functions. They must not modify the pdf, since the threads of a
+  //    fit evaluate the same pdf at once.
   virtual const double evaluate( const std::vector< double >& vars ) const throw( PdfException ) = 0; // For any pdf.
   virtual const double evaluate( const double& value )               const throw( PdfException )      // For pdfs of a single variable.
   {
@@ -89,6 +128,17 @@ public:
                                  const std::vector< double                 >&     ,
                                  const std::vector< std::complex< double > >&       ) const throw( PdfException ) = 0;
 
+  // Gradient of the logarithm of the pdf at an event with respect to all its
+  //    parameters, sorted alphabetically. Pdfs that do not provide it analytically
+  //    return false, and the gradient is computed by finite differences instead.
+  virtual const bool logGradient( const std::vector< double                 >& vars  ,
+                                  const std::vector< double                 >& cacheR,
+                                  const std::vector< std::complex< double > >& cacheC,
+                                        std::vector< double                 >& grad   ) const
+  {
+    return false;
+  }
+
   virtual const std::map< std::string, double > generate()           const throw( PdfException ) = 0;
 
   virtual const double project( const std::string& varName,
@@ -109,6 +159,22 @@ public:
 
   virtual const double yield() const = 0;
 
+  // Source of a translation unit defining the kernel of Codegen for the pdf,
+  //    with the parameters given by the code of their values in pars, and the
+  //    columns of the events and of the norm points that the kernel reads.
+  //    Pdfs without generated code throw.
+  virtual const std::string kernelCode( const std::map< std::string, std::string >& pars ) const throw( PdfException )
+  {
+    throw PdfException( "PdfBase: the pdf does not support code generation." );
+  }
+
+  virtual void kernelColumns( const Dataset&                        data  ,
+                              std::vector< std::vector< double > >& events,
+                              std::vector< std::vector< double > >& norm   ) const throw( PdfException )
+  {
+    throw PdfException( "PdfBase: the pdf does not support code generation." );
+  }
+
   const bool dependsOn( const std::string& var ) const
   {
     const std::vector< std::string >& vars = varNames();
@@ -61,6 +61,12 @@ private:
 
   const std::map< unsigned, std::vector<               double   > > cacheReal   ( const Dataset& data );
   const std::map< unsigned, std::vector< std::complex< double > > > cacheComplex( const Dataset& data );
+  void cacheBlock( const Dataset&                                               data  ,
+                   const std::size_t&                                           first ,
+                   const std::size_t&                                           last  ,
+                   std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const;
+
+  const std::vector< PdfBase* > cacheSources();
 
 public:
   PdfExpr() : _scale( 1.0 ) {};
@@ -89,6 +95,7 @@ public:
   void setPars( const FunctionMinimum&                    min  ) throw( PdfException );
 
   void         cache();
+  void         setNormBins( const unsigned& nBins );
   const double evaluate( const std::vector< double >& vars ) const throw( PdfException );
 
   const std::map< std::string, double > generate() const throw( PdfException );
@@ -2,6 +2,7 @@
 #define __PHASESPACE_HH__
 
 #include <cmath>
+#include <string>
 #include <exception>
 
 class PhaseSpace
@@ -71,9 +72,31 @@ public:
     throw std::exception();
   };
 
+  // Area of the kinematically allowed region in ( mSq12, mSq13 ).
+  const double area() const;
+
   // Check if the kinematically allowed region contains a given point.
   bool contains( const double& mSq12, const double& mSq13, const double& mSq23 ) const;
   bool contains( const double& mSq12, const double& mSq13                      ) const;
+
+  // Source of an inline function contains( s12, s13, s23 ) with the masses
+  //    as literals, for the code generation backend.
+  const std::string code() const;
+
+  // Square Dalitz plot coordinates ( m', theta' ), both in [ 0, 1 ], which map
+  //    the unit square exactly onto the kinematically allowed region:
+  //
+  //    m'     = 1/pi arccos( 2 ( m12 - m12min ) / ( m12max - m12min ) - 1 )
+  //    theta' = 1/pi arccos( ( 2 mSq13 - mSq13max - mSq13min ) / ( mSq13max - mSq13min ) )
+  //
+  //    where the limits of mSq13 are those at the given mSq12. Cells of uniform
+  //    size in the square are narrower in mSq12 at low and high masses, and
+  //    in mSq13 close to the boundaries.
+  void toSquare  ( const double& mSq12 , const double& mSq13  , double& mPrime, double& thPrime ) const;
+  void fromSquare( const double& mPrime, const double& thPrime, double& mSq12 , double& mSq13   ) const;
+
+  // Jacobian | d( mSq12, mSq13 ) / d( m', theta' ) |, to integrate over the square.
+  const double squareJacobian( const double& mPrime, const double& thPrime ) const;
 };
 
 #endif
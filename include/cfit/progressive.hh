@@ -0,0 +1,54 @@
+#ifndef __PROGRESSIVE_HH__
+#define __PROGRESSIVE_HH__
+
+#include <vector>
+
+#include <cfit/exceptions.hh>
+
+
+// Stages of a coarse-to-fine minimization. Each stage fits a random subsample
+//    of the data with a coarser norm integration grid, and starts from the
+//    minimum of the previous stage. The last stage, always with the full
+//    dataset at full precision, is implicit.
+class Progressive
+{
+private:
+  std::vector< double   > _fractions;
+  std::vector< unsigned > _normBins;
+
+  // Minuit tolerance of the coarse stages. There is no point in converging
+  //    tightly to a minimum that will be moved by the next stage.
+  double _tolerance;
+
+public:
+  Progressive()
+    : _tolerance( 1.0 )
+  {}
+
+  // Append a stage using the given fraction of the data and number of bins per
+  //    dimension of the norm grids. Stages must be given in increasing fraction.
+  void addStage( const double& fraction, const unsigned& normBins ) throw( MinimizerException )
+  {
+    if ( fraction <= 0.0 || fraction > 1.0 )
+      throw MinimizerException( "Progressive: the data fraction of a stage must be in (0, 1]." );
+
+    if ( ! _fractions.empty() && fraction < _fractions.back() )
+      throw MinimizerException( "Progressive: stages must be given in increasing data fraction." );
+
+    if ( normBins == 0 )
+      throw MinimizerException( "Progressive: the norm grid of a stage must have at least one bin." );
+
+    _fractions.push_back( fraction );
+    _normBins .push_back( normBins );
+  }
+
+  void setTolerance( const double& tolerance ) { _tolerance = tolerance; }
+
+  // Getters.
+  const std::size_t nStages()                            const { return _fractions.size();   }
+  const double&     fraction ( const std::size_t& stage ) const { return _fractions[ stage ]; }
+  const unsigned&   normBins ( const std::size_t& stage ) const { return _normBins [ stage ]; }
+  const double&     tolerance()                           const { return _tolerance;          }
+};
+
+#endif
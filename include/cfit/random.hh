@@ -2,14 +2,23 @@
 #define __RANDOM_HH__
 
 #include <random>
+#include <cstdint>
 
+#include <cfit/randomstream.hh>
+
+// Each thread has its own engines, so that generations in parallel do not
+//    share any state. Threads other than the main one start from the default
+//    seed, and should seed their own independent stream.
 class Random
 {
 private:
-  static std::mt19937_64                          _engine;
+  static thread_local std::mt19937_64                          _engine;
+
+  static thread_local std::uniform_real_distribution< double > _uniform;
+  static thread_local std::normal_distribution      < double > _normal;
 
-  static std::uniform_real_distribution< double > _uniform;
-  static std::normal_distribution      < double > _normal;
+  // Fast stream for the samplers that generate in bulk.
+  static thread_local RandomStream                             _stream;
 
 public:
   static std::mt19937_64& engine()
@@ -17,7 +26,27 @@ public:
     return _engine;
   }
 
-  static void setSeed( const unsigned& seed ) { _engine.seed( seed ); }
+  static RandomStream& stream()
+  {
+    return _stream;
+  }
+
+  static void setSeed( const unsigned& seed )
+  {
+    _engine.seed( seed );
+    _stream.seed( seed );
+  }
+
+  // Seed the engines of the calling thread with one of many independent
+  //    streams of a seed, e.g. one per chunk of a parallel generation.
+  static void setSeed( const uint64_t& seed, const uint64_t& stream )
+  {
+    std::seed_seq seq{ uint32_t( seed ), uint32_t( seed >> 32 ), uint32_t( stream ), uint32_t( stream >> 32 ) };
+
+    _engine.seed( seq );
+    _stream.seed( seed, stream );
+    _normal.reset();
+  }
 
   static const double flat   ( const double& min = 0.0, const double& max = 1.0 )
   {
@@ -33,6 +62,11 @@ public:
   {
     return mu + sigma * _normal( _engine );
   }
+
+  // Uniform value in [0, 1) that only depends on a seed, a stream and an index,
+  //    from a counter-based generator. Any value of any stream can be drawn
+  //    independently of the others, in any order and from any thread.
+  static const double counter( const uint64_t& seed, const uint64_t& stream, const uint64_t& index );
 };
 
 
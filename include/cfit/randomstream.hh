@@ -0,0 +1,81 @@
+#ifndef __RANDOMSTREAM_HH__
+#define __RANDOMSTREAM_HH__
+
+#include <vector>
+#include <cstdint>
+
+// Independent stream of random numbers, with a xoshiro256** engine and fast
+//    samplers of the distributions used to generate in bulk. Streams with the
+//    same seed and different stream numbers are statistically independent,
+//    so each thread or each chunk of a generation can use its own one, and
+//    reproduce the same values whatever the number of threads.
+//
+// The stream satisfies the requirements of a uniform random bit generator,
+//    so it can also be used with the distributions of the standard library.
+class RandomStream
+{
+private:
+  uint64_t _state[ 4 ];
+
+  static inline uint64_t rotl( const uint64_t& x, const int& k ) { return ( x << k ) | ( x >> ( 64 - k ) ); }
+
+  // Tail of the normal distribution beyond the last layer of the ziggurat.
+  const double normalTail( const bool& negative );
+
+  const unsigned poissonSmall( const double& mean );
+  const unsigned poissonLarge( const double& mean );
+
+public:
+  typedef uint64_t result_type;
+
+  RandomStream( const uint64_t& seed = 0, const uint64_t& stream = 0 );
+
+  void seed( const uint64_t& seed, const uint64_t& stream = 0 );
+
+  static constexpr result_type min() { return 0;                 }
+  static constexpr result_type max() { return ~result_type( 0 ); }
+
+  result_type operator()()
+  {
+    const uint64_t result = rotl( _state[ 1 ] * 5, 7 ) * 9;
+    const uint64_t t      = _state[ 1 ] << 17;
+
+    _state[ 2 ] ^= _state[ 0 ];
+    _state[ 3 ] ^= _state[ 1 ];
+    _state[ 1 ] ^= _state[ 2 ];
+    _state[ 0 ] ^= _state[ 3 ];
+    _state[ 2 ] ^= t;
+    _state[ 3 ]  = rotl( _state[ 3 ], 45 );
+
+    return result;
+  }
+
+  // Uniform value in [0, 1), from the 53 most significant bits.
+  const double flat()
+  {
+    return ( (*this)() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+  }
+
+  const double uniform( const double& min = 0.0, const double& max = 1.0 )
+  {
+    return min + ( max - min ) * flat();
+  }
+
+  // Single variates.
+  const double   normal     ( const double&   mu = 0.0, const double& sigma = 1.0 );
+  const double   exponential( const double&   rate = 1.0                          );
+  const unsigned poisson    ( const double&   mean                                );
+  const unsigned binomial   ( const unsigned& n, const double& prob               );
+
+  // Numbers of the n trials that fall in each category, with the given
+  //    probabilities, which do not need to be normalized.
+  const std::vector< unsigned > multinomial( const unsigned& n, const std::vector< double >& probs );
+
+  // Fill the range [ first, last ) with variates of each distribution.
+  void fill           ( double*   first, double*   last, const double& min = 0.0, const double& max   = 1.0 );
+  void fillNormal     ( double*   first, double*   last, const double& mu  = 0.0, const double& sigma = 1.0 );
+  void fillExponential( double*   first, double*   last, const double& rate = 1.0                           );
+  void fillPoisson    ( unsigned* first, unsigned* last, const double& mean                                 );
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define __RESONANCE_HH__
 
 #include <map>
+#include <string>
 #include <vector>
 #include <complex>
 
@@ -28,6 +29,30 @@ protected:
   std::map< std::string, Parameter > _parMap;
   std::vector< std::string >         _parOrder;
 
+  // Angular term times the primed Blatt-Weisskopf factors, which multiply the
+  //    propagator in the value of the resonance.
+  std::complex< double > factor( const PhaseSpace& ps,
+                                 const double&     mSqAB,
+                                 const double&     mSqAC,
+                                 const double&     mSqBC ) const;
+
+  // Code of the value of the index-th parameter in a generated source.
+  const std::string& parCode( const unsigned& index, const std::map< std::string, std::string >& pars ) const throw( PdfException );
+
+  // Constructor for S-wave lineshapes not described by a mass, a width and
+  //    a radius. The derived class pushes its own parameters.
+  template <class T>
+  Resonance( const T& resoA, const T& resoB )
+  {
+    _resoA  = resoA;
+    _resoB  = resoB;
+    _noRes  = 6 - resoA - resoB;
+    _l      = 0;
+
+    _helicity = false;
+    _twoBW    = false;
+  }
+
 public:
   template <class T>
   Resonance( const T&         resoA, const T&         resoB,
@@ -70,7 +95,7 @@ public:
   const double mSq()    const { return std::pow( m(), 2 );                             }
   const double mGamma() const { return m() * width();                                  }
 
-  void setPars( const std::map< std::string, Parameter >& pars );
+  virtual void setPars( const std::map< std::string, Parameter >& pars );
 
   // AB is the resonant pair, with A the first and B the second particle in the pair.
   //    Order is only relevant for the sign of the Zemach angular term for l = 1.
@@ -110,7 +135,57 @@ public:
                                                const double&     mSqAC,
                                                const double&     mSqBC )                                       const;
 
+  // Versions over n contiguous points, with the real and imaginary parts in
+  //    separate arrays. The parameters are read once, and the loops only do
+  //    arithmetic on contiguous data, so that the compiler can vectorize them.
+  void                   blattWeisskopfSq    ( const PhaseSpace& ps, const double* mSqAB,
+                                               double*           bwSq , const std::size_t& n )             const;
+  void                   runningWidth        ( const PhaseSpace& ps, const double* mSqAB,
+                                               double*           width, const std::size_t& n )             const;
+  void                   evaluate            ( const PhaseSpace& ps,
+                                               const double*     mSq12,
+                                               const double*     mSq13,
+                                               const double*     mSq23,
+                                               double*           re   ,
+                                               double*           im   , const std::size_t& n )             const;
+
   virtual std::complex< double > propagator( const PhaseSpace& ps, const double& mSqAB ) const = 0;
+
+  // Lineshapes without a kernel of their own loop over the scalar propagator.
+  virtual void                   propagators( const PhaseSpace& ps, const double* mSqAB,
+                                              double* re, double* im, const std::size_t& n ) const;
+
+  // Lineshapes linear in their own parameters are sums c_1 T_1 + ... + c_n T_n
+  //    of terms that do not depend on them, so the values of the terms can be
+  //    kept by the amplitude while the coefficients float. By default, the
+  //    resonance is a single term with coefficient 1, fixed if its parameters are.
+  virtual const unsigned                              nTerms()     const { return 1;         }
+  virtual const bool                                  termsFixed() const { return isFixed(); }
+  virtual const std::vector< std::complex< double > > termCoefs()  const
+  {
+    return std::vector< std::complex< double > >( 1, 1.0 );
+  }
+
+  // Values of the terms at the given point.
+  virtual void                   terms( const PhaseSpace& ps,
+                                        const double&     mSq12,
+                                        const double&     mSq13,
+                                        const double&     mSq23,
+                                        std::complex< double >* values ) const;
+
+  // Source of an inline function name( par, s12, s13, s23 ) with the value of
+  //    the resonance, for the code generation backend. pars maps the names of
+  //    the parameters to the code of their values: a literal for the fixed
+  //    ones, or an element of the array par for the floating ones.
+  const std::string              code( const PhaseSpace& ps, const std::string& name,
+                                       const std::map< std::string, std::string >& pars ) const throw( PdfException );
+
+  // Statements that set the complex propagator prop at the squared mass s of
+  //    the resonant pair, with the helpers defined by code(). Lineshapes
+  //    without generated code throw.
+  virtual const std::string      propagatorCode( const PhaseSpace& ps,
+                                                 const std::map< std::string, std::string >& pars ) const throw( PdfException );
+
   virtual Resonance*             copy()                                                  const = 0;
 
   // Operations of resonances with themselves.
@@ -163,4 +238,16 @@ inline Resonance::Resonance( const char&      resoA, const char&      resoB,
   push( r     );
 }
 
+template <>
+inline Resonance::Resonance( const char& resoA, const char& resoB )
+{
+  _resoA  = std::tolower( resoA ) - 'a' + 1;
+  _resoB  = std::tolower( resoB ) - 'a' + 1;
+  _noRes  = 6 - _resoA - _resoB;
+  _l      = 0;
+
+  _helicity = false;
+  _twoBW    = false;
+}
+
 #endif
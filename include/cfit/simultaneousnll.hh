@@ -0,0 +1,121 @@
+#ifndef __SIMULTANEOUSNLL_HH__
+#define __SIMULTANEOUSNLL_HH__
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <complex>
+
+#include <Minuit/FCNBase.h>
+#include <Minuit/FunctionMinimum.h>
+
+#include <cfit/exceptions.hh>
+#include <cfit/parameter.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfbase.hh>
+#include <cfit/cachemanager.hh>
+
+class MultiStart;
+class Lbfgs;
+class LbfgsMinimum;
+
+// Negative log-likelihood of a simultaneous fit to the categories of a single
+//    dataset, e.g. split by charge or run period. Each category index of the
+//    category column is mapped to a pdf, and categories mapped to the same
+//    pdf object share a single copy of it, with a single set of per-event
+//    caches. The events are sorted in contiguous blocks of the same pdf, so
+//    that the data is walked once per call, without the overheads of adding
+//    one Nll per category to a MinimizerExpr. The events of each block are
+//    summed by the threads in chunks, as in Nll. The caches of each pdf are
+//    kept by a CacheManager, within the memory budget shared by all the
+//    minimizers.
+//
+// Only categories given the very same pdf object share it. Pdfs built from a
+//    common sub-model, e.g. the same amplitude with a different efficiency
+//    for each category, keep their own copies of it, with their own caches.
+class SimultaneousNll : public FCNBase
+{
+private:
+  typedef std::map< unsigned, std::vector< double >                 > CacheReal;
+  typedef std::map< unsigned, std::vector< std::complex< double > > > CacheComplex;
+
+  double _up;
+  bool   _verbose;
+
+  // Distinct pdfs, and index of the pdf of each category.
+  std::vector< PdfBase* >        _pdfs;
+  std::map< unsigned, unsigned > _pdfIdx;
+
+  // Events in the order they were given, and limits of the block of each pdf
+  //    when they are sorted by pdf.
+  std::shared_ptr< Dataset > _data;
+  std::vector< std::size_t > _blocks;
+
+  // Entries of the dataset in the block of each pdf, in the order of the block.
+  std::shared_ptr< std::vector< std::vector< std::size_t > > > _entries;
+
+  // Name of the field with the weight of each event, if any, and its values
+  //    in the block of each pdf, read again when events are appended.
+  std::string                                                   _weights;
+  std::shared_ptr< const std::vector< std::vector< double > > > _weightValues;
+
+  void readWeights();
+
+  // Values of the variables of each pdf in its block, and cached expressions.
+  //    Copies share them. Appending events grows them in place when no copy
+  //    shares them, and copies them first otherwise.
+  std::shared_ptr< std::vector< std::vector< std::vector< double > > > > _columns;
+  std::shared_ptr< std::vector< CacheReal    >                         > _cacheR;
+  std::shared_ptr< std::vector< CacheComplex >                         > _cacheC;
+
+  // Managers of the caches of each pdf, and events of the blocks with columns
+  //    that are recomputed when read. The other blocks are left empty.
+  std::shared_ptr< std::vector< std::shared_ptr< CacheManager > > > _caches;
+  std::shared_ptr< std::vector< Dataset > >                         _blockData;
+
+  // Parameters of all the pdfs, and position among them of those of each pdf.
+  std::map< std::string, Parameter >     _parMap;
+  std::vector< std::vector< unsigned > > _parIdx;
+
+public:
+  SimultaneousNll( const Dataset& data, const std::map< unsigned, const PdfBase* >& pdfs ) throw( PdfException, DataException );
+
+  // Copy constructor. Copies own their pdfs and share the data and caches.
+  SimultaneousNll( const SimultaneousNll& right );
+
+  SimultaneousNll* copy() const { return new SimultaneousNll( *this ); }
+
+  ~SimultaneousNll();
+
+  // Getters.
+  double                                    up()                             const throw( MinimizerException );
+  const Dataset&                            data()                           const { return *_data;       }
+  const unsigned                            nPdfs()                          const { return _pdfs.size(); }
+  const std::map< std::string, Parameter >& getPars()                        const { return _parMap;      }
+  const PdfBase&                            pdf( const unsigned& category ) const throw( PdfException );
+
+  // Setters.
+  void setUp  ( const double& up         ) { _up      = up;  }
+  void verbose( const bool&   val = true ) { _verbose = val; }
+
+  // Weight each event by the value of a field of the dataset, as in Nll.
+  void               setWeights( const std::string& field ) throw( DataException );
+  const std::string& weights() const { return _weights; }
+
+  // Add new events, of categories that have a pdf. The per-event caches are
+  //    only computed for the new events, as in Minimizer::append.
+  void append( const Dataset& events ) throw( PdfException, DataException );
+
+  double operator()( const std::vector< double >& pars ) const throw( PdfException );
+
+  FunctionMinimum minimize() const;
+
+  // Minimize from several starting points in parallel, and return the distinct
+  //    minima found, sorted by increasing function value.
+  const std::vector< FunctionMinimum > minimize( const MultiStart& multiStart ) const;
+
+  // Minimize with L-BFGS-B, as in Minimizer.
+  const LbfgsMinimum minimize( const Lbfgs& lbfgs ) const;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef __THREADS_HH__
+#define __THREADS_HH__
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+
+class Threads
+{
+private:
+  static unsigned _nThreads;
+  static bool     _pin;
+
+  // Whether the calling thread is a worker of a parallel loop. Loops started
+  //    from a worker, such as the nll of each fit of a bootstrap, run serially
+  //    on it, since the outer loop already keeps every thread busy.
+  static thread_local bool _worker;
+
+  // Pin the calling worker to the CPU of its thread, if pinning is enabled.
+  static void pin( const unsigned& thread, const unsigned& nThreads );
+
+  // Give the pages inside a buffer back to the system, so that they are
+  //    placed on the node of the thread that first writes each of them.
+  static void release( void* data, const std::size_t& bytes );
+
+public:
+  // Number of worker threads used by the parallel loops. Defaults to the
+  //    number of hardware threads of the node, and is 1 inside a worker.
+  static const unsigned nThreads();
+  static void           setNThreads( const unsigned& nThreads ) { _nThreads = nThreads; }
+
+  // Pin the workers to the CPUs given by Topology, consecutive threads on the
+  //    same NUMA node. Since chunks are deterministic, the vectors filled with
+  //    fill are then placed chunk by chunk on the node of the thread that
+  //    owns it, and later loops over the same range read local memory.
+  static const bool pinning()                        { return _pin; }
+  static void       setPinning( const bool& pin = true ) { _pin = pin; }
+
+  // Whether the calling thread is a worker of chunks or forEach.
+  static const bool inWorker() { return _worker; }
+
+  // Sum of the partial results of each thread of a parallel loop. The threads
+  //    of each node are added first, in order, and then the nodes.
+  static const double reduce( const std::vector< double >& partial );
+
+  // Split the range [0, size) into one contiguous chunk per thread, and call
+  //    func( first, last, thread ) on each of them. Chunks are deterministic
+  //    for a given size and number of threads. Inside a worker, the whole
+  //    range is a single chunk.
+  template< class Func >
+  static void chunks( const std::size_t& size, Func func, unsigned nThreads = 0 );
+
+  // Call func( index, thread ) for every index in [0, size). Indices are handed
+  //    out dynamically, so it is suited to tasks with very different costs.
+  //    Inside a worker, the indices are processed in order by thread 0.
+  template< class Func >
+  static void forEach( const std::size_t& size, Func func, unsigned nThreads = 0 );
+
+  // Set values[ index ] = func( index ) for every element of a vector that has
+  //    already been sized, with each thread writing its own contiguous chunk.
+  template< class T, class Func >
+  static void fill( std::vector< T >& values, Func func, unsigned nThreads = 0 );
+};
+
+
+
+template< class Func >
+inline void Threads::chunks( const std::size_t& size, Func func, unsigned nThreads )
+{
+  if ( nThreads == 0 )
+    nThreads = Threads::nThreads();
+
+  if ( _worker )
+    nThreads = 1;
+
+  nThreads = std::max( 1u, unsigned( std::min< std::size_t >( nThreads, size ) ) );
+
+  if ( nThreads == 1 )
+  {
+    func( std::size_t( 0 ), size, 0u );
+    return;
+  }
+
+  std::vector< std::thread > workers;
+  for ( unsigned thread = 0; thread < nThreads; ++thread )
+  {
+    const std::size_t first = size * thread         / nThreads;
+    const std::size_t last  = size * ( thread + 1 ) / nThreads;
+
+    workers.push_back( std::thread( [ &func, first, last, thread, nThreads ]()
+    {
+      _worker = true;
+      pin( thread, nThreads );
+      func( first, last, thread );
+    } ) );
+  }
+
+  std::for_each( workers.begin(), workers.end(), std::mem_fn( &std::thread::join ) );
+}
+
+
+
+template< class Func >
+inline void Threads::forEach( const std::size_t& size, Func func, unsigned nThreads )
+{
+  if ( nThreads == 0 )
+    nThreads = Threads::nThreads();
+
+  if ( _worker )
+    nThreads = 1;
+
+  nThreads = std::max( 1u, unsigned( std::min< std::size_t >( nThreads, size ) ) );
+
+  std::atomic< std::size_t > next( 0 );
+
+  // Each worker keeps picking the next unprocessed index until none is left.
+  auto worker = [ &next, &size, &func, nThreads ]( const unsigned thread )
+  {
+    if ( nThreads > 1 )
+    {
+      _worker = true;
+      pin( thread, nThreads );
+    }
+
+    for ( std::size_t index = next++; index < size; index = next++ )
+      func( index, thread );
+  };
+
+  if ( nThreads == 1 )
+  {
+    worker( 0 );
+    return;
+  }
+
+  std::vector< std::thread > workers;
+  for ( unsigned thread = 0; thread < nThreads; ++thread )
+    workers.push_back( std::thread( worker, thread ) );
+
+  std::for_each( workers.begin(), workers.end(), std::mem_fn( &std::thread::join ) );
+}
+
+
+
+template< class T, class Func >
+inline void Threads::fill( std::vector< T >& values, Func func, unsigned nThreads )
+{
+  // The previous values are overwritten, so their pages can be dropped.
+  if ( _pin && std::is_trivially_destructible< T >::value )
+    release( values.data(), values.size() * sizeof( T ) );
+
+  chunks( values.size(), [ &values, &func ]( const std::size_t first, const std::size_t last, const unsigned thread )
+  {
+    for ( std::size_t index = first; index < last; ++index )
+      values[ index ] = func( index );
+  }, nThreads );
+}
+
+#endif
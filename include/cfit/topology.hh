@@ -0,0 +1,39 @@
+#ifndef __TOPOLOGY_HH__
+#define __TOPOLOGY_HH__
+
+#include <string>
+#include <vector>
+
+
+// NUMA nodes of the machine and the CPUs of each of them that the process is
+//    allowed to run on, read from /sys/devices/system/node. Machines without
+//    that information are taken as a single node with all the allowed CPUs.
+//    On most machines each socket is one node.
+class Topology
+{
+private:
+  std::vector< unsigned >                _nodeIds;
+  std::vector< std::vector< unsigned > > _cpus;
+
+  // CPUs of all the nodes, node after node.
+  std::vector< unsigned >                _ordered;
+
+  static const std::vector< unsigned > parseList( const std::string& list );
+
+public:
+  Topology();
+
+  // Topology detected the first time it is requested.
+  static const Topology& system();
+
+  const unsigned                 nNodes()                        const { return _cpus.size();   }
+  const unsigned&                nodeId( const unsigned& node )  const { return _nodeIds[ node ]; }
+  const std::vector< unsigned >& cpus  ( const unsigned& node )  const { return _cpus[ node ];    }
+
+  // CPU and node of thread out of nThreads. The threads are spread evenly
+  //    over the CPUs, node after node, so consecutive threads share a node.
+  const unsigned cpu ( const unsigned& thread, const unsigned& nThreads ) const;
+  const unsigned node( const unsigned& thread, const unsigned& nThreads ) const;
+};
+
+#endif
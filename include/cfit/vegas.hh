@@ -0,0 +1,75 @@
+#ifndef __VEGAS_HH__
+#define __VEGAS_HH__
+
+#include <vector>
+#include <functional>
+
+#include <cfit/randomstream.hh>
+
+
+// Adaptive Monte Carlo integrator on the unit hypercube, following the VEGAS
+//    algorithm of Lepage. The sampling density is a product of one piecewise
+//    constant density per dimension, whose intervals are refined over the
+//    iterations so that each one holds the same share of | f |. Inside the
+//    mapped space, the points are stratified in equal hypercubes.
+//
+// After the adaptation, sample returns a frozen set of points and weights,
+//    so that the sum of the weights times any integrand close to the one used
+//    to adapt the grid is a precise estimate of its integral. The points are
+//    stored as one column per dimension, and the integrand is evaluated on
+//    them by several threads at once, so it must not modify shared state.
+class Vegas
+{
+public:
+  typedef std::function< double( const std::vector< double >& ) > Integrand;
+
+private:
+  unsigned _nDim;
+  unsigned _nIntervals;
+
+  // Edges of the intervals of each dimension, from 0 to 1.
+  std::vector< std::vector< double > > _edges;
+
+  // Estimates of the integral and its error from the last iteration.
+  double _integral;
+  double _error;
+
+  // Map a point of the stratified space into the unit hypercube, and return
+  //    the Jacobian of the map. The intervals used are stored in bins.
+  const double map( const std::vector< double >& y, std::vector< double >& x, std::vector< unsigned >& bins ) const;
+
+  // Redistribute the edges of a dimension from the sums of the squared values
+  //    of the integrand in each interval.
+  void refine( std::vector< double >& edges, const std::vector< double >& sums ) const;
+
+public:
+  Vegas( const unsigned& nDim, const unsigned& nIntervals = 50 );
+
+  // Run nIter iterations of nPoints each, refining the grid after each one.
+  void adapt( const Integrand& func, const unsigned& nPoints, const unsigned& nIter, RandomStream& stream );
+
+  // Stratified sample of about nPoints points in the unit hypercube, with
+  //    the weights that make their sum an estimate of the integral, and the
+  //    stratum of each point. The points of a stratum are consecutive, and
+  //    points[ dim ][ point ] is the coordinate dim of a point.
+  void sample( const unsigned& nPoints, RandomStream& stream,
+               std::vector< std::vector< double > >& points, std::vector< double >& weights,
+               std::vector< unsigned >& strata ) const;
+  void sample( const unsigned& nPoints, RandomStream& stream,
+               std::vector< std::vector< double > >& points, std::vector< double >& weights ) const;
+
+  // Values of the integrand times the weights on a sample.
+  static void evaluate( const Integrand& func, const std::vector< std::vector< double > >& points,
+                        const std::vector< double >& weights, std::vector< double >& values );
+
+  // Error of the sum of the weighted values of the integrand on a stratified
+  //    sample, from their spread within each stratum.
+  static const double error( const std::vector< double >& values, const std::vector< unsigned >& strata );
+
+  // Getters.
+  const unsigned& nDim()     const { return _nDim;     }
+  const double&   integral() const { return _integral; }
+  const double&   error()    const { return _error;    }
+};
+
+#endif
@@ -1,5 +1,6 @@
 
 #include <stack>
+#include <sstream>
 #include <algorithm>
 #include <functional>
 
@@ -8,6 +9,7 @@
 #include <cfit/coef.hh>
 #include <cfit/resonance.hh>
 #include <cfit/operation.hh>
+#include <cfit/codegen.hh>
 
 void Amplitude::append( const double& ctnt )
 {
@@ -156,15 +158,12 @@ void Amplitude::setPars( const std::map< std::string, Parameter >& pars )
 
 
 
-// Evaluate the amplitude at the given point, with the current values of its parameters.
-std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
-                                            const double&     mSq12,
-                                            const double&     mSq13,
-                                            const double&     mSq23 ) const throw( PdfException )
+// Parse the expression in reverse polish notation with a stack. The values of
+//    the resonances and F vector components are provided by the callers, so
+//    the same parser serves to evaluate and to combine cached components.
+template< class R, class F >
+std::complex< double > Amplitude::parse( const R& reso, const F& fvec ) const throw( PdfException )
 {
-  if ( ! ps.contains( mSq12, mSq13, mSq23 ) )
-    return 0.0;
-
   std::stack< std::complex< double > > values;
 
   std::complex< double > x;
@@ -173,10 +172,11 @@ std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
   std::vector< std::complex< double > >::const_iterator ctt = _ctnts.begin();
   std::vector< Parameter              >::const_iterator par = _parms.begin();
   std::vector< Coef                   >::const_iterator coe = _coefs.begin();
-  std::vector< Resonance*             >::const_iterator res = _resos.begin();
-  std::vector< Fvector                >::const_iterator fvc = _fvecs.begin();
   std::vector< Operation::Op          >::const_iterator ops = _opers.begin();
 
+  std::size_t res = 0;
+  std::size_t fvc = 0;
+
   // Parsing loop.
   typedef std::string::const_iterator eIter;
   for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
@@ -187,9 +187,9 @@ std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
     else if ( *ch == 'k' )
       values.push( coe++->value() );
     else if ( *ch == 'r' )
-      values.push( (*res++)->evaluate( ps, mSq12, mSq13, mSq23 ) );
+      values.push( reso( res++ ) );
     else if ( *ch == 'F' )
-      values.push( fvc++->evaluate( ps, mSq12, mSq13, mSq23 ) );
+      values.push( fvec( fvc++ ) );
     else
     {
       if ( *ch == 'b' ) // Binary operation with complex numbers.
@@ -223,6 +223,302 @@ std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
 }
 
 
+// Evaluate the amplitude at the given point, with the current values of its parameters.
+std::complex< double > Amplitude::evaluate( const PhaseSpace& ps,
+                                            const double&     mSq12,
+                                            const double&     mSq13,
+                                            const double&     mSq23 ) const throw( PdfException )
+{
+  if ( ! ps.contains( mSq12, mSq13, mSq23 ) )
+    return 0.0;
+
+  return parse( [ & ]( const std::size_t& index ) { return _resos[ index ]->evaluate( ps, mSq12, mSq13, mSq23 ); },
+                [ & ]( const std::size_t& index ) { return _fvecs[ index ] .evaluate( ps, mSq12, mSq13, mSq23 ); } );
+}
+
+
+// The values of each resonance at all the points are computed first, and the
+//    expression is then parsed at each point with them.
+void Amplitude::evaluate( const PhaseSpace& ps,
+                          const double*     mSq12,
+                          const double*     mSq13,
+                          const double*     mSq23,
+                          std::complex< double >* values, const std::size_t& n ) const throw( PdfException )
+{
+  if ( ! n )
+    return;
+
+  const std::size_t nResos = _resos.size();
+
+  std::vector< double > re( nResos * n );
+  std::vector< double > im( nResos * n );
+  for ( std::size_t res = 0; res < nResos; ++res )
+    _resos[ res ]->evaluate( ps, mSq12, mSq13, mSq23, &re[ res * n ], &im[ res * n ], n );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    if ( ! ps.contains( mSq12[ point ], mSq13[ point ], mSq23[ point ] ) )
+    {
+      values[ point ] = 0.0;
+      continue;
+    }
+
+    values[ point ] = parse( [ & ]( const std::size_t& index )
+                             {
+                               return std::complex< double >( re[ index * n + point ], im[ index * n + point ] );
+                             },
+                             [ & ]( const std::size_t& index )
+                             {
+                               return _fvecs[ index ].evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+                             } );
+  }
+}
+
+
+// Follow the degree of each value of the stack in the components: 0 for
+//    constants, 1 for linear terms, and 2 for anything else.
+const bool Amplitude::isLinear() const
+{
+  std::stack< unsigned > degrees;
+
+  std::vector< Operation::Op >::const_iterator ops = _opers.begin();
+
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+    if ( ( *ch == 'r' ) || ( *ch == 'F' ) )
+      degrees.push( 1 );
+    else if ( *ch == 'b' )
+    {
+      if ( degrees.size() < 2 )
+        return false;
+      const unsigned y = degrees.top();
+      degrees.pop();
+      const unsigned x = degrees.top();
+      degrees.pop();
+
+      const Operation::Op& oper = *ops++;
+      if ( ( oper == Operation::plus ) || ( oper == Operation::minus ) )
+        degrees.push( std::max( x, y ) );
+      else if ( oper == Operation::mult )
+        degrees.push( std::min( x + y, 2u ) );
+      else if ( oper == Operation::div )
+        degrees.push( y ? 2 : x );
+      else
+        degrees.push( ( x || y ) ? 2 : 0 );
+    }
+    else if ( *ch == 'u' )
+    {
+      if ( degrees.empty() )
+        return false;
+      const unsigned x = degrees.top();
+      degrees.pop();
+
+      degrees.push( ( *ops++ == Operation::minus ) ? x : ( x ? 2 : 0 ) );
+    }
+    else
+      degrees.push( 0 );
+
+  return ( degrees.size() == 1 ) && ( degrees.top() < 2 );
+}
+
+
+const bool Amplitude::componentsFixed() const
+{
+  bool fixed = true;
+  fixed &= std::all_of( _resos.begin(), _resos.end(), std::mem_fun    ( &Resonance::termsFixed ) );
+  fixed &= std::all_of( _fvecs.begin(), _fvecs.end(), std::mem_fun_ref( &Fvector  ::isFixed ) );
+
+  return fixed;
+}
+
+
+const std::size_t Amplitude::nComponents() const
+{
+  std::size_t nTerms = 0;
+
+  typedef std::vector< Resonance* >::const_iterator rIter;
+  for ( rIter res = _resos.begin(); res != _resos.end(); ++res )
+    nTerms += (*res)->nTerms();
+
+  return nTerms + _fvecs.size();
+}
+
+
+void Amplitude::components( const PhaseSpace& ps,
+                            const double&     mSq12,
+                            const double&     mSq13,
+                            const double&     mSq23,
+                            std::complex< double >* values ) const
+{
+  if ( ! ps.contains( mSq12, mSq13, mSq23 ) )
+  {
+    std::fill( values, values + nComponents(), std::complex< double >( 0.0 ) );
+    return;
+  }
+
+  typedef std::vector< Resonance* >::const_iterator rIter;
+  for ( rIter res = _resos.begin(); res != _resos.end(); ++res )
+  {
+    (*res)->terms( ps, mSq12, mSq13, mSq23, values );
+    values += (*res)->nTerms();
+  }
+
+  for ( std::size_t fvc = 0; fvc < _fvecs.size(); ++fvc )
+    values[ fvc ] = _fvecs[ fvc ].evaluate( ps, mSq12, mSq13, mSq23 );
+}
+
+
+// The value of each resonance is the sum of its terms times their coefficients.
+std::complex< double > Amplitude::combine( const std::vector< std::complex< double > >& values ) const throw( PdfException )
+{
+  const std::size_t nResos = _resos.size();
+
+  std::vector< std::complex< double > > resos( nResos, 0.0 );
+
+  std::size_t term = 0;
+  for ( std::size_t res = 0; res < nResos; ++res )
+  {
+    const std::vector< std::complex< double > >& coefs = _resos[ res ]->termCoefs();
+    for ( std::size_t coef = 0; coef < coefs.size(); ++coef )
+      resos[ res ] += coefs[ coef ] * values[ term++ ];
+  }
+
+  return parse( [ & ]( const std::size_t& index ) { return resos [        index ]; },
+                [ & ]( const std::size_t& index ) { return values[ term + index ]; } );
+}
+
+
+// Combine the null vector and each unit vector of the components.
+const std::vector< std::complex< double > > Amplitude::coefficients() const throw( PdfException )
+{
+  const std::size_t nComps = nComponents();
+
+  std::vector< std::complex< double > > values( nComps, 0.0 );
+  std::vector< std::complex< double > > coefs ( nComps + 1  );
+
+  coefs[ 0 ] = combine( values );
+  for ( std::size_t comp = 0; comp < nComps; ++comp )
+  {
+    values[ comp    ] = 1.0;
+    coefs [ comp + 1 ] = combine( values ) - coefs[ 0 ];
+    values[ comp    ] = 0.0;
+  }
+
+  return coefs;
+}
+
+
+// The expression is parsed as in evaluate, with a stack of strings of code
+//    instead of values, so the generated expression does the same operations
+//    in the same order.
+const std::string Amplitude::code( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  const auto parCode = [ & ]( const Parameter& par )
+  {
+    const std::map< std::string, std::string >::const_iterator code = pars.find( par.name() );
+    if ( code == pars.end() )
+      throw PdfException( "Amplitude: no code given for parameter " + par.name() + "." );
+
+    return code->second;
+  };
+
+  std::ostringstream out;
+
+  for ( std::size_t res = 0; res < _resos.size(); ++res )
+  {
+    std::ostringstream name;
+    name << "reso" << res;
+    out << _resos[ res ]->code( ps, name.str(), pars );
+  }
+
+  std::stack< std::string > values;
+
+  std::string x;
+  std::string y;
+
+  std::vector< std::complex< double > >::const_iterator ctt = _ctnts.begin();
+  std::vector< Parameter              >::const_iterator par = _parms.begin();
+  std::vector< Coef                   >::const_iterator coe = _coefs.begin();
+  std::vector< Operation::Op          >::const_iterator ops = _opers.begin();
+
+  std::size_t res = 0;
+
+  typedef std::string::const_iterator eIter;
+  for ( eIter ch = _expression.begin(); ch != _expression.end(); ++ch )
+    if ( *ch == 'c' )
+    {
+      values.push( "std::complex< double >( " + Codegen::literal( ctt->real() ) + ", " + Codegen::literal( ctt->imag() ) + " )" );
+      ++ctt;
+    }
+    else if ( *ch == 'p' )
+      values.push( "std::complex< double >( " + parCode( *par++ ) + ", 0. )" );
+    else if ( *ch == 'k' )
+    {
+      values.push( "std::complex< double >( " + parCode( coe->real() ) + ", " + parCode( coe->imag() ) + " )" );
+      ++coe;
+    }
+    else if ( *ch == 'r' )
+    {
+      std::ostringstream call;
+      call << "reso" << res++ << "( par, s12, s13, s23 )";
+      values.push( call.str() );
+    }
+    else if ( *ch == 'F' )
+      throw PdfException( "Amplitude: F vector components do not support code generation." );
+    else if ( *ch == 'b' )
+    {
+      if ( values.size() < 2 )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      y = values.top();
+      values.pop();
+      x = values.top();
+      values.pop();
+
+      const Operation::Op& oper = *ops++;
+      if      ( oper == Operation::plus  ) values.push( "( " + x + " + " + y + " )" );
+      else if ( oper == Operation::minus ) values.push( "( " + x + " - " + y + " )" );
+      else if ( oper == Operation::mult  ) values.push( "( " + x + " * " + y + " )" );
+      else if ( oper == Operation::div   ) values.push( "( " + x + " / " + y + " )" );
+      else if ( oper == Operation::pow   ) values.push( "std::pow( " + x + ", " + y + " )" );
+      else
+        throw PdfException( std::string( "Parse error: unknown binary operation " ) + Operation::tostring( oper ) + "." );
+    }
+    else if ( *ch == 'u' )
+    {
+      if ( values.empty() )
+        throw PdfException( "Parse error: not enough values in the stack." );
+      x = values.top();
+      values.pop();
+
+      const Operation::Op& oper = *ops++;
+      if ( oper == Operation::minus )
+        values.push( "( - " + x + " )" );
+      else if ( ( oper == Operation::exp ) || ( oper == Operation::log ) || ( oper == Operation::sin  ) ||
+                ( oper == Operation::cos ) || ( oper == Operation::tan ) || ( oper == Operation::tanh ) ||
+                ( oper == Operation::atanh ) )
+        values.push( "std::" + Operation::tostring( oper ) + "( " + x + " )" );
+      else
+        throw PdfException( std::string( "Parse error: unknown unary operation " ) + Operation::tostring( oper ) + "." );
+    }
+    else
+      throw PdfException( std::string( "Parse error: unknown operation " ) + *ch + "." );
+
+  if ( values.size() != 1 )
+    throw PdfException( "Amplitude parse error: too many values have been supplied." );
+
+  out << ps.code()
+      << "static inline std::complex< double > amplitude( const double* par, const double s12, const double s13, const double s23 )\n"
+      << "{\n"
+      << "  if ( ! contains( s12, s13, s23 ) )\n"
+      << "    return 0.;\n"
+      << "\n"
+      << "  return " << values.top() << ";\n"
+      << "}\n\n";
+
+  return out.str();
+}
+
+
 void Amplitude::clear()
 {
   _parMap.clear();
@@ -0,0 +1,313 @@
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <exception>
+#include <algorithm>
+
+#include <Minuit/MnMigrad.h>
+
+#include <cfit/pdfmodel.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/random.hh>
+#include <cfit/threads.hh>
+#include <cfit/bootstrapnll.hh>
+
+
+BootstrapNll::BootstrapNll( const PdfModel& pdf, const Dataset& data, const unsigned& nReplicas, const uint64_t& seed )
+  : Minimizer( pdf, data ), _nReplicas( nReplicas ), _seed( seed ), _replica( 0 )
+{
+  _up = 1.0;
+
+  dataChanged();
+}
+
+
+BootstrapNll::BootstrapNll( const PdfExpr& pdf, const Dataset& data, const unsigned& nReplicas, const uint64_t& seed )
+  : Minimizer( pdf, data ), _nReplicas( nReplicas ), _seed( seed ), _replica( 0 )
+{
+  _up = 1.0;
+
+  dataChanged();
+}
+
+
+// Copies do not share the pdfs of the batch evaluation.
+BootstrapNll::BootstrapNll( const BootstrapNll& right )
+  : Minimizer( right ), _nReplicas( right._nReplicas ), _seed( right._seed ), _replica( right._replica ),
+    _weights( right._weights ), _weightField( right._weightField ), _weightValues( right._weightValues )
+{}
+
+
+BootstrapNll::~BootstrapNll()
+{
+  clear();
+}
+
+
+void BootstrapNll::clear() const
+{
+  for ( std::vector< PdfBase* >::iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    delete *pdf;
+
+  _pdfs.clear();
+}
+
+
+// Invert the cumulative distribution of a Poisson( 1 ) variable. A weight
+//    above 255 has a probability below 1e-500, so it never fits in a byte.
+void BootstrapNll::dataChanged()
+{
+  std::shared_ptr< std::vector< std::vector< uint8_t > > > weights =
+    std::make_shared< std::vector< std::vector< uint8_t > > >( _nReplicas, std::vector< uint8_t >( _data->size() ) );
+
+  Threads::chunks( _data->size(), [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+  {
+    for ( unsigned replica = 0; replica < _nReplicas; ++replica )
+      for ( std::size_t event = first; event < last; ++event )
+      {
+        const double& unif = Random::counter( _seed, replica, event );
+
+        double   prob = std::exp( -1.0 );
+        double   cdf  = prob;
+        unsigned k    = 0;
+        while ( unif >= cdf && prob > 0.0 )
+        {
+          prob /= ++k;
+          cdf  += prob;
+        }
+
+        ( *weights )[ replica ][ event ] = std::min( k, 255u );
+      }
+  } );
+
+  _weights = weights;
+
+  if ( _weightField.empty() )
+    _weightValues.reset();
+  else
+    _weightValues = std::make_shared< const std::vector< double > >( _data->values( _weightField ) );
+}
+
+
+void BootstrapNll::setReplica( const unsigned& replica ) throw( PdfException )
+{
+  if ( replica >= _nReplicas )
+    throw PdfException( "BootstrapNll: requested replica does not exist." );
+
+  _replica = replica;
+}
+
+
+void BootstrapNll::setWeights( const std::string& field ) throw( DataException )
+{
+  const std::vector< std::string >& fields = _data->fields();
+  if ( std::find( fields.begin(), fields.end(), field ) == fields.end() )
+    throw DataException( "BootstrapNll: requested weight " + field + " does not exist in dataset" );
+
+  _weightField  = field;
+  _weightValues = std::make_shared< const std::vector< double > >( _data->values( field ) );
+}
+
+
+double BootstrapNll::operator()( const std::vector< double >& pars ) const throw( PdfException )
+{
+  return nlls( std::vector< std::vector< double > >( 1, pars ), std::vector< unsigned >( 1, _replica ) ).front();
+}
+
+
+
+const std::vector< double > BootstrapNll::evaluate( const std::vector< std::vector< double > >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _nReplicas )
+    throw PdfException( "BootstrapNll: the number of sets of parameters does not match the number of replicas." );
+
+  std::vector< unsigned > replicas( _nReplicas );
+  for ( unsigned replica = 0; replica < _nReplicas; ++replica )
+    replicas[ replica ] = replica;
+
+  return nlls( pars, replicas );
+}
+
+
+
+const std::vector< double > BootstrapNll::nlls( const std::vector< std::vector< double > >& pars    ,
+                                                const std::vector< unsigned >&              replicas ) const throw( PdfException )
+{
+  const unsigned nReplicas = replicas.size();
+
+  // Replicas at the same point share a pdf, which is only evaluated once per event.
+  std::map< std::vector< double >, unsigned > distinct;
+  std::vector< unsigned >                     pdfIdx;
+  for ( unsigned replica = 0; replica < nReplicas; ++replica )
+  {
+    if ( pars[ replica ].size() != _pdf->nPars() )
+      throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+    pdfIdx.push_back( distinct.insert( std::make_pair( pars[ replica ], distinct.size() ) ).first->second );
+  }
+
+  while ( _pdfs.size() < distinct.size() )
+    _pdfs.push_back( _pdf->copy() );
+
+  // Compute the norms of the distinct pdfs in parallel.
+  std::vector< const std::vector< double >* > points( distinct.size() );
+  typedef std::map< std::vector< double >, unsigned >::const_iterator dIter;
+  for ( dIter point = distinct.begin(); point != distinct.end(); ++point )
+    points[ point->second ] = &point->first;
+
+  // Exceptions cannot cross the thread boundaries. Keep the first one thrown
+  //    and rethrow it once all the threads have finished.
+  std::exception_ptr error;
+  std::mutex         errorMutex;
+
+  Threads::forEach( points.size(), [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    try
+    {
+      _pdfs[ index ]->setPars( *points[ index ] );
+      _pdfs[ index ]->cache();
+    }
+    catch ( ... )
+    {
+      std::lock_guard< std::mutex > lock( errorMutex );
+      if ( ! error )
+        error = std::current_exception();
+    }
+  } );
+
+  if ( error )
+    std::rethrow_exception( error );
+
+  // Look the columns of the variables up once.
+  const std::vector< std::string >& varNames = _pdf->varNames();
+
+  std::vector< const std::vector< std::pair< double, double > >* > columns;
+  if ( _data->size() )
+    for ( std::vector< std::string >::const_iterator var = varNames.begin(); var != varNames.end(); ++var )
+      columns.push_back( &_data->column( *var ) );
+
+  static const std::vector< double > unweighted;
+  const std::vector< double >& eventWeights = _weightValues ? *_weightValues : unweighted;
+
+  // Each thread sums a contiguous chunk of events for all the replicas, as in
+  //    Nll, and the sums of each replica are reduced at the end.
+  const std::size_t size     = _data->size();
+  const unsigned    nThreads = std::max( 1u, unsigned( std::min< std::size_t >( Threads::nThreads(), size ) ) );
+  const unsigned    nPdfs    = distinct.size();
+
+  std::vector< std::vector< double > > partial( nReplicas, std::vector< double >( nThreads, 0.0 ) );
+
+  // Number of cached values, read once before the threads start.
+  const unsigned nCachedR = _pdf->nCachedReal();
+  const unsigned nCachedC = _pdf->nCachedComplex();
+
+  Threads::chunks( size, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+  {
+    typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+    typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+    std::vector< double                 > vars  ( columns.size() );
+    std::vector< double                 > cacheR( nCachedR       );
+    std::vector< std::complex< double > > cacheC( nCachedC       );
+    std::vector< double                 > logs  ( nPdfs          );
+
+    // The distinct pdfs compute the values of their own parameters on each
+    //    block, see PdfBase::cacheBlock.
+    const std::size_t                  blockSize = 4096;
+    CacheManager::Block                block;
+    std::vector< CacheManager::Block > blocks( nPdfs );
+
+    for ( std::size_t n = first; n < last; ++n )
+    {
+      if ( n >= block.last() )
+      {
+        _caches->load( *_data, n, std::min( n + blockSize, last ), block );
+
+        for ( unsigned pdf = 0; pdf < nPdfs; ++pdf )
+        {
+          blocks[ pdf ] = block;
+          blocks[ pdf ].evaluate( *_pdfs[ pdf ], *_data );
+        }
+      }
+
+      for ( std::size_t var = 0; var < columns.size(); ++var )
+        vars[ var ] = ( *columns[ var ] )[ n ].first;
+
+      for ( mrIter cached = _cacheR->begin(); cached != _cacheR->end(); ++cached )
+        cacheR[ cached->first ] = cached->second[ n ];
+
+      for ( mcIter cached = _cacheC->begin(); cached != _cacheC->end(); ++cached )
+        cacheC[ cached->first ] = cached->second[ n ];
+
+      // Vanishing values do not contribute to the nll, as in Nll.
+      for ( unsigned pdf = 0; pdf < nPdfs; ++pdf )
+      {
+        blocks[ pdf ].fill( n, cacheR, cacheC );
+
+        const double& value = _pdfs[ pdf ]->evaluate( vars, cacheR, cacheC );
+        logs[ pdf ] = value ? std::log( value ) : 0.0;
+      }
+
+      const double& eventWeight = eventWeights.empty() ? 1.0 : eventWeights[ n ];
+
+      for ( unsigned replica = 0; replica < nReplicas; ++replica )
+      {
+        const unsigned weight = ( *_weights )[ replicas[ replica ] ][ n ];
+        if ( weight )
+          partial[ replica ][ thread ] -= 2.0 * weight * eventWeight * logs[ pdfIdx[ replica ] ];
+      }
+    }
+  }, nThreads );
+
+  std::vector< double > values( nReplicas );
+  for ( unsigned replica = 0; replica < nReplicas; ++replica )
+    values[ replica ] = Threads::reduce( partial[ replica ] );
+
+  for ( unsigned replica = 0; replica < nReplicas; ++replica )
+    values[ replica ] = values[ replica ] * _scale + 2.0 * _pdfs[ pdfIdx[ replica ] ]->yield();
+
+  return values;
+}
+
+
+const std::vector< FunctionMinimum > BootstrapNll::minimizeAll() const
+{
+  // FunctionMinimum has no default constructor, so keep the minima by pointer.
+  std::vector< std::unique_ptr< FunctionMinimum > > minima( _nReplicas );
+
+  const MnUserParameters& upar = userParameters( _pdf->getPars() );
+
+  // Exceptions cannot cross the thread boundaries, as in MultiStart.
+  std::exception_ptr error;
+  std::mutex         errorMutex;
+
+  // Each thread fits a replica with its own copy, which shares the data and caches.
+  Threads::forEach( _nReplicas, [ & ]( const std::size_t& replica, const unsigned& thread )
+  {
+    try
+    {
+      std::unique_ptr< BootstrapNll > fcn( copy() );
+      fcn->setReplica( replica );
+
+      MnMigrad migrad( *fcn, upar );
+      minima[ replica ].reset( new FunctionMinimum( migrad() ) );
+    }
+    catch ( ... )
+    {
+      std::lock_guard< std::mutex > lock( errorMutex );
+      if ( ! error )
+        error = std::current_exception();
+    }
+  } );
+
+  if ( error )
+    std::rethrow_exception( error );
+
+  std::vector< FunctionMinimum > result;
+  for ( unsigned replica = 0; replica < _nReplicas; ++replica )
+    result.push_back( *minima[ replica ] );
+
+  return result;
+}
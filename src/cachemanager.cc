@@ -0,0 +1,550 @@
+#include <map>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <numeric>
+#include <complex>
+#include <iomanip>
+#include <ostream>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <cfit/threads.hh>
+#include <cfit/cachemanager.hh>
+
+
+std::size_t CacheManager::_budget = 0;
+bool        CacheManager::_reduce = false;
+
+std::atomic< std::size_t > CacheManager::_held( 0 );
+
+
+std::unique_ptr< PdfBase > CacheManager::Copies::acquire()
+{
+  std::lock_guard< std::mutex > lock( _lock );
+
+  if ( _idle.empty() )
+    return std::unique_ptr< PdfBase >( _pdf->copy() );
+
+  std::unique_ptr< PdfBase > copy( std::move( _idle.back() ) );
+  _idle.pop_back();
+
+  return copy;
+}
+
+
+
+void CacheManager::Copies::release( std::unique_ptr< PdfBase > copy )
+{
+  std::lock_guard< std::mutex > lock( _lock );
+  _idle.push_back( std::move( copy ) );
+}
+
+
+
+// The replayed indices are those of the calling thread only.
+void CacheManager::compute( PdfBase&                                                     source,
+                            const std::pair< unsigned, unsigned >&                       first ,
+                            const Dataset&                                               data  ,
+                            std::map< unsigned, std::vector< double >                 >& real  ,
+                            std::map< unsigned, std::vector< std::complex< double > > >& complex )
+{
+  PdfBase::_replay        = true;
+  PdfBase::_replayReal    = first.first;
+  PdfBase::_replayComplex = first.second;
+
+  try
+  {
+    real    = source.cacheReal   ( data );
+    complex = source.cacheComplex( data );
+  }
+  catch ( ... )
+  {
+    PdfBase::_replay = false;
+    throw;
+  }
+
+  PdfBase::_replay = false;
+}
+
+
+void CacheManager::Block::fill( const std::size_t&                     n     ,
+                                std::vector< double >&                 cacheR,
+                                std::vector< std::complex< double > >& cacheC ) const
+{
+  typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+  typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+  for ( mrIter cached = _real.begin(); cached != _real.end(); ++cached )
+    cacheR[ cached->first ] = cached->second[ n - _first ];
+
+  for ( mcIter cached = _complex.begin(); cached != _complex.end(); ++cached )
+    cacheC[ cached->first ] = cached->second[ n - _first ];
+}
+
+
+
+// The columns of each source are found by caching the first events, and its
+//    cost is shared evenly by them. The sources are then computed again on all
+//    the events, one at a time, so that at most the columns of one of them
+//    are held at full precision before being stored as planned. Those to be
+//    recomputed are also run over all the events, block by block, so that
+//    any state they keep when caching, such as the groups of ConditionalPdf,
+//    is complete before the copies that recompute them are made.
+CacheManager::CacheManager( PdfBase&                                                     pdf   ,
+                            const Dataset&                                               data  ,
+                            std::map< unsigned, std::vector< double >                 >& cacheR,
+                            std::map< unsigned, std::vector< std::complex< double > > >& cacheC,
+                            const std::size_t&                                           budget )
+  : _size( data.size() ), _limit( budget ), _memory( 0 ), _reads( 0 )
+{
+  const std::vector< PdfBase* >& sources = pdf.cacheSources();
+
+  std::vector< std::size_t > entries( std::min< std::size_t >( _size, 4096 ) );
+  for ( std::size_t entry = 0; entry < entries.size(); ++entry )
+    entries[ entry ] = entry;
+
+  const Dataset& sample = entries.empty() ? data : data.subset( entries );
+
+  for ( unsigned source = 0; source < sources.size(); ++source )
+  {
+    _firsts.push_back( std::make_pair( PdfBase::_cacheIdxReal, PdfBase::_cacheIdxComplex ) );
+
+    const std::map< unsigned, std::vector< double >                 >& real    = sources[ source ]->cacheReal   ( sample );
+    const std::map< unsigned, std::vector< std::complex< double > > >& complex = sources[ source ]->cacheComplex( sample );
+
+    const double& cost = sources[ source ]->cacheCost() / std::max< double >( 1.0, real.size() + complex.size() );
+
+    typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+    typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+    for ( mrIter cached = real.begin(); cached != real.end(); ++cached )
+    {
+      const Column column = { cached->first, false, source, _size * sizeof( double ), cost, Materialize };
+      _columns.push_back( column );
+    }
+
+    for ( mcIter cached = complex.begin(); cached != complex.end(); ++cached )
+    {
+      const Column column = { cached->first, true, source, _size * sizeof( std::complex< double > ), cost, Materialize };
+      _columns.push_back( column );
+    }
+  }
+
+  if ( ! _size )
+    return;
+
+  plan( budget );
+
+  for ( unsigned source = 0; source < sources.size(); ++source )
+  {
+    std::map< unsigned, std::vector< double >                 > real;
+    std::map< unsigned, std::vector< std::complex< double > > > complex;
+
+    if ( std::find( _recompute.begin(), _recompute.end(), source ) != _recompute.end() )
+    {
+      const std::size_t blockSize = 4096;
+      for ( std::size_t first = 0; first < _size; first += blockSize )
+      {
+        std::vector< std::size_t > block( std::min( blockSize, _size - first ) );
+        for ( std::size_t entry = 0; entry < block.size(); ++entry )
+          block[ entry ] = first + entry;
+
+        compute( *sources[ source ], _firsts[ source ], data.subset( block ), real, complex );
+      }
+
+      continue;
+    }
+
+    compute( *sources[ source ], _firsts[ source ], data, real, complex );
+
+    for ( std::vector< Column >::const_iterator column = _columns.begin(); column != _columns.end(); ++column )
+    {
+      if ( column->source != source )
+        continue;
+
+      if ( column->complex )
+      {
+        std::vector< std::complex< double > >& values = complex[ column->index ];
+
+        if ( column->policy == Materialize )
+          cacheC[ column->index ].swap( values );
+        else
+        {
+          std::vector< std::complex< float > >& reduced = _complex[ column->index ];
+          reduced.resize( values.size() );
+          Threads::fill( reduced, [ &values ]( const std::size_t& entry ) { return std::complex< float >( values[ entry ] ); } );
+        }
+      }
+      else
+      {
+        std::vector< double >& values = real[ column->index ];
+
+        if ( column->policy == Materialize )
+          cacheR[ column->index ].swap( values );
+        else
+        {
+          std::vector< float >& reduced = _real[ column->index ];
+          reduced.resize( values.size() );
+          Threads::fill( reduced, [ &values ]( const std::size_t& entry ) { return float( values[ entry ] ); } );
+        }
+      }
+    }
+  }
+
+  if ( ! _recompute.empty() )
+    _copies = std::make_shared< Copies >( pdf );
+
+  _memory = memory();
+  _held  += _memory;
+}
+
+
+
+// Columns are materialized by decreasing cost per byte until the budget is
+//    exhausted, and the rest are stored as floats while they still fit. All
+//    the columns of a source that must be recomputed are recomputed, since they
+//    come for free, and the memory they release upgrades reduced columns.
+void CacheManager::plan( const std::size_t& budget )
+{
+  std::vector< std::size_t > order( _columns.size() );
+  for ( std::size_t column = 0; column < order.size(); ++column )
+    order[ column ] = column;
+
+  std::stable_sort( order.begin(), order.end(), [ this ]( const std::size_t& left, const std::size_t& right )
+  {
+    return _columns[ left  ].cost / _columns[ left  ].bytes > _columns[ right ].cost / _columns[ right ].bytes;
+  } );
+
+  std::size_t used = 0;
+
+  typedef std::vector< std::size_t >::const_iterator oIter;
+  for ( oIter index = order.begin(); index != order.end(); ++index )
+  {
+    Column& column = _columns[ *index ];
+
+    if ( used + column.bytes <= budget )
+      used += column.bytes;
+    else
+      column.policy = Recompute;
+  }
+
+  if ( _reduce )
+    for ( oIter index = order.begin(); index != order.end(); ++index )
+    {
+      Column& column = _columns[ *index ];
+
+      if ( ( column.policy == Recompute ) && ( used + column.bytes / 2 <= budget ) )
+      {
+        column.policy = Reduce;
+        used         += column.bytes / 2;
+      }
+    }
+
+  for ( std::vector< Column >::const_iterator column = _columns.begin(); column != _columns.end(); ++column )
+    if ( ( column->policy == Recompute ) &&
+         ( std::find( _recompute.begin(), _recompute.end(), column->source ) == _recompute.end() ) )
+      _recompute.push_back( column->source );
+
+  for ( std::vector< Column >::iterator column = _columns.begin(); column != _columns.end(); ++column )
+    if ( ( column->policy != Recompute ) &&
+         ( std::find( _recompute.begin(), _recompute.end(), column->source ) != _recompute.end() ) )
+    {
+      used          -= ( column->policy == Reduce ) ? column->bytes / 2 : column->bytes;
+      column->policy = Recompute;
+    }
+
+  for ( oIter index = order.begin(); index != order.end(); ++index )
+  {
+    Column& column = _columns[ *index ];
+
+    if ( ( column.policy == Reduce ) && ( used + column.bytes / 2 <= budget ) )
+    {
+      column.policy = Materialize;
+      used         += column.bytes / 2;
+    }
+  }
+}
+
+
+
+const std::shared_ptr< CacheManager > CacheManager::subset( const std::vector< std::size_t >& events ) const
+{
+  std::shared_ptr< CacheManager > sub = std::make_shared< CacheManager >();
+
+  sub->_size      = events.size();
+  sub->_limit     = _limit;
+  sub->_columns   = _columns;
+  sub->_firsts    = _firsts;
+  sub->_recompute = _recompute;
+  sub->_copies    = _copies;
+
+  for ( std::vector< Column >::iterator column = sub->_columns.begin(); column != sub->_columns.end(); ++column )
+    column->bytes = events.size() * ( column->complex ? sizeof( std::complex< double > ) : sizeof( double ) );
+
+  sub->_memory = sub->memory();
+  _held       += sub->_memory;
+
+  typedef std::map< unsigned, std::vector< float >                 >::const_iterator mrIter;
+  typedef std::map< unsigned, std::vector< std::complex< float > > >::const_iterator mcIter;
+  typedef std::vector< std::size_t >::const_iterator                                   eIter;
+
+  for ( mrIter cached = _real.begin(); cached != _real.end(); ++cached )
+  {
+    std::vector< float >& values = sub->_real[ cached->first ];
+    values.reserve( events.size() );
+
+    for ( eIter event = events.begin(); event != events.end(); ++event )
+      values.push_back( cached->second[ *event ] );
+  }
+
+  for ( mcIter cached = _complex.begin(); cached != _complex.end(); ++cached )
+  {
+    std::vector< std::complex< float > >& values = sub->_complex[ cached->first ];
+    values.reserve( events.size() );
+
+    for ( eIter event = events.begin(); event != events.end(); ++event )
+      values.push_back( cached->second[ *event ] );
+  }
+
+  return sub;
+}
+
+
+
+const std::shared_ptr< CacheManager > CacheManager::copy() const
+{
+  std::vector< std::size_t > events( _size );
+  std::iota( events.begin(), events.end(), 0 );
+
+  return subset( events );
+}
+
+
+
+// The new events are computed by each source as in the constructor, with the
+//    same policy for each column, so the plan is not made again. The sources
+//    that are recomputed are also run over the new events, to complete their
+//    state, and the copies that recompute them are made again from the pdf,
+//    since the previous ones lack it. Nothing is stored until all the sources
+//    have been computed, so the manager is unchanged if one of them throws.
+void CacheManager::append( PdfBase&                                                     pdf   ,
+                           const Dataset&                                               events,
+                           std::map< unsigned, std::vector< double >                 >& cacheR,
+                           std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) throw( PdfException )
+{
+  const std::vector< PdfBase* >& sources = pdf.cacheSources();
+  const std::size_t              size    = events.size();
+
+  if ( ! size )
+    return;
+
+  if ( sources.size() != _firsts.size() )
+    throw PdfException( "CacheManager::append: the pdf does not have the sources the caches were planned for." );
+
+  std::map< unsigned, std::vector< float >                 > reducedR;
+  std::map< unsigned, std::vector< std::complex< float > > > reducedC;
+
+  for ( unsigned source = 0; source < sources.size(); ++source )
+  {
+    std::map< unsigned, std::vector< double >                 > real;
+    std::map< unsigned, std::vector< std::complex< double > > > complex;
+
+    if ( std::find( _recompute.begin(), _recompute.end(), source ) != _recompute.end() )
+    {
+      const std::size_t blockSize = 4096;
+      for ( std::size_t first = 0; first < size; first += blockSize )
+      {
+        std::vector< std::size_t > block( std::min( blockSize, size - first ) );
+        std::iota( block.begin(), block.end(), first );
+
+        compute( *sources[ source ], _firsts[ source ], events.subset( block ), real, complex );
+      }
+
+      continue;
+    }
+
+    compute( *sources[ source ], _firsts[ source ], events, real, complex );
+
+    for ( std::vector< Column >::const_iterator column = _columns.begin(); column != _columns.end(); ++column )
+    {
+      if ( column->source != source )
+        continue;
+
+      if ( ( column->complex ? complex[ column->index ].size() : real[ column->index ].size() ) != size )
+        throw PdfException( "CacheManager::append: the pdf does not cache the same expressions as before." );
+
+      if ( column->complex )
+      {
+        std::vector< std::complex< double > >& values = complex[ column->index ];
+
+        if ( column->policy == Materialize )
+          cacheC[ column->index ].swap( values );
+        else
+        {
+          std::vector< std::complex< float > >& reduced = reducedC[ column->index ];
+          reduced.resize( size );
+          Threads::fill( reduced, [ &values ]( const std::size_t& entry ) { return std::complex< float >( values[ entry ] ); } );
+        }
+      }
+      else
+      {
+        std::vector< double >& values = real[ column->index ];
+
+        if ( column->policy == Materialize )
+          cacheR[ column->index ].swap( values );
+        else
+        {
+          std::vector< float >& reduced = reducedR[ column->index ];
+          reduced.resize( size );
+          Threads::fill( reduced, [ &values ]( const std::size_t& entry ) { return float( values[ entry ] ); } );
+        }
+      }
+    }
+  }
+
+  typedef std::map< unsigned, std::vector< float >                 >::iterator mrIter;
+  typedef std::map< unsigned, std::vector< std::complex< float > > >::iterator mcIter;
+
+  for ( mrIter cached = reducedR.begin(); cached != reducedR.end(); ++cached )
+    _real[ cached->first ].insert( _real[ cached->first ].end(), cached->second.begin(), cached->second.end() );
+
+  for ( mcIter cached = reducedC.begin(); cached != reducedC.end(); ++cached )
+    _complex[ cached->first ].insert( _complex[ cached->first ].end(), cached->second.begin(), cached->second.end() );
+
+  _size += size;
+
+  for ( std::vector< Column >::iterator column = _columns.begin(); column != _columns.end(); ++column )
+    column->bytes = _size * ( column->complex ? sizeof( std::complex< double > ) : sizeof( double ) );
+
+  if ( ! _recompute.empty() )
+    _copies = std::make_shared< Copies >( pdf );
+
+  _held  -= _memory;
+  _memory = memory();
+  _held  += _memory;
+}
+
+
+
+const std::size_t CacheManager::budget()
+{
+  if ( _budget )
+    return _budget;
+
+  const long pages    = sysconf( _SC_PHYS_PAGES );
+  const long pageSize = sysconf( _SC_PAGE_SIZE  );
+
+  // Without a known size of the memory, materialize everything.
+  if ( ( pages <= 0 ) || ( pageSize <= 0 ) )
+    return std::size_t( -1 );
+
+  return std::size_t( pages ) * std::size_t( pageSize ) / 2;
+}
+
+
+
+const std::size_t CacheManager::available()
+{
+  const std::size_t& total = budget();
+  const std::size_t& held  = _held;
+
+  return ( held < total ) ? total - held : 0;
+}
+
+
+
+const std::size_t CacheManager::memory() const
+{
+  std::size_t memory = 0;
+  for ( std::vector< Column >::const_iterator column = _columns.begin(); column != _columns.end(); ++column )
+    if ( column->policy != Recompute )
+      memory += ( column->policy == Reduce ) ? column->bytes / 2 : column->bytes;
+
+  return memory;
+}
+
+
+
+void CacheManager::load( const Dataset& data, const std::size_t& first, const std::size_t& last, Block& block ) const
+{
+  _reads += last - first;
+
+  block._first = first;
+  block._last  = last;
+
+  if ( complete() )
+    return;
+
+  typedef std::map< unsigned, std::vector< float >                 >::const_iterator mrIter;
+  typedef std::map< unsigned, std::vector< std::complex< float > > >::const_iterator mcIter;
+
+  for ( mrIter cached = _real.begin(); cached != _real.end(); ++cached )
+    block._real[ cached->first ].assign( cached->second.begin() + first, cached->second.begin() + last );
+
+  for ( mcIter cached = _complex.begin(); cached != _complex.end(); ++cached )
+    block._complex[ cached->first ].assign( cached->second.begin() + first, cached->second.begin() + last );
+
+  if ( _recompute.empty() )
+    return;
+
+  std::vector< std::size_t > entries( last - first );
+  for ( std::size_t entry = 0; entry < entries.size(); ++entry )
+    entries[ entry ] = first + entry;
+
+  const Dataset& events = data.subset( entries );
+
+  std::unique_ptr< PdfBase >     pdf     = _copies->acquire();
+  const std::vector< PdfBase* >& sources = pdf->cacheSources();
+
+  for ( std::vector< unsigned >::const_iterator source = _recompute.begin(); source != _recompute.end(); ++source )
+  {
+    std::map< unsigned, std::vector< double >                 > real;
+    std::map< unsigned, std::vector< std::complex< double > > > complex;
+
+    compute( *sources[ *source ], _firsts[ *source ], events, real, complex );
+
+    for ( std::vector< Column >::const_iterator column = _columns.begin(); column != _columns.end(); ++column )
+      if ( column->source == *source )
+      {
+        if ( column->complex )
+          block._complex[ column->index ].swap( complex[ column->index ] );
+        else
+          block._real   [ column->index ].swap( real   [ column->index ] );
+      }
+  }
+
+  _copies->release( std::move( pdf ) );
+}
+
+
+
+void CacheManager::report( std::ostream& os ) const
+{
+  static const char* policies[] = { "materialize", "reduce", "recompute" };
+
+  const double megabyte = 1024.0 * 1024.0;
+  const double passes   = _size ? double( _reads ) / double( _size ) : 0.0;
+
+  os << "CacheManager: " << _columns.size() << " cached columns of " << _size << " events, "
+     << std::fixed << std::setprecision( 1 ) << _memory / megabyte << " MB in memory, budget "
+     << double( _limit ) / megabyte << " MB, " << passes << " passes over the events." << std::endl;
+
+  os << std::setw(  8 ) << "index"
+     << std::setw(  9 ) << "type"
+     << std::setw(  8 ) << "source"
+     << std::setw( 12 ) << "size (MB)"
+     << std::setw( 12 ) << "cost"
+     << std::setw( 13 ) << "policy" << std::endl;
+
+  for ( std::vector< Column >::const_iterator column = _columns.begin(); column != _columns.end(); ++column )
+    os << std::setw(  8 ) << column->index
+       << std::setw(  9 ) << ( column->complex ? "complex" : "real" )
+       << std::setw(  8 ) << column->source
+       << std::setw( 12 ) << std::setprecision( 2 ) << column->bytes / megabyte
+       << std::setw( 12 ) << std::setprecision( 2 ) << column->cost
+       << std::setw( 13 ) << policies[ column->policy ] << std::endl;
+
+  os.unsetf( std::ios::floatfield );
+}
@@ -0,0 +1,316 @@
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+
+#include <Minuit/MinuitParameter.h>
+#include <Minuit/MnUserParameters.h>
+#include <Minuit/MnUserCovariance.h>
+
+#include <cfit/checkpoint.hh>
+
+
+// Tag at the beginning of cache files, to detect files of the wrong kind, and
+//    version of their layout.
+static const std::uint32_t cacheTag     = 0x63666974; // "cfit"
+static const std::uint32_t cacheVersion = 3;
+
+
+// Add some bytes to a 64-bit FNV-1a hash.
+static void fnv1a( std::uint64_t& hash, const void* data, const std::size_t& bytes )
+{
+  const unsigned char* byte = static_cast< const unsigned char* >( data );
+  for ( std::size_t pos = 0; pos < bytes; ++pos )
+  {
+    hash ^= byte[ pos ];
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+
+const bool Checkpoint::exists() const
+{
+  return std::ifstream( _path.c_str() ).good();
+}
+
+
+const bool Checkpoint::cacheExists() const
+{
+  return std::ifstream( cachePath().c_str() ).good();
+}
+
+
+
+// Each name is hashed with its terminating null, so that the boundaries of
+//    the names count, and the values in their binary form.
+const std::uint64_t Checkpoint::hash( const std::vector< std::string >& varNames, const Dataset& data ) throw( DataException )
+{
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+
+  const std::uint64_t size = data.size();
+  fnv1a( hash, &size, sizeof( size ) );
+
+  for ( std::vector< std::string >::const_iterator var = varNames.begin(); var != varNames.end(); ++var )
+  {
+    fnv1a( hash, var->c_str(), var->size() + 1 );
+
+    if ( ! size )
+      continue;
+
+    const std::vector< std::pair< double, double > >& column = data.column( *var );
+    for ( std::vector< std::pair< double, double > >::const_iterator entry = column.begin(); entry != column.end(); ++entry )
+      fnv1a( hash, &entry->first, sizeof( entry->first ) );
+  }
+
+  return hash;
+}
+
+
+
+void Checkpoint::save( const MnUserParameterState& state, const unsigned& nCalls ) const throw( MinimizerException )
+{
+  const std::string& tmpPath = _path + ".tmp";
+
+  std::ofstream file( tmpPath.c_str() );
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: cannot write to file " + tmpPath + "." );
+
+  // Enough digits to recover the exact binary values.
+  file << std::setprecision( 17 );
+
+  file << "cfit-checkpoint"            << "\n";
+  file << "calls  " << nCalls          << "\n";
+  file << "fval   " << state.fval()    << "\n";
+  file << "edm    " << state.edm()     << "\n";
+  file << "caches " << cachePath()     << "\n";
+
+  const std::vector< MinuitParameter >& pars = state.parameters().parameters();
+  for ( std::vector< MinuitParameter >::const_iterator par = pars.begin(); par != pars.end(); ++par )
+    file << "par " << par->name()       << " " << par->value()      << " " << par->error() << " "
+                   << par->isFixed()    << " " << par->hasLimits()  << " "
+                   << par->lowerLimit() << " " << par->upperLimit() << "\n";
+
+  // The covariance is stored as the lower triangle of the matrix of floating parameters.
+  const unsigned nRows = state.hasCovariance() ? state.covariance().nrow() : 0;
+  file << "covariance " << nRows;
+  for ( unsigned row = 0; row < nRows; ++row )
+    for ( unsigned col = 0; col <= row; ++col )
+      file << " " << state.covariance()( row, col );
+  file << "\n";
+
+  file.close();
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: error writing to file " + tmpPath + "." );
+
+  if ( std::rename( tmpPath.c_str(), _path.c_str() ) != 0 )
+    throw MinimizerException( "Checkpoint: cannot move " + tmpPath + " to " + _path + "." );
+}
+
+
+
+const MnUserParameterState Checkpoint::load( unsigned& nCalls ) const throw( MinimizerException )
+{
+  double fval;
+  double edm;
+
+  return load( nCalls, fval, edm );
+}
+
+
+
+const MnUserParameterState Checkpoint::load( unsigned& nCalls, double& fval, double& edm ) const throw( MinimizerException )
+{
+  std::ifstream file( _path.c_str() );
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: cannot read file " + _path + "." );
+
+  std::string tag;
+  if ( ! ( file >> tag ) || tag != "cfit-checkpoint" )
+    throw MinimizerException( "Checkpoint: " + _path + " is not a checkpoint file." );
+
+  MnUserParameters      upar;
+  std::vector< double > covariance;
+  unsigned              nRows = 0;
+
+  std::string key;
+  while ( file >> key )
+  {
+    if ( key == "calls" )
+      file >> nCalls;
+    else if ( key == "fval" )
+      file >> fval;
+    else if ( key == "edm" )
+      file >> edm;
+    else if ( key == "caches" )
+      file.ignore( std::numeric_limits< std::streamsize >::max(), '\n' );
+    else if ( key == "par" )
+    {
+      std::string name;
+      double      value, error, lower, upper;
+      bool        isFixed, hasLimits;
+      file >> name >> value >> error >> isFixed >> hasLimits >> lower >> upper;
+
+      upar.add( name.c_str(), value, error );
+      if ( isFixed )
+        upar.fix( name.c_str() );
+      if ( hasLimits )
+        upar.setLimits( name.c_str(), lower, upper );
+    }
+    else if ( key == "covariance" )
+    {
+      file >> nRows;
+      covariance.resize( nRows * ( nRows + 1 ) / 2 );
+      for ( std::vector< double >::iterator elem = covariance.begin(); elem != covariance.end(); ++elem )
+        file >> *elem;
+    }
+    else
+      throw MinimizerException( "Checkpoint: unknown entry " + key + " in file " + _path + "." );
+
+    if ( ! file )
+      throw MinimizerException( "Checkpoint: malformed entry " + key + " in file " + _path + "." );
+  }
+
+  if ( nRows == 0 )
+    return MnUserParameterState( upar );
+
+  return MnUserParameterState( upar, MnUserCovariance( covariance, nRows ) );
+}
+
+
+
+template< class T >
+void Checkpoint::write( std::ostream& file, const std::map< unsigned, std::vector< T > >& cache, const unsigned& first )
+{
+  const std::uint32_t nEntries = cache.size();
+  file.write( (const char*)( &nEntries ), sizeof( nEntries ) );
+
+  typedef typename std::map< unsigned, std::vector< T > >::const_iterator cIter;
+  for ( cIter cached = cache.begin(); cached != cache.end(); ++cached )
+  {
+    const std::uint32_t index = cached->first - first;
+    const std::uint64_t size  = cached->second.size();
+
+    file.write( (const char*)( &index ), sizeof( index ) );
+    file.write( (const char*)( &size  ), sizeof( size  ) );
+    file.write( (const char*)( cached->second.data() ), size * sizeof( T ) );
+  }
+}
+
+
+
+template< class T >
+void Checkpoint::read( std::istream& file, std::map< unsigned, std::vector< T > >& cache, const unsigned& first,
+                       const unsigned& nCached, const std::size_t& nEvents ) throw( MinimizerException )
+{
+  std::uint32_t nEntries = 0;
+  file.read( (char*)( &nEntries ), sizeof( nEntries ) );
+
+  for ( std::uint32_t entry = 0; entry < nEntries && file; ++entry )
+  {
+    std::uint32_t index = 0;
+    std::uint64_t size  = 0;
+
+    file.read( (char*)( &index ), sizeof( index ) );
+    file.read( (char*)( &size  ), sizeof( size  ) );
+
+    if ( index >= nCached || size != nEvents )
+      throw MinimizerException( "Checkpoint: the cache file does not match the model or the dataset." );
+
+    std::vector< T >& values = cache[ first + index ];
+    values.resize( size );
+    file.read( (char*)( values.data() ), size * sizeof( T ) );
+  }
+
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: the cache file is truncated." );
+}
+
+
+
+void Checkpoint::saveCache( const std::map< unsigned, std::vector< double >                 >& cacheR ,
+                            const std::map< unsigned, std::vector< std::complex< double > > >& cacheC ,
+                            const unsigned& firstR, const unsigned& nCachedR,
+                            const unsigned& firstC, const unsigned& nCachedC,
+                            const std::size_t& nEvents, const std::uint64_t& hash ) const throw( MinimizerException )
+{
+  const std::string& tmpPath = cachePath() + ".tmp";
+
+  std::ofstream file( tmpPath.c_str(), std::ios::binary );
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: cannot write to file " + tmpPath + "." );
+
+  const std::uint64_t size     = nEvents;
+  const std::uint32_t countR   = nCachedR;
+  const std::uint32_t countC   = nCachedC;
+  file.write( (const char*)( &cacheTag     ), sizeof( cacheTag     ) );
+  file.write( (const char*)( &cacheVersion ), sizeof( cacheVersion ) );
+  file.write( (const char*)( &size         ), sizeof( size         ) );
+  file.write( (const char*)( &countR       ), sizeof( countR       ) );
+  file.write( (const char*)( &countC       ), sizeof( countC       ) );
+  file.write( (const char*)( &hash         ), sizeof( hash         ) );
+
+  write( file, cacheR, firstR );
+  write( file, cacheC, firstC );
+
+  file.close();
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: error writing to file " + tmpPath + "." );
+
+  if ( std::rename( tmpPath.c_str(), cachePath().c_str() ) != 0 )
+    throw MinimizerException( "Checkpoint: cannot move " + tmpPath + " to " + cachePath() + "." );
+}
+
+
+
+void Checkpoint::loadCache( std::map< unsigned, std::vector< double >                 >& cacheR ,
+                            std::map< unsigned, std::vector< std::complex< double > > >& cacheC ,
+                            const unsigned& firstR, const unsigned& nCachedR,
+                            const unsigned& firstC, const unsigned& nCachedC,
+                            const std::size_t& nEvents, const std::uint64_t& hash ) const throw( MinimizerException )
+{
+  std::ifstream file( cachePath().c_str(), std::ios::binary );
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: cannot read file " + cachePath() + "." );
+
+  std::uint32_t tag     = 0;
+  std::uint32_t version = 0;
+  std::uint64_t size    = 0;
+  std::uint32_t countR  = 0;
+  std::uint32_t countC  = 0;
+  std::uint64_t saved   = 0;
+  file.read( (char*)( &tag     ), sizeof( tag     ) );
+  file.read( (char*)( &version ), sizeof( version ) );
+
+  if ( ! file || tag != cacheTag )
+    throw MinimizerException( "Checkpoint: " + cachePath() + " is not a cache file." );
+
+  if ( version != cacheVersion )
+    throw MinimizerException( "Checkpoint: " + cachePath() + " was written by another version of cfit." );
+
+  file.read( (char*)( &size   ), sizeof( size   ) );
+  file.read( (char*)( &countR ), sizeof( countR ) );
+  file.read( (char*)( &countC ), sizeof( countC ) );
+  file.read( (char*)( &saved  ), sizeof( saved  ) );
+
+  if ( ! file )
+    throw MinimizerException( "Checkpoint: the cache file is truncated." );
+
+  if ( size != nEvents )
+    throw MinimizerException( "Checkpoint: the cache file does not match the size of the dataset." );
+
+  // The indices are only mapped correctly if the pdf assigned as many as when
+  //    the caches were saved.
+  if ( ( countR != nCachedR ) || ( countC != nCachedC ) )
+    throw MinimizerException( "Checkpoint: the cache file was saved for a pdf with different cached expressions." );
+
+  // Caches of other events, or of a pdf of other variables, would be silently
+  //    wrong even with the same number of events and cached expressions.
+  if ( saved != hash )
+    throw MinimizerException( "Checkpoint: the cache file was saved for other variables or events." );
+
+  read( file, cacheR, firstR, nCachedR, nEvents );
+  read( file, cacheC, firstC, nCachedC, nEvents );
+}
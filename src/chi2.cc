@@ -55,7 +55,7 @@ double Chi2::operator()( const std::vector<double>& pars ) const throw( PdfExcep
   double chi2 = 0.;
 
   // Sum of the terms of the chi^2.
-  for ( std::size_t n = 0; n < _data.size(); ++n )
+  for ( std::size_t n = 0; n < _data->size(); ++n )
     {
       // Initialize the value of the variance for the current entry.
       //    It must be s_y^2 + Sum( s_x^2 ).
@@ -67,18 +67,20 @@ double Chi2::operator()( const std::vector<double>& pars ) const throw( PdfExcep
       // Fill the vector of values and sum the terms of the variance.
       for ( vIter var = varNames.begin(); var != varNames.end(); ++var )
 	{
-	  vars.push_back( _data.value( *var, n ) );
-	  variance += pow( _data.error( *var, n ), 2 );
+	  vars.push_back( _data->value( *var, n ) );
+	  variance += pow( _data->error( *var, n ), 2 );
 	}
 
       // Compute the numerator of the chi^2 term and finish computing the variance.
-      double diff = _pdf->evaluate( vars ) - _data.value( _y.name(), n );
-      variance += pow( _data.error( _y.name(), n ), 2 );
+      double diff = _pdf->evaluate( vars ) - _data->value( _y.name(), n );
+      variance += pow( _data->error( _y.name(), n ), 2 );
 
       // Add the term to the chi^2.
       chi2 += pow( diff, 2 ) / variance;
     }
 
+  chi2 *= _scale;
+
 #ifdef MPI_ON
   // If running with MPI, each process has only computed a piece of the chi2.
   //    Add all the pieces up and broadcast them to all the processes.
@@ -0,0 +1,255 @@
+#include <cmath>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <iterator>
+#include <functional>
+
+#include <dlfcn.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <cfit/codegen.hh>
+
+extern char** environ;
+
+
+namespace
+{
+  const std::string environment( const char* name, const std::string& fallback )
+  {
+    const char* value = std::getenv( name );
+    return ( value && *value ) ? std::string( value ) : fallback;
+  }
+
+
+  // Words of a command line separated by spaces, with no other expansion.
+  const std::vector< std::string > words( const std::string& line )
+  {
+    std::istringstream stream( line );
+    return std::vector< std::string >( std::istream_iterator< std::string >( stream ),
+                                       std::istream_iterator< std::string >() );
+  }
+
+
+  // Contents of a file, empty if it cannot be read.
+  const std::string contents( const std::string& path )
+  {
+    std::ifstream file( path.c_str() );
+    return std::string( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
+  }
+
+
+  const std::string cacheDirectory()
+  {
+    const std::string& dir = environment( "CFIT_CODEGEN_DIR", "" );
+    if ( ! dir.empty() )
+      return dir;
+
+    const std::string& home  = environment( "HOME", "" );
+    const std::string& cache = environment( "XDG_CACHE_HOME", home.empty() ? "" : home + "/.cache" );
+    if ( ! cache.empty() )
+    {
+      mkdir( cache.c_str(), 0700 );
+      return cache + "/cfit";
+    }
+
+    // Made once per process, and only readable by the user.
+    static const std::string temporary = []()
+    {
+      char name[] = "/tmp/cfit.XXXXXX";
+      return mkdtemp( name ) ? std::string( name ) : std::string( "" );
+    }();
+
+    return temporary;
+  }
+
+
+  // Create the directory if needed, and check that nobody else can write in it.
+  void secure( const std::string& dir ) throw( PdfException )
+  {
+    if ( dir.empty() || ( ( mkdir( dir.c_str(), 0700 ) != 0 ) && ( errno != EEXIST ) ) )
+      throw PdfException( "Codegen: cannot create the cache directory \"" + dir + "\"." );
+
+    struct stat info;
+    if ( ( lstat( dir.c_str(), &info ) != 0 ) || ! S_ISDIR( info.st_mode ) )
+      throw PdfException( "Codegen: the cache directory \"" + dir + "\" is not a directory." );
+
+    if ( ( info.st_uid != geteuid() ) || ( info.st_mode & ( S_IWGRP | S_IWOTH ) ) )
+      throw PdfException( "Codegen: the cache directory \"" + dir + "\" must belong to the user and not be writable by others." );
+  }
+
+
+  // Run a command and wait for it, returning its exit status, or -1 if it
+  //    could not be run.
+  const int run( const std::vector< std::string >& command )
+  {
+    std::vector< char* > argv;
+    for ( std::vector< std::string >::const_iterator arg = command.begin(); arg != command.end(); ++arg )
+      argv.push_back( const_cast< char* >( arg->c_str() ) );
+    argv.push_back( 0 );
+
+    pid_t pid;
+    if ( posix_spawnp( &pid, argv[ 0 ], 0, 0, argv.data(), environ ) != 0 )
+      return -1;
+
+    int status = 0;
+    while ( waitpid( pid, &status, 0 ) < 0 )
+      if ( errno != EINTR )
+        return -1;
+
+    return WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+  }
+}
+
+
+
+// The source is stored with a first line naming the compiler and its flags,
+//    so that comparing it checks the whole key of the library. If another
+//    source is found under the same hash, the next name is tried. Files are
+//    first written under names private to the process, and then renamed, so
+//    that processes compiling the same model at the same time never load a
+//    partially written file.
+Codegen::Codegen( const std::string& source, const std::string& cacheDir ) throw( PdfException )
+  : _handle( 0 ), _norm( 0 ), _kernel( 0 )
+{
+  const char*        cxx   = std::getenv( "CFIT_CXX" );
+  const std::string& flags = environment( "CFIT_CXXFLAGS", "-O2 -std=c++11 -shared -fPIC -w" );
+  const std::string& dir   = cacheDir.empty() ? cacheDirectory() : cacheDir;
+  const std::string& comp  = ( cxx && *cxx ) ? std::string( cxx ) : environment( "CXX", "c++" );
+
+  std::vector< std::string > command = words( comp );
+  const std::vector< std::string >& options = words( flags );
+  command.insert( command.end(), options.begin(), options.end() );
+
+  if ( command.empty() )
+    throw PdfException( "Codegen: no compiler given." );
+
+  std::string line = "//";
+  for ( std::vector< std::string >::const_iterator word = command.begin(); word != command.end(); ++word )
+    line += " " + *word;
+
+  const std::string& text = line + "\n" + source;
+
+  secure( dir );
+
+  const std::size_t hash     = std::hash< std::string >()( text );
+  const unsigned    attempts = 16;
+
+  std::string stored;
+  for ( unsigned attempt = 0; attempt < attempts; ++attempt )
+  {
+    std::ostringstream name;
+    name << dir << "/cfit_" << std::hex << hash;
+    if ( attempt )
+      name << "_" << attempt;
+
+    stored   = name.str() + ".cc";
+    _library = name.str() + ".so";
+
+    const std::string& found = contents( stored );
+    if ( found.empty() || ( found == text ) )
+      break;
+
+    if ( attempt + 1 == attempts )
+      throw PdfException( "Codegen: too many different sources with the same hash in " + dir + "." );
+  }
+
+  if ( ( contents( stored ) != text ) || ( access( _library.c_str(), R_OK ) != 0 ) )
+  {
+    std::ostringstream suffix;
+    suffix << "." << getpid();
+
+    const std::string& base = _library.substr( 0, _library.size() - 3 );
+    const std::string& src  = base + suffix.str() + ".cc";
+    const std::string& tmp  = base + suffix.str() + ".so";
+
+    std::ofstream file( src.c_str() );
+    file << text;
+    file.close();
+    if ( ! file )
+      throw PdfException( "Codegen: cannot write the generated source to " + src + "." );
+
+    command.push_back( "-o" );
+    command.push_back( tmp  );
+    command.push_back( src  );
+
+    if ( run( command ) != 0 )
+    {
+      std::remove( src.c_str() );
+      std::remove( tmp.c_str() );
+      throw PdfException( "Codegen: compilation of the generated source " + stored + " failed." );
+    }
+
+    if ( ( std::rename( src.c_str(), stored  .c_str() ) != 0 ) ||
+         ( std::rename( tmp.c_str(), _library.c_str() ) != 0 ) )
+    {
+      std::remove( src.c_str() );
+      std::remove( tmp.c_str() );
+      throw PdfException( "Codegen: cannot move the compiled kernel to " + _library + "." );
+    }
+  }
+
+  _handle = dlopen( _library.c_str(), RTLD_NOW | RTLD_LOCAL );
+  if ( ! _handle )
+    throw PdfException( std::string( "Codegen: cannot load the compiled kernel: " ) + dlerror() );
+
+  _norm   = reinterpret_cast< NormKernel >( dlsym( _handle, "cfit_norm" ) );
+  _kernel = reinterpret_cast< Kernel     >( dlsym( _handle, "cfit_nll"  ) );
+  if ( ! _norm || ! _kernel )
+  {
+    dlclose( _handle );
+    throw PdfException( "Codegen: the compiled kernel does not define cfit_norm and cfit_nll." );
+  }
+}
+
+
+Codegen::~Codegen()
+{
+  if ( _handle )
+    dlclose( _handle );
+}
+
+
+
+// Seventeen significant digits are enough to round trip any double. Negative
+//    values are parenthesized, so that they can follow any operator.
+const std::string Codegen::literal( const double& value )
+{
+  if ( std::isnan( value ) )
+    return "std::numeric_limits< double >::quiet_NaN()";
+  if ( std::isinf( value ) )
+    return value > 0.0 ? "std::numeric_limits< double >::infinity()" : "( - std::numeric_limits< double >::infinity() )";
+
+  std::ostringstream str;
+  str.precision( 17 );
+  str << value;
+
+  std::string result = str.str();
+  if ( result.find_first_of( ".e" ) == std::string::npos )
+    result += ".";
+
+  return ( value < 0.0 ) ? "( " + result + " )" : result;
+}
+
+
+
+const std::string Codegen::prelude()
+{
+  return
+    "#include <cmath>\n"
+    "#include <limits>\n"
+    "#include <complex>\n"
+    "\n"
+    "static inline double kallen( const double x, const double y, const double z )\n"
+    "{\n"
+    "  return x * x + y * y + z * z - 2. * x * y - 2. * x * z - 2. * y * z;\n"
+    "}\n"
+    "\n";
+}
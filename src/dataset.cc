@@ -1,4 +1,5 @@
 
+#include <cmath>
 #include <utility>
 #include <string>
 #include <vector>
@@ -6,6 +7,7 @@
 
 #include <cfit/functors.hh>
 #include <cfit/dataset.hh>
+#include <cfit/threads.hh>
 
 #ifdef MPI_ON
 #include <mpi.h>
@@ -27,6 +29,51 @@ void Dataset::push( const std::map< std::string, double >& event )
 }
 
 
+// Add a block of values of a field.
+void Dataset::push( const std::string& field, const double* values, const std::size_t& n )
+{
+  std::vector< std::pair< double, double > >& column = _data[ field ];
+  column.reserve( column.size() + n );
+
+  for ( std::size_t entry = 0; entry < n; ++entry )
+    column.push_back( std::make_pair( values[ entry ], 0.0 ) );
+}
+
+
+// Columns are copied one at a time, to need at most one more column of memory.
+void Dataset::distribute()
+{
+  typedef std::map< std::string, std::vector< std::pair< double, double > > >::iterator dIter;
+  for ( dIter field = _data.begin(); field != _data.end(); ++field )
+  {
+    const std::vector< std::pair< double, double > >& column = field->second;
+
+    std::vector< std::pair< double, double > > placed( column.size() );
+    Threads::fill( placed, [ &column ]( const std::size_t& entry ) { return column[ entry ]; } );
+
+    field->second.swap( placed );
+  }
+}
+
+
+// Add the events of another dataset at the end.
+void Dataset::append( const Dataset& events ) throw( DataException )
+{
+  if ( events._data.empty() )
+    return;
+
+  if ( ( ! _data.empty() ) && ( fields() != events.fields() ) )
+    throw DataException( "Dataset: cannot append a dataset with different fields" );
+
+  typedef std::map< std::string, std::vector< std::pair< double, double > > >::const_iterator dIter;
+  for ( dIter field = events._data.begin(); field != events._data.end(); ++field )
+  {
+    std::vector< std::pair< double, double > >& column = _data[ field->first ];
+    column.insert( column.end(), field->second.begin(), field->second.end() );
+  }
+}
+
+
 // Getters.
 std::size_t Dataset::size() const
 {
@@ -85,6 +132,18 @@ std::vector< double > Dataset::errors( const std::string& field ) const throw( D
 }
 
 
+const std::vector< std::pair< double, double > >& Dataset::column( const std::string& field ) const throw( DataException )
+{
+  typedef std::map< std::string, std::vector< std::pair< double, double > > >::const_iterator dIter;
+
+  const dIter found = _data.find( field );
+  if ( found == _data.end() )
+    throw DataException( "Dataset: requested variable " + field + " does not exist in dataset" );
+
+  return found->second;
+}
+
+
 std::vector< std::string > Dataset::fields() const
 {
   std::vector< std::string > fieldVect;
@@ -95,6 +154,67 @@ std::vector< std::string > Dataset::fields() const
 }
 
 
+void Dataset::setCategory( const std::string& field ) throw( DataException )
+{
+  if ( ! _data.count( field ) )
+    throw DataException( "Dataset: requested category " + field + " does not exist in dataset" );
+
+  const std::vector< std::pair< double, double > >& entries = _data.find( field )->second;
+
+  typedef std::vector< std::pair< double, double > >::const_iterator eIter;
+  for ( eIter entry = entries.begin(); entry != entries.end(); ++entry )
+    if ( ( entry->first < 0.0 ) || ( entry->first != std::floor( entry->first ) ) )
+      throw DataException( "Dataset: the values of category " + field + " must be non-negative integers" );
+
+  _category = field;
+}
+
+
+std::vector< unsigned > Dataset::categories() const throw( DataException )
+{
+  if ( _category.empty() )
+    throw DataException( "Dataset: no category has been set" );
+
+  const std::vector< std::pair< double, double > >& entries = _data.find( _category )->second;
+
+  std::vector< unsigned > cats;
+  cats.reserve( entries.size() );
+
+  typedef std::vector< std::pair< double, double > >::const_iterator eIter;
+  for ( eIter entry = entries.begin(); entry != entries.end(); ++entry )
+    cats.push_back( unsigned( entry->first ) );
+
+  return cats;
+}
+
+
+const Dataset Dataset::subset( const std::vector< std::size_t >& entries ) const throw( DataException )
+{
+  Dataset subset;
+  subset._category = _category;
+
+  const std::size_t nEntries = size();
+
+  typedef std::map< std::string, std::vector< std::pair< double, double > > >::const_iterator dIter;
+  typedef std::vector< std::size_t >::const_iterator                                         eIter;
+  for ( dIter field = _data.begin(); field != _data.end(); ++field )
+  {
+    std::vector< std::pair< double, double > >& column = subset._data[ field->first ];
+    column.reserve( entries.size() );
+
+    for ( eIter entry = entries.begin(); entry != entries.end(); ++entry )
+    {
+      if ( *entry >= nEntries )
+        throw DataException( "Dataset: requested entry is beyond the size of the dataset" );
+
+      column.push_back( field->second[ *entry ] );
+    }
+  }
+
+  return subset;
+}
+
+
 
 #ifdef MPI_ON
 void Dataset::scatter()
@@ -0,0 +1,433 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+#include <exception>
+#include <algorithm>
+
+#include <cxxabi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cfit/pdfbase.hh>
+#include <cfit/random.hh>
+#include <cfit/threads.hh>
+#include <cfit/eventfile.hh>
+
+
+namespace
+{
+  const std::uint32_t eventTag     = 0x56454643; // "CFEV".
+  const std::uint32_t eventVersion = 1;
+
+  void writeString( std::ostream& file, const std::string& str )
+  {
+    const std::uint64_t size = str.size();
+    file.write( (const char*)( &size ), sizeof( size ) );
+    file.write( str.data(), size );
+  }
+
+  // Sequential reader of the mapped file, which checks that every read lies
+  //    inside it.
+  class Cursor
+  {
+  private:
+    const char* _pos;
+    const char* _end;
+
+  public:
+    Cursor( const char* begin, const char* end ) : _pos( begin ), _end( end ) {}
+
+    const char* pos() const { return _pos; }
+
+    void skip( const std::size_t& size ) throw( DataException )
+    {
+      if ( std::size_t( _end - _pos ) < size )
+        throw DataException( "EventFile: the file is truncated." );
+      _pos += size;
+    }
+
+    template< class T >
+    T read() throw( DataException )
+    {
+      T value;
+      const char* from = _pos;
+      skip( sizeof( T ) );
+      std::memcpy( &value, from, sizeof( T ) );
+      return value;
+    }
+
+    std::string readString() throw( DataException )
+    {
+      const std::uint64_t size = read< std::uint64_t >();
+      const char*         from = _pos;
+      skip( size );
+      return std::string( from, size );
+    }
+
+    // Values are aligned to 8 bytes from the start of the file.
+    void align( const char* begin ) throw( DataException )
+    {
+      skip( ( 8 - ( _pos - begin ) % 8 ) % 8 );
+    }
+
+    const bool atEnd() const { return _pos == _end; }
+  };
+}
+
+
+
+EventWriter::EventWriter( const std::string&                     path  ,
+                          const std::string&                     model ,
+                          const std::uint64_t&                   seed  ,
+                          const std::map< std::string, double >& pars  ,
+                          const std::vector< std::string >&      fields ) throw( DataException )
+  : _path( path ), _fields( fields ), _nEvents( 0 ), _nChunks( 0 )
+{
+  open( model, seed, pars );
+}
+
+
+EventWriter::EventWriter( const std::string&   path ,
+                          const PdfBase&       pdf  ,
+                          const std::uint64_t& seed ,
+                          const std::string&   model ) throw( DataException )
+  : _path( path ), _fields( pdf.varNames() ), _nEvents( 0 ), _nChunks( 0 )
+{
+  std::map< std::string, double > pars;
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pdf.getPars().begin(); par != pdf.getPars().end(); ++par )
+    pars[ par->first ] = par->second.value();
+
+  std::string type = model;
+  if ( type.empty() )
+  {
+    int   status    = 0;
+    char* demangled = abi::__cxa_demangle( typeid( pdf ).name(), 0, 0, &status );
+    type = ( status == 0 ) ? std::string( demangled ) : std::string( typeid( pdf ).name() );
+    std::free( demangled );
+  }
+
+  open( type, seed, pars );
+}
+
+
+// A writer that has not been closed, e.g. because the generation failed,
+//    removes its temporary file.
+EventWriter::~EventWriter()
+{
+  if ( ! _file.is_open() )
+    return;
+
+  _file.close();
+  std::remove( ( _path + ".tmp" ).c_str() );
+}
+
+
+void EventWriter::open( const std::string& model, const std::uint64_t& seed,
+                        const std::map< std::string, double >& pars ) throw( DataException )
+{
+  const std::string& tmpPath = _path + ".tmp";
+
+  _file.open( tmpPath.c_str(), std::ios::binary );
+  if ( ! _file )
+    throw DataException( "EventWriter: cannot write to file " + tmpPath + "." );
+
+  _file.write( (const char*)( &eventTag     ), sizeof( eventTag     ) );
+  _file.write( (const char*)( &eventVersion ), sizeof( eventVersion ) );
+  writeString( _file, model );
+  _file.write( (const char*)( &seed ), sizeof( seed ) );
+
+  const std::uint64_t nPars = pars.size();
+  _file.write( (const char*)( &nPars ), sizeof( nPars ) );
+
+  typedef std::map< std::string, double >::const_iterator pIter;
+  for ( pIter par = pars.begin(); par != pars.end(); ++par )
+  {
+    writeString( _file, par->first );
+    _file.write( (const char*)( &par->second ), sizeof( par->second ) );
+  }
+
+  const std::uint64_t nFields = _fields.size();
+  _file.write( (const char*)( &nFields ), sizeof( nFields ) );
+
+  typedef std::vector< std::string >::const_iterator fIter;
+  for ( fIter field = _fields.begin(); field != _fields.end(); ++field )
+    writeString( _file, *field );
+
+  const char padding[ 8 ] = { 0 };
+  _file.write( padding, ( 8 - _file.tellp() % 8 ) % 8 );
+
+  // The counters are only known at the end.
+  _counters = _file.tellp();
+  _file.write( (const char*)( &_nEvents ), sizeof( _nEvents ) );
+  _file.write( (const char*)( &_nChunks ), sizeof( _nChunks ) );
+
+  if ( ! _file )
+    throw DataException( "EventWriter: error writing to file " + tmpPath + "." );
+}
+
+
+void EventWriter::write( const std::vector< std::vector< double > >& columns ) throw( DataException )
+{
+  if ( ! _file.is_open() )
+    throw DataException( "EventWriter: the file " + _path + " has already been closed." );
+
+  if ( columns.size() != _fields.size() )
+    throw DataException( "EventWriter: the number of columns does not match the number of fields." );
+
+  const std::uint64_t size = columns.empty() ? 0 : columns.front().size();
+  if ( ! size )
+    return;
+
+  typedef std::vector< std::vector< double > >::const_iterator cIter;
+  for ( cIter column = columns.begin(); column != columns.end(); ++column )
+    if ( column->size() != size )
+      throw DataException( "EventWriter: all the columns of a chunk must have the same size." );
+
+  _file.write( (const char*)( &size ), sizeof( size ) );
+  for ( cIter column = columns.begin(); column != columns.end(); ++column )
+    _file.write( (const char*)( column->data() ), size * sizeof( double ) );
+
+  if ( ! _file )
+    throw DataException( "EventWriter: error writing to file " + _path + ".tmp." );
+
+  _nEvents += size;
+  ++_nChunks;
+}
+
+
+void EventWriter::close() throw( DataException )
+{
+  if ( ! _file.is_open() )
+    return;
+
+  const std::string& tmpPath = _path + ".tmp";
+
+  _file.seekp( _counters );
+  _file.write( (const char*)( &_nEvents ), sizeof( _nEvents ) );
+  _file.write( (const char*)( &_nChunks ), sizeof( _nChunks ) );
+  _file.close();
+
+  if ( ! _file )
+  {
+    std::remove( tmpPath.c_str() );
+    throw DataException( "EventWriter: error writing to file " + tmpPath + "." );
+  }
+
+  if ( std::rename( tmpPath.c_str(), _path.c_str() ) != 0 )
+    throw DataException( "EventWriter: cannot move " + tmpPath + " to " + _path + "." );
+}
+
+
+
+// Each batch has one chunk per thread. The chunks of a batch are generated
+//    while the previous batch is written from the other set of buffers, so
+//    the threads only wait for the disk when it is slower than them.
+void EventWriter::generate( const PdfBase&       pdf      ,
+                            const std::size_t&   nEvents  ,
+                            const std::string&   path     ,
+                            const std::uint64_t& seed     ,
+                            const std::size_t&   chunkSize,
+                            const std::string&   model    ) throw( PdfException, DataException )
+{
+  if ( ! chunkSize )
+    throw DataException( "EventWriter: the chunks must have at least one event." );
+
+  EventWriter writer( path, pdf, seed, model );
+
+  const std::vector< std::string >& fields   = writer.fields();
+  const std::size_t                 nFields  = fields.size();
+  const std::size_t                 nChunks  = ( nEvents + chunkSize - 1 ) / chunkSize;
+  const unsigned                    nThreads = Threads::nThreads();
+
+  std::vector< std::unique_ptr< PdfBase > > pdfs;
+  for ( unsigned thread = 0; thread < nThreads; ++thread )
+    pdfs.push_back( std::unique_ptr< PdfBase >( pdf.copy() ) );
+
+  typedef std::vector< std::vector< double > > Chunk;
+  std::vector< Chunk > buffers[ 2 ] = { std::vector< Chunk >( nThreads, Chunk( nFields ) ),
+                                        std::vector< Chunk >( nThreads, Chunk( nFields ) ) };
+
+  std::vector< std::exception_ptr > errors( nThreads );
+  std::future< void >               pending;
+
+  unsigned parity = 0;
+  for ( std::size_t first = 0; first < nChunks; first += nThreads, parity ^= 1 )
+  {
+    const std::size_t    count = std::min< std::size_t >( nThreads, nChunks - first );
+    std::vector< Chunk >& batch = buffers[ parity ];
+
+    Threads::forEach( count, [ & ]( const std::size_t& index, const unsigned& thread )
+    {
+      try
+      {
+        const std::size_t chunk = first + index;
+        const std::size_t size  = std::min( chunkSize, nEvents - chunk * chunkSize );
+
+        Random::setSeed( seed, chunk );
+
+        Chunk& columns = batch[ index ];
+        for ( std::size_t field = 0; field < nFields; ++field )
+          columns[ field ].resize( size );
+
+        // Both the fields and the generated values are sorted by name.
+        typedef std::map< std::string, double >::const_iterator vIter;
+        for ( std::size_t event = 0; event < size; ++event )
+        {
+          const std::map< std::string, double >& values = pdfs[ thread ]->generate();
+
+          vIter value = values.begin();
+          for ( std::size_t field = 0; field < nFields; ++field )
+          {
+            while ( ( value != values.end() ) && ( value->first < fields[ field ] ) )
+              ++value;
+
+            if ( ( value == values.end() ) || ( value->first != fields[ field ] ) )
+              throw PdfException( "EventWriter: the pdf does not generate the field " + fields[ field ] + "." );
+
+            columns[ field ][ event ] = value->second;
+          }
+        }
+      }
+      catch ( ... )
+      {
+        errors[ thread ] = std::current_exception();
+      }
+    }, count );
+
+    if ( pending.valid() )
+      pending.get();
+
+    for ( std::vector< std::exception_ptr >::const_iterator error = errors.begin(); error != errors.end(); ++error )
+      if ( *error )
+        std::rethrow_exception( *error );
+
+    pending = std::async( std::launch::async, [ &writer, &batch, count ]()
+    {
+      for ( std::size_t index = 0; index < count; ++index )
+        writer.write( batch[ index ] );
+    } );
+  }
+
+  if ( pending.valid() )
+    pending.get();
+
+  writer.close();
+}
+
+
+
+EventFile::EventFile( const std::string& path ) throw( DataException )
+  : _fd( -1 ), _map( 0 ), _length( 0 ), _seed( 0 ), _nEvents( 0 )
+{
+  _fd = ::open( path.c_str(), O_RDONLY );
+  if ( _fd < 0 )
+    throw DataException( "EventFile: cannot read file " + path + "." );
+
+  struct stat info;
+  if ( ( fstat( _fd, &info ) != 0 ) || ( info.st_size == 0 ) )
+  {
+    ::close( _fd );
+    throw DataException( "EventFile: " + path + " is not an event file." );
+  }
+
+  _length = info.st_size;
+
+  void* map = mmap( 0, _length, PROT_READ, MAP_SHARED, _fd, 0 );
+  if ( map == MAP_FAILED )
+  {
+    ::close( _fd );
+    throw DataException( "EventFile: cannot map file " + path + " in memory." );
+  }
+
+  _map = static_cast< const char* >( map );
+  madvise( map, _length, MADV_SEQUENTIAL );
+
+  try
+  {
+    Cursor cursor( _map, _map + _length );
+
+    if ( ( cursor.read< std::uint32_t >() != eventTag ) || ( cursor.read< std::uint32_t >() != eventVersion ) )
+      throw DataException( "EventFile: " + path + " is not an event file." );
+
+    _model = cursor.readString();
+    _seed  = cursor.read< std::uint64_t >();
+
+    const std::uint64_t nPars = cursor.read< std::uint64_t >();
+    for ( std::uint64_t par = 0; par < nPars; ++par )
+    {
+      const std::string& name = cursor.readString();
+      _pars[ name ] = cursor.read< double >();
+    }
+
+    const std::uint64_t nFields = cursor.read< std::uint64_t >();
+    for ( std::uint64_t field = 0; field < nFields; ++field )
+      _fields.push_back( cursor.readString() );
+
+    cursor.align( _map );
+
+    _nEvents = cursor.read< std::uint64_t >();
+    const std::uint64_t nChunks = cursor.read< std::uint64_t >();
+
+    std::uint64_t nRead = 0;
+    for ( std::uint64_t chunk = 0; chunk < nChunks; ++chunk )
+    {
+      const std::uint64_t size = cursor.read< std::uint64_t >();
+
+      _chunkSizes.push_back( size );
+      _chunkData .push_back( reinterpret_cast< const double* >( cursor.pos() ) );
+
+      cursor.skip( nFields * size * sizeof( double ) );
+      nRead += size;
+    }
+
+    if ( ( nRead != _nEvents ) || ! cursor.atEnd() )
+      throw DataException( "EventFile: the number of events in " + path + " does not match its header." );
+  }
+  catch ( ... )
+  {
+    munmap( const_cast< char* >( _map ), _length );
+    ::close( _fd );
+    throw;
+  }
+}
+
+
+EventFile::~EventFile()
+{
+  munmap( const_cast< char* >( _map ), _length );
+  ::close( _fd );
+}
+
+
+const double* EventFile::column( const std::size_t& chunk, const std::string& field ) const throw( DataException )
+{
+  if ( chunk >= _chunkSizes.size() )
+    throw DataException( "EventFile: requested chunk does not exist." );
+
+  const std::vector< std::string >::const_iterator pos = std::find( _fields.begin(), _fields.end(), field );
+  if ( pos == _fields.end() )
+    throw DataException( "EventFile: requested variable " + field + " does not exist in file" );
+
+  return _chunkData[ chunk ] + ( pos - _fields.begin() ) * _chunkSizes[ chunk ];
+}
+
+
+const Dataset EventFile::dataset() const
+{
+  Dataset data;
+
+  for ( std::size_t chunk = 0; chunk < _chunkSizes.size(); ++chunk )
+    for ( std::size_t field = 0; field < _fields.size(); ++field )
+      data.push( _fields[ field ], _chunkData[ chunk ] + field * _chunkSizes[ chunk ], _chunkSizes[ chunk ] );
+
+  return data;
+}
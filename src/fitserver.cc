@@ -0,0 +1,400 @@
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <Minuit/MnMigrad.h>
+#include <Minuit/MinuitParameter.h>
+
+#include <cfit/fitserver.hh>
+#include <cfit/dataset.hh>
+#include <cfit/random.hh>
+
+
+// Auxiliary function to fill the address of a Unix-domain socket.
+static const sockaddr_un address( const std::string& path ) throw( MinimizerException )
+{
+  sockaddr_un addr;
+  std::memset( &addr, 0, sizeof( addr ) );
+
+  if ( path.size() >= sizeof( addr.sun_path ) )
+    throw MinimizerException( "FitServer: socket path " + path + " is too long." );
+
+  addr.sun_family = AF_UNIX;
+  std::strncpy( addr.sun_path, path.c_str(), sizeof( addr.sun_path ) - 1 );
+
+  return addr;
+}
+
+
+// Auxiliary function to write a whole string to a socket.
+static const bool sendMessage( const int& socket, const std::string& message )
+{
+  std::size_t sent = 0;
+  while ( sent < message.size() )
+  {
+    const ssize_t n = ::send( socket, message.c_str() + sent, message.size() - sent, MSG_NOSIGNAL );
+    if ( n < 0 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      return false;
+
+    sent += n;
+  }
+
+  return true;
+}
+
+
+// Auxiliary function to remove the file at a socket path, only if it is a socket.
+static void removeSocket( const std::string& path )
+{
+  struct stat status;
+  if ( lstat( path.c_str(), &status ) == 0 && S_ISSOCK( status.st_mode ) )
+    unlink( path.c_str() );
+}
+
+
+// Auxiliary function to read a line from a socket. Characters read past the
+//    end of the line are kept in the buffer for the next call. Lines longer
+//    than maxLine fail as if the connection had been closed.
+static const std::size_t maxLine = 65536;
+
+static const bool receiveLine( const int& socket, std::string& buffer, std::string& line )
+{
+  char chunk[ 4096 ];
+
+  std::size_t end;
+  while ( ( end = buffer.find( '\n' ) ) == std::string::npos )
+  {
+    if ( buffer.size() > maxLine )
+      return false;
+
+    const ssize_t n = ::recv( socket, chunk, sizeof( chunk ), 0 );
+    if ( n < 0 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      return false;
+
+    buffer.append( chunk, n );
+  }
+
+  line = buffer.substr( 0, end );
+  buffer.erase( 0, end + 1 );
+
+  return true;
+}
+
+
+
+FitServer::FitServer( const Minimizer& minimizer, const std::string& path )
+  : _minimizer( minimizer.copy() ), _initial( _minimizer->pdf().getPars() ), _path( path ), _socket( -1 ), _running( false )
+{}
+
+
+FitServer::~FitServer()
+{
+  if ( _socket >= 0 )
+  {
+    close( _socket );
+    removeSocket( _path );
+  }
+
+  delete _minimizer;
+}
+
+
+
+void FitServer::run() throw( MinimizerException )
+{
+  const sockaddr_un& addr = address( _path );
+
+  _socket = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( _socket < 0 )
+    throw MinimizerException( "FitServer: cannot create socket: " + std::string( std::strerror( errno ) ) );
+
+  // Remove any stale socket left by a previous server. Any other kind of file
+  //    is kept, and makes the bind fail.
+  removeSocket( _path );
+
+  if ( bind( _socket, (const sockaddr*)( &addr ), sizeof( addr ) ) < 0 )
+    throw MinimizerException( "FitServer: cannot bind socket " + _path + ": " + std::strerror( errno ) );
+
+  if ( listen( _socket, 8 ) < 0 )
+    throw MinimizerException( "FitServer: cannot listen on socket " + _path + ": " + std::strerror( errno ) );
+
+  // Requests are served one at a time, so that they all reuse the same caches.
+  _running = true;
+  while ( _running )
+  {
+    const int connection = accept( _socket, 0, 0 );
+    if ( connection < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+      throw MinimizerException( "FitServer: cannot accept connection: " + std::string( std::strerror( errno ) ) );
+    }
+
+    serve( connection );
+    close( connection );
+  }
+
+  close( _socket );
+  removeSocket( _path );
+  _socket = -1;
+}
+
+
+
+void FitServer::serve( const int& connection )
+{
+  std::string buffer;
+  std::string line;
+
+  // A connection may send any number of requests before closing.
+  while ( _running && receiveLine( connection, buffer, line ) )
+    if ( ! sendMessage( connection, process( line ) + "end\n" ) )
+      return;
+}
+
+
+
+const std::string FitServer::process( const std::string& line )
+{
+  std::istringstream request( line );
+
+  std::string command;
+  request >> command;
+
+  try
+  {
+    if ( command == "fit"  ) return fit ( request );
+    if ( command == "scan" ) return scan( request );
+    if ( command == "toy"  ) return toy ( request );
+    if ( command == "pars" ) return pars();
+    if ( command == "quit" )
+    {
+      _running = false;
+      return "status ok\n";
+    }
+
+    return "error unknown request '" + command + "'\n";
+  }
+  catch ( std::exception& error )
+  {
+    return "error " + std::string( error.what() ) + "\n";
+  }
+}
+
+
+
+const std::map< std::string, Parameter > FitServer::parameters( std::istringstream& request ) const throw( MinimizerException )
+{
+  std::map< std::string, Parameter > pars = _initial;
+
+  std::string modifier;
+  std::string name;
+  while ( request >> modifier )
+  {
+    if ( ! ( request >> name ) )
+      throw MinimizerException( "modifier '" + modifier + "' needs a parameter name" );
+
+    if ( ! pars.count( name ) )
+      throw MinimizerException( "unknown parameter '" + name + "'" );
+
+    Parameter& par = pars[ name ];
+
+    double value;
+    double upper;
+    if      ( modifier == "fix"     ) par.fix();
+    else if ( modifier == "release" ) par.release();
+    else if ( modifier == "set"    && request >> value          ) par.setValue( value );
+    else if ( modifier == "limits" && request >> value >> upper ) par.setLimits( value, upper );
+    else
+      throw MinimizerException( "malformed modifier '" + modifier + "' of parameter '" + name + "'" );
+  }
+
+  return pars;
+}
+
+
+
+const std::string FitServer::format( const FunctionMinimum& min )
+{
+  std::ostringstream result;
+  result << std::setprecision( 12 );
+
+  result << "status " << ( min.isValid() ? "valid" : "invalid" ) << "\n";
+  result << "fval "   << min.fval() << "\n";
+  result << "edm "    << min.edm()  << "\n";
+  result << "nfcn "   << min.nfcn() << "\n";
+
+  const std::vector< MinuitParameter >& pars = min.userParameters().parameters();
+  for ( std::vector< MinuitParameter >::const_iterator par = pars.begin(); par != pars.end(); ++par )
+    result << "par " << par->name() << " " << par->value() << " " << par->error() << "\n";
+
+  return result.str();
+}
+
+
+
+const std::string FitServer::fit( std::istringstream& request ) const
+{
+  MnMigrad migrad( *_minimizer, Minimizer::userParameters( parameters( request ) ) );
+
+  return format( migrad() );
+}
+
+
+
+const std::string FitServer::scan( std::istringstream& request ) const
+{
+  std::string name;
+  double      min;
+  double      max;
+  unsigned    nPoints;
+
+  if ( ! ( request >> name >> min >> max >> nPoints ) || nPoints == 0 )
+    throw MinimizerException( "scan expects a parameter name, a range and a number of points" );
+
+  std::map< std::string, Parameter > pars = parameters( request );
+  if ( ! pars.count( name ) )
+    throw MinimizerException( "unknown parameter '" + name + "'" );
+
+  // At each point of the scan, fix the parameter and minimize with respect to the rest.
+  pars[ name ].fix();
+
+  std::ostringstream result;
+  result << std::setprecision( 12 );
+
+  for ( unsigned point = 0; point < nPoints; ++point )
+  {
+    const double value = ( nPoints == 1 ) ? min : min + ( max - min ) * point / double( nPoints - 1 );
+    pars[ name ].setValue( value );
+
+    MnMigrad migrad( *_minimizer, Minimizer::userParameters( pars ) );
+    const FunctionMinimum& minimum = migrad();
+
+    result << "point " << value << " " << minimum.fval() << " " << ( minimum.isValid() ? "valid" : "invalid" ) << "\n";
+  }
+
+  return result.str();
+}
+
+
+
+const std::string FitServer::toy( std::istringstream& request ) const
+{
+  unsigned nEvents;
+  unsigned nToys;
+  unsigned seed;
+
+  if ( ! ( request >> nEvents >> nToys ) )
+    throw MinimizerException( "toy expects a number of events and a number of toys" );
+
+  // The seed is optional.
+  const std::streampos position = request.tellg();
+  if ( request >> seed )
+    Random::setSeed( seed );
+  else
+  {
+    request.clear();
+    request.seekg( position );
+  }
+
+  const std::map< std::string, Parameter >& pars = parameters( request );
+
+  // Generate from a private copy of the pdf with the requested parameters.
+  std::unique_ptr< PdfBase > pdf( _minimizer->pdf().copy() );
+  pdf->setPars( pars );
+  pdf->cache();
+
+  std::ostringstream result;
+
+  for ( unsigned toy = 0; toy < nToys; ++toy )
+  {
+    Dataset data;
+    for ( unsigned event = 0; event < nEvents; ++event )
+      data.push( pdf->generate() );
+
+    std::unique_ptr< Minimizer > minimizer( _minimizer->rebind( data ) );
+
+    MnMigrad migrad( *minimizer, Minimizer::userParameters( pars ) );
+
+    result << "toy " << toy << "\n" << format( migrad() );
+  }
+
+  return result.str();
+}
+
+
+
+const std::string FitServer::pars() const
+{
+  std::ostringstream result;
+  result << std::setprecision( 12 );
+
+  for ( std::map< std::string, Parameter >::const_iterator par = _initial.begin(); par != _initial.end(); ++par )
+  {
+    result << "par " << par->first << " " << par->second.value() << " " << par->second.error();
+    if ( par->second.isFixed() )
+      result << " fixed";
+    if ( par->second.hasLimits() )
+      result << " limits " << par->second.lower() << " " << par->second.upper();
+    result << "\n";
+  }
+
+  return result.str();
+}
+
+
+
+FitClient::FitClient( const std::string& path ) throw( MinimizerException )
+{
+  const sockaddr_un& addr = address( path );
+
+  _socket = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( _socket < 0 )
+    throw MinimizerException( "FitClient: cannot create socket: " + std::string( std::strerror( errno ) ) );
+
+  if ( connect( _socket, (const sockaddr*)( &addr ), sizeof( addr ) ) < 0 )
+  {
+    close( _socket );
+    throw MinimizerException( "FitClient: cannot connect to " + path + ": " + std::strerror( errno ) );
+  }
+}
+
+
+FitClient::~FitClient()
+{
+  close( _socket );
+}
+
+
+const std::vector< std::string > FitClient::request( const std::string& line ) throw( MinimizerException )
+{
+  if ( line.find( '\n' ) != std::string::npos )
+    throw MinimizerException( "FitClient: requests must fit in a single line." );
+
+  if ( ! sendMessage( _socket, line + "\n" ) )
+    throw MinimizerException( "FitClient: cannot send request." );
+
+  std::vector< std::string > response;
+  std::string                received;
+  while ( receiveLine( _socket, _buffer, received ) )
+  {
+    if ( received == "end" )
+      return response;
+
+    response.push_back( received );
+  }
+
+  throw MinimizerException( "FitClient: connection closed before the end of the response." );
+}
@@ -0,0 +1,314 @@
+
+#include <cmath>
+#include <iostream>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include <Minuit/FCNGradientBase.h>
+#include <Minuit/MinuitParameter.h>
+#include <Minuit/MnHesse.h>
+#include <Minuit/MnMigrad.h>
+#include <Minuit/MnStrategy.h>
+
+#include <cfit/lbfgs.hh>
+
+
+// Auxiliary function to compute the scalar product of two vectors.
+static const double dot( const std::vector< double >& left, const std::vector< double >& right )
+{
+  return std::inner_product( left.begin(), left.end(), right.begin(), 0.0 );
+}
+
+
+
+const MnUserParameterState LbfgsMinimum::hesse( const FCNBase& fcn ) const
+{
+  MnHesse hesse;
+
+  return hesse( fcn, _pars );
+}
+
+
+
+FunctionMinimum LbfgsMinimum::migrad( const FCNBase& fcn ) const
+{
+  // Starting at the minimum with the Hesse covariance, Migrad converges right away.
+  MnMigrad migrad( fcn, hesse( fcn ), MnStrategy( 1 ) );
+
+  return migrad();
+}
+
+
+
+void Lbfgs::project( std::vector< double >& x, const std::vector< double >& lower, const std::vector< double >& upper )
+{
+  for ( std::size_t par = 0; par < x.size(); ++par )
+    x[ par ] = std::min( std::max( x[ par ], lower[ par ] ), upper[ par ] );
+}
+
+
+
+void Lbfgs::gradient( const FCNBase&                 fcn  ,
+                      const std::vector< double >&   x    ,
+                      const std::vector< unsigned >& free ,
+                      const std::vector< double >&   steps,
+                      const std::vector< double >&   lower,
+                      const std::vector< double >&   upper,
+                      std::vector< double >&         grad ,
+                      unsigned&                      nfcn  )
+{
+  grad.assign( x.size(), 0.0 );
+
+  // Use the analytical gradient if the function provides one.
+  const FCNGradientBase* analytical = dynamic_cast< const FCNGradientBase* >( &fcn );
+  if ( analytical )
+  {
+    const std::vector< double >& fullGrad = analytical->gradient( x );
+    for ( std::vector< unsigned >::const_iterator par = free.begin(); par != free.end(); ++par )
+      grad[ *par ] = fullGrad[ *par ];
+    ++nfcn;
+    return;
+  }
+
+  // Central differences, falling back to one-sided ones next to a limit.
+  std::vector< double > shifted( x );
+  for ( std::vector< unsigned >::const_iterator par = free.begin(); par != free.end(); ++par )
+  {
+    const double& value = x[ *par ];
+
+    const double high = std::min( value + steps[ *par ], upper[ *par ] );
+    const double low  = std::max( value - steps[ *par ], lower[ *par ] );
+
+    shifted[ *par ] = high;
+    const double fHigh = fcn( shifted );
+    shifted[ *par ] = low;
+    const double fLow  = fcn( shifted );
+    shifted[ *par ] = value;
+
+    nfcn += 2;
+
+    if ( high > low )
+      grad[ *par ] = ( fHigh - fLow ) / ( high - low );
+  }
+}
+
+
+
+const LbfgsMinimum Lbfgs::minimize( const FCNBase& fcn, const MnUserParameters& upar, const bool& verbose ) const throw( MinimizerException )
+{
+  const std::vector< MinuitParameter >& pars = upar.parameters();
+  const std::size_t nPars = pars.size();
+
+  const double infinity = std::numeric_limits< double >::infinity();
+
+  // Starting point, boxes, and diagonal guess of the inverse Hessian from the
+  //    parameter errors. Fixed parameters have an empty box.
+  std::vector< double   > x    ( nPars );
+  std::vector< double   > lower( nPars );
+  std::vector< double   > upper( nPars );
+  std::vector< double   > steps( nPars );
+  std::vector< double   > diag ( nPars, 0.0 );
+  std::vector< unsigned > free;
+
+  const double up = fcn.up();
+
+  for ( unsigned par = 0; par < nPars; ++par )
+  {
+    const MinuitParameter& param = pars[ par ];
+
+    x[ par ] = param.value();
+
+    if ( param.isFixed() || param.isConst() )
+    {
+      lower[ par ] = upper[ par ] = x[ par ];
+      continue;
+    }
+
+    free.push_back( par );
+
+    lower[ par ] = param.hasLowerLimit() ? param.lowerLimit() : - infinity;
+    upper[ par ] = param.hasUpperLimit() ? param.upperLimit() :   infinity;
+
+    const double& error = param.error();
+    steps[ par ] = ( error > 0.0 ) ? std::max( 1.0e-3 * error, 1.0e-8 * ( 1.0 + std::fabs( x[ par ] ) ) )
+                                   : 1.0e-4 * ( 1.0 + std::fabs( x[ par ] ) );
+
+    // If f changes by up when moving one error away, the curvature is 2 up / error^2.
+    diag[ par ] = ( error > 0.0 ) ? error * error / ( 2.0 * up ) : 1.0;
+  }
+
+  if ( free.empty() )
+    throw MinimizerException( "Lbfgs: there are no floating parameters to minimize." );
+
+  project( x, lower, upper );
+
+  LbfgsMinimum min( upar );
+
+  const unsigned nFree    = free.size();
+  const unsigned maxCalls = _maxCalls ? _maxCalls : 200 + 100 * nFree + 5 * nFree * nFree;
+  const double   maxEdm   = 0.002 * _tolerance * up;
+
+  unsigned nfcn = 0;
+
+  double f = fcn( x );
+  ++nfcn;
+
+  std::vector< double > g;
+  gradient( fcn, x, free, steps, lower, upper, g, nfcn );
+
+  // History of the position and gradient changes of the last iterations.
+  std::deque< std::vector< double > > sHist;
+  std::deque< std::vector< double > > yHist;
+  std::deque< double                > rHist;
+
+  std::vector< double > q    ( nPars );
+  std::vector< double > d    ( nPars );
+  std::vector< double > xNew ( nPars );
+  std::vector< double > gNew ( nPars );
+  std::vector< double > alpha;
+
+  unsigned iter = 0;
+  while ( nfcn < maxCalls )
+  {
+    // Parameters at a limit with the gradient pointing outwards are kept there.
+    q = g;
+    for ( std::vector< unsigned >::const_iterator par = free.begin(); par != free.end(); ++par )
+      if ( ( x[ *par ] <= lower[ *par ] && g[ *par ] > 0.0 ) ||
+           ( x[ *par ] >= upper[ *par ] && g[ *par ] < 0.0 ) )
+        q[ *par ] = 0.0;
+
+    // Two-loop recursion for the product of the inverse Hessian estimate with the gradient.
+    const std::vector< double > active( q );
+    const std::size_t nHist = sHist.size();
+    alpha.assign( nHist, 0.0 );
+    for ( std::size_t hist = nHist; hist-- > 0; )
+    {
+      alpha[ hist ] = rHist[ hist ] * dot( sHist[ hist ], q );
+      for ( std::size_t par = 0; par < nPars; ++par )
+        q[ par ] -= alpha[ hist ] * yHist[ hist ][ par ];
+    }
+
+    if ( nHist )
+    {
+      const double gamma = dot( sHist.back(), yHist.back() ) / dot( yHist.back(), yHist.back() );
+      for ( std::size_t par = 0; par < nPars; ++par )
+        q[ par ] *= gamma;
+    }
+    else
+      for ( std::size_t par = 0; par < nPars; ++par )
+        q[ par ] *= diag[ par ];
+
+    for ( std::size_t hist = 0; hist < nHist; ++hist )
+    {
+      const double beta = rHist[ hist ] * dot( yHist[ hist ], q );
+      for ( std::size_t par = 0; par < nPars; ++par )
+        q[ par ] += sHist[ hist ][ par ] * ( alpha[ hist ] - beta );
+    }
+
+    for ( std::size_t par = 0; par < nPars; ++par )
+      d[ par ] = ( active[ par ] == 0.0 ) ? 0.0 : - q[ par ];
+
+    // If the estimate does not give a descent direction, forget the history.
+    double slope = dot( g, d );
+    if ( slope >= 0.0 )
+    {
+      sHist.clear();
+      yHist.clear();
+      rHist.clear();
+
+      for ( std::size_t par = 0; par < nPars; ++par )
+        d[ par ] = - diag[ par ] * active[ par ];
+      slope = dot( g, d );
+    }
+
+    // Estimated distance to the minimum, as Migrad's EDM.
+    min._edm = - 0.5 * slope;
+    if ( min._edm < maxEdm )
+    {
+      min._isValid = true;
+      break;
+    }
+
+    // Backtracking line search along the projected path, with Armijo's condition.
+    double step     = 1.0;
+    double fNew     = f;
+    bool   accepted = false;
+    for ( unsigned trial = 0; trial < 30 && nfcn < maxCalls; ++trial, step *= 0.5 )
+    {
+      for ( std::size_t par = 0; par < nPars; ++par )
+        xNew[ par ] = x[ par ] + step * d[ par ];
+      project( xNew, lower, upper );
+
+      fNew = fcn( xNew );
+      ++nfcn;
+
+      double decrease = 0.0;
+      for ( std::size_t par = 0; par < nPars; ++par )
+        decrease += g[ par ] * ( xNew[ par ] - x[ par ] );
+
+      if ( fNew <= f + 1.0e-4 * decrease )
+      {
+        accepted = true;
+        break;
+      }
+    }
+
+    if ( ! accepted )
+    {
+      // Without history the direction is already the scaled gradient, so
+      //    there is nothing left to try.
+      if ( sHist.empty() )
+        break;
+
+      sHist.clear();
+      yHist.clear();
+      rHist.clear();
+      continue;
+    }
+
+    gradient( fcn, xNew, free, steps, lower, upper, gNew, nfcn );
+
+    std::vector< double > s( nPars );
+    std::vector< double > y( nPars );
+    for ( std::size_t par = 0; par < nPars; ++par )
+    {
+      s[ par ] = xNew[ par ] - x[ par ];
+      y[ par ] = gNew[ par ] - g[ par ];
+    }
+
+    // Keep the pair only if the curvature condition holds.
+    const double sy = dot( s, y );
+    if ( sy > std::numeric_limits< double >::epsilon() * std::sqrt( dot( s, s ) * dot( y, y ) ) )
+    {
+      sHist.push_back( s );
+      yHist.push_back( y );
+      rHist.push_back( 1.0 / sy );
+
+      if ( sHist.size() > _memory )
+      {
+        sHist.pop_front();
+        yHist.pop_front();
+        rHist.pop_front();
+      }
+    }
+
+    x.swap( xNew );
+    g.swap( gNew );
+    f = fNew;
+    ++iter;
+  }
+
+  for ( std::vector< unsigned >::const_iterator par = free.begin(); par != free.end(); ++par )
+    min._pars.setValue( *par, x[ *par ] );
+
+  min._fval  = f;
+  min._nfcn  = nfcn;
+  min._nIter = iter;
+
+  if ( verbose )
+    std::cout << "Lbfgs: " << min._nfcn << " calls, fval = " << min._fval << ", edm = " << min._edm << std::endl;
+
+  return min;
+}
@@ -1,25 +1,227 @@
 
+#include <iostream>
 #include <vector>
+#include <memory>
+#include <limits>
+#include <numeric>
+#include <algorithm>
 
 #include <Minuit/MnMigrad.h>
+#include <Minuit/MnStrategy.h>
+#include <Minuit/MnUserParameterState.h>
 
 #include <cfit/minimizer.hh>
+#include <cfit/multistart.hh>
+#include <cfit/progressive.hh>
+#include <cfit/checkpoint.hh>
+#include <cfit/lbfgs.hh>
+#include <cfit/random.hh>
+#include <cfit/threads.hh>
 #include <cfit/variable.hh>
 #include <cfit/parameter.hh>
 
 
-void Minimizer::cache()
+Minimizer::Minimizer( const PdfBase& pdf, const Dataset& data, const Checkpoint& checkpoint )
+  : _pdf    ( pdf.copy()                                ),
+    _data   ( place( data )                             ),
+    _up     ( -1.0                                      ),
+    _verbose( false                                     ),
+    _scale  ( 1.0                                       )
 {
-  const std::map< unsigned, std::vector< double >                 >& cachedR = _pdf->cacheReal   ( _data );
-  const std::map< unsigned, std::vector< std::complex< double > > >& cachedC = _pdf->cacheComplex( _data );
+  if ( checkpoint.cacheExists() )
+    restore( checkpoint );
+  else
+  {
+    // The checkpoint persists all the caches, so they are all materialized.
+    cache( std::numeric_limits< std::size_t >::max() );
+    checkpoint.saveCache( *_cacheR, *_cacheC,
+                          _firstCacheR, PdfBase::_cacheIdxReal    - _firstCacheR,
+                          _firstCacheC, PdfBase::_cacheIdxComplex - _firstCacheC,
+                          _data->size(), Checkpoint::hash( _pdf->varNames(), *_data ) );
+  }
+}
+
+
 
-  _cacheR.insert( cachedR.begin(), cachedR.end() );
-  _cacheC.insert( cachedC.begin(), cachedC.end() );
+void Minimizer::cache( const std::size_t& budget )
+{
+  _firstCacheR = PdfBase::_cacheIdxReal;
+  _firstCacheC = PdfBase::_cacheIdxComplex;
+
+  std::map< unsigned, std::vector< double >                 > cacheR;
+  std::map< unsigned, std::vector< std::complex< double > > > cacheC;
+
+  _caches = std::make_shared< CacheManager >( *_pdf, *_data, cacheR, cacheC, budget );
+  _cacheR = std::make_shared< std::map< unsigned, std::vector< double >                 > >( std::move( cacheR ) );
+  _cacheC = std::make_shared< std::map< unsigned, std::vector< std::complex< double > > > >( std::move( cacheC ) );
 }
 
 
 
-FunctionMinimum Minimizer::minimize() const
+void Minimizer::restore( const Checkpoint& checkpoint )
+{
+  _firstCacheR = PdfBase::_cacheIdxReal;
+  _firstCacheC = PdfBase::_cacheIdxComplex;
+
+  // Caching an empty dataset assigns the cache indices of the pdf in the same
+  //    order as the original process did, without computing anything.
+  const Dataset empty;
+  _pdf->cacheReal   ( empty );
+  _pdf->cacheComplex( empty );
+
+  std::map< unsigned, std::vector< double >                 > cacheR;
+  std::map< unsigned, std::vector< std::complex< double > > > cacheC;
+
+  checkpoint.loadCache( cacheR, cacheC,
+                        _firstCacheR, PdfBase::_cacheIdxReal    - _firstCacheR,
+                        _firstCacheC, PdfBase::_cacheIdxComplex - _firstCacheC,
+                        _data->size(), Checkpoint::hash( _pdf->varNames(), *_data ) );
+
+  _cacheR = std::make_shared< std::map< unsigned, std::vector< double >                 > >( cacheR );
+  _cacheC = std::make_shared< std::map< unsigned, std::vector< std::complex< double > > > >( cacheC );
+  _caches = std::make_shared< CacheManager >();
+}
+
+
+
+const std::shared_ptr< Dataset > Minimizer::place( const Dataset& data )
+{
+  std::shared_ptr< Dataset > placed = std::make_shared< Dataset >( data );
+
+  if ( Threads::pinning() )
+    placed->distribute();
+
+  return placed;
+}
+
+
+
+template< class T >
+const std::map< unsigned, std::vector< T > > Minimizer::subset( const std::map< unsigned, std::vector< T > >& cache ,
+                                                                const std::vector< std::size_t >&             events )
+{
+  std::map< unsigned, std::vector< T > > subset;
+
+  typedef typename std::map< unsigned, std::vector< T > >::const_iterator cIter;
+  for ( cIter cached = cache.begin(); cached != cache.end(); ++cached )
+  {
+    std::vector< T >& values = subset[ cached->first ];
+    values.reserve( events.size() );
+
+    for ( std::vector< std::size_t >::const_iterator event = events.begin(); event != events.end(); ++event )
+      values.push_back( cached->second[ *event ] );
+  }
+
+  return subset;
+}
+
+
+
+Minimizer* Minimizer::subsample( const std::vector< std::size_t >& events ) const
+{
+  // The cached values do not need to be recomputed, just selected.
+  Minimizer* sub = copy();
+
+  sub->_data   = place( _data->subset( events ) );
+  sub->_cacheR = std::make_shared< std::map< unsigned, std::vector< double >                 > >( subset( *_cacheR, events ) );
+  sub->_cacheC = std::make_shared< std::map< unsigned, std::vector< std::complex< double > > > >( subset( *_cacheC, events ) );
+  sub->_caches = _caches->subset( events );
+  sub->_scale  = _scale * double( _data->size() ) / double( std::max< std::size_t >( events.size(), 1 ) );
+  sub->dataChanged();
+
+  return sub;
+}
+
+
+
+Minimizer* Minimizer::rebind( const Dataset& data ) const
+{
+  Minimizer* bound = copy();
+
+  bound->_data  = place( data );
+  bound->_scale = 1.0;
+  bound->cache();
+  bound->dataChanged();
+
+  return bound;
+}
+
+
+
+// What the copies of the minimizer share is copied before growing it, so that
+//    they keep the previous events. The new events are not distributed over the
+//    NUMA nodes, since that would copy all the events again; rebind does it.
+void Minimizer::append( const Dataset& events ) throw( PdfException, DataException )
+{
+  if ( ! events.size() )
+    return;
+
+  if ( _data->size() && ( _data->fields() != events.fields() ) )
+    throw DataException( "Minimizer::append: the events do not have the fields of the dataset." );
+
+  std::map< unsigned, std::vector< double >                 > newR;
+  std::map< unsigned, std::vector< std::complex< double > > > newC;
+
+  if ( _caches->columns().empty() )
+  {
+    // Without a plan, e.g. with the caches restored from a checkpoint, caching
+    //    the new events assigns the pdf the same indices as the original
+    //    caching did.
+    const unsigned lastR = PdfBase::_cacheIdxReal;
+    const unsigned lastC = PdfBase::_cacheIdxComplex;
+
+    PdfBase::_cacheIdxReal    = _firstCacheR;
+    PdfBase::_cacheIdxComplex = _firstCacheC;
+
+    newR = _pdf->cacheReal   ( events );
+    newC = _pdf->cacheComplex( events );
+
+    PdfBase::_cacheIdxReal    = std::max( lastR, PdfBase::_cacheIdxReal    );
+    PdfBase::_cacheIdxComplex = std::max( lastC, PdfBase::_cacheIdxComplex );
+
+    if ( ( newR.size() != _cacheR->size() ) || ( newC.size() != _cacheC->size() ) )
+      throw PdfException( "Minimizer::append: the pdf does not cache the same expressions as before. Use rebind instead." );
+  }
+  else
+  {
+    if ( _caches.use_count() > 1 )
+      _caches = _caches->copy();
+
+    _caches->append( *_pdf, events, newR, newC );
+  }
+
+  if ( _data.use_count() > 1 )
+    _data = std::make_shared< Dataset >( *_data );
+
+  if ( _cacheR.use_count() > 1 )
+    _cacheR = std::make_shared< std::map< unsigned, std::vector< double >                 > >( *_cacheR );
+
+  if ( _cacheC.use_count() > 1 )
+    _cacheC = std::make_shared< std::map< unsigned, std::vector< std::complex< double > > > >( *_cacheC );
+
+  _data->append( events );
+
+  typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+  typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+  for ( mrIter cached = newR.begin(); cached != newR.end(); ++cached )
+  {
+    std::vector< double >& values = ( *_cacheR )[ cached->first ];
+    values.insert( values.end(), cached->second.begin(), cached->second.end() );
+  }
+
+  for ( mcIter cached = newC.begin(); cached != newC.end(); ++cached )
+  {
+    std::vector< std::complex< double > >& values = ( *_cacheC )[ cached->first ];
+    values.insert( values.end(), cached->second.begin(), cached->second.end() );
+  }
+
+  dataChanged();
+}
+
+
+
+MnUserParameters Minimizer::userParameters( const std::map< std::string, Parameter >& pars )
 {
   // Work with Minuit user defined parameters.
   MnUserParameters upar;
@@ -27,7 +229,6 @@ FunctionMinimum Minimizer::minimize() const
   typedef std::map< std::string, Parameter >::const_iterator pIter;
 
   // Set the Minuit parameters' name, value and uncertainty.
-  const std::map< std::string, Parameter >& pars = _pdf->getPars();
 
   for ( pIter par = pars.begin(); par != pars.end(); ++par )
   {
@@ -46,7 +247,67 @@ FunctionMinimum Minimizer::minimize() const
       upar.setLimits( par->first.c_str(), par->second.lower(), par->second.upper() );
   }
 
-  MnMigrad migrad( *this, upar );
+  return upar;
+}
+
+
+
+FunctionMinimum Minimizer::minimize() const
+{
+  MnMigrad migrad( *this, userParameters( _pdf->getPars() ) );
+
+  return migrad();
+}
+
+
+
+FunctionMinimum Minimizer::minimize( const FunctionMinimum& previous ) const
+{
+  MnMigrad migrad( *this, previous.userState(), MnStrategy( 1 ) );
+
+  return migrad();
+}
+
+
+
+const std::vector< FunctionMinimum > Minimizer::minimize( const MultiStart& multiStart ) const
+{
+  return multiStart.minimize( *this, _pdf->getPars() );
+}
+
+
+
+FunctionMinimum Minimizer::minimize( const Progressive& progressive ) const
+{
+  // Draw a single permutation of the events, so that the subsample of each
+  //    stage contains the one of the previous stage.
+  std::vector< std::size_t > events( _data->size() );
+  std::iota( events.begin(), events.end(), 0 );
+  std::shuffle( events.begin(), events.end(), Random::engine() );
+
+  MnUserParameterState state( userParameters( _pdf->getPars() ) );
+
+  for ( std::size_t stage = 0; stage < progressive.nStages(); ++stage )
+  {
+    const std::size_t nEvents = std::max< std::size_t >( 1, progressive.fraction( stage ) * events.size() );
+
+    // Keep the selected events in their original order, for memory locality.
+    std::vector< std::size_t > selected( events.begin(), events.begin() + std::min( nEvents, events.size() ) );
+    std::sort( selected.begin(), selected.end() );
+
+    std::unique_ptr< Minimizer > coarse( subsample( selected ) );
+    coarse->_pdf->setNormBins( progressive.normBins( stage ) );
+
+    if ( _verbose )
+      std::cout << "Progressive minimization: stage " << stage << " with " << selected.size()
+                << " events and " << progressive.normBins( stage ) << " norm bins." << std::endl;
+
+    // Warm start each stage from the parameters and covariance of the previous one.
+    MnMigrad migrad( *coarse, state, MnStrategy( 1 ) );
+    state = migrad( 0, progressive.tolerance() ).userState();
+  }
+
+  MnMigrad migrad( *this, state, MnStrategy( 1 ) );
 
   return migrad();
 }
@@ -60,3 +321,44 @@ double Minimizer::up() const throw( MinimizerException )
   return _up;
 }
 
+
+
+
+FunctionMinimum Minimizer::minimize( const Checkpoint& checkpoint ) const
+{
+  unsigned nCalls = 0;
+  double   fval   = 0.0;
+  double   edm    = 0.0;
+
+  MnUserParameterState state = checkpoint.exists() ? checkpoint.load( nCalls, fval, edm )
+                                                   : MnUserParameterState( userParameters( _pdf->getPars() ) );
+
+  if ( _verbose && nCalls )
+    std::cout << "Checkpoint: resuming after " << nCalls << " calls, fval = " << fval << ", edm = " << edm << std::endl;
+
+  // Run Migrad in segments of the given number of calls. Each segment starts
+  //    from the parameters and covariance estimate of the previous one.
+  while ( true )
+  {
+    MnMigrad migrad( *this, state, MnStrategy( 1 ) );
+    const FunctionMinimum& min = migrad( checkpoint.calls() );
+
+    nCalls += min.nfcn();
+    state   = min.userState();
+
+    checkpoint.save( state, nCalls );
+
+    if ( _verbose )
+      std::cout << "Checkpoint: " << nCalls << " calls, fval = " << min.fval() << ", edm = " << min.edm() << std::endl;
+
+    if ( ! min.hasReachedCallLimit() )
+      return min;
+  }
+}
+
+
+
+const LbfgsMinimum Minimizer::minimize( const Lbfgs& lbfgs ) const
+{
+  return lbfgs.minimize( *this, userParameters( _pdf->getPars() ), _verbose );
+}
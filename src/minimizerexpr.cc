@@ -2,11 +2,25 @@
 #include <iostream>
 
 #include <algorithm>
+#include <functional>
 
 #include <Minuit/MnMigrad.h>
+#include <Minuit/MnStrategy.h>
 
 #include <cfit/functors.hh>
 #include <cfit/minimizerexpr.hh>
+#include <cfit/multistart.hh>
+#include <cfit/lbfgs.hh>
+
+
+MinimizerExpr::MinimizerExpr( const MinimizerExpr& right )
+  : _up     ( right._up      ),
+    _verbose( right._verbose ),
+    _parMap ( right._parMap  )
+{
+  std::transform( right._minimizers.begin(), right._minimizers.end(), std::back_inserter( _minimizers ),
+                  std::mem_fn( &Minimizer::copy ) );
+}
 
 
 double MinimizerExpr::up() const throw( MinimizerException )
@@ -18,6 +32,15 @@ double MinimizerExpr::up() const throw( MinimizerException )
 }
 
 
+void MinimizerExpr::append( const std::size_t& term, const Dataset& events ) throw( MinimizerException, PdfException, DataException )
+{
+  if ( term >= _minimizers.size() )
+    throw MinimizerException( "The minimizer expression does not have the requested term." );
+
+  _minimizers[ term ]->append( events );
+}
+
+
 double MinimizerExpr::operator()( const std::vector< double >& pars ) const throw( PdfException )
 {
   if ( _minimizers.empty() )
@@ -36,7 +59,7 @@ double MinimizerExpr::operator()( const std::vector< double >& pars ) const thro
     parMap[ par->first ].setValue( pars[ index++ ] );
 
   // Set each minimizer's parameter vector from the just set local values of the parameters.
-  typedef std::vector< const Minimizer* >::const_iterator mIter;
+  typedef std::vector< Minimizer* >::const_iterator mIter;
   double total = 0.;
   for ( mIter mmzr = _minimizers.begin(); mmzr != _minimizers.end(); ++mmzr )
   {
@@ -58,32 +81,43 @@ double MinimizerExpr::operator()( const std::vector< double >& pars ) const thro
 
 FunctionMinimum MinimizerExpr::minimize() const
 {
-  // Work with Minuit user defined parameters.
-  MnUserParameters upar;
+  MnMigrad migrad( *this, Minimizer::userParameters( _parMap ) );
 
-  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  return migrad();
+}
 
-  // Set the Minuit parameters' name, value and uncertainty.
-  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
-  {
-    upar.add( par->first.c_str(), par->second.value(), par->second.error() );
 
-    // Fix the parameters that are set to be fixed.
-    if ( par->second.isFixed() )
-      upar.fix( par->first.c_str() );
 
-    // Set the blinding if requested.
-    if ( par->second.isBlind() )
-      upar.blind( par->first.c_str() );
+const std::vector< FunctionMinimum > MinimizerExpr::minimize( const MultiStart& multiStart ) const
+{
+  return multiStart.minimize( *this, _parMap );
+}
 
-    // Set the limits for those parameters that have some.
-    if ( par->second.hasLimits() )
-      upar.setLimits( par->first.c_str(), par->second.lower(), par->second.upper() );
-  }
 
-  MnMigrad migrad( *this, upar );
 
-  return migrad();
+const LbfgsMinimum MinimizerExpr::minimize( const Lbfgs& lbfgs ) const
+{
+  return lbfgs.minimize( *this, Minimizer::userParameters( _parMap ), _verbose );
+}
+
+
+
+MinimizerExpr& MinimizerExpr::operator=( const MinimizerExpr& right )
+{
+  if ( this == &right )
+    return *this;
+
+  // Deallocate currently owned pointers to minimizers and current _parMap.
+  clear();
+
+  _up      = right._up;
+  _verbose = right._verbose;
+  _parMap  = right._parMap;
+
+  std::transform( right._minimizers.begin(), right._minimizers.end(), std::back_inserter( _minimizers ),
+                  std::mem_fn( &Minimizer::copy ) );
+
+  return *this;
 }
 
 
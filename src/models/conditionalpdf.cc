@@ -0,0 +1,267 @@
+#include <map>
+#include <vector>
+#include <string>
+#include <iterator>
+#include <algorithm>
+
+#include <cfit/dataset.hh>
+#include <cfit/threads.hh>
+#include <cfit/models/conditionalpdf.hh>
+
+
+thread_local ConditionalPdf::Copies ConditionalPdf::_copies;
+std::atomic< unsigned long >        ConditionalPdf::_versions( 0 );
+
+
+ConditionalPdf::ConditionalPdf( const PdfModel& pdf, const Variable& cond, const Parameter& target,
+                                const double& lower, const double& upper ) throw( PdfException )
+  : _pdf( pdf.copy() ), _lower( lower ), _upper( upper ), _obsIdx( 0 ), _doCache( false ), _cacheIdx( 0 ),
+    _version( ++_versions )
+{
+  if ( pdf.nVars() != 1 )
+    throw PdfException( "ConditionalPdf: the wrapped pdf must depend on a single observable." );
+
+  if ( upper <= lower )
+    throw PdfException( "ConditionalPdf: the upper limit of the observable must be larger than the lower one." );
+
+  push( pdf.getVars().begin()->second );
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pdf.getPars().begin(); par != pdf.getPars().end(); ++par )
+    push( par->second );
+
+  bind( cond, target );
+}
+
+
+ConditionalPdf::ConditionalPdf( const ConditionalPdf& right )
+  : PdfModel( right ), _pdf( right._pdf->copy() ), _lower( right._lower ), _upper( right._upper ),
+    _conds( right._conds ), _targets( right._targets ), _refs( right._refs ),
+    _condIdx( right._condIdx ), _obsIdx( right._obsIdx ),
+    _doCache( right._doCache ), _cacheIdx( right._cacheIdx ), _groups( right._groups ),
+    _norms( right._norms ), _shape( right._shape ), _version( right._version )
+{}
+
+
+// Copies held by other threads are dropped when those threads end.
+ConditionalPdf::~ConditionalPdf()
+{
+  _copies.erase( this );
+  delete _pdf;
+}
+
+
+ConditionalPdf* ConditionalPdf::copy() const
+{
+  return new ConditionalPdf( *this );
+}
+
+
+void ConditionalPdf::addCondition( const Variable& cond, const Parameter& target ) throw( PdfException )
+{
+  bind( cond, target );
+}
+
+
+// The target is no longer a parameter of the model, and the conditioning
+//    variable becomes one of its variables.
+void ConditionalPdf::bind( const Variable& cond, const Parameter& target ) throw( PdfException )
+{
+  if ( ! _parMap.count( target.name() ) )
+    throw PdfException( "ConditionalPdf: \"" + target.name() + "\" is not a free parameter of the wrapped pdf." );
+
+  push( cond );
+
+  _conds  .push_back( cond.name()                                        );
+  _targets.push_back( target.name()                                      );
+  _refs   .push_back( _pdf->getPars().find( target.name() )->second.value() );
+
+  _parMap.erase( target.name() );
+  _parOrder.erase( std::remove( _parOrder.begin(), _parOrder.end(), target.name() ), _parOrder.end() );
+
+  setIndices();
+
+  // Force the norms to be computed again.
+  _shape.clear();
+  cache();
+}
+
+
+// The variables are passed to evaluate sorted alphabetically by name.
+void ConditionalPdf::setIndices()
+{
+  _obsIdx = std::distance( _varMap.begin(), _varMap.find( getVar( 0 ).name() ) );
+
+  _condIdx.clear();
+  typedef std::vector< std::string >::const_iterator cIter;
+  for ( cIter cond = _conds.begin(); cond != _conds.end(); ++cond )
+    _condIdx.push_back( std::distance( _varMap.begin(), _varMap.find( *cond ) ) );
+}
+
+
+void ConditionalPdf::setParExpr()
+{
+  _pdf->setPars( _parMap );
+  _version = ++_versions;
+}
+
+
+// The wrapped pdf only normalizes itself in its cache function. Caching it
+//    with the targets at fixed reference values keeps its norm constant for
+//    given shape parameters, so the areas at every conditioning value are
+//    consistent with each other and can be kept until the shape changes.
+void ConditionalPdf::cache()
+{
+  std::vector< double > shape;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
+    shape.push_back( par->second.value() );
+
+  if ( shape == _shape )
+    return;
+
+  _shape = shape;
+
+  for ( std::size_t cond = 0; cond < _targets.size(); ++cond )
+    _pdf->setPar( _targets[ cond ], _refs[ cond ] );
+  _pdf->setParExpr();
+
+  _pdf->cache();
+  _version = ++_versions;
+
+  normalize( 0 );
+}
+
+
+void ConditionalPdf::normalize( const unsigned& first )
+{
+  std::vector< const std::vector< double >* > values( _groups.size() - first );
+
+  typedef std::map< std::vector< double >, unsigned >::const_iterator gIter;
+  for ( gIter group = _groups.begin(); group != _groups.end(); ++group )
+    if ( group->second >= first )
+      values[ group->second - first ] = &group->first;
+
+  std::vector< double > norms( values.size() );
+  Threads::fill( norms, [ this, &values ]( const std::size_t& index )
+  {
+    return this->group( *values[ index ] ).area( _lower, _upper );
+  } );
+
+  _norms.resize( first );
+  _norms.insert( _norms.end(), norms.begin(), norms.end() );
+}
+
+
+// Assign the same index to all the events with the same conditioning values.
+const std::map< unsigned, std::vector< double > > ConditionalPdf::cacheReal( const Dataset& data )
+{
+  std::map< unsigned, std::vector< double > > cached;
+
+  _doCache  = true;
+  _cacheIdx = assignCacheIdxReal();
+
+  std::vector< double >& groups = cached[ _cacheIdx ];
+
+  const std::size_t& size = data.size();
+  if ( ! size )
+    return cached;
+
+  const unsigned known = _groups.size();
+
+  // Look the columns up once. The groups are numbered in order of appearance,
+  //    so the events are visited sequentially.
+  std::vector< const std::vector< std::pair< double, double > >* > columns;
+  for ( std::size_t cond = 0; cond < _conds.size(); ++cond )
+    columns.push_back( &data.column( _conds[ cond ] ) );
+
+  std::vector< double > values( _conds.size() );
+
+  groups.reserve( size );
+  for ( std::size_t entry = 0; entry < size; ++entry )
+  {
+    for ( std::size_t cond = 0; cond < _conds.size(); ++cond )
+      values[ cond ] = ( *columns[ cond ] )[ entry ].first;
+
+    const unsigned group = _groups.insert( std::make_pair( values, _groups.size() ) ).first->second;
+    groups.push_back( group );
+  }
+
+  normalize( known );
+
+  return cached;
+}
+
+
+PdfModel& ConditionalPdf::local() const
+{
+  std::pair< unsigned long, std::unique_ptr< PdfModel > >& copy = _copies[ this ];
+
+  if ( ( ! copy.second ) || ( copy.first != _version ) )
+  {
+    copy.first = _version;
+    copy.second.reset( _pdf->copy() );
+  }
+
+  return *copy.second;
+}
+
+
+PdfModel& ConditionalPdf::condition( const std::vector< double >& vars ) const
+{
+  PdfModel& pdf = local();
+
+  for ( std::size_t cond = 0; cond < _targets.size(); ++cond )
+    pdf.setPar( _targets[ cond ], vars[ _condIdx[ cond ] ] );
+
+  pdf.setParExpr();
+
+  return pdf;
+}
+
+
+PdfModel& ConditionalPdf::group( const std::vector< double >& value ) const
+{
+  PdfModel& pdf = local();
+
+  for ( std::size_t cond = 0; cond < _targets.size(); ++cond )
+    pdf.setPar( _targets[ cond ], value[ cond ] );
+
+  pdf.setParExpr();
+
+  return pdf;
+}
+
+
+const double ConditionalPdf::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+{
+  const double& x = vars[ _obsIdx ];
+  if ( ( x < _lower ) || ( x > _upper ) )
+    return 0.0;
+
+  const PdfModel& pdf = condition( vars );
+
+  return pdf.evaluate( x ) / pdf.area( _lower, _upper );
+}
+
+
+const double ConditionalPdf::evaluate( const std::vector< double >&                 vars  ,
+                                       const std::vector< double >&                 cacheR,
+                                       const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
+{
+  if ( ! _doCache )
+    return evaluate( vars );
+
+  const double& x = vars[ _obsIdx ];
+  if ( ( x < _lower ) || ( x > _upper ) )
+    return 0.0;
+
+  const PdfModel& pdf = condition( vars );
+
+  // The groups are not known if the cache was restored from a checkpoint, and
+  //    their norms are then computed for each event.
+  const unsigned group = unsigned( cacheR[ _cacheIdx ] );
+  const double&  norm  = ( group < _norms.size() ) ? _norms[ group ] : pdf.area( _lower, _upper );
+
+  return pdf.evaluate( x ) / norm;
+}
@@ -1,14 +1,20 @@
 
+#include <numeric>
+#include <sstream>
+
 #include <cfit/models/decay3body.hh>
 #include <cfit/function.hh>
 #include <cfit/random.hh>
+#include <cfit/threads.hh>
+#include <cfit/codegen.hh>
 
 Decay3Body::Decay3Body( const Variable&   mSq12,
 			const Variable&   mSq13,
 			const Variable&   mSq23,
 			const Amplitude&  amp  ,
 			const PhaseSpace& ps     )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _norm( 1.0 ), _maxPdf( 14.0 )
+  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _norm( 1.0 ), _maxPdf( 14.0 ), _maxSquare( 0.0 ),
+    _cacheAmps( false ), _blockAmps( false ), _ampCache( 0 )
 {
   // Do calculations common to all values of variables
   //    (usually compute norm).
@@ -55,39 +61,104 @@ void Decay3Body::cache()
   _norm = 0.0;
 
   // Define the properties of the integration method.
-  const int    nBins = 400;
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( nBins );
-
+  const int    nBins  = _normBins;
   const double mSqSum = _ps.mSqSum();
 
   // Define the variables at each bin.
   double mSq12;
   double mSq13;
   double mSq23;
+  double weight;
+  double value;
+
+  _maxSquare = 0.0;
+
+  // With an amplitude linear in fixed components, use their sums of products.
+  if ( normProducts() )
+  {
+    double                 nCnj;
+    std::complex< double > nXed;
+    double                 maxDir;
+    double                 maxCnj;
+    productIntegrals( _norm, nCnj, nXed, maxDir, maxCnj );
+    return;
+  }
+
+  // Compute the integral on the Monte Carlo points, if any, by chunks whose
+  //    partial sums are added in their order.
+  if ( ! _normWeight.empty() )
+  {
+    const unsigned        nChunks = Threads::nThreads();
+    std::vector< double > sums( nChunks, 0.0 );
+
+    Threads::chunks( _normWeight.size(), [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& chunk )
+    {
+      for ( std::size_t point = first; point < last; ++point )
+      {
+        const double& mSq12 = _normMSq12[ point ];
+        const double& mSq13 = _normMSq13[ point ];
+        const double& mSq23 = mSqSum - mSq12 - mSq13;
+
+        sums[ chunk ] += std::norm( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) ) * evaluateFuncs( mSq12, mSq13, mSq23 ) * _normWeight[ point ];
+      }
+    }, nChunks );
+
+    _norm = std::accumulate( sums.begin(), sums.end(), 0.0 );
+    return;
+  }
 
   // Compute the integral on the grid.
   for ( int binX = 0; binX < nBins; ++binX )
     for ( int binY = 0; binY < nBins; ++binY )
     {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
+      normPoint( binX, binY, mSq12, mSq13, weight );
       mSq23 = mSqSum - mSq12 - mSq13;
 
       // Proceed only if the point lies inside the kinematically allowed Dalitz region.
       // std::norm returns the squared modulus of the complex number, not its norm.
       if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-        _norm += std::norm( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) ) * evaluateFuncs( mSq12, mSq13, mSq23 );
+      {
+        value = std::norm( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) ) * evaluateFuncs( mSq12, mSq13, mSq23 );
+        _norm += value * weight;
+
+        // Keep the maximum of the pdf in the square Dalitz plot, for generation.
+        if ( _squareNorm )
+          _maxSquare = std::max( _maxSquare, value * weight );
+      }
     }
 
-  _norm *= std::pow( step, 2 );
+  // The weights include the area of the cells.
+  _maxSquare *= std::pow( double( nBins ), 2 ) / _norm;
 
   return;
 }
 
 
 
+// Same scan as the grid of cache(), with the norm already known.
+void Decay3Body::cacheMaxSquare() const
+{
+  const unsigned nBins  = _normBins;
+  const double   mSqSum = _ps.mSqSum();
+
+  double mSq12;
+  double mSq13;
+  double weight;
+
+  _maxSquare = 0.0;
+  for ( unsigned binX = 0; binX < nBins; ++binX )
+    for ( unsigned binY = 0; binY < nBins; ++binY )
+    {
+      normPoint( binX, binY, mSq12, mSq13, weight );
+      if ( _ps.contains( mSq12, mSq13, mSqSum - mSq12 - mSq13 ) )
+        _maxSquare = std::max( _maxSquare, evaluate( mSq12, mSq13, mSqSum - mSq12 - mSq13 ) * weight );
+    }
+
+  _maxSquare *= std::pow( double( nBins ), 2 );
+}
+
+
+
 const double Decay3Body::evaluate( const double& mSq12, const double& mSq13, const double& mSq23 ) const throw( PdfException )
 {
   // Phase space amplitude of the decay of the particle.
@@ -110,6 +181,47 @@ const double Decay3Body::evaluate( const double& mSq12, const double& mSq13 ) co
 }
 
 
+const std::map< unsigned, std::vector< std::complex< double > > > Decay3Body::cacheComplex( const Dataset& data )
+{
+  // The amplitude is cached if all its parameters are fixed, and computed
+  //    for each block of events through the array kernels otherwise.
+  _cacheAmps = _amp.isFixed();
+  _blockAmps = ! _cacheAmps;
+
+  std::map< unsigned, std::vector< std::complex< double > > > cached;
+
+  _ampCache = assignCacheIdxComplex();
+
+  if ( ! _cacheAmps )
+    return cached;
+
+  std::vector< std::complex< double > >& amps = cached[ _ampCache ];
+  amps.resize( data.size() );
+
+  Threads::chunks( data.size(), [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+  {
+    evaluateAmps( data, first, last, &amps[ first ], 0 );
+  } );
+
+  return cached;
+}
+
+
+void Decay3Body::cacheBlock( const Dataset&                                               data  ,
+                             const std::size_t&                                           first ,
+                             const std::size_t&                                           last  ,
+                             std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const
+{
+  if ( ! _blockAmps )
+    return;
+
+  std::vector< std::complex< double > >& amps = cacheC[ _ampCache ];
+  amps.resize( last - first );
+
+  evaluateAmps( data, first, last, amps.data(), 0 );
+}
+
+
 const double Decay3Body::project( const std::string& varName, const double& x ) const throw( PdfException )
 {
   // Find the index of the variable to be projected.
@@ -160,6 +272,25 @@ const double Decay3Body::evaluate( const std::vector< double >& vars ) const thr
 }
 
 
+// Use the amplitude of the event, cached or computed with those of its block.
+const double Decay3Body::evaluate( const std::vector< double >&                 vars  ,
+                                   const std::vector< double >&                 cacheR,
+                                   const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
+{
+  if ( ! _cacheAmps && ! _blockAmps )
+    return evaluate( vars );
+
+  const std::size_t& size = vars.size();
+
+  if ( ( size != 2 ) && ( size != 3 ) )
+    throw PdfException( "Decay3Body can only take either 2 or 3 arguments." );
+
+  const double& mSq23 = ( size == 3 ) ? vars[ 2 ] : _ps.mSqSum() - vars[ 0 ] - vars[ 1 ];
+
+  return std::norm( cacheC[ _ampCache ] ) * evaluateFuncs( vars[ 0 ], vars[ 1 ], mSq23 ) / _norm;
+}
+
+
 // No need to append an operator, since it can only be multiplication.
 const Decay3Body& Decay3Body::operator*=( const Function& right ) throw( PdfException )
 {
@@ -229,6 +360,107 @@ const Decay3Body operator*( const Function& left, Decay3Body right )
 }
 
 
+// The events are given by their three invariant masses and their efficiency,
+//    and the norm points by their invariant masses, efficiency and weight.
+//    The sums follow cache() and evaluate(), term by term.
+const std::string Decay3Body::kernelCode( const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  std::ostringstream out;
+  out << Codegen::prelude()
+      << _amp.code( _ps, pars )
+      << "extern \"C\" double cfit_norm( const double* par,\n"
+      << "                               const double* const* norm, const unsigned long first, const unsigned long last )\n"
+      << "{\n"
+      << "  double integral = 0.;\n"
+      << "  for ( unsigned long point = first; point < last; ++point )\n"
+      << "    integral += std::norm( amplitude( par, norm[ 0 ][ point ], norm[ 1 ][ point ], norm[ 2 ][ point ] ) ) * norm[ 3 ][ point ] * norm[ 4 ][ point ];\n"
+      << "\n"
+      << "  return integral;\n"
+      << "}\n"
+      << "\n"
+      << "extern \"C\" double cfit_nll( const double* par, const double integral,\n"
+      << "                              const double* const* events, const double* weights, const unsigned long first, const unsigned long last )\n"
+      << "{\n"
+      << "  double nll = 0.;\n"
+      << "  for ( unsigned long event = first; event < last; ++event )\n"
+      << "  {\n"
+      << "    const double value = std::norm( amplitude( par, events[ 0 ][ event ], events[ 1 ][ event ], events[ 2 ][ event ] ) ) * events[ 3 ][ event ] / integral;\n"
+      << "    if ( value )\n"
+      << "      nll += - 2. * ( weights ? weights[ event ] : 1. ) * std::log( value );\n"
+      << "  }\n"
+      << "\n"
+      << "  return nll;\n"
+      << "}\n";
+
+  return out.str();
+}
+
+
+void Decay3Body::kernelColumns( const Dataset&                        data  ,
+                                std::vector< std::vector< double > >& events,
+                                std::vector< std::vector< double > >& norm   ) const throw( PdfException )
+{
+  typedef std::vector< Function >::const_iterator                  fIter;
+  typedef std::map< std::string, Parameter >::const_iterator       pIter;
+  for ( fIter func = _funcs.begin(); func != _funcs.end(); ++func )
+    for ( pIter par = func->getParMap().begin(); par != func->getParMap().end(); ++par )
+      if ( ! _parMap.find( par->first )->second.isFixed() )
+        throw PdfException( "Decay3Body: code generation needs the parameters of the efficiency functions to be fixed." );
+
+  // Same order of the variables as in the evaluation from a minimizer.
+  const std::vector< std::string >& names = varNames();
+  const std::size_t                 size  = data.size();
+
+  events.assign( 4, std::vector< double >( size ) );
+  if ( size )
+    for ( unsigned var = 0; var < 3; ++var )
+    {
+      const std::vector< std::pair< double, double > >& column = data.column( names[ var ] );
+      for ( std::size_t entry = 0; entry < size; ++entry )
+        events[ var ][ entry ] = column[ entry ].first;
+    }
+
+  Threads::fill( events[ 3 ], [ & ]( const std::size_t& entry )
+  {
+    return evaluateFuncs( events[ 0 ][ entry ], events[ 1 ][ entry ], events[ 2 ][ entry ] );
+  } );
+
+  norm.assign( 5, std::vector< double >() );
+
+  const double mSqSum = _ps.mSqSum();
+
+  const auto push = [ & ]( const double& mSq12, const double& mSq13, const double& weight )
+  {
+    const double& mSq23 = mSqSum - mSq12 - mSq13;
+
+    norm[ 0 ].push_back( mSq12 );
+    norm[ 1 ].push_back( mSq13 );
+    norm[ 2 ].push_back( mSq23 );
+    norm[ 3 ].push_back( evaluateFuncs( mSq12, mSq13, mSq23 ) );
+    norm[ 4 ].push_back( weight );
+  };
+
+  for ( std::size_t point = 0; point < _normWeight.size(); ++point )
+    push( _normMSq12[ point ], _normMSq13[ point ], _normWeight[ point ] );
+
+  if ( ! _normWeight.empty() )
+    return;
+
+  // Only the cells inside the Dalitz plot contribute to the grid.
+  double mSq12;
+  double mSq13;
+  double weight;
+  for ( unsigned binX = 0; binX < _normBins; ++binX )
+    for ( unsigned binY = 0; binY < _normBins; ++binY )
+    {
+      normPoint( binX, binY, mSq12, mSq13, weight );
+      if ( _ps.contains( mSq12, mSq13, mSqSum - mSq12 - mSq13 ) )
+        push( mSq12, mSq13, weight );
+    }
+}
+
+
+
 const std::map< std::string, double > Decay3Body::generate() const throw( PdfException )
 {
   // Generate mSq12 and mSq13, and compute mSq23 from these.
@@ -256,10 +488,32 @@ const std::map< std::string, double > Decay3Body::generate() const throw( PdfExc
 
   std::map< std::string, double > values;
 
+  // The norm from Monte Carlo points or from the products of the components
+  //    does not scan the square Dalitz plot.
+  if ( _squareNorm && ! ( _maxSquare > 0.0 ) )
+    cacheMaxSquare();
+
+  // In the square Dalitz plot, use the maximum found on the grid, with some margin.
+  const double& max = _squareNorm ? 1.2 * _maxSquare : _maxPdf;
+
+  double mPrime  = 0.0;
+  double thPrime = 0.0;
+
   while ( count-- )
   {
-    mSq12 = Random::flat( min12, max12 );
-    mSq13 = Random::flat( min13, max13 );
+    if ( _squareNorm )
+    {
+      // Generate uniformly in the square Dalitz plot, which always lies inside the
+      //    kinematically allowed region, and weight by the Jacobian.
+      mPrime  = Random::flat();
+      thPrime = Random::flat();
+      _ps.fromSquare( mPrime, thPrime, mSq12, mSq13 );
+    }
+    else
+    {
+      mSq12 = Random::flat( min12, max12 );
+      mSq13 = Random::flat( min13, max13 );
+    }
     mSq23 = mSqSum - mSq12 - mSq13;
 
     values[ mSq12name ] = mSq12;
@@ -267,12 +521,14 @@ const std::map< std::string, double > Decay3Body::generate() const throw( PdfExc
     values[ mSq23name ] = mSq23;
 
     pdfVal = this->evaluate( mSq12, mSq13, mSq23 );
+    if ( _squareNorm )
+      pdfVal *= _ps.squareJacobian( mPrime, thPrime );
 
-    if ( pdfVal > _maxPdf )
+    if ( pdfVal > max )
       std::cout << "Problem: " << pdfVal << " " << mSq12 << " " << mSq13 << " " << mSqSum - mSq12 - mSq13 << std::endl;
 
     // Apply the accept-reject decision.
-    if ( Random::flat( 0.0, _maxPdf ) < pdfVal )
+    if ( Random::flat( 0.0, max ) < pdfVal )
       return values;
   }
 
@@ -1,9 +1,12 @@
 
+#include <cmath>
 #include <complex>
+#include <algorithm>
 
 #include <cfit/dataset.hh>
 #include <cfit/function.hh>
 #include <cfit/random.hh>
+#include <cfit/threads.hh>
 
 #include <cfit/models/decay3bodybin.hh>
 
@@ -105,15 +108,11 @@ void Decay3BodyBin::setParExpr()
 
 
 
-void Decay3BodyBin::cacheNormComponents()
+// Integrate the efficiency in each bin on a grid of _gridBins x _gridBins cells.
+void Decay3BodyBin::integrateEffs() const
 {
-  // If the amplitude is fixed and the components have already
-  //    been computed, just return without recomputing anything.
-  if ( _fixedAmp )
-    return;
-
   // Define the properties of the integration method.
-  const unsigned& nBins = 100;
+  const unsigned nBins = _gridBins;
   const double min   = _ps.mSq12min();
   const double max   = _ps.mSq12max();
   const double step  = ( max - min ) / double( nBins );
@@ -128,10 +127,7 @@ void Decay3BodyBin::cacheNormComponents()
   double mSq13;
 
   // Initialize the integrated efficiencies.
-  std::vector< double > effs;
-  effs.resize( _amp.nBins() );
-  for ( unsigned bin = 0; bin < _amp.nBins(); ++bin )
-    effs[ bin ] = 0.0;
+  _effs.assign( _amp.nBins(), 0.0 );
 
   unsigned bin;
   // Integrate only over the region mSq13 < mSq12 (positive bins).
@@ -146,23 +142,31 @@ void Decay3BodyBin::cacheNormComponents()
         if ( needToCache )
         {
           bin = std::abs( _binning.bin( mSq12, mSq13 ) );
-
-          if ( needToCache )
-            _binCache[ nBins * binX + binY ] = bin;
+          _binCache[ nBins * binX + binY ] = bin;
         }
         else
         {
           bin = _binCache[ nBins * binX + binY ];
         }
 
-        // std::cout << "DEBUG Decay3BodyBin: " << mSq12 << " " << mSq13 << " " << _binning.bin( mSq12, mSq13 ) << std::endl;
-        // bin = std::abs( _binning.bin( mSq12, mSq13 ) );
-        effs[ bin - 1 ] += evaluateFuncs( mSq12, mSq13 );
+        _effs[ bin - 1 ] += evaluateFuncs( mSq12, mSq13 );
       }
     }
 
   for ( unsigned bin = 0; bin < _amp.nBins(); ++bin )
-    effs[ bin ] *= std::pow( step, 2 );
+    _effs[ bin ] *= std::pow( step, 2 );
+}
+
+
+
+void Decay3BodyBin::cacheNormComponents()
+{
+  // If the amplitude is fixed and the components have already
+  //    been computed, just return without recomputing anything.
+  if ( _fixedAmp )
+    return;
+
+  integrateEffs();
 
   // Initialize the value of the norm components and the norm.
   _nDir = 0.0;
@@ -172,7 +176,7 @@ void Decay3BodyBin::cacheNormComponents()
   std::vector< Parameter >::const_iterator tpb = _amp.tpb().begin();
   std::vector< Parameter >::const_iterator tmb = _amp.tmb().begin();
   std::vector< CoefExpr  >::const_iterator xb  = _amp.xb() .begin();
-  std::vector< double    >::const_iterator eff = effs      .begin();
+  std::vector< double    >::const_iterator eff = _effs     .begin();
 
   double                 ef;
   double                 tp;
@@ -198,6 +202,9 @@ void Decay3BodyBin::cacheNormComponents()
 
 void Decay3BodyBin::cache()
 {
+  // The efficiency may have changed, so the fractions are computed again when needed.
+  _fractions.clear();
+
   // Compute the norm components, only if the amplitude
   //    is not fixed or they have not yet been computed.
   cacheNormComponents();
@@ -221,22 +228,18 @@ const std::map< unsigned, std::vector< double > > Decay3BodyBin::cacheReal( cons
   std::map< unsigned, std::vector< double > > cached;
 
   // Get an index for the cached bin.
-  _binIndex = _cacheIdxReal++;
+  _binIndex = assignCacheIdxReal();
 
-  const std::string& mSq12name = getVar( 0 ).name();
-  const std::string& mSq13name = getVar( 1 ).name();
+  if ( ! data.size() )
+    return cached;
 
-  double mSq12;
-  double mSq13;
+  // Look the columns up once, and find the bins in parallel chunks of events.
+  const std::vector< std::pair< double, double > >& mSq12 = data.column( getVar( 0 ).name() );
+  const std::vector< std::pair< double, double > >& mSq13 = data.column( getVar( 1 ).name() );
 
-  const std::size_t& size = data.size();
-  for ( std::size_t entry = 0; entry < size; ++entry )
-  {
-    mSq12 = data.value( mSq12name, entry );
-    mSq13 = data.value( mSq13name, entry );
-
-    cached[ _binIndex ].push_back( _binning.bin( mSq12, mSq13 ) );
-  }
+  std::vector< double >& bins = cached[ _binIndex ];
+  bins.resize( data.size() );
+  Threads::fill( bins, [ & ]( const std::size_t& entry ) { return _binning.bin( mSq12[ entry ].first, mSq13[ entry ].first ); } );
 
   return cached;
 }
@@ -384,3 +387,265 @@ const Decay3BodyBin operator*( const Function& left, Decay3BodyBin right )
   return right;
 }
 
+
+
+
+// The efficiency is integrated separately in each signed bin, since it need
+//    not be symmetric under the exchange of mSq12 and mSq13. The points of a
+//    negative bin are the mirror images of those of the positive one.
+void Decay3BodyBin::cacheFractions() const throw( PdfException )
+{
+  std::vector< double > pars;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = _parMap.begin(); par != _parMap.end(); ++par )
+    pars.push_back( par->second.value() );
+
+  if ( ( ! _fractions.empty() ) && ( pars == _fractionPars ) )
+    return;
+
+  if ( _binCache.empty() )
+    integrateEffs();
+
+  const unsigned nGrid = _gridBins;
+  const double   min   = _ps.mSq12min();
+  const double   step  = ( _ps.mSq12max() - min ) / double( nGrid );
+
+  _signedEffs.clear();
+  _maxEffs   .clear();
+
+  for ( unsigned binX = 0; binX < nGrid; ++binX )
+    for ( unsigned binY = 0; binY < binX; ++binY )
+    {
+      const double mSq12 = min + step * ( binX + 0.5 );
+      const double mSq13 = min + step * ( binY + 0.5 );
+
+      if ( ! _ps.contains( mSq12, mSq13 ) )
+        continue;
+
+      const int      bin    = _binCache[ nGrid * binX + binY ];
+      const double&& eff    = evaluateFuncs( mSq12, mSq13 );
+      const double&& effCnj = evaluateFuncs( mSq13, mSq12 );
+
+      _signedEffs[   bin ] += eff    * step * step;
+      _signedEffs[ - bin ] += effCnj * step * step;
+      _maxEffs   [   bin ]  = std::max( _maxEffs[   bin ], eff    );
+      _maxEffs   [ - bin ]  = std::max( _maxEffs[ - bin ], effCnj );
+    }
+
+  const std::complex< double >&& vz     = z();
+  const double&&                 vKappa = kappa();
+
+  const int nBins = _amp.nBins();
+
+  std::map< int, double > fractions;
+  double                  total = 0.0;
+  for ( int bin = - nBins; bin <= nBins; ++bin )
+  {
+    if ( bin == 0 )
+      continue;
+
+    const std::tuple< double, double, std::complex< double > >&& tx = _amp.evaluate( bin );
+
+    const double& value = ( std::get< 0 >( tx )                   +
+                            std::get< 1 >( tx ) * std::norm( vz ) +
+                            2.0 * vKappa * std::real( vz * std::get< 2 >( tx ) ) ) * _signedEffs[ bin ];
+
+    total += fractions[ bin ] = std::max( value, 0.0 );
+  }
+
+  if ( ! ( total > 0.0 ) )
+    throw PdfException( "Decay3BodyBin: the expected yields of all the bins vanish." );
+
+  for ( std::map< int, double >::iterator bin = fractions.begin(); bin != fractions.end(); ++bin )
+    bin->second /= total;
+
+  _fractions    = fractions;
+  _fractionPars = pars;
+}
+
+
+
+const std::map< int, double > Decay3BodyBin::binFractions() const
+{
+  cacheFractions();
+
+  return _fractions;
+}
+
+
+
+const std::map< int, unsigned > Decay3BodyBin::generateCounts( const unsigned& nEvents ) const
+{
+  const std::map< int, double >& fractions = binFractions();
+
+  std::vector< double > probs;
+  for ( std::map< int, double >::const_iterator bin = fractions.begin(); bin != fractions.end(); ++bin )
+    probs.push_back( bin->second );
+
+  const std::vector< unsigned >& drawn = Random::stream().multinomial( nEvents, probs );
+
+  std::map< int, unsigned > counts;
+  std::vector< unsigned >::const_iterator count = drawn.begin();
+  for ( std::map< int, double >::const_iterator bin = fractions.begin(); bin != fractions.end(); ++bin )
+    counts[ bin->first ] = *count++;
+
+  return counts;
+}
+
+
+
+const std::map< int, unsigned > Decay3BodyBin::generateCountsPoisson( const double& nExpected ) const
+{
+  const std::map< int, double >& fractions = binFractions();
+
+  std::map< int, unsigned > counts;
+  for ( std::map< int, double >::const_iterator bin = fractions.begin(); bin != fractions.end(); ++bin )
+    counts[ bin->first ] = Random::stream().poisson( nExpected * bin->second );
+
+  return counts;
+}
+
+
+
+// Cells of the integration grid that may hold points of each positive bin:
+//    those whose center lies in the bin and their neighbours.
+void Decay3BodyBin::cacheBinCells() const
+{
+  if ( _binCache.empty() )
+    integrateEffs();
+
+  const int nGrid = _gridBins;
+
+  std::vector< std::vector< bool > > inBin( _amp.nBins(), std::vector< bool >( nGrid * nGrid, false ) );
+  for ( int binX = 0; binX < nGrid; ++binX )
+    for ( int binY = 0; binY < binX; ++binY )
+    {
+      const unsigned& bin = _binCache[ nGrid * binX + binY ];
+      if ( bin == 0 )
+        continue;
+
+      for ( int cellX = std::max( binX - 1, 0 ); cellX <= std::min( binX + 1, nGrid - 1 ); ++cellX )
+        for ( int cellY = std::max( binY - 1, 0 ); cellY <= std::min( binY + 1, nGrid - 1 ); ++cellY )
+          inBin[ bin - 1 ][ nGrid * cellX + cellY ] = true;
+    }
+
+  _binCells.assign( _amp.nBins(), std::vector< unsigned >() );
+  for ( unsigned bin = 0; bin < _amp.nBins(); ++bin )
+    for ( unsigned cell = 0; cell < inBin[ bin ].size(); ++cell )
+      if ( inBin[ bin ][ cell ] )
+        _binCells[ bin ].push_back( cell );
+}
+
+
+
+// The amplitude is constant within a bin, so the points are drawn uniformly
+//    in the cells of the bin, kept if the binning assigns them to it, and then
+//    accepted with a probability proportional to the efficiency. Its bound is
+//    the maximum found on the integration grid, with some margin, as for the
+//    square Dalitz plot of Decay3Body. Points of negative bins are the mirror
+//    images of those of the positive ones.
+void Decay3BodyBin::generatePoint( const int& bin, RandomStream& stream, double& mSq12, double& mSq13 ) const throw( PdfException )
+{
+  if ( _binCells.empty() )
+    cacheBinCells();
+
+  const std::vector< unsigned >& cells = _binCells[ std::abs( bin ) - 1 ];
+  if ( cells.empty() )
+    throw PdfException( "Decay3BodyBin: cannot generate points in a bin outside the integration grid." );
+
+  if ( ! _funcs.empty() )
+    cacheFractions();
+
+  const double max  = _funcs.empty() ? 0.0 : 1.2 * _maxEffs[ bin ];
+  const double min  = _ps.mSq12min();
+  const double step = ( _ps.mSq12max() - min ) / double( _gridBins );
+
+  if ( ( ! _funcs.empty() ) && ! ( max > 0.0 ) )
+    throw PdfException( "Decay3BodyBin: cannot generate points in a bin where the efficiency vanishes." );
+
+  while ( true )
+  {
+    const unsigned& cell = cells[ std::min< std::size_t >( stream.flat() * cells.size(), cells.size() - 1 ) ];
+
+    mSq12 = min + step * ( cell / _gridBins + stream.flat() );
+    mSq13 = min + step * ( cell % _gridBins + stream.flat() );
+
+    if ( ( ! _ps.contains( mSq12, mSq13 ) ) || ( _binning.bin( mSq12, mSq13 ) != std::abs( bin ) ) )
+      continue;
+
+    if ( bin < 0 )
+      std::swap( mSq12, mSq13 );
+
+    if ( _funcs.empty() )
+      return;
+
+    const double&& eff = evaluateFuncs( mSq12, mSq13 );
+    if ( eff > max )
+      throw PdfException( "Decay3BodyBin: the efficiency exceeds the bound used to generate points in a bin." );
+
+    if ( stream.flat() * max < eff )
+      return;
+  }
+}
+
+
+
+const std::map< std::string, double > Decay3BodyBin::generate() const throw( PdfException )
+{
+  cacheFractions();
+
+  const std::map< int, double >& fractions = _fractions;
+
+  // Choose the bin by inversion of the cumulative fractions.
+  const double& unif = Random::flat();
+
+  double sum = 0.0;
+  int    bin = fractions.rbegin()->first;
+  for ( std::map< int, double >::const_iterator frac = fractions.begin(); frac != fractions.end(); ++frac )
+    if ( unif < ( sum += frac->second ) )
+    {
+      bin = frac->first;
+      break;
+    }
+
+  double mSq12;
+  double mSq13;
+  generatePoint( bin, Random::stream(), mSq12, mSq13 );
+
+  std::map< std::string, double > values;
+  values[ mSq12name() ] = mSq12;
+  values[ mSq13name() ] = mSq13;
+  values[ mSq23name() ] = _ps.mSqSum() - mSq12 - mSq13;
+
+  return values;
+}
+
+
+
+const Dataset Decay3BodyBin::generate( const std::map< int, unsigned >& counts ) const throw( PdfException )
+{
+  const std::string& name12 = mSq12name();
+  const std::string& name13 = mSq13name();
+  const std::string& name23 = mSq23name();
+
+  RandomStream& stream = Random::stream();
+
+  Dataset data;
+
+  double mSq12;
+  double mSq13;
+
+  std::map< std::string, double > values;
+  for ( std::map< int, unsigned >::const_iterator bin = counts.begin(); bin != counts.end(); ++bin )
+    for ( unsigned event = 0; event < bin->second; ++event )
+    {
+      generatePoint( bin->first, stream, mSq12, mSq13 );
+
+      values[ name12 ] = mSq12;
+      values[ name13 ] = mSq13;
+      values[ name23 ] = _ps.mSqSum() - mSq12 - mSq13;
+      data.push( values );
+    }
+
+  return data;
+}
@@ -17,7 +17,7 @@ Decay3BodyCP::Decay3BodyCP( const Variable&   mSq12  ,
                             bool              docache  )
   : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( false ), _phi( phi ),
     _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
-    _maxPdf( 14.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _maxPdf( 14.0 ), _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
 {
   push( phi );
 
@@ -40,7 +40,7 @@ Decay3BodyCP::Decay3BodyCP( const Variable&   mSq12  ,
                             bool              docache  )
   : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( true ), _kappa( kappa ), _phi( phi ),
     _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
-    _maxPdf( 14.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _maxPdf( 14.0 ), _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
 {
   push( phi   );
   push( kappa );
@@ -65,7 +65,7 @@ Decay3BodyCP::Decay3BodyCP( const Variable&      mSq12  ,
                             bool                 docache  )
   : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _hasKappa( true ), _kappa( kappa ), _phi( phi ),
     _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
-    _maxPdf( 14.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _maxPdf( 14.0 ), _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
 {
   push( phi   );
   push( kappa );
@@ -106,83 +106,10 @@ void Decay3BodyCP::cache()
     return;
   }
 
-  // Compute the value of _norm.
-  _nDir = 0.0;
-  _nCnj = 0.0;
-  _nXed = 0.0;
-  _norm = 0.0;
-
-  // Define the properties of the integration method.
-  const int&   nBins = 400;
-  if ( nBins < 400 )
-    std::cout << "\e[91mALERT: calculating normalisation with only " << nBins << " bins.\e[0m" << std::endl;
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( nBins );
-
-  const double mSqSum = _ps.mSqSum();
-
-  // Determine whether the amplitudes in the 400x400 bins should be cached.
-  //    Cache them if the amplitude is fixed, but it has not yet been cached.
-  bool cachedAmp   = ! _ampCache.empty();
-  bool needToCache = ! cachedAmp && _amp.isFixed();
-  if ( needToCache )
-    _ampCache.resize( std::pow( nBins, 2 ) );
-
-  // Define the variables at each bin.
-  double mSq12;
-  double mSq13;
-  double mSq23;
-
-  double funcs;
-  std::complex< double > ampDir;
-  std::complex< double > ampCnj;
-
-  unsigned binDir;
-  unsigned binCnj;
-
-  // Compute the integral on the grid.
-  for ( int binX = 0; binX < nBins; ++binX )
-    for ( int binY = 0; binY < nBins; ++binY )
-    {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
-      mSq23 = mSqSum - mSq12 - mSq13;
-
-      // Proceed only if the point lies inside the kinematically allowed phase space region.
-      // std::norm returns the squared modulus of the complex number, not its norm.
-      if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-      {
-        funcs = evaluateFuncs( mSq12, mSq13, mSq23 );
-
-        // If the amplitude is fixed, but the efficiency is not, use cached amplitude values.
-        if ( cachedAmp )
-        {
-          binDir = nBins * binX + binY;
-          binCnj = nBins * binY + binX;
-
-          ampDir = _ampCache[ binDir ];
-          ampCnj = _ampCache[ binCnj ];
-        }
-        else
-        {
-          ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
-          ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
-
-          if ( needToCache )
-            _ampCache[ nBins * binX + binY ] = ampDir;
-        }
-
-        _nDir += std::norm( ampDir ) * funcs;
-        _nCnj += std::norm( ampCnj ) * funcs;
-        _nXed += conj( ampDir ) * ampCnj * funcs;
-      }
-    }
-
-  const double& stepSq = std::pow( step, 2 );
-  _nDir *= stepSq;
-  _nCnj *= stepSq;
-  _nXed *= stepSq;
+  // Compute the norm components, reusing the amplitudes on the grid if it is fixed.
+  double maxDir;
+  double maxCnj;
+  normIntegrals( _nDir, _nCnj, _nXed, maxDir, maxCnj );
 
   _fixed = _amp.isFixed();
   for ( std::vector< Function >::const_iterator func = _funcs.begin(); func != _funcs.end(); ++func )
@@ -196,38 +123,34 @@ void Decay3BodyCP::cache()
 
 const std::map< unsigned, std::vector< std::complex< double > > > Decay3BodyCP::cacheComplex( const Dataset& data )
 {
-  // Determine whether the amplitudes should be cached, i.e. only if all their parameters are fixed.
-  _cacheAmps = true;
+  // The amplitudes are cached if all their parameters are fixed, and computed
+  //    for each block of events through the array kernels otherwise.
+  _cacheAmps = _amp.isFixed();
+  _blockAmps = ! _cacheAmps;
 
   std::map< unsigned, std::vector< std::complex< double > > > cached;
 
+  // Get an index for the complex amplitudes.
+  _ampDirCache = assignCacheIdxComplex();
+  _ampCnjCache = assignCacheIdxComplex();
+
   if ( ! _cacheAmps )
     return cached;
 
-  // Get an index for the cached complex amplitudes.
-  _ampDirCache = _cacheIdxComplex++;
-  _ampCnjCache = _cacheIdxComplex++;
-
-  const std::string& mSq12name = getVar( 0 ).name();
-  const std::string& mSq13name = getVar( 1 ).name();
-  const std::string& mSq23name = getVar( 2 ).name();
-
-  double mSq12;
-  double mSq13;
-  double mSq23;
+  // Cache the direct and conjugated amplitudes for every point in the given dataset.
+  cacheAmps( data, cached[ _ampDirCache ], cached[ _ampCnjCache ] );
 
-  const std::size_t& size = data.size();
-  for ( std::size_t entry = 0; entry < size; ++entry )
-  {
-    mSq12 = data.value( mSq12name, entry );
-    mSq13 = data.value( mSq13name, entry );
-    mSq23 = data.value( mSq23name, entry );
+  return cached;
+}
 
-    cached[ _ampDirCache ].push_back( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) );
-    cached[ _ampCnjCache ].push_back( _amp.evaluate( _ps, mSq13, mSq12, mSq23 ) );
-  }
 
-  return cached;
+void Decay3BodyCP::cacheBlock( const Dataset&                                               data  ,
+                               const std::size_t&                                           first ,
+                               const std::size_t&                                           last  ,
+                               std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const
+{
+  if ( _blockAmps )
+    cacheAmps( data, first, last, cacheC[ _ampDirCache ], cacheC[ _ampCnjCache ] );
 }
 
 
@@ -325,7 +248,7 @@ const double Decay3BodyCP::evaluate( const std::vector< double >&
                                      const std::vector< double >&                 cacheR,
                                      const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
 {
-  if ( ! _cacheAmps )
+  if ( ! _cacheAmps && ! _blockAmps )
     return evaluate( vars );
 
   const std::size_t& size = vars.size();
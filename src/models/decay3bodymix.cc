@@ -1,5 +1,7 @@
 
+#include <cmath>
 #include <complex>
+#include <algorithm>
 
 #include <cfit/dataset.hh>
 #include <cfit/function.hh>
@@ -25,7 +27,7 @@ Decay3BodyMix::Decay3BodyMix( const Variable&      mSq12  ,
     _hasMixing( true  ),
     _hasCPV   ( false ),
     _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _maxPdf( 54.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _genBins( 50 ), _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
 {
   // Make the variables available to cfit.
   // The squared invariant masses are already made available by the DecayModel constructor.
@@ -60,7 +62,7 @@ Decay3BodyMix::Decay3BodyMix( const Variable&      mSq12  ,
     _hasMixing( true ),
     _hasCPV   ( true ),
     _nDir( 0.0 ), _nCnj( 0.0 ), _nXed( 0.0 ), _norm( 1.0 ), _fixedAmp( false ),
-    _maxPdf( 54.0 ), _cacheAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
+    _genBins( 50 ), _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 )
 {
   // Make the variables available to cfit.
   // The squared invariant masses are already made available by the DecayModel constructor.
@@ -175,54 +177,10 @@ void Decay3BodyMix::cacheNormComponents()
   if ( _fixedAmp )
     return;
 
-  // Compute the value of _norm.
-  _nDir = 0.0;
-  _nCnj = 0.0;
-  _nXed = 0.0;
-
-  // Define the properties of the integration method.
-  const int    nBins = 400;
-  const double min   = _ps.mSq12min();
-  const double max   = _ps.mSq12max();
-  const double step  = ( max - min ) / double( nBins );
-
-  const double mSqSum = _ps.mSqSum();
-
-  // Define the variables at each bin.
-  double mSq12;
-  double mSq13;
-  double mSq23;
-
-  double funcs;
-  std::complex< double > ampDir;
-  std::complex< double > ampCnj;
-
-  // Compute the integral on the grid.
-  for ( int binX = 0; binX < nBins; ++binX )
-    for ( int binY = 0; binY < nBins; ++binY )
-    {
-      mSq12 = min + step * ( binX + 0.5 );
-      mSq13 = min + step * ( binY + 0.5 );
-      mSq23 = mSqSum - mSq12 - mSq13;
-
-      // Proceed only if the point lies inside the kinematically allowed Dalitz region.
-      // std::norm returns the squared modulus of the complex number, not its norm.
-      if ( _ps.contains( mSq12, mSq13, mSq23 ) )
-      {
-        funcs = evaluateFuncs( mSq12, mSq13, mSq23 );
-        ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
-        ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
-
-        _nDir += std::norm( ampDir ) * funcs;
-        _nCnj += std::norm( ampCnj ) * funcs;
-        _nXed += conj( ampDir ) * ampCnj * funcs;
-      }
-    }
-
-  const double& stepSq = std::pow( step, 2 );
-  _nDir *= stepSq;
-  _nCnj *= stepSq;
-  _nXed *= stepSq;
+  // Compute the norm components on the grid.
+  double maxDir;
+  double maxCnj;
+  normIntegrals( _nDir, _nCnj, _nXed, maxDir, maxCnj );
 
   _fixedAmp = _amp.isFixed();
 }
@@ -258,38 +216,37 @@ void Decay3BodyMix::cache()
 
 const std::map< unsigned, std::vector< std::complex< double > > > Decay3BodyMix::cacheComplex( const Dataset& data )
 {
-  // Determine whether the amplitudes should be cached, i.e. only if all their parameters are fixed.
+  // The amplitudes are cached if all their parameters are fixed, and computed
+  //    for each block of events through the array kernels otherwise.
   _cacheAmps = _amp.isFixed();
+  _blockAmps = ! _cacheAmps;
 
   std::map< unsigned, std::vector< std::complex< double > > > cached;
 
+  // Get an index for the complex amplitudes.
+  _ampDirCache = assignCacheIdxComplex();
+  _ampCnjCache = assignCacheIdxComplex();
+
   if ( ! _cacheAmps )
     return cached;
 
-  // Get an index for the cached complex amplitudes.
-  _ampDirCache = _cacheIdxComplex++;
-  _ampCnjCache = _cacheIdxComplex++;
-
-  double mSq12;
-  double mSq13;
-  double mSq23;
-
   // Cache the direct and conjugated amplitudes for every point in the given dataset.
-  const std::size_t& size = data.size();
-  for ( std::size_t entry = 0; entry < size; ++entry )
-  {
-    mSq12 = data.value( _mSq12, entry );
-    mSq13 = data.value( _mSq13, entry );
-    mSq23 = data.value( _mSq23, entry );
-
-    cached[ _ampDirCache ].push_back( _amp.evaluate( _ps, mSq12, mSq13, mSq23 ) );
-    cached[ _ampCnjCache ].push_back( _amp.evaluate( _ps, mSq13, mSq12, mSq23 ) );
-  }
+  cacheAmps( data, cached[ _ampDirCache ], cached[ _ampCnjCache ] );
 
   return cached;
 }
 
 
+void Decay3BodyMix::cacheBlock( const Dataset&                                               data  ,
+                                const std::size_t&                                           first ,
+                                const std::size_t&                                           last  ,
+                                std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const
+{
+  if ( _blockAmps )
+    cacheAmps( data, first, last, cacheC[ _ampDirCache ], cacheC[ _ampCnjCache ] );
+}
+
+
 // Unnormalized evaluation. Calculate:
 // | A + Abar |^2            | A* - Abar* |^2                [ A + Abar   A* - Abar*            ]
 // | -------- |   psi_+(t) + | ---------- |   psi_-(t) + 2 Re[ -------- * ---------- * psi_i(t) ]
@@ -347,7 +304,7 @@ const double Decay3BodyMix::evaluate( const std::vector< double >&
                                       const std::vector< double >&                 cacheR,
                                       const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
 {
-  if ( ! _cacheAmps )
+  if ( ! _cacheAmps && ! _blockAmps )
     return evaluate( vars );
 
   std::map< std::string, Variable >::const_iterator&& tpos = _varMap.find( _t );
@@ -464,69 +421,244 @@ const Decay3BodyMix operator*( const Function& left, Decay3BodyMix right )
 
 
 
-const std::map< std::string, double > Decay3BodyMix::generate() const throw( PdfException )
+void Decay3BodyMix::coefficients( const double& mSq12, const double& mSq13, const double& mSq23,
+                                  std::complex< double >& apb2, std::complex< double >& amb2 ) const
+{
+  std::complex< double > ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
+  std::complex< double > ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
+  if ( _hasCPV )
+    ampCnj *= _qoverp.evaluate();
+
+  apb2 =          ( ampDir + ampCnj ) / 2.0;
+  amb2 = std::conj( ampDir - ampCnj ) / 2.0;
+}
+
+
+// Integral of a psi_+(t) + b psi_-(t) + 2 Re[ c psi_i(t) ] over all times.
+const double Decay3BodyMix::timeIntegral( const double& a, const double& b, const std::complex< double >& c ) const
 {
-  // Generate mSq12 and mSq13, and compute mSq23 from these.
-  const double& min12 = std::pow( _ps.m1()      + _ps.m2(), 2 );
-  const double& min13 = std::pow( _ps.m1()      + _ps.m3(), 2 );
-  const double& max12 = std::pow( _ps.mMother() - _ps.m3(), 2 );
-  const double& max13 = std::pow( _ps.mMother() - _ps.m2(), 2 );
+  const double&                gammaP = ( 1.0 - x() ) * gamma();
+  const double&                gammaM = ( 1.0 + x() ) * gamma();
+  const std::complex< double > gammaI = std::complex< double >( 1.0, - y() ) * gamma();
 
-  // Maximum value of the pdf.
-  const double& max = _maxPdf * tau();
+  return a / gammaP + b / gammaM + 2.0 * std::real( c / gammaI );
+}
 
-  // Sum of squared invariant masses of all particles (mother and daughters).
+
+// Solve for the time where the integral of the time dependence from it to
+//    infinity is a uniform fraction of the total, with Newton steps that fall
+//    back to bisection whenever they leave the bracket of the solution.
+const double Decay3BodyMix::generateTime( const double& a, const double& b, const std::complex< double >& c ) const
+{
+  const double&                gammaP = ( 1.0 - x() ) * gamma();
+  const double&                gammaM = ( 1.0 + x() ) * gamma();
+  const std::complex< double > gammaI = std::complex< double >( 1.0, - y() ) * gamma();
+
+  const auto density = [ & ]( const double& t )
+  {
+    return a * std::exp( - gammaP * t ) + b * std::exp( - gammaM * t ) + 2.0 * std::real( c * std::exp( - gammaI * t ) );
+  };
+
+  const auto survival = [ & ]( const double& t )
+  {
+    return a * std::exp( - gammaP * t ) / gammaP + b * std::exp( - gammaM * t ) / gammaM +
+           2.0 * std::real( c * std::exp( - gammaI * t ) / gammaI );
+  };
+
+  const double& total  = survival( 0.0 );
+  const double& target = ( 1.0 - Random::flat() ) * total;
+
+  double lower = 0.0;
+  double upper = tau();
+  while ( survival( upper ) > target )
+  {
+    lower  = upper;
+    upper *= 2.0;
+  }
+
+  double time = 0.5 * ( lower + upper );
+  for ( unsigned iter = 0; iter < 100; ++iter )
+  {
+    const double& diff = survival( time ) - target;
+    if ( std::abs( diff ) < 1e-14 * total )
+      break;
+
+    if ( diff > 0.0 )
+      lower = time;
+    else
+      upper = time;
+
+    if ( upper - lower < 1e-14 * upper )
+      break;
+
+    const double& value = density( time );
+    const double& step  = ( value > 0.0 ) ? time + diff / value : - 1.0;
+
+    time = ( step >= lower && step <= upper ) ? step : 0.5 * ( lower + upper );
+  }
+
+  return time;
+}
+
+
+// The maximum in each cell is first taken over the points of a grid with
+//    twice its resolution in the cell and its neighbours, so cells that lie
+//    only partly inside the Dalitz plot also have one. The points of each cell
+//    are then refined, doubling their number in each dimension, until its
+//    maximum grows by less than a percent twice in a row, which finds the
+//    peaks of the resonances narrower than the cells. It is finally increased by a safety
+//    factor.
+void Decay3BodyMix::cacheGenerator() const
+{
+  std::vector< double > pars;
+  const std::map< std::string, Parameter >& parMap = getPars();
+  for ( std::map< std::string, Parameter >::const_iterator par = parMap.begin(); par != parMap.end(); ++par )
+    pars.push_back( par->second.value() );
+
+  if ( ( pars == _genPars ) && ! _genMax.empty() )
+    return;
+
+  const double& min12  = _ps.mSq12min();
+  const double& min13  = _ps.mSq13min();
+  const double& step12 = ( _ps.mSq12max() - min12 ) / double( _genBins );
+  const double& step13 = ( _ps.mSq13max() - min13 ) / double( _genBins );
   const double& mSqSum = _ps.mSqSum();
 
-  double mSq12  = 0.0;
-  double mSq13  = 0.0;
-  double mSq23  = 0.0;
-  double gammat = 0.0;
-  double time   = 0.0;
+  const unsigned nNodes = 2 * _genBins + 1;
+  const unsigned maxSub = 64;
+
+  // Time-integrated pdf at a point, zero outside the Dalitz plot.
+  const auto integrated = [ & ]( const double& mSq12, const double& mSq13 )
+  {
+    const double& mSq23 = mSqSum - mSq12 - mSq13;
+    if ( ! _ps.contains( mSq12, mSq13, mSq23 ) )
+      return 0.0;
+
+    std::complex< double > apb2;
+    std::complex< double > amb2;
+    coefficients( mSq12, mSq13, mSq23, apb2, amb2 );
+
+    return timeIntegral( std::norm( apb2 ), std::norm( amb2 ), apb2 * amb2 ) * evaluateFuncs( mSq12, mSq13, mSq23 );
+  };
+
+  // Time-integrated pdf on the nodes.
+  std::vector< double > nodes( nNodes * nNodes, 0.0 );
+  for ( unsigned node12 = 0; node12 < nNodes; ++node12 )
+    for ( unsigned node13 = 0; node13 < nNodes; ++node13 )
+      nodes[ nNodes * node12 + node13 ] = integrated( min12 + 0.5 * step12 * node12, min13 + 0.5 * step13 * node13 );
+
+  _genMax.assign( _genBins * _genBins, 0.0 );
+  _genCdf.assign( _genBins * _genBins, 0.0 );
+
+  double total = 0.0;
+  for ( unsigned bin12 = 0; bin12 < _genBins; ++bin12 )
+    for ( unsigned bin13 = 0; bin13 < _genBins; ++bin13 )
+    {
+      const unsigned first12 = 2 * std::max( bin12, 1u ) - 2;
+      const unsigned first13 = 2 * std::max( bin13, 1u ) - 2;
+      const unsigned last12  = std::min( 2 * bin12 + 4, nNodes - 1 );
+      const unsigned last13  = std::min( 2 * bin13 + 4, nNodes - 1 );
+
+      double& max = _genMax[ _genBins * bin12 + bin13 ];
+      for ( unsigned node12 = first12; node12 <= last12; ++node12 )
+        for ( unsigned node13 = first13; node13 <= last13; ++node13 )
+          max = std::max( max, nodes[ nNodes * node12 + node13 ] );
+
+      // Maximum on the nodes of the cell itself, refined while it grows.
+      double cell = 0.0;
+      for ( unsigned node12 = 2 * bin12; node12 <= 2 * bin12 + 2; ++node12 )
+        for ( unsigned node13 = 2 * bin13; node13 <= 2 * bin13 + 2; ++node13 )
+          cell = std::max( cell, nodes[ nNodes * node12 + node13 ] );
+
+      unsigned converged = 0;
+      for ( unsigned sub = 4; ( sub <= maxSub ) && ( converged < 2 ); sub *= 2 )
+      {
+        double refined = 0.0;
+        for ( unsigned node12 = 0; node12 <= sub; ++node12 )
+          for ( unsigned node13 = 0; node13 <= sub; ++node13 )
+            refined = std::max( refined, integrated( min12 + step12 * ( bin12 + node12 / double( sub ) ),
+                                                     min13 + step13 * ( bin13 + node13 / double( sub ) ) ) );
+
+        converged = ( refined <= 1.01 * cell ) ? converged + 1 : 0;
+        cell      = std::max( cell, refined );
+      }
+
+      max    = 1.2 * std::max( max, cell );
+      total += max;
+      _genCdf[ _genBins * bin12 + bin13 ] = total;
+    }
+
+  if ( ! ( total > 0.0 ) )
+    throw PdfException( "Decay3BodyMix: the pdf vanishes on the grid of the generator." );
+
+  _genPars = pars;
+}
+
+
 
-  double pdfVal = 0.0;
+const std::map< std::string, double > Decay3BodyMix::generate() const throw( PdfException )
+{
+  cacheGenerator();
 
-  // Attempts to generate an event.
-  unsigned count = 10000;
+  const double& min12  = _ps.mSq12min();
+  const double& min13  = _ps.mSq13min();
+  const double& step12 = ( _ps.mSq12max() - min12 ) / double( _genBins );
+  const double& step13 = ( _ps.mSq13max() - min13 ) / double( _genBins );
 
-  std::map< std::string, double > values;
+  // Sum of squared invariant masses of all particles (mother and daughters).
+  const double& mSqSum = _ps.mSqSum();
 
-  while ( count-- )
+  double mSq12 = 0.0;
+  double mSq13 = 0.0;
+  double mSq23 = 0.0;
+
+  std::complex< double > apb2;
+  std::complex< double > amb2;
+
+  while ( true )
   {
-    // Generate uniform mSq12 and mSq13.
-    mSq12 = Random::flat( min12, max12 );
-    mSq13 = Random::flat( min13, max13 );
+    // Choose a cell with probability proportional to its maximum.
+    const std::size_t cell = std::upper_bound( _genCdf.begin(), _genCdf.end(), Random::flat( 0.0, _genCdf.back() ) ) - _genCdf.begin();
+    if ( cell >= _genCdf.size() )
+      continue;
+
+    mSq12 = min12 + step12 * ( cell / _genBins + Random::flat() );
+    mSq13 = min13 + step13 * ( cell % _genBins + Random::flat() );
     mSq23 = mSqSum - mSq12 - mSq13;
 
-    // Generate time according to q(t) = e^[ - ( 1 - |x| ) Gamma t ]
-    gammat = - std::log( Random::flat() ) / ( 1.0 - std::abs( x() ) );
-    time   = gammat / gamma();
+    if ( ! _ps.contains( mSq12, mSq13, mSq23 ) )
+      continue;
 
-    // Prepare to run accept-reject on p(t) / q(t).
-    pdfVal = this->evaluate( mSq12, mSq13, mSq23, time ) * std::exp( ( 1.0 - std::abs( x() ) ) * gammat );
+    coefficients( mSq12, mSq13, mSq23, apb2, amb2 );
+    const double& a = std::norm( apb2 );
+    const double& b = std::norm( amb2 );
+    const std::complex< double >& c = apb2 * amb2;
 
-    // Complain if the maximum value of the pdf was not properly estimated.
-    if ( pdfVal > max )
-      std::cout << "Problem: " << pdfVal << " > " << max
-                << " for ( " << mSq12 << ", " << mSq13 << ", " << mSq23 << ", " << time << " )" << std::endl;
+    const double& pdfVal = timeIntegral( a, b, c ) * evaluateFuncs( mSq12, mSq13, mSq23 );
 
-    // Apply the accept-reject decision.
-    if ( Random::flat( 0.0, max ) < pdfVal )
+    // A peak that the refinement missed can still exceed the maximum of its
+    //    cell. The maximum is then raised above the value found, and the event
+    //    is drawn again from the raised envelope. Only the events generated
+    //    before in that cell were sampled with the lower maximum.
+    if ( pdfVal > _genMax[ cell ] )
     {
+      const double& raise = 1.2 * pdfVal - _genMax[ cell ];
+
+      _genMax[ cell ] += raise;
+      for ( std::size_t next = cell; next < _genCdf.size(); ++next )
+        _genCdf[ next ] += raise;
+
+      continue;
+    }
+
+    if ( Random::flat( 0.0, _genMax[ cell ] ) < pdfVal )
+    {
+      std::map< std::string, double > values;
       values[ _mSq12 ] = mSq12;
       values[ _mSq13 ] = mSq13;
       values[ _mSq23 ] = mSq23;
-      values[ _t     ] = time;
+      values[ _t     ] = generateTime( a, b, c );
       return values;
     }
   }
-
-  std::cout << "Problem: too many attempts" << std::endl;
-  values[ _mSq12 ] = 0.0;
-  values[ _mSq13 ] = 0.0;
-  values[ _mSq23 ] = 0.0;
-  values[ _t     ] = 0.0;
-
-  return values;
 }
-
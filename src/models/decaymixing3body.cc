@@ -1,73 +1,417 @@
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <iterator>
+
+#include <cfit/dataset.hh>
+#include <cfit/function.hh>
+#include <cfit/random.hh>
 
 #include <cfit/models/decaymixing3body.hh>
 
-DecayMixing3Body::DecayMixing3Body( const Variable&   mSq12,
-                                    const Variable&   mSq13,
-                                    const Variable&   mSq23,
-                                    const Variable&   t    ,
-                                    const Amplitude&  amp  ,
-                                    const Parameter&  tau  ,
-                                    const Parameter&  x    ,
-                                    const Parameter&  y    ,
-                                    const PhaseSpace& ps     )
-  : DecayModel( mSq12, mSq13, mSq23, amp, ps ), _t( t ), _tau( tau ), _x( x ), _y( y )
+// Constructor without CP violation in the mixing, i.e. q/p = 1.
+DecayMixing3Body::DecayMixing3Body( const Variable&      mSq12,
+                                    const Variable&      mSq13,
+                                    const Variable&      mSq23,
+                                    const Variable&      t    ,
+                                    const Amplitude&     amp  ,
+                                    const ParameterExpr& tau  ,
+                                    const ParameterExpr& x    ,
+                                    const ParameterExpr& y    ,
+                                    const PhaseSpace&    ps     )
+  : DecayModel( mSq12, mSq13, mSq23, amp, ps ),
+    _mSq12( mSq12.name() ), _mSq13( mSq13.name() ), _mSq23( mSq23.name() ), _t( t.name() ),
+    _idx12( 0 ), _idx13( 0 ), _idx23( 0 ), _idxT( 0 ),
+    _tau( tau ), _x( x ), _y( y ), _qoverp( 1.0 ), _hasCPV( false ),
+    _tauVal( 1.0 ), _xVal( 0.0 ), _yVal( 0.0 ), _qoverpVal( 1.0 ),
+    _iDir( 0.0 ), _iCnj( 0.0 ), _iXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
+    _maxDir( 0.0 ), _maxCnj( 0.0 ), _maxPdf( 0.0 ),
+    _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 ), _cacheFuncs( false ), _funcsCache( 0 )
 {
-  // Push the variables.
-  push( _t );
+  // Make the variables available to cfit.
+  // The squared invariant masses are already made available by the DecayModel constructor.
+  push( t );
+
+  // Make all the parameters in tau, x and y available to cfit.
+  push( tau );
+  push( x   );
+  push( y   );
 
-  // Push the parameters.
-  push( _tau );
-  push( _x   );
-  push( _y   );
+  // Variables are passed to evaluate sorted by name.
+  _idx12 = std::distance( _varMap.begin(), _varMap.find( _mSq12 ) );
+  _idx13 = std::distance( _varMap.begin(), _varMap.find( _mSq13 ) );
+  _idx23 = std::distance( _varMap.begin(), _varMap.find( _mSq23 ) );
+  _idxT  = std::distance( _varMap.begin(), _varMap.find( _t     ) );
+
+  setParExpr();
+  cache();
 }
 
-double DecayMixing3Body::evaluate() const throw( PdfException )
+
+// Constructor with CP violation in the mixing.
+DecayMixing3Body::DecayMixing3Body( const Variable&      mSq12 ,
+                                    const Variable&      mSq13 ,
+                                    const Variable&      mSq23 ,
+                                    const Variable&      t     ,
+                                    const Amplitude&     amp   ,
+                                    const ParameterExpr& tau   ,
+                                    const ParameterExpr& x     ,
+                                    const ParameterExpr& y     ,
+                                    const CoefExpr&      qoverp,
+                                    const PhaseSpace&    ps      )
+  : DecayModel( mSq12, mSq13, mSq23, amp, ps ),
+    _mSq12( mSq12.name() ), _mSq13( mSq13.name() ), _mSq23( mSq23.name() ), _t( t.name() ),
+    _idx12( 0 ), _idx13( 0 ), _idx23( 0 ), _idxT( 0 ),
+    _tau( tau ), _x( x ), _y( y ), _qoverp( qoverp ), _hasCPV( true ),
+    _tauVal( 1.0 ), _xVal( 0.0 ), _yVal( 0.0 ), _qoverpVal( 1.0 ),
+    _iDir( 0.0 ), _iCnj( 0.0 ), _iXed( 0.0 ), _norm( 1.0 ), _fixed( false ),
+    _maxDir( 0.0 ), _maxCnj( 0.0 ), _maxPdf( 0.0 ),
+    _cacheAmps( false ), _blockAmps( false ), _ampDirCache( 0 ), _ampCnjCache( 0 ), _cacheFuncs( false ), _funcsCache( 0 )
 {
-  // Phase space amplitudes of the decay of the particle and that of the antiparticle.
-  std::complex< double > ampDirect = _amp.evaluate( _ps, _mSq12.value(), _mSq13.value(), _mSq23.value() );
-  std::complex< double > ampConjug = _amp.evaluate( _ps, _mSq13.value(), _mSq12.value(), _mSq23.value() );
+  // Make the variables available to cfit.
+  // The squared invariant masses are already made available by the DecayModel constructor.
+  push( t );
 
-  // Assume there's no direct CP violation.
-  std::complex< double > barAOverA = ampConjug / ampDirect;
+  // Make all the parameters in tau, x, y and qoverp available to cfit.
+  push( tau    );
+  push( x      );
+  push( y      );
+  push( qoverp );
 
-  // TEMPORARY.
-  double _qp = 1;
-  double _norm = 1;
+  // Variables are passed to evaluate sorted by name.
+  _idx12 = std::distance( _varMap.begin(), _varMap.find( _mSq12 ) );
+  _idx13 = std::distance( _varMap.begin(), _varMap.find( _mSq13 ) );
+  _idx23 = std::distance( _varMap.begin(), _varMap.find( _mSq23 ) );
+  _idxT  = std::distance( _varMap.begin(), _varMap.find( _t     ) );
 
-  // CP violation in the interference. _qp implements CP violation in the mixing.
-  std::complex< double > chi = _qp * barAOverA;
+  setParExpr();
+  cache();
+}
 
-  // Gamma t. Notice that Gamma is not 1 / tau, since it also depends on x and y,
-  //    as well as on integrals of products of amplitudes over the Dalitz plot.
-  double gt = _t.value() / _tau.value();
 
-  // Compute time dependent amplitude.
-  std::complex< double > amp = .5 * ampDirect * ( ( 1. + chi ) * e1( gt ) + ( 1. - chi ) * e2( gt ) );
 
-  // std::norm returns the squared modulus of the complex number, not its norm.
-  return std::norm( amp ) / _norm;
+// Copy function using default copy constructor.
+DecayMixing3Body* DecayMixing3Body::copy() const
+{
+  return new DecayMixing3Body( *this );
 }
 
 
-double DecayMixing3Body::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+
+// Evaluate the parameter expressions only once per parameter change, since
+//    their values are needed for every event.
+void DecayMixing3Body::setParExpr()
 {
-  throw PdfException( "Do not use evaluate( vars ) in decaymixing3body" );
+  _tau.setPars( _parMap );
+  _x  .setPars( _parMap );
+  _y  .setPars( _parMap );
+
+  _tauVal = _tau.evaluate();
+  _xVal   = _x  .evaluate();
+  _yVal   = _y  .evaluate();
+
+  if ( _hasCPV )
+  {
+    _qoverp.setPars( _parMap );
+    _qoverpVal = _qoverp.evaluate();
+  }
 }
 
 
-// < f | H | D^0 (t) > = 1/2 * [ ( 1 + \chi_f ) * A_f * e_1(gt) + ( 1 - \chi_f ) * A_f * e_2(gt) ]
-std::complex< double > DecayMixing3Body::e1( const double& gt ) const
+
+// Calculate, in terms of S = A + q/p Abar and D = A - q/p Abar,
+//    1/4 [ |S|^2 |e_1|^2 + |D|^2 |e_2|^2 + 2 Re( S D* e_1 e_2* ) ],
+//    with |e_1|^2 = e^-(1+y)gt, |e_2|^2 = e^-(1-y)gt and e_1 e_2* = e^-(1+ix)gt.
+const double DecayMixing3Body::ampSq( const std::complex< double >& ampDir, const std::complex< double >& ampCnj, const double& t ) const
 {
-  double real = exp ( - ( 1. + _y.value() ) * gt / 2. ) * cos(   _x.value() * gt / 2. );
-  double imag = exp ( - ( 1. + _y.value() ) * gt / 2. ) * sin( - _x.value() * gt / 2. );
+  const std::complex< double >&& qAmpCnj = _qoverpVal * ampCnj;
+
+  const std::complex< double >&& sum  = ampDir + qAmpCnj;
+  const std::complex< double >&& diff = ampDir - qAmpCnj;
+
+  const double&& gt   = t / _tauVal;
+  const double&& expT = std::exp( - gt );
+  const double&& expY = std::exp( - _yVal * gt );
+  const double&& xgt  = _xVal * gt;
 
-  return std::complex< double >( real, imag );
+  double value = 0.0;
+  value += std::norm( sum  ) * expY;
+  value += std::norm( diff ) / expY;
+  value += 2.0 * std::real( sum * std::conj( diff ) * std::complex< double >( std::cos( xgt ), - std::sin( xgt ) ) );
+
+  return 0.25 * value * expT;
 }
 
-std::complex< double > DecayMixing3Body::e2( const double& gt ) const
+
+
+void DecayMixing3Body::cacheIntegrals()
 {
-  double real = exp ( - ( 1. - _y.value() ) * gt / 2. ) * cos( _x.value() * gt / 2. );
-  double imag = exp ( - ( 1. - _y.value() ) * gt / 2. ) * sin( _x.value() * gt / 2. );
+  // If the amplitude and the efficiency are fixed and the integrals
+  //    have already been computed, there is nothing to recompute.
+  if ( _fixed )
+    return;
+
+  normIntegrals( _iDir, _iCnj, _iXed, _maxDir, _maxCnj );
+
+  _fixed = _amp.isFixed();
+  for ( std::vector< Function >::const_iterator func = _funcs.begin(); func != _funcs.end(); ++func )
+    _fixed &= func->isFixed();
+}
+
+
+
+// The time integrals of |e_1|^2, |e_2|^2 and e_1 e_2* are tau / ( 1 + y ),
+//    tau / ( 1 - y ) and tau / ( 1 + ix ), so the norm only needs the Dalitz
+//    plot integrals of |S|^2, |D|^2 and S D*, which are linear combinations
+//    of those of |A|^2, |Abar|^2 and A* Abar.
+void DecayMixing3Body::cache()
+{
+  // Compute the Dalitz plot integrals, only if the amplitude or the
+  //    efficiency are not fixed or they have not yet been computed.
+  cacheIntegrals();
+
+  const std::complex< double >&& qXed = _qoverpVal * _iXed;
+  const double&&                 qSq  = std::norm( _qoverpVal );
+
+  const double&&                 iSum  = _iDir + qSq * _iCnj + 2.0 * std::real( qXed );
+  const double&&                 iDiff = _iDir + qSq * _iCnj - 2.0 * std::real( qXed );
+  const std::complex< double >&& iXed  = std::complex< double >( _iDir - qSq * _iCnj, 2.0 * std::imag( qXed ) );
+
+  _norm  = iSum  / ( 1.0 + _yVal );
+  _norm += iDiff / ( 1.0 - _yVal );
+  _norm += 2.0 * std::real( iXed / std::complex< double >( 1.0, _xVal ) );
+  _norm *= 0.25 * _tauVal;
+}
+
+
+
+const std::map< unsigned, std::vector< double > > DecayMixing3Body::cacheReal( const Dataset& data )
+{
+  // Cache the product of efficiency functions only if all of them are fixed.
+  _cacheFuncs = ! _funcs.empty();
+  for ( std::vector< Function >::const_iterator func = _funcs.begin(); func != _funcs.end(); ++func )
+    _cacheFuncs &= func->isFixed();
+
+  std::map< unsigned, std::vector< double > > cached;
+
+  if ( ! _cacheFuncs )
+    return cached;
+
+  // Get an index for the cached efficiency.
+  _funcsCache = assignCacheIdxReal();
+
+  cacheFuncs( data, cached[ _funcsCache ] );
+
+  return cached;
+}
+
+
+
+const std::map< unsigned, std::vector< std::complex< double > > > DecayMixing3Body::cacheComplex( const Dataset& data )
+{
+  // The amplitudes are cached if all their parameters are fixed, and computed
+  //    for each block of events through the array kernels otherwise.
+  _cacheAmps = _amp.isFixed();
+  _blockAmps = ! _cacheAmps;
+
+  std::map< unsigned, std::vector< std::complex< double > > > cached;
+
+  // Get an index for the complex amplitudes.
+  _ampDirCache = assignCacheIdxComplex();
+  _ampCnjCache = assignCacheIdxComplex();
+
+  if ( ! _cacheAmps )
+    return cached;
+
+  // Cache the direct and conjugated amplitudes for every point in the given dataset.
+  cacheAmps( data, cached[ _ampDirCache ], cached[ _ampCnjCache ] );
+
+  return cached;
+}
+
+
+void DecayMixing3Body::cacheBlock( const Dataset&                                               data  ,
+                                   const std::size_t&                                           first ,
+                                   const std::size_t&                                           last  ,
+                                   std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const
+{
+  if ( _blockAmps )
+    cacheAmps( data, first, last, cacheC[ _ampDirCache ], cacheC[ _ampCnjCache ] );
+}
+
+
+
+const double DecayMixing3Body::evaluateUnnorm( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const
+{
+  const std::complex< double >&& ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
+  const std::complex< double >&& ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
+
+  return ampSq( ampDir, ampCnj, t ) * evaluateFuncs( mSq12, mSq13, mSq23 );
+}
+
+
+const double DecayMixing3Body::evaluate( const double& mSq12, const double& mSq13, const double& mSq23, const double& t ) const
+{
+  return evaluateUnnorm( mSq12, mSq13, mSq23, t ) / _norm;
+}
+
+
+const double DecayMixing3Body::evaluate( const double& mSq12, const double& mSq13, const double& t ) const
+{
+  const double& mSq23 = _ps.mSqSum() - mSq12 - mSq13;
+
+  return evaluateUnnorm( mSq12, mSq13, mSq23, t ) / _norm;
+}
+
+
+const double DecayMixing3Body::evaluate( const std::vector< double >& vars ) const throw( PdfException )
+{
+  if ( vars.size() != 4 )
+    throw PdfException( "DecayMixing3Body can only take 4 arguments." );
+
+  return evaluate( vars[ _idx12 ], vars[ _idx13 ], vars[ _idx23 ], vars[ _idxT ] );
+}
+
+
+
+// Use the cached amplitudes and efficiency when available. Then the cost per
+//    event is reduced to a few complex products and the time dependence.
+const double DecayMixing3Body::evaluate( const std::vector< double >&                 vars  ,
+                                         const std::vector< double >&                 cacheR,
+                                         const std::vector< std::complex< double > >& cacheC ) const throw( PdfException )
+{
+  if ( vars.size() != 4 )
+    throw PdfException( "DecayMixing3Body can only take 4 arguments." );
+
+  const double& mSq12 = vars[ _idx12 ];
+  const double& mSq13 = vars[ _idx13 ];
+  const double& mSq23 = vars[ _idx23 ];
+  const double& t     = vars[ _idxT  ];
+
+  const double&& funcs = _cacheFuncs ? cacheR[ _funcsCache ] : evaluateFuncs( mSq12, mSq13, mSq23 );
+
+  if ( _cacheAmps || _blockAmps )
+    return ampSq( cacheC[ _ampDirCache ], cacheC[ _ampCnjCache ], t ) * funcs / _norm;
+
+  const std::complex< double >&& ampDir = _amp.evaluate( _ps, mSq12, mSq13, mSq23 );
+  const std::complex< double >&& ampCnj = _amp.evaluate( _ps, mSq13, mSq12, mSq23 );
+
+  return ampSq( ampDir, ampCnj, t ) * funcs / _norm;
+}
+
+
+
+const double DecayMixing3Body::project( const std::string& varName, const double& x ) const throw( PdfException )
+{
+  throw PdfException( "DecayMixing3Body::project is not implemented yet" );
+
+  return 0.0;
+}
+
+
+// No need to append an operator, since it can only be multiplication.
+const DecayMixing3Body& DecayMixing3Body::operator*=( const Function& right )
+{
+  // Check that the function does not depend on any variables that the model does not.
+  const std::map< std::string, Variable >& varMap = right.getVarMap();
+  for ( std::map< std::string, Variable >::const_iterator var = varMap.begin(); var != varMap.end(); ++var )
+    if ( ! _varMap.count( var->second.name() ) )
+      throw PdfException( "Cannot multiply a DecayMixing3Body pdf model by a function that depends on other variables." );
+
+  // Consider the function parameters as own ones.
+  const std::map< std::string, Parameter >& parMap = right.getParMap();
+  _parMap.insert( parMap.begin(), parMap.end() );
+
+  // Append the function to the functions vector.
+  _funcs.push_back( right );
+
+  // Recompute the norm, since the pdf shape has changed under this operation.
+  _fixed = false;
+  cache();
+
+  return *this;
+}
+
+
+
+const DecayMixing3Body operator*( DecayMixing3Body left, const Function& right )
+{
+  return left *= right;
+}
+
+
+
+const DecayMixing3Body operator*( const Function& left, DecayMixing3Body right )
+{
+  return right *= left;
+}
+
+
+
+// Accept-reject on a uniform Dalitz plot and an exponential decay time.
+//    Since | e_1 |, | e_2 | <= e^-(1-|y|)gt/2, the pdf is bounded by
+//    1/4 ( |S| + |D| )^2 e^-(1-|y|)gt <= ( |A|^2 + |q/p|^2 |Abar|^2 ) e^-(1-|y|)gt,
+//    so generating gt with rate 1 - |y| leaves a time-independent bound.
+const std::map< std::string, double > DecayMixing3Body::generate() const throw( PdfException )
+{
+  // Generate mSq12 and mSq13, and compute mSq23 from these.
+  const double& min12 = std::pow( _ps.m1()      + _ps.m2(), 2 );
+  const double& min13 = std::pow( _ps.m1()      + _ps.m3(), 2 );
+  const double& max12 = std::pow( _ps.mMother() - _ps.m3(), 2 );
+  const double& max13 = std::pow( _ps.mMother() - _ps.m2(), 2 );
+
+  // Sum of squared invariant masses of all particles (mother and daughters).
+  const double& mSqSum = _ps.mSqSum();
+
+  // Bound of the unnormalized pdf times e^(1-|y|)gt. Allow for some margin
+  //    over the maxima found on the grid, unless the maximum has been set.
+  const double& max = ( _maxPdf > 0.0 ) ? _maxPdf : 1.2 * ( _maxDir + std::norm( _qoverpVal ) * _maxCnj );
+
+  const double& rate = 1.0 - std::abs( _yVal );
+
+  double mSq12  = 0.0;
+  double mSq13  = 0.0;
+  double mSq23  = 0.0;
+  double gt     = 0.0;
+  double time   = 0.0;
+
+  double pdfVal = 0.0;
+
+  // Attempts to generate an event.
+  unsigned count = 100000;
+
+  std::map< std::string, double > values;
+
+  while ( count-- )
+  {
+    // Generate uniform mSq12 and mSq13.
+    mSq12 = Random::flat( min12, max12 );
+    mSq13 = Random::flat( min13, max13 );
+    mSq23 = mSqSum - mSq12 - mSq13;
+
+    if ( ! _ps.contains( mSq12, mSq13, mSq23 ) )
+      continue;
+
+    // Generate time according to q(t) = e^[ - ( 1 - |y| ) t / tau ].
+    gt   = - std::log( Random::flat() ) / rate;
+    time = gt * _tauVal;
+
+    // Prepare to run accept-reject on p(t) / q(t).
+    pdfVal = evaluateUnnorm( mSq12, mSq13, mSq23, time ) * std::exp( rate * gt );
+
+    if ( pdfVal > max )
+      throw PdfException( "DecayMixing3Body: the maximum of the pdf is too low. Use setMaxPdf to increase it." );
+
+    // Apply the accept-reject decision.
+    if ( Random::flat( 0.0, max ) < pdfVal )
+    {
+      values[ _mSq12 ] = mSq12;
+      values[ _mSq13 ] = mSq13;
+      values[ _mSq23 ] = mSq23;
+      values[ _t     ] = time;
+      return values;
+    }
+  }
 
-  return std::complex< double >( real, imag );
+  throw PdfException( "DecayMixing3Body: too many attempts to generate an event." );
 }
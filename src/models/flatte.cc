@@ -1,5 +1,6 @@
 
 #include <complex>
+#include <sstream>
 #include <cfit/phasespace.hh>
 #include <cfit/models/flatte.hh>
 
@@ -23,6 +24,63 @@ std::complex< double > Flatte::propagator( const PhaseSpace& ps, const double& m
 }
 
 
+// With the squared Blatt-Weisskopf factors in the imaginary parts. The phase
+//    space factors of the second channel are both divided by mSqAB, as in the
+//    scalar propagator, so only the ratio of the square roots remains.
+void Flatte::propagators( const PhaseSpace& ps, const double* mSqAB, double* re, double* im, const std::size_t& n ) const
+{
+  blattWeisskopfSq( ps, mSqAB, im, n );
+
+  const double mSq     = this->mSq();
+  const double mGamma0 = mGamma();
+  const double g1Sq    = gamma1Sq();
+  const double g2Sq    = gamma2Sq();
+  const double num     = mGamma0 * g1Sq;
+
+  const double sum1    = ps.mSq( _resoA ) + ps.mSq( _resoB );
+  const double diff1   = std::pow( ps.mSq( _resoA ) - ps.mSq( _resoB ), 2 );
+  const double sum2    = m02aSq() + m02bSq();
+  const double diff2   = std::pow( m02aSq() - m02bSq(), 2 );
+
+  const double rho10   = rho( ps, mSq );
+  const double root20  = std::sqrt( kallen( mSq, m02aSq(), m02bSq() ) );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double s  = mSqAB[ point ];
+    const double g1 = g1Sq * std::sqrt( s * s - 2.0 * s * sum1 + diff1 ) / s / rho10;
+    const double g2 = g2Sq * std::sqrt( s * s - 2.0 * s * sum2 + diff2 ) / root20;
+
+    const double a   = mSq - s;
+    const double b   = mGamma0 * ( g1 + g2 ) * im[ point ];
+    const double den = a * a + b * b;
+
+    re[ point ] = num * a / den;
+    im[ point ] = num * b / den;
+  }
+}
+
+
+const std::string Flatte::propagatorCode( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  std::ostringstream out;
+  out << "  const double gamma1Sq = std::pow( " << parCode( 3, pars ) << ", 2 );\n"
+      << "  const double gamma2Sq = std::pow( " << parCode( 4, pars ) << ", 2 );\n"
+      << "  const double m02aSq   = std::pow( " << parCode( 5, pars ) << ", 2 );\n"
+      << "  const double m02bSq   = std::pow( " << parCode( 6, pars ) << ", 2 );\n"
+      << "  const double mGamma0  = m * w;\n"
+      << "  const double rho10    = rho( mSq );\n"
+      << "  const double rho1     = rho( s );\n"
+      << "  const double g1       = gamma1Sq * rho1 / rho10;\n"
+      << "  const double rho20    = std::sqrt( kallen( mSq, m02aSq, m02bSq ) ) / s;\n"
+      << "  const double rho2     = std::sqrt( kallen( s  , m02aSq, m02bSq ) ) / s;\n"
+      << "  const double g2       = gamma2Sq * rho2 / rho20;\n"
+      << "  prop = mGamma0 * gamma1Sq / ( mSq - s - std::complex< double >( 0., 1. ) * mGamma0 * ( g1 + g2 ) * std::pow( bw( s ), 2 ) );\n";
+
+  return out.str();
+}
+
+
 Flatte* Flatte::copy() const
 {
   return new Flatte( *this );
@@ -5,6 +5,7 @@
 #include <cfit/random.hh>
 
 #include <cfit/dataset.hh>
+#include <cfit/threads.hh>
 
 /*
   Definitions of several functions based on the definition of the norm.
@@ -159,12 +160,17 @@ const std::map< unsigned, std::vector< double > > Gauss::cacheReal( const Datase
     return cached;
 
   // Get an index for the cached complex amplitudes.
-  _cacheIdx = _cacheIdxReal++;
+  _cacheIdx = assignCacheIdxReal();
 
-  const std::string& varname = getVar( 0 ).name();
-  const std::size_t& size = data.size();
-  for ( std::size_t entry = 0; entry < size; ++entry )
-    cached[ _cacheIdx ].push_back( evaluate( data.value( varname, entry ) ) );
+  if ( ! data.size() )
+    return cached;
+
+  // Look the column up once, and fill the cache in parallel chunks of events.
+  const std::vector< std::pair< double, double > >& column = data.column( getVar( 0 ).name() );
+
+  std::vector< double >& values = cached[ _cacheIdx ];
+  values.resize( data.size() );
+  Threads::fill( values, [ & ]( const std::size_t& entry ) { return evaluate( column[ entry ].first ); } );
 
   return cached;
 }
@@ -1,5 +1,6 @@
 
 #include <complex>
+#include <sstream>
 #include <cfit/phasespace.hh>
 #include <cfit/models/glass.hh>
 
@@ -26,6 +27,90 @@ std::complex< double > GLass::propagator( const PhaseSpace& ps, const double& mS
 }
 
 
+// The phases only depend on the parameters, so the exponentials are computed
+//    once. Per point, with D = qCotDeltaB^2 + q^2,
+//    ( qCotDeltaB + i q ) / ( qCotDeltaB - i q ) = ( qCotDeltaB + i q )^2 / D,
+//    1 / ( qCotDeltaB - i q )                    = ( qCotDeltaB + i q )   / D.
+void GLass::propagators( const PhaseSpace& ps, const double* mSqAB, double* re, double* im, const std::size_t& n ) const
+{
+  runningWidth( ps, mSqAB, im, n );
+
+  const double m      = this->m();
+  const double mSq    = m * m;
+  const double scale  = m * width() / rho( ps, mSq );
+
+  const double phaseR = phiR() + 2. * phiB();
+  const double rRe    = lassR() * std::cos( phaseR );
+  const double rIm    = lassR() * std::sin( phaseR );
+  const double cosB   = std::cos( phiB() );
+  const double sinB   = std::sin( phiB() );
+  const double bRe    = lassB() / 2. * cosB;
+  const double bIm    = lassB() / 2. * sinB;
+  const double invA   = 1. / lassa();
+  const double halfR  = lassr() / 2.;
+
+  const double sum    = ps.mSq( _resoA ) + ps.mSq( _resoB );
+  const double diff2  = std::pow( ps.mSq( _resoA ) - ps.mSq( _resoB ), 2 );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double s     = mSqAB[ point ];
+    const double qSqAB = ( s * s - 2.0 * s * sum + diff2 ) / ( 4.0 * s );
+    const double qAB   = std::sqrt( qSqAB );
+
+    const double qCot  = invA + halfR * qSqAB;
+    const double cot   = qCot / qAB;
+    const double d     = qCot * qCot + qSqAB;
+
+    // Phase of the scattering term.
+    const double phRe  = ( qCot * qCot - qSqAB ) / d;
+    const double phIm  = 2. * qCot * qAB / d;
+
+    // Breit-Wigner term.
+    const double a     = mSq - s;
+    const double b     = m * im[ point ];
+    const double bw    = scale / ( a * a + b * b );
+    const double bwRe  = a * bw;
+    const double bwIm  = b * bw;
+
+    const double xRe   = rRe * phRe - rIm * phIm;
+    const double xIm   = rRe * phIm + rIm * phRe;
+
+    // Background term.
+    const double bg    = std::sqrt( s ) * ( cosB + sinB * cot ) / d;
+
+    re[ point ] = xRe * bwRe - xIm * bwIm + bg * ( bRe * qCot - bIm * qAB );
+    im[ point ] = xRe * bwIm + xIm * bwRe + bg * ( bRe * qAB  + bIm * qCot );
+  }
+}
+
+
+const std::string GLass::propagatorCode( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  std::ostringstream out;
+  out << "  const double lassR = " << parCode( 3, pars ) << ";\n"
+      << "  const double lassB = " << parCode( 4, pars ) << ";\n"
+      << "  const double phiR  = " << parCode( 5, pars ) << ";\n"
+      << "  const double phiB  = " << parCode( 6, pars ) << ";\n"
+      << "  const double lassr = " << parCode( 7, pars ) << ";\n"
+      << "  const double lassa = " << parCode( 8, pars ) << ";\n"
+      << "  const std::complex< double > I( 0., 1. );\n"
+      << "  const double qAB        = q  ( s );\n"
+      << "  const double qSqAB      = qSq( s );\n"
+      << "  const double rho0       = rho( mSq );\n"
+      << "  const double qCotDeltaB = 1. / lassa + lassr * qSqAB / 2.;\n"
+      << "  const double cotDeltaB  = qCotDeltaB / qAB;\n"
+      << "  std::complex< double > rTerm = lassR * std::exp( I * phiR + 2. * I * phiB );\n"
+      << "  rTerm *= ( qCotDeltaB + I * qAB ) / ( qCotDeltaB - I * qAB );\n"
+      << "  rTerm *= m * w / rho0 / ( mSq - s - I * m * runningWidth( s ) );\n"
+      << "  std::complex< double > bTerm = lassB * std::sqrt( s ) / 2. * std::exp( I * phiB );\n"
+      << "  bTerm *= ( std::cos( phiB ) + std::sin( phiB ) * cotDeltaB ) / ( qCotDeltaB - I * qAB );\n"
+      << "  prop = rTerm + bTerm;\n";
+
+  return out.str();
+}
+
+
 GLass* GLass::copy() const
 {
   return new GLass( *this );
@@ -1,6 +1,8 @@
 
 #include <complex>
+#include <sstream>
 #include <cfit/phasespace.hh>
+#include <cfit/codegen.hh>
 #include <cfit/models/gounarissakurai.hh>
 
 std::complex< double > GounarisSakurai::propagator( const PhaseSpace& ps, const double& mSqAB ) const
@@ -22,6 +24,85 @@ std::complex< double > GounarisSakurai::propagator( const PhaseSpace& ps, const
 }
 
 
+// The terms at the mass of the resonance are computed once, and only the
+//    function h, with a square root and a logarithm, is evaluated per point.
+void GounarisSakurai::propagators( const PhaseSpace& ps, const double* mSqAB, double* re, double* im, const std::size_t& n ) const
+{
+  runningWidth( ps, mSqAB, im, n );
+
+  const double m     = mass();
+  const double mSq   = m * m;
+  const double mA    = ps.m  ( _resoA );
+  const double mASq  = ps.mSq( _resoA );
+  const double q0    = q  ( ps, mSq );
+  const double q0Sq  = qSq( ps, mSq );
+
+  double gsd = ( 3. / M_PI ) * ( mASq / q0Sq ) * log( ( m + 2. * q0 ) / ( 2. * mA ) );
+  gsd += m / ( 2. * M_PI * q0 ) - ( mASq * m ) / ( M_PI * std::pow( q0, 3 ) );
+
+  const double numer  = 1. + gsd * width() / m;
+  const double factor = width() * mSq / q0;
+  const double h0     = gsh     ( ps, mSq );
+  const double hPrime = gshprime( ps, mSq );
+
+  const double sum    = ps.mSq( _resoA ) + ps.mSq( _resoB );
+  const double diff2  = std::pow( ps.mSq( _resoA ) - ps.mSq( _resoB ), 2 );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double s     = mSqAB[ point ];
+    const double m12   = std::sqrt( s );
+    const double qSqAB = ( s * s - 2.0 * s * sum + diff2 ) / ( 4.0 * s );
+    const double qAB   = std::sqrt( qSqAB );
+    const double h     = ( 2. / M_PI ) * ( qAB / m12 ) * std::log( ( m12 + 2. * qAB ) / ( 2. * mA ) );
+    const double f     = factor * ( ( qSqAB / q0Sq ) * ( h - h0 ) + ( mSq - s ) * hPrime );
+
+    const double a   = mSq - s + f;
+    const double b   = ( _buggy ? m12 : m ) * im[ point ];
+    const double den = a * a + b * b;
+
+    re[ point ] = numer * a / den;
+    im[ point ] = numer * b / den;
+  }
+}
+
+
+const std::string GounarisSakurai::propagatorCode( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  const std::string& pi = Codegen::literal( M_PI );
+
+  std::ostringstream out;
+  out << "  const double mA = " << Codegen::literal( ps.m( _resoA ) ) << ";\n"
+      << "  const auto gsh = [ & ]( const double x )\n"
+      << "  {\n"
+      << "    const double m12 = std::sqrt( x );\n"
+      << "    const double p12 = q( x );\n"
+      << "    return ( 2. / " << pi << " ) * ( p12 / m12 ) * std::log( ( m12 + 2. * p12 ) / ( 2. * mA ) );\n"
+      << "  };\n"
+      << "  const auto gshprime = [ & ]( const double x )\n"
+      << "  {\n"
+      << "    const double first  = 1. / ( 8. * qSq( x ) );\n"
+      << "    const double second = 1. / ( 2. * x );\n"
+      << "    return ( first - second ) * gsh( x ) + second / " << pi << ";\n"
+      << "  };\n"
+      << "  const auto gsf = [ & ]( const double x )\n"
+      << "  {\n"
+      << "    const double factor = w * std::pow( m, 2 ) / q( mSq );\n"
+      << "    const double first  = ( qSq( x ) / qSq( mSq ) ) * ( gsh( x ) - gsh( mSq ) );\n"
+      << "    const double second = ( mSq - x ) * gshprime( mSq );\n"
+      << "    return factor * ( first + second );\n"
+      << "  };\n"
+      << "  double gsd = ( 3. / " << pi << " ) * ( mA2 / qSq( mSq ) );\n"
+      << "  gsd *= std::log( ( m + 2. * q( mSq ) ) / ( 2. * mA ) );\n"
+      << "  gsd += m / ( 2. * " << pi << " * q( mSq ) ) - ( mA2 * m ) / ( " << pi << " * std::pow( q( mSq ), 3 ) );\n"
+      << "  prop  = 1. + gsd * w / m;\n"
+      << "  prop *= 1. / ( std::pow( m, 2 ) - s + gsf( s ) - std::complex< double >( 0., 1. ) * "
+      << ( _buggy ? "std::sqrt( s )" : "m" ) << " * runningWidth( s ) );\n";
+
+  return out.str();
+}
+
+
 GounarisSakurai* GounarisSakurai::copy() const
 {
   return new GounarisSakurai( *this );
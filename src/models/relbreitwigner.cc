@@ -11,6 +11,33 @@ std::complex< double > RelBreitWigner::propagator( const PhaseSpace& ps, const d
 }
 
 
+// With the running width in the imaginary parts,
+//    1 / ( a - i b ) = ( a + i b ) / ( a^2 + b^2 ).
+void RelBreitWigner::propagators( const PhaseSpace& ps, const double* mSqAB, double* re, double* im, const std::size_t& n ) const
+{
+  runningWidth( ps, mSqAB, im, n );
+
+  const double m   = mass();
+  const double mSq = m * m;
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double a   = mSq - mSqAB[ point ];
+    const double b   = m * im[ point ];
+    const double den = a * a + b * b;
+
+    re[ point ] = a / den;
+    im[ point ] = b / den;
+  }
+}
+
+
+const std::string RelBreitWigner::propagatorCode( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  return "  prop = 1. / ( std::pow( m, 2 ) - s - std::complex< double >( 0., 1. ) * m * runningWidth( s ) );\n";
+}
+
+
 RelBreitWigner* RelBreitWigner::copy() const
 {
   return new RelBreitWigner( *this );
@@ -0,0 +1,168 @@
+#include <cmath>
+#include <complex>
+#include <algorithm>
+
+#include <cfit/phasespace.hh>
+#include <cfit/models/splineresonance.hh>
+
+
+void SplineResonance::pushKnots( const std::vector< double >& knots, const std::vector< Coef >& coefs ) throw( PdfException )
+{
+  if ( knots.size() < 2 )
+    throw PdfException( "SplineResonance: at least two knots are needed." );
+
+  if ( knots.size() != coefs.size() )
+    throw PdfException( "SplineResonance: the number of knots and of coefficients must be the same." );
+
+  for ( std::size_t knot = 1; knot < knots.size(); ++knot )
+    if ( knots[ knot ] <= knots[ knot - 1 ] )
+      throw PdfException( "SplineResonance: the knots must be sorted in increasing order." );
+
+  _knots = knots;
+
+  typedef std::vector< Coef >::const_iterator kIter;
+  for ( kIter coef = coefs.begin(); coef != coefs.end(); ++coef )
+  {
+    push( coef->real() );
+    push( coef->imag() );
+    _coefs.push_back( std::make_pair( coef->real().name(), coef->imag().name() ) );
+  }
+
+  update();
+}
+
+
+
+void SplineResonance::update()
+{
+  _values.resize( _coefs.size() );
+
+  for ( std::size_t knot = 0; knot < _coefs.size(); ++knot )
+    _values[ knot ] = std::complex< double >( _parMap.find( _coefs[ knot ].first  )->second.value(),
+                                              _parMap.find( _coefs[ knot ].second )->second.value() );
+}
+
+
+
+void SplineResonance::setPars( const std::map< std::string, Parameter >& pars )
+{
+  Resonance::setPars( pars );
+  update();
+}
+
+
+
+// In the interval [ x_i, x_i+1 ], with t = ( x - x_i ) / h and h = x_i+1 - x_i,
+//    f = h00( t ) y_i + h h10( t ) m_i + h01( t ) y_i+1 + h h11( t ) m_i+1,
+//    with the Catmull-Rom slopes m_k = ( y_k+1 - y_k-1 ) / ( x_k+1 - x_k-1 ),
+//    taken one-sided at the first and last knots.
+const bool SplineResonance::basis( const double& mSqAB, unsigned& first, double weights[ 4 ] ) const
+{
+  std::fill( weights, weights + 4, 0.0 );
+
+  const unsigned nKnots = _knots.size();
+  if ( mSqAB < _knots.front() || mSqAB > _knots.back() )
+    return false;
+
+  // Interval that contains the point.
+  const unsigned interval = std::min( unsigned( std::upper_bound( _knots.begin(), _knots.end(), mSqAB ) - _knots.begin() ), nKnots - 1 ) - 1;
+
+  first = ( interval > 0 ) ? interval - 1 : 0;
+
+  const double& h = _knots[ interval + 1 ] - _knots[ interval ];
+  const double  t = ( mSqAB - _knots[ interval ] ) / h;
+
+  const double& tSq = t * t;
+  const double& tCb = tSq * t;
+
+  const double h00 =   2.0 * tCb - 3.0 * tSq + 1.0;
+  const double h10 =         tCb - 2.0 * tSq + t;
+  const double h01 = - 2.0 * tCb + 3.0 * tSq;
+  const double h11 =         tCb -       tSq;
+
+  weights[ interval     - first ] += h00;
+  weights[ interval + 1 - first ] += h01;
+
+  // Contributions of the slopes at both ends of the interval.
+  const double slopeWeights[ 2 ] = { h * h10, h * h11 };
+  for ( unsigned side = 0; side < 2; ++side )
+  {
+    const unsigned knot = interval + side;
+    const unsigned lo   = ( knot > 0          ) ? knot - 1 : knot;
+    const unsigned hi   = ( knot < nKnots - 1 ) ? knot + 1 : knot;
+
+    const double& scale = slopeWeights[ side ] / ( _knots[ hi ] - _knots[ lo ] );
+    weights[ hi - first ] += scale;
+    weights[ lo - first ] -= scale;
+  }
+
+  return true;
+}
+
+
+
+const std::vector< double > SplineResonance::basis( const double& mSqAB ) const
+{
+  std::vector< double > dense( _knots.size(), 0.0 );
+
+  unsigned first;
+  double   weights[ 4 ];
+  if ( ! basis( mSqAB, first, weights ) )
+    return dense;
+
+  for ( unsigned knot = 0; knot < 4 && first + knot < _knots.size(); ++knot )
+    dense[ first + knot ] = weights[ knot ];
+
+  return dense;
+}
+
+
+
+std::complex< double > SplineResonance::propagator( const PhaseSpace& ps, const double& mSqAB ) const
+{
+  unsigned first;
+  double   weights[ 4 ];
+  if ( ! basis( mSqAB, first, weights ) )
+    return 0.0;
+
+  std::complex< double > value = 0.0;
+  const unsigned last = std::min( first + 4, unsigned( _values.size() ) );
+  for ( unsigned knot = first; knot < last; ++knot )
+    value += weights[ knot - first ] * _values[ knot ];
+
+  return value;
+}
+
+
+
+// The weights of the knots times the angular and centrifugal factor, which
+//    are the values of the lineshape with a single knot at 1.
+void SplineResonance::terms( const PhaseSpace& ps,
+                             const double&     mSq12,
+                             const double&     mSq13,
+                             const double&     mSq23,
+                             std::complex< double >* values ) const
+{
+  const unsigned nKnots = _knots.size();
+  std::fill( values, values + nKnots, std::complex< double >( 0.0 ) );
+
+  const double& mSqAB = m2AB( mSq12, mSq13, mSq23 );
+
+  unsigned first;
+  double   weights[ 4 ];
+  if ( ! basis( mSqAB, first, weights ) )
+    return;
+
+  const std::complex< double >& shape = factor( ps, mSqAB, m2AC( mSq12, mSq13, mSq23 ), m2BC( mSq12, mSq13, mSq23 ) );
+
+  const unsigned last = std::min( first + 4, nKnots );
+  for ( unsigned knot = first; knot < last; ++knot )
+    values[ knot ] = weights[ knot - first ] * shape;
+}
+
+
+
+SplineResonance* SplineResonance::copy() const
+{
+  return new SplineResonance( *this );
+}
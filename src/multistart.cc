@@ -0,0 +1,191 @@
+
+#include <cmath>
+#include <mutex>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+#include <Minuit/MnMigrad.h>
+#include <Minuit/MnStrategy.h>
+#include <Minuit/MinuitParameter.h>
+
+#include <cfit/multistart.hh>
+#include <cfit/minimizer.hh>
+#include <cfit/threads.hh>
+#include <cfit/random.hh>
+
+
+const unsigned MultiStart::nThreads() const
+{
+  const unsigned nThreads = _nThreads ? _nThreads : Threads::nThreads();
+
+  return std::max( 1u, std::min( nThreads, _nStarts ) );
+}
+
+
+
+const std::vector< MnUserParameters > MultiStart::startPoints( const std::map< std::string, Parameter >& pars ) const
+{
+  std::vector< MnUserParameters > starts;
+
+  // The first start is always the nominal starting point.
+  starts.push_back( Minimizer::userParameters( pars ) );
+
+  // The rest are drawn sequentially from the global engine, so that they are
+  //    reproducible for a given seed, regardless of the number of threads.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( unsigned start = 1; start < _nStarts; ++start )
+  {
+    MnUserParameters upar = Minimizer::userParameters( pars );
+
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+    {
+      if ( par->second.isFixed() )
+        continue;
+
+      if ( par->second.hasLimits() )
+        upar.setValue( par->first.c_str(), Random::uniform( par->second.lower(), par->second.upper() ) );
+      else
+        upar.setValue( par->first.c_str(), Random::normal( par->second.value(), _spread * par->second.error() ) );
+    }
+
+    starts.push_back( upar );
+  }
+
+  return starts;
+}
+
+
+
+const bool MultiStart::sameMinimum( const FunctionMinimum& left, const FunctionMinimum& right ) const
+{
+  if ( std::fabs( left.fval() - right.fval() ) > _fvalTolerance )
+    return false;
+
+  const std::vector< MinuitParameter >& lPars = left .userParameters().parameters();
+  const std::vector< MinuitParameter >& rPars = right.userParameters().parameters();
+
+  // Parameters are compared in units of the largest of their uncertainties.
+  for ( std::size_t par = 0; par < lPars.size(); ++par )
+  {
+    if ( lPars[ par ].isFixed() )
+      continue;
+
+    const double error = std::max( lPars[ par ].error(), rPars[ par ].error() );
+    const double diff  = std::fabs( lPars[ par ].value() - rPars[ par ].value() );
+
+    if ( diff > _parTolerance * error )
+      return false;
+  }
+
+  return true;
+}
+
+
+
+const std::vector< FunctionMinimum > MultiStart::run( const std::vector< FCNBase* >&             fcns,
+                                                      const std::map< std::string, Parameter >& pars ) const
+{
+  if ( _nStarts == 0 )
+    throw MinimizerException( "At least one starting point is needed for a multi-start minimization." );
+
+  const std::vector< MnUserParameters >& starts = startPoints( pars );
+
+  // FunctionMinimum has no default constructor, so keep the minima by pointer.
+  std::vector< std::unique_ptr< FunctionMinimum > > minima( starts.size() );
+
+  // Exceptions cannot cross the thread boundaries. Keep the first one thrown
+  //    and rethrow it once all the threads have finished.
+  std::exception_ptr error;
+  std::mutex         errorMutex;
+
+  // If pruning is requested, the first pass is limited to _pruneCalls calls.
+  Threads::forEach( starts.size(), [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    try
+    {
+      MnMigrad migrad( *fcns[ thread ], starts[ index ] );
+      minima[ index ].reset( new FunctionMinimum( migrad( _pruneCalls ) ) );
+    }
+    catch ( ... )
+    {
+      std::lock_guard< std::mutex > lock( errorMutex );
+      if ( ! error )
+        error = std::current_exception();
+    }
+  }, fcns.size() );
+
+  if ( error )
+    std::rethrow_exception( error );
+
+  // Continue only the promising starts that have not converged yet, and
+  //    discard the rest.
+  if ( _pruneCalls )
+  {
+    double best = minima.front()->fval();
+    for ( std::size_t index = 1; index < minima.size(); ++index )
+      best = std::min( best, minima[ index ]->fval() );
+
+    std::vector< std::size_t > survivors;
+    for ( std::size_t index = 0; index < minima.size(); ++index )
+      if ( minima[ index ]->fval() <= best + _pruneDelta )
+        survivors.push_back( index );
+      else
+        minima[ index ].reset();
+
+    Threads::forEach( survivors.size(), [ & ]( const std::size_t& index, const unsigned& thread )
+    {
+      std::unique_ptr< FunctionMinimum >& min = minima[ survivors[ index ] ];
+
+      if ( ! min->hasReachedCallLimit() )
+        return;
+
+      try
+      {
+        MnMigrad migrad( *fcns[ thread ], min->userState(), MnStrategy( 1 ) );
+        min.reset( new FunctionMinimum( migrad() ) );
+      }
+      catch ( ... )
+      {
+        std::lock_guard< std::mutex > lock( errorMutex );
+        if ( ! error )
+          error = std::current_exception();
+      }
+    }, fcns.size() );
+
+    if ( error )
+      std::rethrow_exception( error );
+  }
+
+  // Keep the valid minima, or all of them if none is valid, so that the
+  //    user can still inspect what happened.
+  std::vector< const FunctionMinimum* > found;
+  for ( std::size_t index = 0; index < minima.size(); ++index )
+    if ( minima[ index ] && minima[ index ]->isValid() )
+      found.push_back( minima[ index ].get() );
+
+  if ( found.empty() )
+    for ( std::size_t index = 0; index < minima.size(); ++index )
+      if ( minima[ index ] )
+        found.push_back( minima[ index ].get() );
+
+  // Sort by function value, ties broken by start index to be deterministic.
+  std::stable_sort( found.begin(), found.end(),
+                    []( const FunctionMinimum* left, const FunctionMinimum* right ) { return left->fval() < right->fval(); } );
+
+  // Merge the minima that are equal within tolerances, keeping the best one.
+  std::vector< FunctionMinimum > distinct;
+  typedef std::vector< const FunctionMinimum* >::const_iterator fIter;
+  typedef std::vector< FunctionMinimum        >::const_iterator dIter;
+  for ( fIter min = found.begin(); min != found.end(); ++min )
+  {
+    bool isNew = true;
+    for ( dIter other = distinct.begin(); other != distinct.end() && isNew; ++other )
+      isNew = ! sameMinimum( **min, *other );
+
+    if ( isNew )
+      distinct.push_back( **min );
+  }
+
+  return distinct;
+}
@@ -1,8 +1,11 @@
 
 #include <iostream>
 
+#include <cmath>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <algorithm>
 
 #ifdef MPI_ON
 #include <mpi.h>
@@ -12,86 +15,185 @@
 #include <cfit/dataset.hh>
 #include <cfit/pdfmodel.hh>
 #include <cfit/nll.hh>
+#include <cfit/threads.hh>
 
 
 Nll::Nll( const PdfModel& pdf, const Dataset& data )
-  : Minimizer( pdf, data )
+  : Minimizer( pdf, data ), _memoSum( 0.0 ), _memoSize( 0 )
 {
   _up = 1.0;
 }
 
 
 Nll::Nll( const PdfExpr& pdf, const Dataset& data )
-  : Minimizer( pdf, data )
+  : Minimizer( pdf, data ), _memoSum( 0.0 ), _memoSize( 0 )
+{
+  _up = 1.0;
+}
+
+
+Nll::Nll( const PdfModel& pdf, const Dataset& data, const Checkpoint& checkpoint )
+  : Minimizer( pdf, data, checkpoint ), _memoSum( 0.0 ), _memoSize( 0 )
+{
+  _up = 1.0;
+}
+
+
+Nll::Nll( const PdfExpr& pdf, const Dataset& data, const Checkpoint& checkpoint )
+  : Minimizer( pdf, data, checkpoint ), _memoSum( 0.0 ), _memoSize( 0 )
 {
   _up = 1.0;
 }
 
 
 Nll::Nll( const Nll& nll )
-  : Minimizer( nll )
+  : Minimizer( nll ), _weights( nll._weights ), _weightValues( nll._weightValues ), _memoSum( 0.0 ), _memoSize( 0 ),
+    _kernel( nll._kernel ), _kernelEvents( nll._kernelEvents ), _kernelNorm( nll._kernelNorm ),
+    _kernelFolded( nll._kernelFolded )
 {}
 
 
-double Nll::operator()( const std::vector<double>& pars ) const throw( PdfException )
+void Nll::setWeights( const std::string& field ) throw( DataException )
 {
-  if ( pars.size() != _pdf->nPars() )
-    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+  const std::vector< std::string >& fields = _data->fields();
+  if ( std::find( fields.begin(), fields.end(), field ) == fields.end() )
+    throw DataException( "Nll: requested weight " + field + " does not exist in dataset" );
 
-  _pdf->setPars( pars );
+  _weights = field;
+  _memoPars.clear();
 
-  // Before evaluating the pdf at all data points, cache anything common to
-  //    all points (usually compute the norm).
-  _pdf->cache();
+  dataChanged();
+}
 
-  // Get the vector of variable names that the pdf depends on.
-  std::vector< std::string > varNames = _pdf->varNames();
 
-  typedef std::vector< std::string                                     >::const_iterator vIter;
-  typedef std::map   < unsigned, std::vector< double >                 >::const_iterator mrIter;
-  typedef std::map   < unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
 
-  // Vector of values of the variables that the pdf must be evaluated at, and vectors of cached values.
-  std::vector< double                 > vars;
-  std::vector< double                 > cacheR;
-  std::vector< std::complex< double > > cacheC;
+void Nll::dataChanged()
+{
+  if ( _weights.empty() )
+    _weightValues.reset();
+  else
+    _weightValues = std::make_shared< const std::vector< double > >( _data->values( _weights ) );
+}
+
+
+
+const std::vector< double >& Nll::weightValues() const
+{
+  static const std::vector< double > none;
+
+  return _weightValues ? *_weightValues : none;
+}
+
 
-  // Allocate memory for the vectors of cached variables.
-  cacheR.reserve( _pdf->nCachedReal()    );
-  cacheC.reserve( _pdf->nCachedComplex() );
+// The parameters are sorted alphabetically, as the pdf takes them.
+void Nll::compile( const std::string& cacheDir ) throw( PdfException )
+{
+  const std::map< std::string, Parameter >& parMap = _pdf->getPars();
 
-  // Initialize the value of the nll.
-  double nll = 0.;
+  std::map< std::string, std::string >         pars;
+  std::vector< std::pair< unsigned, double > > folded;
 
-  double value = 0.;
+  unsigned index = 0;
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = parMap.begin(); par != parMap.end(); ++par, ++index )
+    if ( par->second.isFixed() )
+    {
+      pars[ par->first ] = Codegen::literal( par->second.value() );
+      folded.push_back( std::make_pair( index, par->second.value() ) );
+    }
+    else
+    {
+      std::ostringstream code;
+      code << "par[ " << index << " ]";
+      pars[ par->first ] = code.str();
+    }
 
-  // Sum of the terms of the nll.
-  for ( std::size_t n = 0; n < _data.size(); ++n )
+  std::shared_ptr< std::vector< std::vector< double > > > events = std::make_shared< std::vector< std::vector< double > > >();
+  std::shared_ptr< std::vector< std::vector< double > > > norm   = std::make_shared< std::vector< std::vector< double > > >();
+  _pdf->kernelColumns( *_data, *events, *norm );
+
+  _kernel       = std::make_shared< const Codegen >( _pdf->kernelCode( pars ), cacheDir );
+  _kernelEvents = events;
+  _kernelNorm   = norm;
+  _kernelFolded = folded;
+}
+
+
+void Nll::interpret()
+{
+  _kernel      .reset();
+  _kernelEvents.reset();
+  _kernelNorm  .reset();
+  _kernelFolded.clear();
+}
+
+
+const bool Nll::usesKernel( const std::vector< double >& pars ) const
+{
+  if ( ! _kernel || _kernelEvents->empty() || ( _kernelEvents->front().size() != _data->size() ) )
+    return false;
+
+  typedef std::vector< std::pair< unsigned, double > >::const_iterator fIter;
+  for ( fIter par = _kernelFolded.begin(); par != _kernelFolded.end(); ++par )
+    if ( pars[ par->first ] != par->second )
+      return false;
+
+  return true;
+}
+
+
+const double Nll::kernelTerms( const std::vector< double >& pars ) const throw( PdfException )
+{
+  std::vector< const double* > events;
+  std::vector< const double* > norm;
+
+  typedef std::vector< std::vector< double > >::const_iterator cIter;
+  for ( cIter column = _kernelEvents->begin(); column != _kernelEvents->end(); ++column )
+    events.push_back( column->data() );
+  for ( cIter column = _kernelNorm  ->begin(); column != _kernelNorm  ->end(); ++column )
+    norm  .push_back( column->data() );
+
+  const std::vector< double >& weights = weightValues();
+  const Codegen&               kernel  = *_kernel;
+
+  // The norm and then the data terms are summed by the threads in chunks, as
+  //    in dataTerms, each chunk by a call to the kernel.
+  const std::size_t nNorm     = _kernelNorm->front().size();
+  const unsigned    nThreadsN = std::max( 1u, unsigned( std::min< std::size_t >( Threads::nThreads(), nNorm ) ) );
+
+  std::vector< double > partialNorm( nThreadsN, 0.0 );
+  Threads::chunks( nNorm, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
   {
-    // Reset the vector of values of the variables and the previously cached values.
-    vars  .clear();
-    cacheR.clear();
-    cacheC.clear();
+    partialNorm[ thread ] = kernel.norm( pars.data(), norm.data(), first, last );
+  }, nThreadsN );
 
-    // Fill the vector of values and sum the terms of the variance.
-    for ( vIter var = varNames.begin(); var != varNames.end(); ++var )
-      vars.push_back( _data.value( *var, n ) );
+  const double integral = Threads::reduce( partialNorm );
 
-    for ( mrIter cached = _cacheR.begin(); cached != _cacheR.end(); ++cached )
-      cacheR[ cached->first ] = cached->second[ n ];
+  const std::size_t size     = _data->size();
+  const unsigned    nThreads = std::max( 1u, unsigned( std::min< std::size_t >( Threads::nThreads(), size ) ) );
 
-    for ( mcIter cached = _cacheC.begin(); cached != _cacheC.end(); ++cached )
-      cacheC[ cached->first ] = cached->second[ n ];
+  std::vector< double > partial( nThreads, 0.0 );
+  Threads::chunks( size, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+  {
+    partial[ thread ] = kernel( pars.data(), integral, events.data(), weights.empty() ? 0 : weights.data(), first, last );
+  }, nThreads );
 
-    // Add the term to the nll.
-    value = _pdf->evaluate( vars, cacheR, cacheC );
+  return Threads::reduce( partial );
+}
 
-    if ( value )
-      nll += - 2. * log( value );
-//       else
-// 	std::cout << "Warning: pdf evaluates to zero for entry " << n
-// 		  << ". Not taking this entry into account for the nll." << std::endl;
-  }
+
+double Nll::operator()( const std::vector<double>& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _pdf->nPars() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  _pdf->setPars( pars );
+
+  // The compiled kernel computes the norm and the data terms by itself.
+  double nll = usesKernel( pars ) ? kernelTerms( pars ) : dataTerms( pars );
+
+  // If fitting a subsample, scale the data terms to approximate the full sample.
+  nll *= _scale;
 
   nll += 2.0 * _pdf->yield();
 
@@ -111,3 +213,282 @@ double Nll::operator()( const std::vector<double>& pars ) const throw( PdfExcept
 #endif
 }
 
+
+const double Nll::dataTerms( const std::vector< double >& pars ) const throw( PdfException )
+{
+  // Before evaluating the pdf at all data points, cache anything common to
+  //    all points (usually compute the norm).
+  _pdf->cache();
+
+  // Get the vector of variable names that the pdf depends on, and look their
+  //    columns up once.
+  std::vector< std::string > varNames = _pdf->varNames();
+
+  std::vector< const std::vector< std::pair< double, double > >* > columns;
+  if ( _data->size() )
+    for ( std::vector< std::string >::const_iterator var = varNames.begin(); var != varNames.end(); ++var )
+      columns.push_back( &_data->column( *var ) );
+
+  typedef std::vector< const std::vector< std::pair< double, double > >* >::const_iterator vIter;
+  typedef std::map   < unsigned, std::vector< double >                 >::const_iterator mrIter;
+  typedef std::map   < unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+  // Weights of the events, if any.
+  const std::vector< double >& weights = weightValues();
+
+  // Initialize the value of the nll, with the terms of the events already
+  //    summed at the same parameters, if any.
+  const bool  memo  = ( pars == _memoPars ) && ( _memoSize <= _data->size() );
+  double      nll   = memo ? _memoSum  : 0.;
+  std::size_t first = memo ? _memoSize : 0;
+
+  // Each thread sums a contiguous chunk of events, the same chunk whose
+  //    columns and caches it placed on its node if the threads are pinned.
+  //    Evaluating a pdf does not modify it, so all the threads share the pdf
+  //    with the norm just computed.
+  const std::size_t size     = _data->size() - first;
+  const unsigned    nThreads = std::max( 1u, unsigned( std::min< std::size_t >( Threads::nThreads(), size ) ) );
+
+  const PdfBase& pdf = *_pdf;
+
+  std::vector< double > partial( nThreads, 0.0 );
+
+  // Number of cached values, read once before the threads start.
+  const unsigned nCachedR = _pdf->nCachedReal();
+  const unsigned nCachedC = _pdf->nCachedComplex();
+
+  Threads::chunks( size, [ & ]( const std::size_t& begin, const std::size_t& end, const unsigned& thread )
+  {
+    // Vector of values of the variables that the pdf must be evaluated at, and vectors of cached values.
+    std::vector< double                 > vars;
+    std::vector< double                 > cacheR;
+    std::vector< std::complex< double > > cacheC;
+
+    // Allocate memory for the vectors of cached variables. Cached values are
+    //    accessed by their index, so the vectors must span all of them.
+    cacheR.resize( nCachedR );
+    cacheC.resize( nCachedC );
+
+    // Cached values that are not materialized are read in blocks of events.
+    const std::size_t   blockSize = 4096;
+    CacheManager::Block block;
+
+    double  value = 0.;
+    double& sum   = partial[ thread ];
+
+    // Sum of the terms of the nll.
+    for ( std::size_t n = first + begin; n < first + end; ++n )
+    {
+      if ( n >= block.last() )
+      {
+        _caches->load( *_data, n, std::min( n + blockSize, first + end ), block );
+        block.evaluate( pdf, *_data );
+      }
+
+      // Reset the vector of values of the variables.
+      vars.clear();
+
+      // Fill the vector of values and sum the terms of the variance.
+      for ( vIter column = columns.begin(); column != columns.end(); ++column )
+        vars.push_back( ( **column )[ n ].first );
+
+      for ( mrIter cached = _cacheR->begin(); cached != _cacheR->end(); ++cached )
+        cacheR[ cached->first ] = cached->second[ n ];
+
+      for ( mcIter cached = _cacheC->begin(); cached != _cacheC->end(); ++cached )
+        cacheC[ cached->first ] = cached->second[ n ];
+
+      block.fill( n, cacheR, cacheC );
+
+      // Add the term to the nll.
+      value = pdf.evaluate( vars, cacheR, cacheC );
+
+      if ( value )
+        sum += - 2. * ( weights.empty() ? 1.0 : weights[ n ] ) * log( value );
+//         else
+// 	  std::cout << "Warning: pdf evaluates to zero for entry " << n
+// 		    << ". Not taking this entry into account for the nll." << std::endl;
+    }
+  }, nThreads );
+
+  nll += Threads::reduce( partial );
+
+  _memoPars = pars;
+  _memoSum  = nll;
+  _memoSize = _data->size();
+
+  return nll;
+}
+
+
+
+
+const MnUserCovariance Nll::sandwich( const FunctionMinimum& min ) const throw( PdfException )
+{
+  const std::map< std::string, Parameter >& parMap = _pdf->getPars();
+  const MnUserParameters&                   upar   = min.userParameters();
+
+  // Values of the parameters at the minimum, sorted alphabetically as the pdf
+  //    takes them, and positions and finite difference steps of the floating ones.
+  std::vector< double   > central;
+  std::vector< unsigned > floating;
+  std::vector< double   > steps;
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = parMap.begin(); par != parMap.end(); ++par )
+  {
+    const MinuitParameter& mpar = upar.parameter( upar.index( par->first.c_str() ) );
+
+    if ( ! mpar.isFixed() )
+    {
+      floating.push_back( central.size() );
+      steps   .push_back( 1.e-3 * ( ( mpar.error() > 0.0 ) ? mpar.error() : std::max( std::abs( mpar.value() ), 1.0 ) ) );
+    }
+
+    central.push_back( mpar.value() );
+  }
+
+  const unsigned nFloat = floating.size();
+
+  const MnUserCovariance& cov = min.userCovariance();
+  if ( cov.nrow() != nFloat )
+    throw PdfException( "Nll::sandwich: the minimum does not have a covariance of the floating parameters." );
+
+  // The pdf at the minimum goes first, followed by those shifted up and down
+  //    by the step of each floating parameter.
+  const unsigned nShifts = 1 + 2 * nFloat;
+
+  std::vector< PdfBase* > shifted;
+  for ( unsigned shift = 0; shift < nShifts; ++shift )
+    shifted.push_back( _pdf->copy() );
+
+  // Compute the norms of the shifted pdfs in parallel.
+  Threads::forEach( nShifts, [ & ]( const std::size_t& shift, const unsigned& thread )
+  {
+    std::vector< double > pars = central;
+    if ( shift > 0 )
+      pars[ floating[ ( shift - 1 ) / 2 ] ] += ( shift % 2 ) ? steps[ ( shift - 1 ) / 2 ] : - steps[ ( shift - 1 ) / 2 ];
+
+    shifted[ shift ]->setPars( pars );
+    shifted[ shift ]->cache();
+  } );
+
+  // Blocks of events of fixed size, whose sums are added in order at the end.
+  const std::size_t size      = _data->size();
+  const std::size_t blockSize = 1024;
+  const std::size_t nBlocks   = ( size + blockSize - 1 ) / blockSize;
+
+  // The threads share the shifted pdfs, which are not modified when evaluated.
+  const unsigned nThreads = std::max< std::size_t >( 1, std::min< std::size_t >( Threads::nThreads(), nBlocks ) );
+
+  const std::vector< std::string >& varNames = _pdf->varNames();
+  const std::vector< double >&      weights  = weightValues();
+
+  // Look the columns of the variables up once, as in dataTerms.
+  std::vector< const std::vector< std::pair< double, double > >* > columns;
+  if ( size )
+    for ( std::vector< std::string >::const_iterator var = varNames.begin(); var != varNames.end(); ++var )
+      columns.push_back( &_data->column( *var ) );
+
+  std::vector< std::vector< double > > partial( nBlocks, std::vector< double >( nFloat * nFloat, 0.0 ) );
+
+  // Number of cached values, as in dataTerms.
+  const unsigned nCachedR = _pdf->nCachedReal();
+  const unsigned nCachedC = _pdf->nCachedComplex();
+
+  Threads::forEach( nBlocks, [ & ]( const std::size_t& block, const unsigned& thread )
+  {
+    typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+    typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+    std::vector< double                 > vars  ( varNames.size()          );
+    std::vector< double                 > cacheR( nCachedR                 );
+    std::vector< std::complex< double > > cacheC( nCachedC                 );
+    std::vector< double                 > full;
+    std::vector< double                 > grad  ( nFloat                   );
+
+    const std::vector< PdfBase* >& pdf = shifted;
+    std::vector< double >&         sum = partial[ block ];
+
+    const std::size_t last = std::min( size, ( block + 1 ) * blockSize );
+
+    CacheManager::Block stored;
+    _caches->load( *_data, block * blockSize, last, stored );
+
+    // Each shifted pdf computes the values of its own parameters on the block.
+    std::vector< CacheManager::Block > blocks( pdf.size(), stored );
+    for ( std::size_t shift = 0; shift < pdf.size(); ++shift )
+      blocks[ shift ].evaluate( *pdf[ shift ], *_data );
+
+    for ( std::size_t n = block * blockSize; n < last; ++n )
+    {
+      for ( std::size_t var = 0; var < columns.size(); ++var )
+        vars[ var ] = ( *columns[ var ] )[ n ].first;
+
+      for ( mrIter cached = _cacheR->begin(); cached != _cacheR->end(); ++cached )
+        cacheR[ cached->first ] = cached->second[ n ];
+
+      for ( mcIter cached = _cacheC->begin(); cached != _cacheC->end(); ++cached )
+        cacheC[ cached->first ] = cached->second[ n ];
+
+      blocks[ 0 ].fill( n, cacheR, cacheC );
+
+      // Events where the pdf vanishes do not contribute to the nll either.
+      if ( ! pdf[ 0 ]->evaluate( vars, cacheR, cacheC ) )
+        continue;
+
+      if ( pdf[ 0 ]->logGradient( vars, cacheR, cacheC, full ) )
+        for ( unsigned par = 0; par < nFloat; ++par )
+          grad[ par ] = full[ floating[ par ] ];
+      else
+        for ( unsigned par = 0; par < nFloat; ++par )
+        {
+          blocks[ 1 + 2 * par ].fill( n, cacheR, cacheC );
+          const double& up   = pdf[ 1 + 2 * par ]->evaluate( vars, cacheR, cacheC );
+
+          blocks[ 2 + 2 * par ].fill( n, cacheR, cacheC );
+          const double& down = pdf[ 2 + 2 * par ]->evaluate( vars, cacheR, cacheC );
+
+          grad[ par ] = ( up && down ) ? ( std::log( up ) - std::log( down ) ) / ( 2.0 * steps[ par ] ) : 0.0;
+        }
+
+      const double& weightSq = weights.empty() ? 1.0 : weights[ n ] * weights[ n ];
+      for ( unsigned row = 0; row < nFloat; ++row )
+        for ( unsigned col = 0; col <= row; ++col )
+          sum[ row * nFloat + col ] += weightSq * grad[ row ] * grad[ col ];
+    }
+  }, nThreads );
+
+  for ( unsigned shift = 0; shift < nShifts; ++shift )
+    delete shifted[ shift ];
+
+  // Add the blocks in order, and fill the upper triangle.
+  std::vector< double > outer( nFloat * nFloat, 0.0 );
+  for ( std::size_t block = 0; block < nBlocks; ++block )
+    for ( unsigned elem = 0; elem < nFloat * nFloat; ++elem )
+      outer[ elem ] += partial[ block ][ elem ];
+
+  for ( unsigned row = 0; row < nFloat; ++row )
+    for ( unsigned col = row + 1; col < nFloat; ++col )
+      outer[ row * nFloat + col ] = outer[ col * nFloat + row ];
+
+  // V * outer * V.
+  std::vector< double > left( nFloat * nFloat, 0.0 );
+  for ( unsigned row = 0; row < nFloat; ++row )
+    for ( unsigned col = 0; col < nFloat; ++col )
+      for ( unsigned k = 0; k < nFloat; ++k )
+        left[ row * nFloat + col ] += cov( row, k ) * outer[ k * nFloat + col ];
+
+  MnUserCovariance corrected( nFloat );
+  for ( unsigned row = 0; row < nFloat; ++row )
+    for ( unsigned col = 0; col <= row; ++col )
+    {
+      double value = 0.0;
+      for ( unsigned k = 0; k < nFloat; ++k )
+        value += left[ row * nFloat + k ] * cov( k, col );
+
+      corrected( row, col ) = value;
+    }
+
+  return corrected;
+}
@@ -9,6 +9,10 @@
 unsigned PdfBase::_cacheIdxReal    = 0;
 unsigned PdfBase::_cacheIdxComplex = 0;
 
+thread_local bool     PdfBase::_replay        = false;
+thread_local unsigned PdfBase::_replayReal    = 0;
+thread_local unsigned PdfBase::_replayComplex = 0;
+
 
 void PdfBase::fix( const std::string& name ) throw( PdfException )
 {
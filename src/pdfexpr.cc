@@ -362,6 +362,15 @@ void PdfExpr::cache()
 
 
 
+void PdfExpr::setNormBins( const unsigned& nBins )
+{
+  typedef std::vector< PdfModel* >::const_iterator pIter;
+  for ( pIter pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    (*pdf)->setNormBins( nBins );
+}
+
+
+
 const std::map< std::string, double > PdfExpr::generate() const throw( PdfException )
 {
   std::map< std::string, double > genVals;
@@ -546,6 +555,25 @@ const std::map< unsigned, std::vector< std::complex< double > > > PdfExpr::cache
 
 
 
+void PdfExpr::cacheBlock( const Dataset&                                               data  ,
+                          const std::size_t&                                           first ,
+                          const std::size_t&                                           last  ,
+                          std::map< unsigned, std::vector< std::complex< double > > >& cacheC ) const
+{
+  for ( std::vector< PdfModel* >::const_iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    (*pdf)->cacheBlock( data, first, last, cacheC );
+}
+
+
+
+// Each model caches its own expressions.
+const std::vector< PdfBase* > PdfExpr::cacheSources()
+{
+  return std::vector< PdfBase* >( _pdfs.begin(), _pdfs.end() );
+}
+
+
+
 const double PdfExpr::evaluate( const std::vector< double >& vars ) const throw( PdfException )
 {
   if ( _varMap.size() != vars.size() )
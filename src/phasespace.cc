@@ -1,7 +1,10 @@
 
 #include <cmath>
+#include <sstream>
+#include <algorithm>
 
 #include <cfit/phasespace.hh>
+#include <cfit/codegen.hh>
 
 
 PhaseSpace::PhaseSpace()
@@ -104,6 +107,31 @@ const double PhaseSpace::m( unsigned index ) const
 
 
 
+// Integrate the width of the allowed range of mSq13 over m12, through the
+//    variable m' of the square Dalitz plot, where the integrand vanishes
+//    smoothly at both ends and the midpoint rule converges quickly.
+const double PhaseSpace::area() const
+{
+  const unsigned nSteps = 1000;
+  const double   mMin   = _m1      + _m2;
+  const double   mMax   = _mMother - _m3;
+
+  double area = 0.;
+  for ( unsigned step = 0; step < nSteps; ++step )
+  {
+    const double& mPrime = ( step + .5 ) / nSteps;
+    const double& m12    = mMin + ( mMax - mMin ) * ( std::cos( M_PI * mPrime ) + 1. ) / 2.;
+    const double& dm12   = ( mMax - mMin ) * M_PI * std::sin( M_PI * mPrime ) / 2.;
+    const double& mSq12  = m12 * m12;
+
+    area += ( mSq13max( mSq12 ) - mSq13min( mSq12 ) ) * 2. * m12 * dm12;
+  }
+
+  return area / nSteps;
+}
+
+
+
 // Check if the kinematically allowed region contains a given point.
 bool PhaseSpace::contains( const double& mSq12, const double& mSq13, const double& mSq23 ) const
 {
@@ -121,3 +149,84 @@ bool PhaseSpace::contains( const double& mSq12, const double& mSq13 ) const
   return ( mSq13 > mSq13min( mSq12 ) ) && ( mSq13 < mSq13max( mSq12 ) ) &&
          ( mSq23 > mSq23min( mSq12 ) ) && ( mSq23 < mSq23max( mSq12 ) );
 }
+
+
+
+// Same bounds as mSq13min( mSq12 ) and the other limits, which share the
+//    square roots of the Kallen functions.
+const std::string PhaseSpace::code() const
+{
+  std::ostringstream out;
+  out << "static inline bool contains( const double s12, const double s13, const double s23 )\n"
+      << "{\n"
+      << "  const double mSqMother = " << Codegen::literal( _mSqMother ) << ";\n"
+      << "  const double mSq1      = " << Codegen::literal( _mSq1      ) << ";\n"
+      << "  const double mSq2      = " << Codegen::literal( _mSq2      ) << ";\n"
+      << "  const double mSq3      = " << Codegen::literal( _mSq3      ) << ";\n"
+      << "\n"
+      << "  const double first13 = std::pow( mSqMother + mSq1 - mSq2 - mSq3, 2 );\n"
+      << "  const double first23 = std::pow( mSqMother - mSq1 + mSq2 - mSq3, 2 );\n"
+      << "  const double second  = std::sqrt( kallen( s12, mSq1     , mSq2 ) );\n"
+      << "  const double third   = std::sqrt( kallen( s12, mSqMother, mSq3 ) );\n"
+      << "\n"
+      << "  return ( s13 > ( first13 - std::pow( second + third, 2 ) ) / ( 4. * s12 ) ) &&\n"
+      << "         ( s13 < ( first13 - std::pow( second - third, 2 ) ) / ( 4. * s12 ) ) &&\n"
+      << "         ( s23 > ( first23 - std::pow( second + third, 2 ) ) / ( 4. * s12 ) ) &&\n"
+      << "         ( s23 < ( first23 - std::pow( second - third, 2 ) ) / ( 4. * s12 ) );\n"
+      << "}\n\n";
+
+  return out.str();
+}
+
+
+
+void PhaseSpace::toSquare( const double& mSq12, const double& mSq13, double& mPrime, double& thPrime ) const
+{
+  const double& mMin = _m1 + _m2;
+  const double& mMax = _mMother - _m3;
+
+  const double& lo = mSq13min( mSq12 );
+  const double& hi = mSq13max( mSq12 );
+
+  // Protect the arc cosines against rounding at the boundaries.
+  const double  cosM  = std::min( std::max( 2.0 * ( std::sqrt( mSq12 ) - mMin ) / ( mMax - mMin ) - 1.0, -1.0 ), 1.0 );
+  const double  cosTh = std::min( std::max( ( 2.0 * mSq13 - hi - lo ) / ( hi - lo )                    , -1.0 ), 1.0 );
+
+  mPrime  = std::acos( cosM  ) / M_PI;
+  thPrime = std::acos( cosTh ) / M_PI;
+}
+
+
+
+void PhaseSpace::fromSquare( const double& mPrime, const double& thPrime, double& mSq12, double& mSq13 ) const
+{
+  const double& mMin = _m1 + _m2;
+  const double& mMax = _mMother - _m3;
+
+  const double& m12 = mMin + 0.5 * ( mMax - mMin ) * ( 1.0 + std::cos( M_PI * mPrime ) );
+  mSq12 = m12 * m12;
+
+  const double& lo = mSq13min( mSq12 );
+  const double& hi = mSq13max( mSq12 );
+
+  mSq13 = 0.5 * ( hi + lo ) + 0.5 * ( hi - lo ) * std::cos( M_PI * thPrime );
+}
+
+
+
+// d mSq12 / d m'     = pi m12 ( m12max - m12min ) sin( pi m' )
+// d mSq13 / d theta' = pi / 2 ( mSq13max - mSq13min ) sin( pi theta' )
+// mSq12 does not depend on theta', so the Jacobian is the product of both.
+const double PhaseSpace::squareJacobian( const double& mPrime, const double& thPrime ) const
+{
+  const double& mMin = _m1 + _m2;
+  const double& mMax = _mMother - _m3;
+
+  const double& m12   = mMin + 0.5 * ( mMax - mMin ) * ( 1.0 + std::cos( M_PI * mPrime ) );
+  const double& mSq12 = m12 * m12;
+
+  const double& dmSq12 = M_PI * m12 * ( mMax - mMin ) * std::sin( M_PI * mPrime );
+  const double& dmSq13 = 0.5 * M_PI * ( mSq13max( mSq12 ) - mSq13min( mSq12 ) ) * std::sin( M_PI * thPrime );
+
+  return std::abs( dmSq12 * dmSq13 );
+}
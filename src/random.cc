@@ -1,8 +1,32 @@
 
 #include <cfit/random.hh>
 
-std::mt19937_64                          Random::_engine  = std::mt19937_64();
+thread_local std::mt19937_64                          Random::_engine  = std::mt19937_64();
 
-std::uniform_real_distribution< double > Random::_uniform = std::uniform_real_distribution< double >();
-std::normal_distribution      < double > Random::_normal  = std::normal_distribution      < double >();
+thread_local std::uniform_real_distribution< double > Random::_uniform = std::uniform_real_distribution< double >();
+thread_local std::normal_distribution      < double > Random::_normal  = std::normal_distribution      < double >();
 
+thread_local RandomStream                             Random::_stream  = RandomStream();
+
+
+
+
+// Finalizer of the splitmix64 generator, which maps consecutive integers to
+//    statistically independent ones.
+static inline uint64_t mix( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x  = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  x  = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+
+  return x ^ ( x >> 31 );
+}
+
+
+const double Random::counter( const uint64_t& seed, const uint64_t& stream, const uint64_t& index )
+{
+  const uint64_t& bits = mix( mix( mix( seed ) ^ stream ) ^ index );
+
+  // Use the 53 most significant bits, which fill the mantissa of a double.
+  return ( bits >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
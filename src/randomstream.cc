@@ -0,0 +1,309 @@
+#include <cmath>
+#include <vector>
+#include <numeric>
+
+#include <cfit/randomstream.hh>
+
+
+// Layers of the ziggurat of the normal distribution, following Marsaglia and
+//    Tsang, with the layout of Doornik: x[ i ] are the right edges of the
+//    128 layers of equal area V, and ratio[ i ] = x[ i + 1 ] / x[ i ] is the
+//    fraction of each layer that lies entirely below the density.
+namespace
+{
+  const unsigned nLayers = 128;
+  const double   zigR    = 3.442619855899;
+  const double   zigV    = 9.91256303526217e-3;
+
+  struct Ziggurat
+  {
+    double x    [ nLayers + 1 ];
+    double ratio[ nLayers     ];
+
+    Ziggurat()
+    {
+      double f = std::exp( -0.5 * zigR * zigR );
+      x[ 0       ] = zigV / f;
+      x[ 1       ] = zigR;
+      x[ nLayers ] = 0.0;
+
+      for ( unsigned layer = 2; layer < nLayers; ++layer )
+      {
+        x[ layer ] = std::sqrt( -2.0 * std::log( zigV / x[ layer - 1 ] + f ) );
+        f          = std::exp( -0.5 * x[ layer ] * x[ layer ] );
+      }
+
+      for ( unsigned layer = 0; layer < nLayers; ++layer )
+        ratio[ layer ] = x[ layer + 1 ] / x[ layer ];
+    }
+  };
+
+  const Ziggurat zig;
+
+  // Finalizer of splitmix64, to expand the seed into the state of the engine.
+  uint64_t splitmix( uint64_t& x )
+  {
+    uint64_t z = ( x += 0x9e3779b97f4a7c15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+
+    return z ^ ( z >> 31 );
+  }
+}
+
+
+
+RandomStream::RandomStream( const uint64_t& seed, const uint64_t& stream )
+{
+  this->seed( seed, stream );
+}
+
+
+
+void RandomStream::seed( const uint64_t& seed, const uint64_t& stream )
+{
+  uint64_t x = seed;
+  x = splitmix( x ) ^ stream;
+
+  for ( unsigned word = 0; word < 4; ++word )
+    _state[ word ] = splitmix( x );
+}
+
+
+
+const double RandomStream::normalTail( const bool& negative )
+{
+  double x;
+  double y;
+  do
+  {
+    x = std::log( 1.0 - flat() ) / zigR;
+    y = std::log( 1.0 - flat() );
+  }
+  while ( -2.0 * y < x * x );
+
+  return negative ? x - zigR : zigR - x;
+}
+
+
+
+const double RandomStream::normal( const double& mu, const double& sigma )
+{
+  while ( true )
+  {
+    const uint64_t bits  = (*this)();
+    const unsigned layer = bits & ( nLayers - 1 );
+    const double   u     = 2.0 * ( ( bits >> 11 ) * ( 1.0 / 9007199254740992.0 ) ) - 1.0;
+
+    // Most of the times, the point lies in the rectangle below the density.
+    if ( std::abs( u ) < zig.ratio[ layer ] )
+      return mu + sigma * u * zig.x[ layer ];
+
+    if ( layer == 0 )
+      return mu + sigma * normalTail( u < 0.0 );
+
+    const double x  = u * zig.x[ layer ];
+    const double f0 = std::exp( -0.5 * ( zig.x[ layer     ] * zig.x[ layer     ] - x * x ) );
+    const double f1 = std::exp( -0.5 * ( zig.x[ layer + 1 ] * zig.x[ layer + 1 ] - x * x ) );
+
+    if ( f1 + flat() * ( f0 - f1 ) < 1.0 )
+      return mu + sigma * x;
+  }
+}
+
+
+
+const double RandomStream::exponential( const double& rate )
+{
+  return - std::log( 1.0 - flat() ) / rate;
+}
+
+
+
+// Inversion by sequential search, for small means.
+const unsigned RandomStream::poissonSmall( const double& mean )
+{
+  const double& unif = flat();
+
+  double   prob = std::exp( - mean );
+  double   cdf  = prob;
+  unsigned k    = 0;
+  while ( unif >= cdf && prob > 0.0 )
+  {
+    prob *= mean / ++k;
+    cdf  += prob;
+  }
+
+  return k;
+}
+
+
+
+// Transformed rejection with squeeze (PTRS) of Hoermann, for large means.
+const unsigned RandomStream::poissonLarge( const double& mean )
+{
+  const double smu      = std::sqrt( mean );
+  const double b        = 0.931 + 2.53 * smu;
+  const double a        = -0.059 + 0.02483 * b;
+  const double invAlpha = 1.1239 + 1.1328 / ( b - 3.4 );
+  const double vr       = 0.9277 - 3.6224 / ( b - 2.0 );
+  const double logMean  = std::log( mean );
+
+  while ( true )
+  {
+    const double u  = flat() - 0.5;
+    const double v  = flat();
+    const double us = 0.5 - std::abs( u );
+    const double k  = std::floor( ( 2.0 * a / us + b ) * u + mean + 0.43 );
+
+    if ( ( us >= 0.07 ) && ( v <= vr ) )
+      return unsigned( k );
+
+    if ( ( k < 0.0 ) || ( ( us < 0.013 ) && ( v > us ) ) )
+      continue;
+
+    if ( std::log( v * invAlpha / ( a / ( us * us ) + b ) ) <= - mean + k * logMean - std::lgamma( k + 1.0 ) )
+      return unsigned( k );
+  }
+}
+
+
+
+const unsigned RandomStream::poisson( const double& mean )
+{
+  if ( mean <= 0.0 )
+    return 0;
+
+  return ( mean < 10.0 ) ? poissonSmall( mean ) : poissonLarge( mean );
+}
+
+
+
+// Inversion for small n p, and transformed rejection (BTRS) of Hoermann otherwise.
+//    The sampling is done for p <= 1/2, and reflected for larger probabilities.
+const unsigned RandomStream::binomial( const unsigned& n, const double& prob )
+{
+  if ( ( n == 0 ) || ( prob <= 0.0 ) )
+    return 0;
+  if ( prob >= 1.0 )
+    return n;
+
+  const bool   flip = ( prob > 0.5 );
+  const double p    = flip ? 1.0 - prob : prob;
+  const double q    = 1.0 - p;
+
+  unsigned k = 0;
+
+  if ( n * p < 10.0 )
+  {
+    const double& unif  = flat();
+    const double  ratio = p / q;
+
+    double pk  = std::pow( q, double( n ) );
+    double cdf = pk;
+    while ( ( unif >= cdf ) && ( k < n ) )
+    {
+      pk  *= ratio * double( n - k ) / double( k + 1 );
+      cdf += pk;
+      ++k;
+    }
+  }
+  else
+  {
+    const double spq   = std::sqrt( n * p * q );
+    const double b     = 1.15 + 2.53 * spq;
+    const double a     = -0.0873 + 0.0248 * b + 0.01 * p;
+    const double c     = n * p + 0.5;
+    const double vr    = 0.92 - 4.2 / b;
+    const double alpha = ( 2.83 + 5.1 / b ) * spq;
+    const double lpq   = std::log( p / q );
+    const double m     = std::floor( ( n + 1 ) * p );
+    const double h     = std::lgamma( m + 1.0 ) + std::lgamma( n - m + 1.0 );
+
+    while ( true )
+    {
+      const double u  = flat() - 0.5;
+      const double v  = flat();
+      const double us = 0.5 - std::abs( u );
+      const double kk = std::floor( ( 2.0 * a / us + b ) * u + c );
+
+      if ( ( kk < 0.0 ) || ( kk > n ) )
+        continue;
+
+      if ( ( us >= 0.07 ) && ( v <= vr ) )
+      {
+        k = unsigned( kk );
+        break;
+      }
+
+      if ( std::log( v * alpha / ( a / ( us * us ) + b ) ) <= h - std::lgamma( kk + 1.0 ) - std::lgamma( n - kk + 1.0 ) + ( kk - m ) * lpq )
+      {
+        k = unsigned( kk );
+        break;
+      }
+    }
+  }
+
+  return flip ? n - k : k;
+}
+
+
+
+// Draw each count as a binomial of the remaining trials, with the probability
+//    of its category conditional on not being in any of the previous ones.
+const std::vector< unsigned > RandomStream::multinomial( const unsigned& n, const std::vector< double >& probs )
+{
+  std::vector< unsigned > counts( probs.size(), 0 );
+
+  double   left   = std::accumulate( probs.begin(), probs.end(), 0.0 );
+  unsigned trials = n;
+
+  for ( std::size_t cat = 0; ( cat < probs.size() ) && trials; ++cat )
+  {
+    if ( cat + 1 == probs.size() )
+      counts[ cat ] = trials;
+    else if ( left > 0.0 )
+      counts[ cat ] = binomial( trials, probs[ cat ] / left );
+
+    trials -= counts[ cat ];
+    left   -= probs[ cat ];
+  }
+
+  return counts;
+}
+
+
+
+void RandomStream::fill( double* first, double* last, const double& min, const double& max )
+{
+  const double width = max - min;
+  for ( double* value = first; value != last; ++value )
+    *value = min + width * flat();
+}
+
+
+
+void RandomStream::fillNormal( double* first, double* last, const double& mu, const double& sigma )
+{
+  for ( double* value = first; value != last; ++value )
+    *value = normal( mu, sigma );
+}
+
+
+
+void RandomStream::fillExponential( double* first, double* last, const double& rate )
+{
+  // Fill with uniform values first, which the compiler can vectorize separately.
+  fill( first, last );
+
+  for ( double* value = first; value != last; ++value )
+    *value = - std::log( 1.0 - *value ) / rate;
+}
+
+
+
+void RandomStream::fillPoisson( unsigned* first, unsigned* last, const double& mean )
+{
+  for ( unsigned* value = first; value != last; ++value )
+    *value = poisson( mean );
+}
@@ -1,8 +1,11 @@
 
+#include <cmath>
+#include <sstream>
 #include <algorithm>
 
 #include <cfit/resonance.hh>
 #include <cfit/phasespace.hh>
+#include <cfit/codegen.hh>
 
 
 void Resonance::push( const Parameter& par )
@@ -259,6 +262,26 @@ double Resonance::blattWeisskopf( const PhaseSpace& ps, const double& mSqAB ) co
 }
 
 
+std::complex< double > Resonance::factor( const PhaseSpace& ps,
+                                          const double&     mSqAB,
+                                          const double&     mSqAC,
+                                          const double&     mSqBC ) const
+{
+  std::complex< double > angular;
+  if ( _helicity )
+    angular = helicity( ps, mSqAB, mSqAC, mSqBC );
+  else
+    angular = zemach( ps, mSqAB, mSqAC, mSqBC );
+
+
+  std::complex< double > centrifugal = blattWeisskopfPrime( ps, mSqAB );
+  if ( _twoBW )
+    centrifugal *= blattWeisskopfPrimeP( ps, mSqAB );
+
+  return angular * centrifugal;
+}
+
+
 std::complex< double > Resonance::evaluate( const PhaseSpace& ps,
                                             const double&     mSq12,
                                             const double&     mSq13,
@@ -271,16 +294,289 @@ std::complex< double > Resonance::evaluate( const PhaseSpace& ps,
   const double& mSqAC = m2AC( mSq12, mSq13, mSq23 );
   const double& mSqBC = m2BC( mSq12, mSq13, mSq23 );
 
-  std::complex< double > angular;
-  if ( _helicity )
-    angular = helicity( ps, mSqAB, mSqAC, mSqBC );
+  return propagator( ps, mSqAB ) * factor( ps, mSqAB, mSqAC, mSqBC );
+}
+
+
+void Resonance::terms( const PhaseSpace& ps,
+                       const double&     mSq12,
+                       const double&     mSq13,
+                       const double&     mSq23,
+                       std::complex< double >* values ) const
+{
+  values[ 0 ] = evaluate( ps, mSq12, mSq13, mSq23 );
+}
+
+
+
+// Squared Blatt-Weisskopf factor, ( q / q0 )^2l times the squared primed factor.
+//    The Kallen function is expanded as s^2 - 2 s ( y + z ) + ( y - z )^2.
+void Resonance::blattWeisskopfSq( const PhaseSpace& ps, const double* mSqAB, double* bwSq, const std::size_t& n ) const
+{
+  if ( ( _l != 1 ) && ( _l != 2 ) )
+  {
+    std::fill( bwSq, bwSq + n, ( _l == 0 ) ? 1.0 : 0.0 );
+    return;
+  }
+
+  const double sum   = ps.mSq( _resoA ) + ps.mSq( _resoB );
+  const double diff2 = std::pow( ps.mSq( _resoA ) - ps.mSq( _resoB ), 2 );
+
+  const double q0Sq  = qSq( ps, mSq() );
+  const double rSq   = std::pow( r(), 2 );
+  const double rqSq0 = rSq * q0Sq;
+
+  if ( _l == 1 )
+    for ( std::size_t point = 0; point < n; ++point )
+    {
+      const double s     = mSqAB[ point ];
+      const double qSqAB = ( s * s - 2.0 * s * sum + diff2 ) / ( 4.0 * s );
+      const double rqSq  = rSq * qSqAB;
+
+      bwSq[ point ] = ( qSqAB / q0Sq ) * ( 1.0 + rqSq0 ) / ( 1.0 + rqSq );
+    }
   else
-    angular = zemach( ps, mSqAB, mSqAC, mSqBC );
+  {
+    const double num = 9.0 + 3.0 * rqSq0 + rqSq0 * rqSq0;
 
+    for ( std::size_t point = 0; point < n; ++point )
+    {
+      const double s     = mSqAB[ point ];
+      const double qSqAB = ( s * s - 2.0 * s * sum + diff2 ) / ( 4.0 * s );
+      const double rqSq  = rSq * qSqAB;
+      const double ratio = qSqAB / q0Sq;
 
-  std::complex< double > centrifugal = blattWeisskopfPrime( ps, mSqAB );
-  if ( _twoBW )
-    centrifugal *= blattWeisskopfPrimeP( ps, mSqAB );
+      bwSq[ point ] = ratio * ratio * num / ( 9.0 + 3.0 * rqSq + rqSq * rqSq );
+    }
+  }
+}
+
+
+void Resonance::runningWidth( const PhaseSpace& ps, const double* mSqAB, double* width, const std::size_t& n ) const
+{
+  blattWeisskopfSq( ps, mSqAB, width, n );
+
+  const double sum   = ps.mSq( _resoA ) + ps.mSq( _resoB );
+  const double diff2 = std::pow( ps.mSq( _resoA ) - ps.mSq( _resoB ), 2 );
+  const double scale = this->width() / rho( ps, mSq() );
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double s = mSqAB[ point ];
+    width[ point ] *= scale * std::sqrt( s * s - 2.0 * s * sum + diff2 ) / s;
+  }
+}
+
+
+void Resonance::propagators( const PhaseSpace& ps, const double* mSqAB, double* re, double* im, const std::size_t& n ) const
+{
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const std::complex< double >& prop = propagator( ps, mSqAB[ point ] );
+
+    re[ point ] = prop.real();
+    im[ point ] = prop.imag();
+  }
+}
+
+
+// Same as the scalar evaluation: propagator times angular term times primed
+//    Blatt-Weisskopf factors.
+void Resonance::evaluate( const PhaseSpace& ps,
+                          const double*     mSq12,
+                          const double*     mSq13,
+                          const double*     mSq23,
+                          double*           re   ,
+                          double*           im   , const std::size_t& n ) const
+{
+  const auto select = [ & ]( const unsigned& index ) { return ( index == 3 ) ? mSq12 : ( ( index == 2 ) ? mSq13 : mSq23 ); };
+
+  const double* mSqAB = select( _noRes );
+  const double* mSqAC = select( _resoB );
+  const double* mSqBC = select( _resoA );
+
+  propagators( ps, mSqAB, re, im, n );
+
+  if ( _l == 0 )
+    return;
+
+  if ( _l > 2 )
+  {
+    std::fill( re, re + n, 0.0 );
+    std::fill( im, im + n, 0.0 );
+    return;
+  }
+
+  const double diffSqMC = ps.mSqMother()   - ps.mSq( _noRes );
+  const double diffSqAB = ps.mSq( _resoA ) - ps.mSq( _resoB );
+  const double sumSqMC  = ps.mSqMother()   + ps.mSq( _noRes );
+  const double sumSqAB  = ps.mSq( _resoA ) + ps.mSq( _resoB );
+
+  // The Zemach tensors divide by the squared invariant mass of the pair, and
+  //    the helicity ones by the squared mass of the resonance.
+  const double invMSq = 1.0 / mSq();
+
+  const double rSq    = std::pow( r(), 2 );
+  const double rqSq0  = rSq * qSq( ps, mSq() );
+  const double rpSq0  = rSq * pSq( ps, mSq() );
+  const double numQ   = ( _l == 1 ) ? 1.0 + rqSq0 : 9.0 + 3.0 * rqSq0 + rqSq0 * rqSq0;
+  const double numP   = ( _l == 1 ) ? 1.0 + rpSq0 : 9.0 + 3.0 * rpSq0 + rpSq0 * rpSq0;
+  const double diffAB = diffSqAB * diffSqAB;
+  const double diffMC = diffSqMC * diffSqMC;
+
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const double s   = mSqAB[ point ];
+    const double inv = _helicity ? invMSq : 1.0 / s;
+
+    const double zemach1 = mSqAC[ point ] - mSqBC[ point ] - diffSqMC * diffSqAB * inv;
+    const double first   = s - 2.0 * sumSqMC + diffMC * inv;
+    const double second  = s - 2.0 * sumSqAB + diffAB * inv;
+    const double angular = ( _l == 1 ) ? zemach1 : zemach1 * zemach1 - first * second / 3.0;
+
+    const double rqSq = rSq * ( s * s - 2.0 * s * sumSqAB + diffAB ) / ( 4.0 * s );
+    const double rpSq = rSq * ( s * s - 2.0 * s * sumSqMC + diffMC ) / ( 4.0 * s );
+    const double denQ = ( _l == 1 ) ? 1.0 + rqSq : 9.0 + 3.0 * rqSq + rqSq * rqSq;
+    const double denP = ( _l == 1 ) ? 1.0 + rpSq : 9.0 + 3.0 * rpSq + rpSq * rpSq;
+
+    const double centrifugal = std::sqrt( numQ / denQ ) * ( _twoBW ? std::sqrt( numP / denP ) : 1.0 );
+
+    re[ point ] *= angular * centrifugal;
+    im[ point ] *= angular * centrifugal;
+  }
+}
+
+
+
+const std::string& Resonance::parCode( const unsigned& index, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  if ( index >= _parOrder.size() )
+    throw PdfException( "Trying to access unexisting parameter." );
+
+  const std::map< std::string, std::string >::const_iterator par = pars.find( _parOrder[ index ] );
+  if ( par == pars.end() )
+    throw PdfException( "Resonance: no code given for parameter " + _parOrder[ index ] + "." );
+
+  return par->second;
+}
+
+
+const std::string Resonance::propagatorCode( const PhaseSpace& ps, const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  throw PdfException( "Resonance: the lineshape does not support code generation." );
+}
+
+
+// The generated function follows the scalar evaluation: the helpers are
+//    lambdas with the same expressions as the member functions, so that the
+//    compiler can inline them and fold the fixed parameters, and the choices
+//    of the angular momentum and of the formalism are done here.
+const std::string Resonance::code( const PhaseSpace& ps, const std::string& name,
+                                   const std::map< std::string, std::string >& pars ) const throw( PdfException )
+{
+  const auto pick = []( const unsigned& index ) { return ( index == 3 ) ? "s12" : ( ( index == 2 ) ? "s13" : "s23" ); };
+
+  // Lineshapes without a mass, a width and a radius only have S-wave terms.
+  const bool massive = ( _parOrder.size() >= 3 );
+  if ( ! massive && _l != 0 )
+    throw PdfException( "Resonance: cannot generate the angular terms of a lineshape without a mass." );
+
+  std::ostringstream out;
+  out << "static inline std::complex< double > " << name << "( const double* par, const double s12, const double s13, const double s23 )\n"
+      << "{\n"
+      << "  const double mA2 = " << Codegen::literal( ps.mSq( _resoA ) ) << ";\n"
+      << "  const double mB2 = " << Codegen::literal( ps.mSq( _resoB ) ) << ";\n"
+      << "  const double mC2 = " << Codegen::literal( ps.mSq( _noRes ) ) << ";\n"
+      << "  const double mM2 = " << Codegen::literal( ps.mSqMother()   ) << ";\n"
+      << "\n"
+      << "  const double s   = " << pick( _noRes ) << ";\n"
+      << "  const double sAC = " << pick( _resoB ) << ";\n"
+      << "  const double sBC = " << pick( _resoA ) << ";\n"
+      << "\n"
+      << "  const auto qSq = [ & ]( const double x ) { return kallen( x, mA2, mB2 ) / ( 4. * x ); };\n"
+      << "  const auto q   = [ & ]( const double x ) { return std::sqrt( kallen( x, mA2, mB2 ) ) / ( 2. * std::sqrt( x ) ); };\n"
+      << "  const auto pc  = [ & ]( const double x ) { return std::sqrt( kallen( x, mC2, mM2 ) ) / ( 2. * std::sqrt( x ) ); };\n"
+      << "  const auto rho = [ & ]( const double x ) { return std::sqrt( kallen( x, mA2, mB2 ) ) / x; };\n"
+      << "\n";
+
+  if ( massive )
+  {
+    out << "  const double m   = " << parCode( 0, pars ) << ";\n"
+        << "  const double w   = " << parCode( 1, pars ) << ";\n"
+        << "  const double r   = " << parCode( 2, pars ) << ";\n"
+        << "  const double mSq = std::pow( m, 2 );\n"
+        << "\n";
+
+    // Primed Blatt-Weisskopf factors, with the momentum of a resonant and of
+    //    the non-resonant particle.
+    const char* momenta[ 2 ] = { "q", "pc" };
+    const char* names  [ 2 ] = { "bwPrime", "bwPrimeP" };
+    for ( unsigned factor = 0; factor < 2; ++factor )
+    {
+      out << "  const auto " << names[ factor ] << " = [ & ]( const double x )\n  {\n";
+
+      if ( _l == 0 )
+        out << "    return 1.;\n";
+      else if ( ( _l == 1 ) || ( _l == 2 ) )
+      {
+        out << "    const double rSq0 = std::pow( r * " << momenta[ factor ] << "( mSq ), 2 );\n"
+            << "    const double rSq  = std::pow( r * " << momenta[ factor ] << "( x   ), 2 );\n";
+        if ( _l == 1 )
+          out << "    return std::sqrt( ( 1. + rSq0 ) / ( 1. + rSq ) );\n";
+        else
+          out << "    return std::sqrt( ( 9. + 3. * rSq0 + std::pow( rSq0, 2 ) ) / ( 9. + 3. * rSq + std::pow( rSq, 2 ) ) );\n";
+      }
+      else
+        out << "    return 0.;\n";
+
+      out << "  };\n";
+    }
+
+    if ( _l == 0 )
+      out << "  const auto bw = [ & ]( const double x ) { return 1.; };\n";
+    else
+      out << "  const auto bw = [ & ]( const double x ) { return std::pow( q( x ) / q( mSq ), " << _l << " ) * bwPrime( x ); };\n";
+
+    out << "  const auto runningWidth = [ & ]( const double x ) { return w * ( rho( x ) / rho( mSq ) ) * std::pow( bw( x ), 2 ); };\n"
+        << "\n";
+  }
+
+  out << "  std::complex< double > prop;\n"
+      << propagatorCode( ps, pars )
+      << "\n";
+
+  // Zemach tensors divide by the squared mass of the pair, and helicity ones
+  //    by the squared mass of the resonance.
+  if ( _l == 0 )
+    out << "  const double angular = 1.;\n";
+  else if ( ( _l == 1 ) || ( _l == 2 ) )
+  {
+    const char* den = _helicity ? "mSq" : "s";
+
+    out << "  const double diffSqMC = mM2 - mC2;\n"
+        << "  const double diffSqAB = mA2 - mB2;\n"
+        << "  const double tensor1  = sAC - sBC - diffSqMC * diffSqAB / " << den << ";\n";
+
+    if ( _l == 1 )
+      out << "  const double angular  = tensor1;\n";
+    else
+      out << "  const double sumSqMC  = mM2 + mC2;\n"
+          << "  const double sumSqAB  = mA2 + mB2;\n"
+          << "  const double first    = s - 2. * sumSqMC + std::pow( diffSqMC, 2 ) / " << den << ";\n"
+          << "  const double second   = s - 2. * sumSqAB + std::pow( diffSqAB, 2 ) / " << den << ";\n"
+          << "  const double angular  = std::pow( tensor1, 2 ) - first * second / 3.;\n";
+  }
+  else
+    out << "  const double angular = 0.;\n";
+
+  if ( ! massive )
+    out << "  const double centrifugal = 1.;\n";
+  else
+    out << "  const double centrifugal = bwPrime( s )" << ( _twoBW ? " * bwPrimeP( s )" : "" ) << ";\n";
+
+  out << "\n"
+      << "  return prop * angular * centrifugal;\n"
+      << "}\n\n";
 
-  return propagator( ps, mSqAB ) * angular * centrifugal;
+  return out.str();
 }
@@ -0,0 +1,428 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <numeric>
+#include <functional>
+#include <algorithm>
+
+#ifdef MPI_ON
+#include <mpi.h>
+#endif
+
+#include <Minuit/MnMigrad.h>
+#include <Minuit/MnStrategy.h>
+
+#include <cfit/simultaneousnll.hh>
+#include <cfit/minimizer.hh>
+#include <cfit/multistart.hh>
+#include <cfit/lbfgs.hh>
+#include <cfit/threads.hh>
+
+
+SimultaneousNll::SimultaneousNll( const Dataset& data, const std::map< unsigned, const PdfBase* >& pdfs ) throw( PdfException, DataException )
+  : _up( 1.0 ), _verbose( false )
+{
+  if ( pdfs.empty() )
+    throw PdfException( "SimultaneousNll: at least one category must be given a pdf." );
+
+  // Entries of each category, in their original order.
+  const std::vector< unsigned >& categories = data.categories();
+
+  std::map< unsigned, std::vector< std::size_t > > entries;
+  for ( std::size_t entry = 0; entry < categories.size(); ++entry )
+    entries[ categories[ entry ] ].push_back( entry );
+
+  typedef std::map< unsigned, std::vector< std::size_t > >::const_iterator eIter;
+  for ( eIter cat = entries.begin(); cat != entries.end(); ++cat )
+    if ( ! pdfs.count( cat->first ) )
+      throw PdfException( "SimultaneousNll: the dataset has events of a category without pdf." );
+
+  typedef std::map< unsigned, const PdfBase* >::const_iterator cIter;
+
+  // Each distinct pdf object is copied once, in order of its first category.
+  std::map< const PdfBase*, unsigned > sources;
+  for ( cIter cat = pdfs.begin(); cat != pdfs.end(); ++cat )
+  {
+    if ( ! sources.count( cat->second ) )
+    {
+      sources[ cat->second ] = _pdfs.size();
+      _pdfs.push_back( cat->second->copy() );
+    }
+
+    _pdfIdx[ cat->first ] = sources[ cat->second ];
+  }
+
+  // Sort the events by pdf, and by category within the block of each pdf.
+  std::vector< std::vector< std::size_t > > blockEntries( _pdfs.size() );
+  std::vector< std::size_t >                order;
+  order.reserve( categories.size() );
+  _blocks.push_back( 0 );
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    for ( cIter cat = pdfs.begin(); cat != pdfs.end(); ++cat )
+      if ( ( _pdfIdx[ cat->first ] == pdf ) && entries.count( cat->first ) )
+        blockEntries[ pdf ].insert( blockEntries[ pdf ].end(), entries[ cat->first ].begin(), entries[ cat->first ].end() );
+
+    order.insert( order.end(), blockEntries[ pdf ].begin(), blockEntries[ pdf ].end() );
+    _blocks.push_back( order.size() );
+  }
+
+  _entries = std::make_shared< std::vector< std::vector< std::size_t > > >( blockEntries );
+
+  _data = std::make_shared< Dataset >( data );
+
+  const Dataset& sorted = data.subset( order );
+
+  std::vector< std::vector< std::vector< double > > > columns( _pdfs.size() );
+  std::vector< CacheReal    >                         cacheR ( _pdfs.size() );
+  std::vector< CacheComplex >                         cacheC ( _pdfs.size() );
+
+  std::vector< std::shared_ptr< CacheManager > > caches;
+  std::vector< Dataset >                         blocks;
+
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    std::vector< std::size_t > block( _blocks[ pdf + 1 ] - _blocks[ pdf ] );
+    std::iota( block.begin(), block.end(), _blocks[ pdf ] );
+
+    // Compute the caches of each pdf only on its own events.
+    const Dataset& blockData = sorted.subset( block );
+
+    caches.push_back( std::make_shared< CacheManager >( *_pdfs[ pdf ], blockData, cacheR[ pdf ], cacheC[ pdf ] ) );
+    blocks.push_back( caches.back()->recomputes() ? blockData : Dataset() );
+
+    const std::vector< std::string >& varNames = _pdfs[ pdf ]->varNames();
+    for ( std::vector< std::string >::const_iterator var = varNames.begin(); var != varNames.end(); ++var )
+      columns[ pdf ].push_back( blockData.values( *var ) );
+
+    const std::map< std::string, Parameter >& pars = _pdfs[ pdf ]->getPars();
+    _parMap.insert( pars.begin(), pars.end() );
+  }
+
+  _columns = std::make_shared< std::vector< std::vector< std::vector< double > > > >( columns );
+  _cacheR  = std::make_shared< std::vector< CacheReal    >                         >( cacheR  );
+  _cacheC  = std::make_shared< std::vector< CacheComplex >                         >( cacheC  );
+
+  _caches    = std::make_shared< std::vector< std::shared_ptr< CacheManager > > >( caches );
+  _blockData = std::make_shared< std::vector< Dataset >                         >( blocks );
+
+  // Position of the parameters of each pdf in the vector of all the parameters.
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    const std::map< std::string, Parameter >& pars = _pdfs[ pdf ]->getPars();
+
+    _parIdx.push_back( std::vector< unsigned >() );
+    for ( pIter par = pars.begin(); par != pars.end(); ++par )
+      _parIdx.back().push_back( std::distance( _parMap.begin(), _parMap.find( par->first ) ) );
+  }
+}
+
+
+SimultaneousNll::SimultaneousNll( const SimultaneousNll& right )
+  : _up          ( right._up           ),
+    _verbose     ( right._verbose      ),
+    _pdfIdx      ( right._pdfIdx       ),
+    _data        ( right._data         ),
+    _blocks      ( right._blocks       ),
+    _entries     ( right._entries      ),
+    _weights     ( right._weights      ),
+    _weightValues( right._weightValues ),
+    _columns     ( right._columns      ),
+    _cacheR      ( right._cacheR       ),
+    _cacheC      ( right._cacheC       ),
+    _caches      ( right._caches       ),
+    _blockData   ( right._blockData    ),
+    _parMap      ( right._parMap       ),
+    _parIdx      ( right._parIdx       )
+{
+  std::transform( right._pdfs.begin(), right._pdfs.end(), std::back_inserter( _pdfs ),
+                  std::mem_fn( &PdfBase::copy ) );
+}
+
+
+SimultaneousNll::~SimultaneousNll()
+{
+  for ( std::vector< PdfBase* >::iterator pdf = _pdfs.begin(); pdf != _pdfs.end(); ++pdf )
+    delete *pdf;
+}
+
+
+double SimultaneousNll::up() const throw( MinimizerException )
+{
+  if ( _up < 0.0 )
+    throw MinimizerException( "The minimizer variation that specifies the sigma level of uncertainties must be positive." );
+
+  return _up;
+}
+
+
+const PdfBase& SimultaneousNll::pdf( const unsigned& category ) const throw( PdfException )
+{
+  if ( ! _pdfIdx.count( category ) )
+    throw PdfException( "SimultaneousNll: requested category has no pdf." );
+
+  return *_pdfs[ _pdfIdx.find( category )->second ];
+}
+
+
+void SimultaneousNll::setWeights( const std::string& field ) throw( DataException )
+{
+  const std::vector< std::string >& fields = _data->fields();
+  if ( std::find( fields.begin(), fields.end(), field ) == fields.end() )
+    throw DataException( "SimultaneousNll: requested weight " + field + " does not exist in dataset" );
+
+  _weights = field;
+
+  readWeights();
+}
+
+
+
+void SimultaneousNll::readWeights()
+{
+  if ( _weights.empty() )
+    return;
+
+  const std::vector< double >& values = _data->values( _weights );
+
+  std::vector< std::vector< double > > weights( _pdfs.size() );
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    const std::vector< std::size_t >& entries = ( *_entries )[ pdf ];
+
+    weights[ pdf ].reserve( entries.size() );
+    for ( std::vector< std::size_t >::const_iterator entry = entries.begin(); entry != entries.end(); ++entry )
+      weights[ pdf ].push_back( values[ *entry ] );
+  }
+
+  _weightValues = std::make_shared< const std::vector< std::vector< double > > >( weights );
+}
+
+
+// The new events of each pdf go at the end of its block. What the copies share
+//    is copied before growing it, so that they keep the previous events.
+void SimultaneousNll::append( const Dataset& events ) throw( PdfException, DataException )
+{
+  if ( ! events.size() )
+    return;
+
+  if ( _data->fields() != events.fields() )
+    throw DataException( "SimultaneousNll::append: the events do not have the fields of the dataset." );
+
+  const std::vector< unsigned >& categories = events.categories();
+
+  std::vector< std::vector< std::size_t > > entries( _pdfs.size() );
+  for ( std::size_t entry = 0; entry < categories.size(); ++entry )
+  {
+    if ( ! _pdfIdx.count( categories[ entry ] ) )
+      throw PdfException( "SimultaneousNll: the dataset has events of a category without pdf." );
+
+    entries[ _pdfIdx[ categories[ entry ] ] ].push_back( entry );
+  }
+
+  if ( _caches.use_count() > 1 )
+    _caches = std::make_shared< std::vector< std::shared_ptr< CacheManager > > >( *_caches );
+
+  std::vector< Dataset >      blocks( _pdfs.size() );
+  std::vector< CacheReal    > newR  ( _pdfs.size() );
+  std::vector< CacheComplex > newC  ( _pdfs.size() );
+
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    if ( entries[ pdf ].empty() )
+      continue;
+
+    std::shared_ptr< CacheManager >& caches = ( *_caches )[ pdf ];
+    if ( caches.use_count() > 1 )
+      caches = caches->copy();
+
+    blocks[ pdf ] = events.subset( entries[ pdf ] );
+    caches->append( *_pdfs[ pdf ], blocks[ pdf ], newR[ pdf ], newC[ pdf ] );
+  }
+
+  if ( _data.use_count() > 1 )
+    _data = std::make_shared< Dataset >( *_data );
+
+  if ( _entries.use_count() > 1 )
+    _entries = std::make_shared< std::vector< std::vector< std::size_t > > >( *_entries );
+
+  // The new events are numbered after the previous ones.
+  const std::size_t offset = _data->size();
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+    for ( std::vector< std::size_t >::const_iterator entry = entries[ pdf ].begin(); entry != entries[ pdf ].end(); ++entry )
+      ( *_entries )[ pdf ].push_back( offset + *entry );
+
+  if ( _columns.use_count() > 1 )
+    _columns = std::make_shared< std::vector< std::vector< std::vector< double > > > >( *_columns );
+
+  if ( _cacheR.use_count() > 1 )
+    _cacheR = std::make_shared< std::vector< CacheReal > >( *_cacheR );
+
+  if ( _cacheC.use_count() > 1 )
+    _cacheC = std::make_shared< std::vector< CacheComplex > >( *_cacheC );
+
+  if ( _blockData.use_count() > 1 )
+    _blockData = std::make_shared< std::vector< Dataset > >( *_blockData );
+
+  _data->append( events );
+
+  typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+  typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+  std::size_t added = 0;
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    const std::vector< std::string >& varNames = _pdfs[ pdf ]->varNames();
+    for ( std::size_t var = 0; var < varNames.size() && blocks[ pdf ].size(); ++var )
+    {
+      const std::vector< double >& values = blocks[ pdf ].values( varNames[ var ] );
+      std::vector< double >&       column = ( *_columns )[ pdf ][ var ];
+      column.insert( column.end(), values.begin(), values.end() );
+    }
+
+    for ( mrIter cached = newR[ pdf ].begin(); cached != newR[ pdf ].end(); ++cached )
+    {
+      std::vector< double >& values = ( *_cacheR )[ pdf ][ cached->first ];
+      values.insert( values.end(), cached->second.begin(), cached->second.end() );
+    }
+
+    for ( mcIter cached = newC[ pdf ].begin(); cached != newC[ pdf ].end(); ++cached )
+    {
+      std::vector< std::complex< double > >& values = ( *_cacheC )[ pdf ][ cached->first ];
+      values.insert( values.end(), cached->second.begin(), cached->second.end() );
+    }
+
+    if ( ( *_caches )[ pdf ]->recomputes() )
+      ( *_blockData )[ pdf ].append( blocks[ pdf ] );
+
+    added            += entries[ pdf ].size();
+    _blocks[ pdf + 1 ] += added;
+  }
+
+  readWeights();
+}
+
+
+
+double SimultaneousNll::operator()( const std::vector< double >& pars ) const throw( PdfException )
+{
+  if ( pars.size() != _parMap.size() )
+    throw PdfException( "Number of parameters passed does not match number of required arguments." );
+
+  // Number of cached values, read once before the threads start.
+  const unsigned nCachedR = PdfBase::_cacheIdxReal;
+  const unsigned nCachedC = PdfBase::_cacheIdxComplex;
+
+  static const std::vector< double > unweighted;
+
+  std::vector< double > pdfPars;
+
+  double nll = 0.;
+
+  for ( unsigned pdf = 0; pdf < _pdfs.size(); ++pdf )
+  {
+    pdfPars.clear();
+    for ( std::vector< unsigned >::const_iterator idx = _parIdx[ pdf ].begin(); idx != _parIdx[ pdf ].end(); ++idx )
+      pdfPars.push_back( pars[ *idx ] );
+
+    _pdfs[ pdf ]->setPars( pdfPars );
+
+    // Compute the norm once for all the categories of this pdf.
+    _pdfs[ pdf ]->cache();
+
+    const PdfBase&                              model   = *_pdfs[ pdf ];
+    const std::vector< std::vector< double > >& columns = ( *_columns )[ pdf ];
+    const CacheReal&                            blockR  = ( *_cacheR  )[ pdf ];
+    const CacheComplex&                         blockC  = ( *_cacheC  )[ pdf ];
+    const CacheManager&                         caches  = *( *_caches )[ pdf ];
+    const Dataset&                              events  = ( *_blockData )[ pdf ];
+    const std::vector< double >&                weights = _weightValues ? ( *_weightValues )[ pdf ] : unweighted;
+
+    // Each thread sums a contiguous chunk of the block, as in Nll, and the
+    //    pdf is shared by all of them.
+    const std::size_t size     = _blocks[ pdf + 1 ] - _blocks[ pdf ];
+    const unsigned    nThreads = std::max( 1u, unsigned( std::min< std::size_t >( Threads::nThreads(), size ) ) );
+
+    std::vector< double > partial( nThreads, 0.0 );
+
+    Threads::chunks( size, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+    {
+      typedef std::map< unsigned, std::vector< double >                 >::const_iterator mrIter;
+      typedef std::map< unsigned, std::vector< std::complex< double > > >::const_iterator mcIter;
+
+      // Vector of values of the variables that the pdf must be evaluated at, and vectors of cached values.
+      std::vector< double                 > vars  ( columns.size() );
+      std::vector< double                 > cacheR( nCachedR       );
+      std::vector< std::complex< double > > cacheC( nCachedC       );
+
+      // Cached values that are not materialized are read in blocks of events.
+      const std::size_t   blockSize = 4096;
+      CacheManager::Block block;
+
+      double& sum = partial[ thread ];
+
+      for ( std::size_t n = first; n < last; ++n )
+      {
+        if ( n >= block.last() )
+        {
+          caches.load( events, n, std::min( n + blockSize, last ), block );
+          block.evaluate( model, events );
+        }
+
+        for ( std::size_t var = 0; var < columns.size(); ++var )
+          vars[ var ] = columns[ var ][ n ];
+
+        for ( mrIter cached = blockR.begin(); cached != blockR.end(); ++cached )
+          cacheR[ cached->first ] = cached->second[ n ];
+
+        for ( mcIter cached = blockC.begin(); cached != blockC.end(); ++cached )
+          cacheC[ cached->first ] = cached->second[ n ];
+
+        block.fill( n, cacheR, cacheC );
+
+        const double& value = model.evaluate( vars, cacheR, cacheC );
+
+        if ( value )
+          sum += - 2. * ( weights.empty() ? 1.0 : weights[ n ] ) * log( value );
+      }
+    }, nThreads );
+
+    nll += Threads::reduce( partial );
+    nll += 2.0 * _pdfs[ pdf ]->yield();
+  }
+
+#ifdef MPI_ON
+  // If running with MPI, each process has only computed a piece of the nll.
+  double result = 0.0;
+  MPI::Comm& world = MPI::COMM_WORLD;
+  world.Allreduce( &nll, &result, 1, MPI::DOUBLE, MPI::SUM );
+
+  return result;
+#else
+  if ( _verbose )
+    std::cout << "nll = " << nll << std::endl;
+
+  return nll;
+#endif
+}
+
+
+FunctionMinimum SimultaneousNll::minimize() const
+{
+  MnMigrad migrad( *this, Minimizer::userParameters( _parMap ) );
+
+  return migrad();
+}
+
+
+const std::vector< FunctionMinimum > SimultaneousNll::minimize( const MultiStart& multiStart ) const
+{
+  return multiStart.minimize( *this, _parMap );
+}
+
+
+const LbfgsMinimum SimultaneousNll::minimize( const Lbfgs& lbfgs ) const
+{
+  return lbfgs.minimize( *this, Minimizer::userParameters( _parMap ), _verbose );
+}
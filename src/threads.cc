@@ -0,0 +1,81 @@
+#include <thread>
+#include <cstdint>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <cfit/threads.hh>
+#include <cfit/topology.hh>
+
+
+unsigned Threads::_nThreads = 0;
+bool     Threads::_pin      = false;
+
+thread_local bool Threads::_worker = false;
+
+
+const unsigned Threads::nThreads()
+{
+  if ( _worker )
+    return 1;
+
+  if ( _nThreads )
+    return _nThreads;
+
+  // hardware_concurrency may return 0 if the number of threads cannot be determined.
+  return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+
+
+void Threads::pin( const unsigned& thread, const unsigned& nThreads )
+{
+  if ( ! _pin )
+    return;
+
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  CPU_SET( Topology::system().cpu( thread, nThreads ), &cpus );
+
+  // Threads that cannot be pinned just run wherever the system places them.
+  pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+}
+
+
+
+// Only the pages entirely inside the buffer are released. Anonymous pages
+//    read back as zeros until they are written again.
+void Threads::release( void* data, const std::size_t& bytes )
+{
+  const std::uintptr_t page  = sysconf( _SC_PAGE_SIZE );
+  const std::uintptr_t begin = ( reinterpret_cast< std::uintptr_t >( data ) + page - 1 ) / page * page;
+  const std::uintptr_t end   = ( reinterpret_cast< std::uintptr_t >( data ) + bytes    ) / page * page;
+
+  if ( end > begin )
+    madvise( reinterpret_cast< void* >( begin ), end - begin, MADV_DONTNEED );
+}
+
+
+
+const double Threads::reduce( const std::vector< double >& partial )
+{
+  const Topology& topology = Topology::system();
+  const unsigned  nThreads = partial.size();
+
+  double total = 0.0;
+
+  unsigned thread = 0;
+  while ( thread < nThreads )
+  {
+    const unsigned node = topology.node( thread, nThreads );
+
+    double sum = 0.0;
+    for ( ; ( thread < nThreads ) && ( topology.node( thread, nThreads ) == node ); ++thread )
+      sum += partial[ thread ];
+
+    total += sum;
+  }
+
+  return total;
+}
@@ -0,0 +1,137 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <sched.h>
+#include <dirent.h>
+
+#include <cfit/topology.hh>
+
+
+// Lists as "0-7,16-23".
+const std::vector< unsigned > Topology::parseList( const std::string& list )
+{
+  std::vector< unsigned > values;
+
+  std::size_t pos = 0;
+  while ( pos < list.size() )
+  {
+    std::size_t end = list.find( ',', pos );
+    if ( end == std::string::npos )
+      end = list.size();
+
+    const std::string& range = list.substr( pos, end - pos );
+    const std::size_t  dash  = range.find( '-' );
+
+    if ( ! range.empty() )
+    {
+      const unsigned first = std::strtoul( range.c_str(), 0, 10 );
+      const unsigned last  = ( dash == std::string::npos ) ? first : std::strtoul( range.c_str() + dash + 1, 0, 10 );
+
+      for ( unsigned value = first; value <= last; ++value )
+        values.push_back( value );
+    }
+
+    pos = end + 1;
+  }
+
+  return values;
+}
+
+
+
+Topology::Topology()
+{
+  cpu_set_t allowed;
+  CPU_ZERO( &allowed );
+  const bool hasMask = ( sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 );
+
+  std::vector< unsigned > ids;
+
+  if ( DIR* dir = opendir( "/sys/devices/system/node" ) )
+  {
+    while ( const dirent* entry = readdir( dir ) )
+    {
+      const std::string name( entry->d_name );
+      if ( ( name.compare( 0, 4, "node" ) == 0 ) && ( name.size() > 4 ) &&
+           ( name.find_first_not_of( "0123456789", 4 ) == std::string::npos ) )
+        ids.push_back( std::strtoul( name.c_str() + 4, 0, 10 ) );
+    }
+
+    closedir( dir );
+  }
+
+  std::sort( ids.begin(), ids.end() );
+
+  for ( std::vector< unsigned >::const_iterator id = ids.begin(); id != ids.end(); ++id )
+  {
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << *id << "/cpulist";
+
+    std::ifstream file( path.str().c_str() );
+
+    std::string list;
+    std::getline( file, list );
+
+    std::vector< unsigned > cpus;
+    const std::vector< unsigned >& all = parseList( list );
+    for ( std::vector< unsigned >::const_iterator cpu = all.begin(); cpu != all.end(); ++cpu )
+      if ( ! hasMask || ( ( *cpu < CPU_SETSIZE ) && CPU_ISSET( *cpu, &allowed ) ) )
+        cpus.push_back( *cpu );
+
+    // Nodes with memory but no usable CPUs do not run any thread.
+    if ( cpus.empty() )
+      continue;
+
+    _nodeIds.push_back( *id );
+    _cpus   .push_back( cpus );
+  }
+
+  if ( _cpus.empty() )
+  {
+    std::vector< unsigned > cpus;
+    for ( unsigned cpu = 0; hasMask && ( cpu < CPU_SETSIZE ); ++cpu )
+      if ( CPU_ISSET( cpu, &allowed ) )
+        cpus.push_back( cpu );
+
+    if ( cpus.empty() )
+      cpus.push_back( 0 );
+
+    _nodeIds.push_back( 0 );
+    _cpus   .push_back( cpus );
+  }
+
+  for ( std::vector< std::vector< unsigned > >::const_iterator node = _cpus.begin(); node != _cpus.end(); ++node )
+    _ordered.insert( _ordered.end(), node->begin(), node->end() );
+}
+
+
+
+const Topology& Topology::system()
+{
+  static const Topology topology;
+  return topology;
+}
+
+
+
+const unsigned Topology::cpu( const unsigned& thread, const unsigned& nThreads ) const
+{
+  return _ordered[ std::size_t( thread ) * _ordered.size() / std::max( 1u, nThreads ) % _ordered.size() ];
+}
+
+
+
+const unsigned Topology::node( const unsigned& thread, const unsigned& nThreads ) const
+{
+  std::size_t position = std::size_t( thread ) * _ordered.size() / std::max( 1u, nThreads ) % _ordered.size();
+
+  unsigned node = 0;
+  while ( position >= _cpus[ node ].size() )
+    position -= _cpus[ node++ ].size();
+
+  return node;
+}
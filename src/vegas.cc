@@ -0,0 +1,234 @@
+#include <cmath>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include <cfit/vegas.hh>
+#include <cfit/threads.hh>
+
+
+Vegas::Vegas( const unsigned& nDim, const unsigned& nIntervals )
+  : _nDim( nDim ), _nIntervals( std::max( nIntervals, 1u ) ), _integral( 0.0 ), _error( 0.0 )
+{
+  // Start with equal intervals.
+  std::vector< double > edges( _nIntervals + 1 );
+  for ( unsigned edge = 0; edge <= _nIntervals; ++edge )
+    edges[ edge ] = double( edge ) / double( _nIntervals );
+
+  _edges.assign( _nDim, edges );
+}
+
+
+const double Vegas::map( const std::vector< double >& y, std::vector< double >& x, std::vector< unsigned >& bins ) const
+{
+  double jacobian = 1.0;
+
+  for ( unsigned dim = 0; dim < _nDim; ++dim )
+  {
+    const double&   pos = y[ dim ] * _nIntervals;
+    const unsigned  bin = std::min( unsigned( pos ), _nIntervals - 1 );
+
+    const std::vector< double >& edges = _edges[ dim ];
+    const double&                width = edges[ bin + 1 ] - edges[ bin ];
+
+    x   [ dim ] = edges[ bin ] + ( pos - bin ) * width;
+    bins[ dim ] = bin;
+
+    jacobian *= _nIntervals * width;
+  }
+
+  return jacobian;
+}
+
+
+// Smooth the sums with their neighbours, compress them as proposed by Lepage
+//    to avoid too fast changes, and place the new edges so that each interval
+//    gets the same share of the compressed sums.
+void Vegas::refine( std::vector< double >& edges, const std::vector< double >& sums ) const
+{
+  const unsigned& n = _nIntervals;
+  if ( n < 2 )
+    return;
+
+  std::vector< double > smooth( n );
+  smooth[ 0     ] = ( sums[ 0     ] + sums[ 1     ] ) / 2.0;
+  smooth[ n - 1 ] = ( sums[ n - 2 ] + sums[ n - 1 ] ) / 2.0;
+  for ( unsigned bin = 1; bin < n - 1; ++bin )
+    smooth[ bin ] = ( sums[ bin - 1 ] + sums[ bin ] + sums[ bin + 1 ] ) / 3.0;
+
+  const double& sum = std::accumulate( smooth.begin(), smooth.end(), 0.0 );
+  if ( ! ( sum > 0.0 ) )
+    return;
+
+  const double alpha = 1.5;
+
+  std::vector< double > rates( n, 0.0 );
+  for ( unsigned bin = 0; bin < n; ++bin )
+  {
+    const double& frac = smooth[ bin ] / sum;
+    if ( frac > 0.0 && frac < 1.0 )
+      rates[ bin ] = std::pow( ( 1.0 - frac ) / std::log( 1.0 / frac ), alpha );
+  }
+
+  const double& total = std::accumulate( rates.begin(), rates.end(), 0.0 );
+  if ( ! ( total > 0.0 ) )
+    return;
+
+  const double& step = total / double( n );
+
+  std::vector< double > newEdges( edges );
+
+  unsigned bin = 0;
+  double   acc = 0.0;
+  for ( unsigned edge = 1; edge < n; ++edge )
+  {
+    const double& target = step * edge;
+    while ( ( bin < n - 1 ) && ( acc + rates[ bin ] < target ) )
+      acc += rates[ bin++ ];
+
+    const double& frac = rates[ bin ] > 0.0 ? std::min( ( target - acc ) / rates[ bin ], 1.0 ) : 0.0;
+    newEdges[ edge ] = edges[ bin ] + frac * ( edges[ bin + 1 ] - edges[ bin ] );
+  }
+
+  edges = newEdges;
+}
+
+
+void Vegas::adapt( const Integrand& func, const unsigned& nPoints, const unsigned& nIter, RandomStream& stream )
+{
+  std::vector< std::vector< double > > points;
+  std::vector< double >                weights;
+  std::vector< unsigned >              strata;
+
+  for ( unsigned iter = 0; iter < nIter; ++iter )
+  {
+    sample( nPoints, stream, points, weights, strata );
+
+    std::vector< std::vector< double > > sums( _nDim, std::vector< double >( _nIntervals, 0.0 ) );
+    std::vector< double >                values;
+
+    evaluate( func, points, weights, values );
+
+    _integral = std::accumulate( values.begin(), values.end(), 0.0 );
+    for ( unsigned dim = 0; dim < _nDim; ++dim )
+    {
+      const std::vector< double >& edges  = _edges[ dim ];
+      const std::vector< double >& coords = points[ dim ];
+
+      for ( std::size_t point = 0; point < values.size(); ++point )
+      {
+        const std::size_t bin = std::upper_bound( edges.begin(), edges.end(), coords[ point ] ) - edges.begin();
+
+        sums[ dim ][ std::min< std::size_t >( bin, _nIntervals ) - 1 ] += values[ point ] * values[ point ];
+      }
+    }
+
+    _error = error( values, strata );
+
+    for ( unsigned dim = 0; dim < _nDim; ++dim )
+      refine( _edges[ dim ], sums[ dim ] );
+  }
+}
+
+
+// Strata of equal size in the mapped space, with at least two points each
+//    so that the error can be estimated from the spread inside them.
+void Vegas::sample( const unsigned& nPoints, RandomStream& stream,
+                    std::vector< std::vector< double > >& points, std::vector< double >& weights,
+                    std::vector< unsigned >& strata ) const
+{
+  const unsigned nStrata = std::max( 1u, unsigned( std::pow( nPoints / 2.0, 1.0 / _nDim ) ) );
+
+  unsigned nCubes = 1;
+  for ( unsigned dim = 0; dim < _nDim; ++dim )
+    nCubes *= nStrata;
+
+  const unsigned perStratum = std::max( 2u, nPoints / nCubes );
+  const unsigned nSample    = nCubes * perStratum;
+
+  points .assign( _nDim, std::vector< double >( nSample ) );
+  weights.assign( nSample, 0.0 );
+  strata .assign( nSample, 0   );
+
+  std::vector< double   > y   ( _nDim );
+  std::vector< double   > x   ( _nDim );
+  std::vector< unsigned > bins( _nDim );
+
+  std::size_t point = 0;
+  for ( unsigned cube = 0; cube < nCubes; ++cube )
+    for ( unsigned draw = 0; draw < perStratum; ++draw, ++point )
+    {
+      unsigned index = cube;
+      for ( unsigned dim = 0; dim < _nDim; ++dim )
+      {
+        y[ dim ] = ( index % nStrata + stream.flat() ) / nStrata;
+        index   /= nStrata;
+      }
+
+      weights[ point ] = map( y, x, bins ) / nSample;
+      strata [ point ] = cube;
+
+      for ( unsigned dim = 0; dim < _nDim; ++dim )
+        points[ dim ][ point ] = x[ dim ];
+    }
+}
+
+
+void Vegas::sample( const unsigned& nPoints, RandomStream& stream,
+                    std::vector< std::vector< double > >& points, std::vector< double >& weights ) const
+{
+  std::vector< unsigned > strata;
+  sample( nPoints, stream, points, weights, strata );
+}
+
+
+void Vegas::evaluate( const Integrand& func, const std::vector< std::vector< double > >& points,
+                      const std::vector< double >& weights, std::vector< double >& values )
+{
+  values.resize( weights.size() );
+
+  Threads::chunks( weights.size(), [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& )
+  {
+    std::vector< double > point( points.size() );
+    for ( std::size_t entry = first; entry < last; ++entry )
+    {
+      for ( std::size_t dim = 0; dim < points.size(); ++dim )
+        point[ dim ] = points[ dim ][ entry ];
+
+      values[ entry ] = func( point ) * weights[ entry ];
+    }
+  } );
+}
+
+
+
+// The sum over a stratum of k values has variance k s^2, with s^2 the
+//    sample variance of the values in it.
+const double Vegas::error( const std::vector< double >& values, const std::vector< unsigned >& strata )
+{
+  double variance = 0.0;
+
+  std::size_t first = 0;
+  while ( first < values.size() )
+  {
+    std::size_t last = first;
+    while ( ( last < values.size() ) && ( strata[ last ] == strata[ first ] ) )
+      ++last;
+
+    const double& size = last - first;
+    if ( size > 1.0 )
+    {
+      const double& mean = std::accumulate( values.begin() + first, values.begin() + last, 0.0 ) / size;
+
+      double sumSq = 0.0;
+      for ( std::size_t point = first; point < last; ++point )
+        sumSq += std::pow( values[ point ] - mean, 2 );
+
+      variance += size * sumSq / ( size - 1.0 );
+    }
+
+    first = last;
+  }
+
+  return std::sqrt( variance );
+}
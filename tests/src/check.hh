@@ -0,0 +1,71 @@
+#ifndef __CHECK_HH__
+#define __CHECK_HH__
+
+#include <cmath>
+#include <string>
+#include <iostream>
+
+
+// Checks of a test program. Each of them is printed with its outcome, and
+//    the failures are counted to give the exit status of the program.
+class Check
+{
+private:
+  unsigned _total;
+  unsigned _failed;
+
+  // Count the outcome of a check and print the end of its line.
+  bool record( const bool& passed )
+  {
+    ++_total;
+    if ( ! passed )
+      ++_failed;
+
+    std::cout << ( passed ? "ok" : "FAILED" ) << std::endl;
+
+    return passed;
+  }
+
+public:
+  Check() : _total( 0 ), _failed( 0 ) {}
+
+  // Check a condition.
+  bool operator()( const std::string& name, const bool& passed )
+  {
+    std::cout << name << ": ";
+    return record( passed );
+  }
+
+  // Check that a value agrees with a reference within a relative tolerance.
+  bool relative( const std::string& name, const double& value, const double& reference, const double& tolerance )
+  {
+    const double& relDiff = std::abs( value - reference ) / std::abs( reference );
+
+    std::cout << name << ": " << value << " (" << reference << "), relative difference " << relDiff << " ";
+    return record( relDiff < tolerance );
+  }
+
+  // Check that a value agrees with a reference within an absolute tolerance.
+  bool absolute( const std::string& name, const double& value, const double& reference, const double& tolerance )
+  {
+    const double& diff = std::abs( value - reference );
+
+    std::cout << name << ": " << value << " (" << reference << "), difference " << diff << " ";
+    return record( diff < tolerance );
+  }
+
+  bool passed() const { return _failed == 0; }
+
+  // Print the number of failures and return the exit status of the program.
+  int summary( const std::string& name ) const
+  {
+    if ( _failed == 0 )
+      std::cout << name << ": all " << _total << " checks passed." << std::endl;
+    else
+      std::cout << name << ": " << _failed << " of " << _total << " checks FAILED." << std::endl;
+
+    return _failed == 0 ? 0 : 1;
+  }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/nll.hh>
+#include <cfit/cachemanager.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MinuitParameter.h>
+
+#include "check.hh"
+
+#define NEVT  ( 30000 )
+#define NOLD  ( 10000 ) // Events given to the minimizer before appending the rest.
+
+
+// Compare the nll and the minimum of a minimizer built from part of the data
+//    and then appended the rest with those of a minimizer of all the data.
+void compare( Check& check, const std::string& name, Nll& appended, Nll& fresh, const std::vector< double >& pars )
+{
+  check.relative( name + " nll", appended( pars ), fresh( pars ), 1e-12 );
+
+  const FunctionMinimum& minAppended = appended.minimize();
+  const FunctionMinimum& minFresh    = fresh   .minimize();
+
+  check.absolute( name + " minimum", minAppended.fval(), minFresh.fval(), 1e-4 );
+
+  const std::vector< MinuitParameter >& parsAppended = minAppended.userParameters().parameters();
+  const std::vector< MinuitParameter >& parsFresh    = minFresh   .userParameters().parameters();
+
+  check( name + " number of parameters", parsAppended.size() == parsFresh.size() );
+  for ( std::size_t par = 0; par < std::min( parsAppended.size(), parsFresh.size() ); ++par )
+    check.absolute( name + " " + parsFresh[ par ].name(), parsAppended[ par ].value(), parsFresh[ par ].value(),
+                    1e-2 * std::max( parsFresh[ par ].error(), 1e-6 ) );
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable x( "x" );
+  Variable z( "z" );
+
+  // The gaussian with fixed parameters caches its values for each event.
+  Parameter mx( "mx", 0.1 );
+  Parameter sx( "sx", 1.2 );
+  Parameter mz( "mz", 0.0, 0.1 );
+  Parameter sz( "sz", 1.0, 0.1 );
+
+  mx.fix();
+  sx.fix();
+
+  Gauss gx( x, mx, sx );
+  Gauss gz( z, mz, sz );
+
+  PdfExpr pdf = gx * gz;
+
+  RandomStream stream( 5 );
+
+  Dataset all;
+  Dataset first;
+  Dataset rest;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal( 0.1, 1.2 );
+    entry[ "z" ] = stream.normal( 0.3, 0.9 );
+
+    all.push( entry );
+    if ( evt < NOLD )
+      first.push( entry );
+    else
+      rest.push( entry );
+  }
+
+  // Parameters in alphabetical order: mx, mz, sx, sz.
+  std::vector< double > pars;
+  pars.push_back( 0.1  );
+  pars.push_back( 0.25 );
+  pars.push_back( 1.2  );
+  pars.push_back( 0.95 );
+
+  // With the caches materialized, and with them recomputed when read.
+  const std::size_t budgets[ 2 ] = { std::numeric_limits< std::size_t >::max(), 1 };
+  const std::string names  [ 2 ] = { "materialized caches", "recomputed caches" };
+
+  for ( unsigned budget = 0; budget < 2; ++budget )
+  {
+    CacheManager::setBudget( budgets[ budget ] );
+
+    Nll appended( pdf, first );
+    Nll* copy = appended.copy();
+    appended.append( rest );
+
+    // Copies made before appending keep the previous events.
+    Nll previous( pdf, first );
+    check( names[ budget ] + " copy before appending", ( *copy )( pars ) == previous( pars ) );
+    delete copy;
+
+    Nll fresh( pdf, all );
+    compare( check, names[ budget ], appended, fresh, pars );
+  }
+
+  return check.summary( "Appending events" );
+}
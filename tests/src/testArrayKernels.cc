@@ -0,0 +1,284 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <string>
+#include <complex>
+#include <iostream>
+#include <algorithm>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/coefexpr.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/resonance.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/cachemanager.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/gounarissakurai.hh>
+#include <cfit/models/flatte.hh>
+#include <cfit/models/glass.hh>
+#include <cfit/models/splineresonance.hh>
+#include <cfit/models/decay3body.hh>
+#include <cfit/models/decay3bodycp.hh>
+
+#include "check.hh"
+
+#define NEVT  ( 5000 )
+#define PREC  ( 5e-11 ) // Required relative agreement of the array and scalar paths.
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+#define MK    ( 0.493677 )
+
+
+// Largest relative difference between the array and the scalar evaluations
+//    of a resonance at the given points.
+double maxDifference( const Resonance& reso, const PhaseSpace& ps,
+                      const std::vector< double >& mSq12, const std::vector< double >& mSq13, const std::vector< double >& mSq23 )
+{
+  const std::size_t& n = mSq12.size();
+
+  std::vector< double > re( n );
+  std::vector< double > im( n );
+  reso.evaluate( ps, &mSq12[ 0 ], &mSq13[ 0 ], &mSq23[ 0 ], &re[ 0 ], &im[ 0 ], n );
+
+  double diff = 0.0;
+  for ( std::size_t point = 0; point < n; ++point )
+  {
+    const std::complex< double >& scalar = reso.evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+    diff = std::max( diff, std::abs( std::complex< double >( re[ point ], im[ point ] ) - scalar ) / std::abs( scalar ) );
+  }
+
+  return diff;
+}
+
+
+// Values of the parameters of a pdf, in the order of its map, with the given
+//    shifts from their initial values.
+const std::vector< double > parameters( const PdfBase& pdf, const std::map< std::string, double >& shifts )
+{
+  std::vector< double > pars;
+
+  typedef std::map< std::string, Parameter >::const_iterator pIter;
+  for ( pIter par = pdf.getPars().begin(); par != pdf.getPars().end(); ++par )
+    pars.push_back( par->second.value() + ( shifts.count( par->first ) ? shifts.at( par->first ) : 0.0 ) );
+
+  return pars;
+}
+
+
+// Nll computed by hand with the scalar evaluation of the pdf at each event,
+//    plus the yield term of a pdf model.
+template < class Pdf >
+double scalarNll( Pdf pdf, const Dataset& data, const std::vector< double >& pars )
+{
+  pdf.setPars( pars );
+  pdf.cache();
+
+  const std::vector< double >& mSq12 = data.values( "mSq12" );
+  const std::vector< double >& mSq13 = data.values( "mSq13" );
+  const std::vector< double >& mSq23 = data.values( "mSq23" );
+
+  std::vector< double > vars( 3 );
+
+  double nll = 0.0;
+  for ( std::size_t entry = 0; entry < data.size(); ++entry )
+  {
+    vars[ 0 ] = mSq12[ entry ];
+    vars[ 1 ] = mSq13[ entry ];
+    vars[ 2 ] = mSq23[ entry ];
+    nll -= 2.0 * std::log( pdf.evaluate( vars ) );
+  }
+
+  return nll + 2.0;
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  // Points spread flat over the Dalitz plot.
+  RandomStream stream( 11 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  while ( data.size() < NEVT )
+  {
+    const double& x = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& y = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& z = ps.mSqSum() - x - y;
+    if ( ! ps.contains( x, y, z ) )
+      continue;
+
+    entry[ "mSq12" ] = x;
+    entry[ "mSq13" ] = y;
+    entry[ "mSq23" ] = z;
+    data.push( entry );
+  }
+
+  const std::vector< double >& mSq12 = data.values( "mSq12" );
+  const std::vector< double >& mSq13 = data.values( "mSq13" );
+  const std::vector< double >& mSq23 = data.values( "mSq23" );
+
+  Parameter mKst ( "mKst" , 0.8917, 0.01 );
+  Parameter wKst ( "wKst" , 0.0508       );
+  Parameter mRho ( "mRho" , 0.7758       );
+  Parameter wRho ( "wRho" , 0.1464       );
+  Parameter mF0  ( "mF0"  , 0.965        );
+  Parameter wF0  ( "wF0"  , 0.0          );
+  Parameter g1F0 ( "g1F0" , 0.165        );
+  Parameter g2F0 ( "g2F0" , 0.695        );
+  Parameter mLass( "mLass", 1.4256       );
+  Parameter wLass( "wLass", 0.2985       );
+  Parameter lassR( "lassR", 1.0          );
+  Parameter lassB( "lassB", 0.9          );
+  Parameter phiR ( "phiR" , 0.3          );
+  Parameter phiB ( "phiB" , -0.2         );
+  Parameter lassr( "lassr", 3.32         );
+  Parameter lassa( "lassa", 2.07         );
+  Parameter mPi  ( "mPi"  , MPI          );
+  Parameter mK   ( "mK"   , MK           );
+  Parameter r    ( "r"    , 1.5          );
+
+  // Resonances in each pair of particles, with each spin and angular term.
+  for ( int l = 0; l < 3; ++l )
+  {
+    const std::string& spin = " l = " + std::to_string( l );
+
+    for ( unsigned helicity = 0; helicity < 2; ++helicity )
+    {
+      const std::string& angular = helicity ? " helicity" : " Zemach";
+
+      RelBreitWigner kst( 1, 2, mKst, wKst, r, l );
+      GounarisSakurai rho( 2, 3, mRho, wRho, r, l );
+      kst.useHelicity( helicity );
+      rho.useHelicity( helicity );
+
+      check.absolute( "RelBreitWigner"  + spin + angular, maxDifference( kst, ps, mSq12, mSq13, mSq23 ), 0.0, PREC );
+      check.absolute( "GounarisSakurai" + spin + angular, maxDifference( rho, ps, mSq12, mSq13, mSq23 ), 0.0, PREC );
+    }
+
+    Flatte f0( 2, 3, mF0, wF0, r, g1F0, g2F0, mPi, mK, l );
+    GLass  lass( 1, 3, mLass, wLass, r, lassR, lassB, phiR, phiB, lassr, lassa, l );
+
+    check.absolute( "Flatte" + spin, maxDifference( f0  , ps, mSq12, mSq13, mSq23 ), 0.0, PREC );
+    check.absolute( "GLass"  + spin, maxDifference( lass, ps, mSq12, mSq13, mSq23 ), 0.0, PREC );
+  }
+
+  // Spline over the range of mSq23, which has no kernel of its own.
+  std::vector< double > knots;
+  std::vector< Coef >   coefs;
+  std::vector< Parameter > knotPars;
+  for ( unsigned knot = 0; knot < 6; ++knot )
+  {
+    knots.push_back( ps.mSqMin( 2 ) + ( ps.mSqMax( 2 ) - ps.mSqMin( 2 ) ) * knot / 5.0 );
+    knotPars.push_back( Parameter( "reS" + std::to_string( knot ), std::cos( knot ) ) );
+    knotPars.push_back( Parameter( "imS" + std::to_string( knot ), std::sin( knot ) ) );
+  }
+  for ( unsigned knot = 0; knot < 6; ++knot )
+    coefs.push_back( Coef( knotPars[ 2 * knot ], knotPars[ 2 * knot + 1 ] ) );
+
+  SplineResonance spline( 2, 3, knots, coefs );
+  check.absolute( "SplineResonance", maxDifference( spline, ps, mSq12, mSq13, mSq23 ), 0.0, PREC );
+
+  // Amplitude with floating coefficients and mass, evaluated by blocks in the
+  //    nll, compared with the scalar evaluation of each event.
+  Parameter reKst( "reKst", 1.5, 0.1  );
+  Parameter imKst( "imKst", -0.5, 0.1 );
+  Parameter reRho( "reRho", 1.0, 0.1  );
+  Parameter imRho( "imRho", 0.0, 0.1  );
+  Parameter reZ  ( "reZ"  , 0.1, 0.1  );
+  Parameter imZ  ( "imZ"  , 0.2, 0.1  );
+
+  wKst .fix();
+  mRho .fix();
+  wRho .fix();
+  r    .fix();
+
+  RelBreitWigner kst( 1, 2, mKst, wKst, r, 1 );
+  GounarisSakurai rho( 2, 3, mRho, wRho, r, 1 );
+
+  Amplitude amp = Coef( reKst, imKst ) * kst + Coef( reRho, imRho ) * rho + 0.3;
+
+  std::vector< std::complex< double > > values( NEVT );
+  amp.evaluate( ps, &mSq12[ 0 ], &mSq13[ 0 ], &mSq23[ 0 ], &values[ 0 ], NEVT );
+
+  double diff = 0.0;
+  for ( std::size_t point = 0; point < NEVT; ++point )
+  {
+    const std::complex< double >& scalar = amp.evaluate( ps, mSq12[ point ], mSq13[ point ], mSq23[ point ] );
+    diff = std::max( diff, std::abs( values[ point ] - scalar ) / std::abs( scalar ) );
+  }
+  check.absolute( "amplitude", diff, 0.0, PREC );
+
+  Variable m12( "mSq12" );
+  Variable m13( "mSq13" );
+  Variable m23( "mSq23" );
+
+  Decay3Body   decay( m12, m13, m23, amp, ps );
+  Decay3BodyCP cp   ( m12, m13, m23, amp, Coef( reZ, imZ ), ps );
+  decay.setNormBins( 200 );
+  cp   .setNormBins( 200 );
+
+  // Floating parameters moved away from their initial values.
+  std::map< std::string, double > shifts;
+  shifts[ "imKst" ] = 0.1;
+  shifts[ "imRho" ] = 0.1;
+  shifts[ "mKst"  ] = 0.002;
+  shifts[ "reKst" ] = -0.1;
+  shifts[ "imZ"   ] = -0.05;
+  shifts[ "reZ"   ] = -0.05;
+
+  const std::vector< double >& pars   = parameters( decay, shifts );
+  const std::vector< double >& parsCP = parameters( cp   , shifts );
+
+  // With the blocks read from memory, and with the cached columns recomputed.
+  const std::size_t budgets[ 2 ] = { std::numeric_limits< std::size_t >::max(), 1 };
+  const std::string names  [ 2 ] = { " materialized", " recomputed" };
+
+  for ( unsigned budget = 0; budget < 2; ++budget )
+  {
+    CacheManager::setBudget( budgets[ budget ] );
+
+    {
+      Nll nll( decay, data );
+      check.relative( "Decay3Body nll" + names[ budget ], nll( pars ), scalarNll( decay, data, pars ), 1e-10 );
+    }
+    {
+      Nll nll( cp, data );
+      check.relative( "Decay3BodyCP nll" + names[ budget ], nll( parsCP ), scalarNll( cp, data, parsCP ), 1e-10 );
+    }
+  }
+
+  // With all the parameters fixed, the amplitudes are cached once.
+  mKst .fix();
+  reKst.fix();
+  imKst.fix();
+  reRho.fix();
+  imRho.fix();
+
+  RelBreitWigner fixedKst( 1, 2, mKst, wKst, r, 1 );
+  Amplitude      fixedAmp = Coef( reKst, imKst ) * fixedKst + Coef( reRho, imRho ) * rho + 0.3;
+  Decay3Body     fixed( m12, m13, m23, fixedAmp, ps );
+  fixed.setNormBins( 200 );
+
+  const std::vector< double >& fixedPars = parameters( fixed, std::map< std::string, double >() );
+
+  CacheManager::setBudget( std::numeric_limits< std::size_t >::max() );
+  {
+    Nll nll( fixed, data );
+    check.relative( "fixed Decay3Body nll", nll( fixedPars ), scalarNll( fixed, data, fixedPars ), 1e-10 );
+  }
+
+  return check.summary( "Array kernels" );
+}
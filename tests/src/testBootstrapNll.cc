@@ -0,0 +1,107 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/bootstrapnll.hh>
+#include <cfit/threads.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FunctionMinimum.h>
+
+#include "check.hh"
+
+#define NEVT  ( 20000 )
+#define NREP  ( 4     )
+#define NTHR  ( 4     )
+#define SEED  ( 99    )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable  x    ( "x"               );
+  Parameter mu   ( "mu"   , 0.0, 0.1 );
+  Parameter sigma( "sigma", 1.0, 0.1 );
+  Gauss     gauss( x, mu, sigma );
+
+  RandomStream stream( 21 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal( 0.3, 1.2 );
+    entry[ "w" ] = stream.uniform( 0.5, 1.5 );
+    data.push( entry );
+  }
+
+  BootstrapNll bootstrap( gauss, data, NREP, SEED );
+  bootstrap.setWeights( "w" );
+
+  // Each replica is equivalent to an Nll weighted by the product of its
+  //    Poisson weight and the weight of the event.
+  const std::vector< double >& xs = data.values( "x" );
+  const std::vector< double >& ws = data.values( "w" );
+
+  std::vector< Dataset > replicas( NREP );
+  for ( unsigned replica = 0; replica < NREP; ++replica )
+    for ( std::size_t evt = 0; evt < NEVT; ++evt )
+    {
+      entry[ "x" ] = xs[ evt ];
+      entry[ "w" ] = ws[ evt ] * bootstrap.weight( replica, evt );
+      replicas[ replica ].push( entry );
+    }
+
+  // Parameters in alphabetical order: mu, sigma. Two replicas share a point.
+  std::vector< std::vector< double > > pars( NREP, std::vector< double >( 2 ) );
+  for ( unsigned replica = 0; replica < NREP; ++replica )
+  {
+    pars[ replica ][ 0 ] = 0.2 + 0.05 * ( replica % 3 );
+    pars[ replica ][ 1 ] = 1.1 + 0.05 * ( replica % 3 );
+  }
+
+  // Summed by several threads, whatever the number of cores, and by one.
+  Threads::setNThreads( NTHR );
+  const std::vector< double >& values = bootstrap.evaluate( pars );
+
+  Threads::setNThreads( 1 );
+  const std::vector< double >& serial = bootstrap.evaluate( pars );
+  Threads::setNThreads( NTHR );
+
+  for ( unsigned replica = 0; replica < NREP; ++replica )
+  {
+    const std::string& name = "replica " + std::to_string( replica );
+
+    Nll nll( gauss, replicas[ replica ] );
+    nll.setWeights( "w" );
+
+    check.relative( name + " nll", values[ replica ], nll( pars[ replica ] ), 1e-12 );
+    check.relative( name + " nll with one thread", serial[ replica ], values[ replica ], 1e-12 );
+
+    bootstrap.setReplica( replica );
+    check.relative( name + " selected nll", bootstrap( pars[ replica ] ), values[ replica ], 1e-12 );
+  }
+
+  // Fits of all the replicas, as fits of the equivalent nlls.
+  const std::vector< FunctionMinimum >& minima = bootstrap.minimizeAll();
+
+  check( "number of fits", minima.size() == NREP );
+  for ( unsigned replica = 0; replica < minima.size(); ++replica )
+  {
+    Nll nll( gauss, replicas[ replica ] );
+    nll.setWeights( "w" );
+
+    check.absolute( "replica " + std::to_string( replica ) + " minimum", minima[ replica ].fval(), nll.minimize().fval(), 1e-4 );
+  }
+
+  return check.summary( "Bootstrap nll" );
+}
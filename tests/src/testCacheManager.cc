@@ -0,0 +1,104 @@
+#include <cmath>
+#include <limits>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/nll.hh>
+#include <cfit/cachemanager.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include "check.hh"
+
+#define NEVT  ( 100000 )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable x( "x" );
+  Variable y( "y" );
+  Variable z( "z" );
+
+  // The gaussians with fixed parameters cache their values for each event.
+  Parameter mx( "mx",  0.1 );
+  Parameter sx( "sx",  1.2 );
+  Parameter my( "my", -0.3 );
+  Parameter sy( "sy",  0.8 );
+  Parameter mz( "mz",  0.0, 0.1 );
+  Parameter sz( "sz",  1.0, 0.1 );
+
+  mx.fix();
+  sx.fix();
+  my.fix();
+  sy.fix();
+
+  Gauss gx( x, mx, sx );
+  Gauss gy( y, my, sy );
+  Gauss gz( z, mz, sz );
+
+  PdfExpr pdf = gx * gy * gz;
+
+  RandomStream stream( 99 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal();
+    entry[ "y" ] = stream.normal();
+    entry[ "z" ] = stream.normal();
+    data.push( entry );
+  }
+
+  // Parameters in alphabetical order: mx, my, mz, sx, sy, sz.
+  std::vector< double > pars;
+  pars.push_back(  0.1  );
+  pars.push_back( -0.3  );
+  pars.push_back(  0.05 );
+  pars.push_back(  1.2  );
+  pars.push_back(  0.8  );
+  pars.push_back(  1.1  );
+
+  // All the columns materialized. The budget is shared by the live managers,
+  //    so each nll is destroyed before the next one is made.
+  CacheManager::setBudget( std::numeric_limits< std::size_t >::max() );
+  double reference;
+  {
+    Nll materialized( pdf, data );
+    reference = materialized( pars );
+    check( "materialized", materialized.caches().complete() );
+  }
+
+  // No memory for any column: all of them are recomputed when read.
+  CacheManager::setBudget( 1 );
+  {
+    Nll recomputed( pdf, data );
+    check( "recomputes", recomputed.caches().recomputes() );
+    check.relative( "recomputed", recomputed( pars ), reference, 1e-12 );
+
+    Nll* copy = recomputed.copy();
+    check.relative( "copy of the recomputed", ( *copy )( pars ), reference, 1e-12 );
+    delete copy;
+  }
+
+  // Columns stored as floats change the nll slightly.
+  CacheManager::setReducedPrecision( true );
+  CacheManager::setBudget( NEVT * 3 * sizeof( float ) );
+  {
+    Nll reduced( pdf, data );
+    check( "partly materialized", ! reduced.caches().complete() && ! reduced.caches().recomputes() );
+    reduced.caches().report( std::cout );
+    check.relative( "reduced precision", reduced( pars ), reference, 1e-6 );
+  }
+  CacheManager::setReducedPrecision( false );
+
+  return check.summary( "Cache plans" );
+}
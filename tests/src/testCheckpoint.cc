@@ -0,0 +1,128 @@
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/pdfexpr.hh>
+#include <cfit/nll.hh>
+#include <cfit/checkpoint.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnMigrad.h>
+
+#include "check.hh"
+
+#define PATH  ( "testCheckpoint.chk" )
+#define NEVT  ( 10000 )
+
+
+// Whether building an nll from the caches of the checkpoint throws.
+const bool rejected( const PdfExpr& pdf, const Dataset& data, const Checkpoint& checkpoint )
+{
+  try
+  {
+    Nll nll( pdf, data, checkpoint );
+  }
+  catch ( const MinimizerException& error )
+  {
+    return true;
+  }
+
+  return false;
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  // Segments long enough for Migrad to get through a few iterations each.
+  Checkpoint checkpoint( PATH, 50 );
+  std::remove( checkpoint.path()     .c_str() );
+  std::remove( checkpoint.cachePath().c_str() );
+
+  Variable x( "x" );
+  Variable y( "y" );
+  Variable z( "z" );
+
+  // The gaussians with fixed parameters cache their values for each event.
+  Parameter mx( "mx", 0.1 );
+  Parameter sx( "sx", 1.2 );
+  Parameter mz( "mz", 0.0, 0.1 );
+  Parameter sz( "sz", 1.0, 0.1 );
+
+  mx.fix();
+  sx.fix();
+
+  PdfExpr pdf   = Gauss( x, mx, sx ) * Gauss( z, mz, sz );
+  PdfExpr other = Gauss( y, mx, sx ) * Gauss( z, mz, sz );
+
+  RandomStream stream( 4 );
+
+  Dataset data;
+  Dataset changed;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal( 0.1, 1.2 );
+    entry[ "y" ] = stream.normal( 0.1, 1.2 );
+    entry[ "z" ] = stream.normal( 0.3, 0.9 );
+    data.push( entry );
+
+    // The same events but for the last one.
+    if ( evt == NEVT - 1 )
+      entry[ "x" ] += 1e-9;
+    changed.push( entry );
+  }
+
+  // Parameters in alphabetical order: mx, mz, sx, sz.
+  std::vector< double > pars;
+  pars.push_back( 0.1  );
+  pars.push_back( 0.25 );
+  pars.push_back( 1.2  );
+  pars.push_back( 0.95 );
+
+  Nll fresh( pdf, data );
+
+  // The first nll computes the caches and saves them, the second one loads them.
+  {
+    Nll saved( pdf, data, checkpoint );
+    check( "caches saved", checkpoint.cacheExists() );
+    check( "nll with saved caches", saved( pars ) == fresh( pars ) );
+  }
+  {
+    Nll restored( pdf, data, checkpoint );
+    check( "nll with restored caches", restored( pars ) == fresh( pars ) );
+  }
+
+  // Caches of other events, or of other variables, are not loaded.
+  check( "other events rejected"   , rejected( pdf  , changed, checkpoint ) );
+  check( "other variables rejected", rejected( other, data   , checkpoint ) );
+
+  // A fit killed after a few calls resumes from the saved state.
+  MnMigrad migrad( fresh, Minimizer::userParameters( pdf.getPars() ) );
+  const FunctionMinimum& killed = migrad( 10 );
+  checkpoint.save( killed.userState(), killed.nfcn() );
+
+  Nll resumed( pdf, data, checkpoint );
+  const FunctionMinimum& min = resumed.minimize( checkpoint );
+  const FunctionMinimum& ref = fresh.minimize();
+
+  unsigned nCalls = 0;
+  checkpoint.load( nCalls );
+
+  check.absolute( "resumed minimum", min.fval(), ref.fval(), 1e-4 );
+  check( "calls before the kill counted", nCalls > unsigned( killed.nfcn() ) );
+
+  std::remove( checkpoint.path()     .c_str() );
+  std::remove( checkpoint.cachePath().c_str() );
+
+  return check.summary( "Checkpoint round trip" );
+}
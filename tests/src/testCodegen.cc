@@ -0,0 +1,126 @@
+#include <cmath>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/threads.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/gounarissakurai.hh>
+#include <cfit/models/decay3body.hh>
+
+#include "check.hh"
+
+#define NEVT  ( 20000 )
+#define NTHR  ( 4     )
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  // Fixed lineshapes, folded into the kernel, and floating coefficients.
+  Parameter mKst( "mKst", 0.8917, 0.01 );
+  Parameter wKst( "wKst", 0.0508       );
+  Parameter mRho( "mRho", 0.7758       );
+  Parameter wRho( "wRho", 0.1464       );
+  Parameter r   ( "r"   , 1.5          );
+
+  wKst.fix();
+  mRho.fix();
+  wRho.fix();
+  r   .fix();
+
+  Parameter reKst( "reKst", 1.5, 0.1 );
+  Parameter imKst( "imKst", -0.5, 0.1 );
+  Parameter reRho( "reRho", 1.0, 0.1 );
+  Parameter imRho( "imRho", 0.0, 0.1 );
+
+  RelBreitWigner kst( 1, 2, mKst, wKst, r, 1 );
+  kst.useHelicity();
+
+  Amplitude amp = Coef( reKst, imKst ) * kst + Coef( reRho, imRho ) * GounarisSakurai( 2, 3, mRho, wRho, r, 1 ) + 0.3;
+
+  Decay3Body pdf( mSq12, mSq13, mSq23, amp, ps );
+  pdf.setNormBins( 200 );
+
+  // Events spread flat over the Dalitz plot.
+  RandomStream stream( 7 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  while ( data.size() < NEVT )
+  {
+    const double& x = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& y = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& z = ps.mSqSum() - x - y;
+    if ( ! ps.contains( x, y, z ) )
+      continue;
+
+    entry[ "mSq12" ] = x;
+    entry[ "mSq13" ] = y;
+    entry[ "mSq23" ] = z;
+    data.push( entry );
+  }
+
+  Nll nll( pdf, data );
+
+  // Parameters in alphabetical order: imKst, imRho, mKst, mRho, r, reKst, reRho, wKst, wRho.
+  std::vector< std::vector< double > > points;
+  for ( unsigned point = 0; point < 3; ++point )
+  {
+    std::vector< double > pars;
+    pars.push_back( -0.5 + 0.1 * point );
+    pars.push_back(  0.0 + 0.2 * point );
+    pars.push_back(  0.8917 + 0.002 * point );
+    pars.push_back(  0.7758 );
+    pars.push_back(  1.5    );
+    pars.push_back(  1.5 - 0.1 * point );
+    pars.push_back(  1.0 );
+    pars.push_back(  0.0508 );
+    pars.push_back(  0.1464 );
+    points.push_back( pars );
+  }
+
+  std::vector< double > interpreted;
+  for ( unsigned point = 0; point < points.size(); ++point )
+    interpreted.push_back( nll( points[ point ] ) );
+
+  nll.compile();
+  check( "compiled", nll.compiled() );
+
+  for ( unsigned point = 0; point < points.size(); ++point )
+    check.relative( "compiled nll", nll( points[ point ] ), interpreted[ point ], 1e-10 );
+
+  // The kernel is called on a chunk of the events and norm points by each
+  //    thread, whatever the number of cores.
+  const unsigned nThreads = Threads::nThreads();
+  Threads::setNThreads( NTHR );
+  for ( unsigned point = 0; point < points.size(); ++point )
+    check.relative( "compiled nll with threads", nll( points[ point ] ), interpreted[ point ], 1e-10 );
+  Threads::setNThreads( nThreads );
+
+  // Going back to the interpreted pdf gives the same values.
+  nll.interpret();
+  check( "interpreted again", ! nll.compiled() && ( nll( points[ 0 ] ) == interpreted[ 0 ] ) );
+
+  return check.summary( "Compiled nll" );
+}
@@ -0,0 +1,144 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/threads.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+#include <cfit/models/conditionalpdf.hh>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameters.h>
+
+#include "check.hh"
+
+#define NEVT  ( 20000 )
+#define NRES  ( 5     ) // Distinct values of the per-event resolution.
+#define NTHR  ( 4     )
+
+#define LOWER ( -2.0 )
+#define UPPER (  6.0 )
+
+
+// Gaussian of mean mu and width sigma normalized on the range of the observable.
+double conditional( const double& x, const double& mu, const double& sigma )
+{
+  const double& area = 0.5 * ( std::erf( ( UPPER - mu ) / ( std::sqrt( 2.0 ) * sigma ) ) -
+                               std::erf( ( LOWER - mu ) / ( std::sqrt( 2.0 ) * sigma ) ) );
+
+  return std::exp( - 0.5 * std::pow( ( x - mu ) / sigma, 2 ) ) / ( std::sqrt( 2.0 * M_PI ) * sigma * area );
+}
+
+
+// Whether conditioning the pdf on a variable throws.
+const bool rejected( const Gauss& gauss, const Variable& cond, const Parameter& target )
+{
+  try
+  {
+    ConditionalPdf pdf( gauss, cond, target, LOWER, UPPER );
+  }
+  catch ( const PdfException& error )
+  {
+    return true;
+  }
+
+  return false;
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  // A decay time resolution model with the per-event error as its width.
+  Variable  t    ( "t"                );
+  Variable  st   ( "st"               );
+  Parameter mu   ( "mu"   , 0.0 , 0.1 );
+  Parameter sigma( "sigma", 0.5       );
+  Parameter other( "other", 1.0       );
+
+  Gauss gauss( t, mu, sigma );
+
+  ConditionalPdf pdf( gauss, st, sigma, LOWER, UPPER );
+
+  check( "width replaced by the condition", ! pdf.getPars().count( "sigma" ) && pdf.getPars().count( "mu" ) );
+  check( "condition is a variable", pdf.nVars() == 2 && pdf.conditions().size() == 1 && pdf.conditions()[ 0 ] == "st" );
+  check( "unknown target refused", rejected( gauss, st, other ) );
+
+  // Events with a few distinct resolutions, within the range of the observable.
+  RandomStream stream( 31 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  while ( data.size() < NEVT )
+  {
+    entry[ "st" ] = 0.2 * ( 1 + data.size() % NRES );
+    entry[ "t"  ] = stream.normal( 0.3, entry[ "st" ] );
+    if ( entry[ "t" ] < LOWER || entry[ "t" ] > UPPER )
+      continue;
+
+    data.push( entry );
+  }
+
+  // Values at each event, with the variables sorted by name: st, t.
+  const std::vector< double >& sts = data.values( "st" );
+  const std::vector< double >& ts  = data.values( "t"  );
+
+  std::vector< double > vars( 2 );
+  double maxDiff = 0.0;
+  for ( unsigned evt = 0; evt < 100; ++evt )
+  {
+    vars[ 0 ] = sts[ evt ];
+    vars[ 1 ] = ts [ evt ];
+
+    const double& reference = conditional( ts[ evt ], 0.0, sts[ evt ] );
+    maxDiff = std::max( maxDiff, std::abs( pdf.evaluate( vars ) / reference - 1.0 ) );
+  }
+  check.absolute( "values at the events", maxDiff, 0.0, 1e-12 );
+
+  vars[ 1 ] = UPPER + 1.0;
+  check( "zero outside the range", pdf.evaluate( vars ) == 0.0 );
+
+  // Events with the same resolution share their norm.
+  ConditionalPdf grouped( pdf );
+  grouped.cacheReal( data );
+  check( "one norm per resolution", grouped.nGroups() == NRES );
+
+  // The nll with the cached norms agrees with the sum of the conditional
+  //    pdfs, with any number of threads.
+  Nll nll( pdf, data );
+
+  std::vector< double > pars( 1, 0.25 );
+
+  double sum = 2.0; // The nll adds twice the yield, one for a pdf that is not extended.
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    sum -= 2.0 * std::log( conditional( ts[ evt ], pars[ 0 ], sts[ evt ] ) );
+
+  check.relative( "nll", nll( pars ), sum, 1e-12 );
+
+  const unsigned nThreads = Threads::nThreads();
+  Threads::setNThreads( NTHR );
+  pars[ 0 ] = 0.35;
+
+  sum = 2.0;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    sum -= 2.0 * std::log( conditional( ts[ evt ], pars[ 0 ], sts[ evt ] ) );
+
+  check.relative( "nll with threads", nll( pars ), sum, 1e-12 );
+  Threads::setNThreads( nThreads );
+
+  // The fit finds the mean the events were generated with.
+  const FunctionMinimum& min = nll.minimize();
+
+  check( "valid minimum", min.isValid() );
+  check.absolute( "fitted mean", min.userParameters().value( "mu" ), 0.3, 5.0 * min.userParameters().error( "mu" ) );
+
+  return check.summary( "Conditional pdf" );
+}
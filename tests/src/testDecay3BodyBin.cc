@@ -0,0 +1,212 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/function.hh>
+#include <cfit/binning.hh>
+#include <cfit/binnedamplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/random.hh>
+
+#include <cfit/models/decay3bodybin.hh>
+
+#include "check.hh"
+
+#define NBINS  ( 4      )
+#define NSEED  ( 60     ) // Seed points of the binning per dimension.
+#define NFINE  ( 1000   ) // Cells per dimension of the reference integrals.
+#define NEVT   ( 200000 )
+#define NSIG   ( 5.0    ) // Allowed deviation, in standard errors.
+
+#define MD0    ( 1.86484  )
+#define MKS    ( 0.497614 )
+#define MPI    ( 0.13957  )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  const double min = ps.mSq12min();
+  const double max = ps.mSq12max();
+
+  // Bands along the diagonal of the Dalitz plot, over the range of
+  //    mSq12 + mSq13 in the phase space.
+  double sumMin = ps.mSqSum();
+  double sumMax = 0.0;
+  for ( unsigned binX = 0; binX < NFINE; ++binX )
+    for ( unsigned binY = 0; binY < NFINE; ++binY )
+    {
+      const double x = min + ( max - min ) * ( binX + 0.5 ) / NFINE;
+      const double y = min + ( max - min ) * ( binY + 0.5 ) / NFINE;
+      if ( ps.contains( x, y ) )
+      {
+        sumMin = std::min( sumMin, x + y );
+        sumMax = std::max( sumMax, x + y );
+      }
+    }
+
+  std::vector< std::pair< std::pair< float, float >, unsigned > > seeds;
+  for ( unsigned binX = 0; binX < NSEED; ++binX )
+    for ( unsigned binY = 0; binY < binX; ++binY )
+    {
+      const float x = min + ( max - min ) * ( binX + 0.5 ) / NSEED;
+      const float y = min + ( max - min ) * ( binY + 0.5 ) / NSEED;
+
+      seeds.push_back( std::make_pair( std::make_pair( x, y ), 1 + std::min( unsigned( std::max( x + y - sumMin, 0.0 ) / ( sumMax - sumMin ) * NBINS ), NBINS - 1u ) ) );
+    }
+
+  Binning binning( seeds );
+
+  std::vector< Parameter > tp;
+  std::vector< Parameter > tm;
+  std::vector< CoefExpr  > xb;
+  for ( unsigned bin = 0; bin < NBINS; ++bin )
+  {
+    const std::string& index = std::to_string( bin );
+    tp.push_back( Parameter( "tp" + index, 0.1 + 0.1 * bin, 0.1 ) );
+    tm.push_back( Parameter( "tm" + index, 0.3 - 0.05 * bin, 0.1 ) );
+    xb.push_back( Coef( Parameter( "xr" + index, 0.5, 0.1 ), Parameter( "xi" + index, 0.2 * bin, 0.1 ) ) );
+  }
+
+  BinnedAmplitude amp( tp, tm, xb );
+
+  Parameter re( "re", 0.3, 0.1 );
+  Parameter im( "im", 0.1, 0.1 );
+
+  // Efficiency proportional to mSq12.
+  const Decay3BodyBin flat     ( mSq12, mSq13, mSq23, amp, binning, Coef( re, im ), ps );
+  const Decay3BodyBin efficient = flat * Function( mSq12 );
+
+  // Reference integrals of the efficiency in each signed bin, and of mSq12
+  //    with and without the efficiency.
+  std::map< int, double > area;
+  std::map< int, double > effs;
+  std::map< int, double > sumFlat;
+  std::map< int, double > sumEff;
+  std::map< int, double > sumSqEff;
+  for ( unsigned binX = 0; binX < NFINE; ++binX )
+    for ( unsigned binY = 0; binY < NFINE; ++binY )
+    {
+      const double x = min + ( max - min ) * ( binX + 0.5 ) / NFINE;
+      const double y = min + ( max - min ) * ( binY + 0.5 ) / NFINE;
+      if ( ! ps.contains( x, y ) )
+        continue;
+
+      const int& bin = binning.bin( x, y );
+      area    [ bin ] += 1.0;
+      effs    [ bin ] += x;
+      sumFlat [ bin ] += x;
+      sumEff  [ bin ] += x * x;
+      sumSqEff[ bin ] += x * x * x;
+    }
+
+  // The efficiency scales the fraction of each bin by its mean in the bin.
+  const std::map< int, double >& fracFlat = flat     .binFractions();
+  const std::map< int, double >& fracEff  = efficient.binFractions();
+
+  double total = 0.0;
+  for ( std::map< int, double >::const_iterator bin = fracFlat.begin(); bin != fracFlat.end(); ++bin )
+    total += bin->second * effs[ bin->first ] / area[ bin->first ];
+
+  for ( std::map< int, double >::const_iterator bin = fracFlat.begin(); bin != fracFlat.end(); ++bin )
+    check.relative( "fraction of bin " + std::to_string( bin->first ), fracEff.at( bin->first ),
+                    bin->second * effs[ bin->first ] / area[ bin->first ] / total, 2e-2 );
+
+  Random::setSeed( 5 );
+
+  // Counts-only toys: multinomial for a fixed total, Poisson for an expected one.
+  const std::map< int, unsigned >& counts  = efficient.generateCounts       ( NEVT );
+  const std::map< int, unsigned >& poisson = efficient.generateCountsPoisson( NEVT );
+
+  unsigned nCounts  = 0;
+  unsigned nPoisson = 0;
+  for ( std::map< int, double >::const_iterator bin = fracEff.begin(); bin != fracEff.end(); ++bin )
+  {
+    const double& expected = NEVT * bin->second;
+    const double& sigma    = std::sqrt( expected );
+
+    check.absolute( "multinomial count of bin " + std::to_string( bin->first ), counts .at( bin->first ), expected, NSIG * sigma );
+    check.absolute( "Poisson count of bin "     + std::to_string( bin->first ), poisson.at( bin->first ), expected, NSIG * sigma );
+
+    nCounts  += counts .at( bin->first );
+    nPoisson += poisson.at( bin->first );
+  }
+
+  check( "multinomial total", nCounts == NEVT );
+  check.absolute( "Poisson total", nPoisson, NEVT, NSIG * std::sqrt( NEVT ) );
+
+  // Positioned toys: each event in its bin, distributed as the efficiency.
+  const Dataset& data = efficient.generate( counts );
+  check( "positioned toy size", data.size() == NEVT );
+
+  std::map< int, unsigned > inBin;
+  std::map< int, double   > meanEff;
+  bool                      inside = true;
+  for ( std::size_t evt = 0; evt < data.size(); ++evt )
+  {
+    const double& x = data.value( "mSq12", evt );
+    const double& y = data.value( "mSq13", evt );
+
+    inside &= ps.contains( x, y ) && std::abs( data.value( "mSq23", evt ) - ( ps.mSqSum() - x - y ) ) < 1e-12;
+
+    const int& bin = binning.bin( x, y );
+    inBin  [ bin ]++;
+    meanEff[ bin ] += x;
+  }
+
+  check( "positioned toy inside the phase space", inside );
+
+  bool   sameBins = true;
+  double meanFlat = 0.0;
+  double meanAll  = 0.0;
+  double varAll   = 0.0;
+  for ( std::map< int, unsigned >::const_iterator bin = counts.begin(); bin != counts.end(); ++bin )
+  {
+    sameBins &= ( inBin[ bin->first ] == bin->second );
+    if ( ! bin->second )
+      continue;
+
+    const double& expected = sumEff[ bin->first ] / effs[ bin->first ];
+    const double& variance = sumSqEff[ bin->first ] / effs[ bin->first ] - expected * expected;
+    const double& mean     = meanEff[ bin->first ] / bin->second;
+
+    check.absolute( "mean mSq12 in bin " + std::to_string( bin->first ), mean, expected, NSIG * std::sqrt( variance / bin->second ) );
+
+    meanFlat += bin->second * sumFlat[ bin->first ] / area[ bin->first ];
+    meanAll  += meanEff[ bin->first ];
+    varAll   += bin->second * variance;
+  }
+  check( "positioned toy bins", sameBins );
+
+  // Without the efficiency, the means would be those of a flat distribution.
+  check( "mean mSq12 shifted by the efficiency", std::abs( meanAll - meanFlat ) > 10.0 * NSIG * std::sqrt( varAll ) );
+
+  // Single events follow the fractions.
+  std::map< int, unsigned > single;
+  for ( unsigned evt = 0; evt < NEVT / 10; ++evt )
+  {
+    const std::map< std::string, double >& event = efficient.generate();
+    single[ binning.bin( event.at( "mSq12" ), event.at( "mSq13" ) ) ]++;
+  }
+
+  for ( std::map< int, double >::const_iterator bin = fracEff.begin(); bin != fracEff.end(); ++bin )
+    check.absolute( "single events in bin " + std::to_string( bin->first ), single[ bin->first ], NEVT / 10 * bin->second,
+                    NSIG * std::sqrt( NEVT / 10 * bin->second ) );
+
+  return check.summary( "Binned decay generation" );
+}
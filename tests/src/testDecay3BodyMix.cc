@@ -0,0 +1,211 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <complex>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/random.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/decay3bodymix.hh>
+
+#include "check.hh"
+
+#define NGEN  ( 40000 )
+#define NBIN  ( 800   ) // Bins per dimension of the reference integrals.
+#define NSIG  ( 5.0   ) // Allowed deviation, in standard deviations.
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+
+#define GAMMA ( 2.4 )
+#define X     ( 0.3 )
+#define Y     ( 0.2 )
+
+
+// Coefficients of the time dependence at a point, as in Decay3BodyMix, from
+//    the direct and conjugated amplitudes.
+void coefficients( const Amplitude& amp, const PhaseSpace& ps, const double& mSq12, const double& mSq13,
+                   double& a, double& b, std::complex< double >& c )
+{
+  const double& mSq23 = ps.mSqSum() - mSq12 - mSq13;
+
+  const std::complex< double >& ampDir = amp.evaluate( ps, mSq12, mSq13, mSq23 );
+  const std::complex< double >& ampCnj = amp.evaluate( ps, mSq13, mSq12, mSq23 );
+
+  const std::complex< double >& apb2 =          ( ampDir + ampCnj ) / 2.0;
+  const std::complex< double >& amb2 = std::conj( ampDir - ampCnj ) / 2.0;
+
+  a = std::norm( apb2 );
+  b = std::norm( amb2 );
+  c = apb2 * amb2;
+}
+
+
+// Integral over the times above t of t^n times the time dependence, for n = 0, 1.
+double moment( const double& a, const double& b, const std::complex< double >& c, const double& t, const unsigned& n )
+{
+  const double&                gammaP = ( 1.0 - X ) * GAMMA;
+  const double&                gammaM = ( 1.0 + X ) * GAMMA;
+  const std::complex< double > gammaI = std::complex< double >( 1.0, - Y ) * GAMMA;
+
+  if ( n == 0 )
+    return a * std::exp( - gammaP * t ) / gammaP + b * std::exp( - gammaM * t ) / gammaM +
+           2.0 * std::real( c * std::exp( - gammaI * t ) / gammaI );
+
+  return a / std::pow( gammaP, 2 ) + b / std::pow( gammaM, 2 ) + 2.0 * std::real( c / std::pow( gammaI, 2 ) );
+}
+
+
+// Bin of mSq23 of a point, with the last bin for the band of the narrow resonance.
+unsigned bin( const PhaseSpace& ps, const double& mSq23, const unsigned& nBins, const double& band )
+{
+  if ( std::abs( mSq23 - band ) < 0.02 )
+    return nBins;
+
+  const double& min = ps.mSqMin( 2 );
+  const double& max = ps.mSqMax( 2 );
+
+  return std::min( unsigned( nBins * ( mSq23 - min ) / ( max - min ) ), nBins - 1 );
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Random::setSeed( 17 );
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+  Variable t    ( "t"     );
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  // The omega is much narrower than the cells of the generator.
+  Parameter mKst  ( "mKst"  , 0.8917  );
+  Parameter wKst  ( "wKst"  , 0.0508  );
+  Parameter mOmega( "mOmega", 0.78265 );
+  Parameter wOmega( "wOmega", 0.00849 );
+  Parameter mRho  ( "mRho"  , 0.7758  );
+  Parameter wRho  ( "wRho"  , 0.1464  );
+  Parameter r     ( "r"     , 1.5     );
+
+  Parameter reOmega( "reOmega", 0.04 );
+  Parameter imOmega( "imOmega", 0.01 );
+  Parameter reRho  ( "reRho"  , 1.0  );
+  Parameter imRho  ( "imRho"  , 0.0  );
+
+  Parameter width( "width", GAMMA );
+  Parameter x    ( "x"    , X     );
+  Parameter y    ( "y"    , Y     );
+
+  Amplitude amp = RelBreitWigner( 1, 2, mKst  , wKst  , r, 1 ) +
+                  Coef( reOmega, imOmega ) * RelBreitWigner( 2, 3, mOmega, wOmega, r, 1 ) +
+                  Coef( reRho  , imRho   ) * RelBreitWigner( 2, 3, mRho  , wRho  , r, 1 ) + 0.5;
+
+  Decay3BodyMix pdf( mSq12, mSq13, mSq23, t, width, amp, Coef( x, y ), ps );
+
+  // Coarse cells, whose maxima are only found by refining them.
+  pdf.setGenBins( 10 );
+
+  const double& band  = std::pow( mOmega.value(), 2 );
+  const unsigned nBins = 8;
+
+  std::vector< double > generated( nBins + 1, 0.0 );
+
+  double a;
+  double b;
+  std::complex< double > c;
+
+  // Differences of the time of each event with its mean at the Dalitz plot
+  //    point, and of the fraction of times above the lifetime with its value.
+  double diffMean     = 0.0;
+  double diffMeanSq   = 0.0;
+  double diffSurvival = 0.0;
+  double diffSurvSq   = 0.0;
+
+  bool thrown = false;
+  bool inside = true;
+  try
+  {
+    for ( unsigned evt = 0; evt < NGEN; ++evt )
+    {
+      std::map< std::string, double > event = pdf.generate();
+
+      inside &= ps.contains( event[ "mSq12" ], event[ "mSq13" ], event[ "mSq23" ] ) && ( event[ "t" ] >= 0.0 );
+      generated[ bin( ps, event[ "mSq23" ], nBins, band ) ] += 1.0;
+
+      coefficients( amp, ps, event[ "mSq12" ], event[ "mSq13" ], a, b, c );
+
+      const double& total    = moment( a, b, c, 0.0, 0 );
+      const double& mean     = moment( a, b, c, 0.0, 1 ) / total;
+      const double& survival = moment( a, b, c, 1.0 / GAMMA, 0 ) / total;
+
+      const double& dMean     = event[ "t" ] - mean;
+      const double& dSurvival = ( event[ "t" ] > 1.0 / GAMMA ? 1.0 : 0.0 ) - survival;
+
+      diffMean     += dMean;
+      diffMeanSq   += dMean * dMean;
+      diffSurvival += dSurvival;
+      diffSurvSq   += dSurvival * dSurvival;
+    }
+  }
+  catch ( const PdfException& error )
+  {
+    thrown = true;
+  }
+
+  check( "generated with a narrow resonance", ! thrown );
+  check( "events inside the phase space", inside );
+
+  // Time-integrated pdf over the Dalitz plot, in the same bins, integrated
+  //    in the square Dalitz plot so that the boundary is exact.
+  std::vector< double > expected( nBins + 1, 0.0 );
+
+  double sum = 0.0;
+  for ( unsigned binM = 0; binM < NBIN; ++binM )
+    for ( unsigned binTh = 0; binTh < NBIN; ++binTh )
+    {
+      const double& mPrime  = ( binM  + 0.5 ) / NBIN;
+      const double& thPrime = ( binTh + 0.5 ) / NBIN;
+
+      double m12;
+      double m13;
+      ps.fromSquare( mPrime, thPrime, m12, m13 );
+
+      coefficients( amp, ps, m12, m13, a, b, c );
+
+      const double& value = moment( a, b, c, 0.0, 0 ) * ps.squareJacobian( mPrime, thPrime );
+      expected[ bin( ps, ps.mSqSum() - m12 - m13, nBins, band ) ] += value;
+      sum                                                         += value;
+    }
+
+  for ( unsigned bin = 0; bin <= nBins; ++bin )
+  {
+    const double& fraction = expected[ bin ] / sum;
+    const double& sigma    = std::sqrt( NGEN * fraction * ( 1.0 - fraction ) );
+
+    const std::string& name = ( bin < nBins ) ? "events in bin " + std::to_string( bin ) : "events in the omega band";
+    check.absolute( name, generated[ bin ], NGEN * fraction, NSIG * sigma );
+  }
+
+  // Times distributed as the time dependence at each point.
+  const double& meanDiff = diffMean / NGEN;
+  const double& survDiff = diffSurvival / NGEN;
+
+  check.absolute( "time minus its mean at the point", meanDiff, 0.0,
+                  NSIG * std::sqrt( ( diffMeanSq / NGEN - meanDiff * meanDiff ) / NGEN ) );
+  check.absolute( "times above the lifetime", survDiff, 0.0,
+                  NSIG * std::sqrt( ( diffSurvSq / NGEN - survDiff * survDiff ) / NGEN ) );
+
+  return check.summary( "Mixing decay generation" );
+}
@@ -0,0 +1,212 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <complex>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/decaymixing3body.hh>
+
+#include "check.hh"
+
+#define NNORM ( 1000 ) // Points of the sample that normalizes the pdf.
+#define NEVT  ( 5000 )
+#define NSTEP ( 4000 ) // Steps of the integration over time.
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+
+
+// Integral of the pdf over time with Simpson's rule, up to many lifetimes.
+double timeIntegral( const DecayMixing3Body& pdf, const double& mSq12, const double& mSq13 )
+{
+  const double& tMax = 40.0 * pdf.tau() / ( 1.0 - std::abs( pdf.y() ) );
+  const double& step = tMax / NSTEP;
+
+  double sum = pdf.evaluate( mSq12, mSq13, 0.0 ) + pdf.evaluate( mSq12, mSq13, tMax );
+  for ( unsigned bin = 1; bin < NSTEP; ++bin )
+    sum += ( ( bin % 2 ) ? 4.0 : 2.0 ) * pdf.evaluate( mSq12, mSq13, bin * step );
+
+  return sum * step / 3.0;
+}
+
+
+// Set the parameters of the mixing and of q/p, and recompute the norm.
+void setMixing( DecayMixing3Body& pdf, const double& tau, const double& x, const double& y, const std::complex< double >& qoverp )
+{
+  std::map< std::string, Parameter > pars = pdf.getPars();
+  pars[ "tau" ].set( tau                 );
+  pars[ "x"   ].set( x                   );
+  pars[ "y"   ].set( y                   );
+  pars[ "reQ" ].set( std::real( qoverp ) );
+  pars[ "imQ" ].set( std::imag( qoverp ) );
+
+  pdf.setPars( pars );
+  pdf.cache();
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+  Variable t    ( "t"     );
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  // A fixed amplitude, different from its conjugate, so that the amplitudes
+  //    of the events are cached, and the mixing and q/p floating.
+  Parameter mKst( "mKst", 0.8917 );
+  Parameter wKst( "wKst", 0.0508 );
+  Parameter mRho( "mRho", 0.7758 );
+  Parameter wRho( "wRho", 0.1464 );
+  Parameter r   ( "r"   , 1.5    );
+
+  Parameter reRho( "reRho", 0.8 );
+  Parameter imRho( "imRho", 0.3 );
+
+  mKst .fix();
+  wKst .fix();
+  mRho .fix();
+  wRho .fix();
+  r    .fix();
+  reRho.fix();
+  imRho.fix();
+
+  Parameter tau( "tau", 0.41 , 0.01  );
+  Parameter x  ( "x"  , 0.005, 0.001 );
+  Parameter y  ( "y"  , 0.007, 0.001 );
+  Parameter reQ( "reQ", 1.0  , 0.01  );
+  Parameter imQ( "imQ", 0.0  , 0.01  );
+
+  Amplitude amp = RelBreitWigner( 1, 2, mKst, wKst, r, 1 ) + Coef( reRho, imRho ) * RelBreitWigner( 2, 3, mRho, wRho, r, 1 ) + 0.5;
+
+  DecayMixing3Body pdf( mSq12, mSq13, mSq23, t, amp, tau, x, y, Coef( reQ, imQ ), ps );
+
+  // The real and imaginary parts of q/p float with the mixing parameters.
+  check( "q/p parameters", pdf.getPars().count( "reQ" ) && pdf.getPars().count( "imQ" ) );
+
+  // Points flat over the Dalitz plot to normalize the pdf, so that the norm
+  //    is an exact sum to compare with.
+  RandomStream stream( 23 );
+
+  Dataset sample;
+  std::map< std::string, double > entry;
+  while ( sample.size() < NNORM )
+  {
+    const double& m12 = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& m13 = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& m23 = ps.mSqSum() - m12 - m13;
+    if ( ! ps.contains( m12, m13, m23 ) )
+      continue;
+
+    entry[ "mSq12" ] = m12;
+    entry[ "mSq13" ] = m13;
+    entry[ "mSq23" ] = m23;
+    sample.push( entry );
+  }
+
+  pdf.setNormSample( sample );
+  pdf.cache();
+
+  const std::vector< double >& m12s   = sample.values( "mSq12" );
+  const std::vector< double >& m13s   = sample.values( "mSq13" );
+  const double&                weight = ps.area() / NNORM;
+
+  // The Dalitz plot integrals of |A|^2, |Abar|^2 and A* Abar.
+  double                 iDir = 0.0;
+  double                 iCnj = 0.0;
+  std::complex< double > iXed = 0.0;
+  for ( unsigned point = 0; point < NNORM; ++point )
+  {
+    const double& m23 = ps.mSqSum() - m12s[ point ] - m13s[ point ];
+
+    const std::complex< double >& ampDir = amp.evaluate( ps, m12s[ point ], m13s[ point ], m23 );
+    const std::complex< double >& ampCnj = amp.evaluate( ps, m13s[ point ], m12s[ point ], m23 );
+
+    iDir += std::norm( ampDir ) * weight;
+    iCnj += std::norm( ampCnj ) * weight;
+    iXed += std::conj( ampDir ) * ampCnj * weight;
+  }
+
+  check.relative( "integral of |A|^2"   , pdf.iDir(), iDir, 1e-10 );
+  check.relative( "integral of |Abar|^2", pdf.iCnj(), iCnj, 1e-10 );
+  check.absolute( "integral of A* Abar" , std::abs( pdf.iXed() - iXed ), 0.0, 1e-10 * std::abs( iXed ) );
+
+  // The pdf integrates to one over the sample and the decay time, with and
+  //    without mixing, and with CP violation in the mixing.
+  const double                 taus   [ 3 ] = { 0.41, 0.41, 0.5 };
+  const double                 xs     [ 3 ] = { 0.0 , 0.05, -0.2 };
+  const double                 ys     [ 3 ] = { 0.0 , 0.03, 0.3  };
+  const std::complex< double > qoverps[ 3 ] = { 1.0, std::polar( 1.0, 0.3 ), std::polar( 0.8, -0.7 ) };
+  const std::string            names  [ 3 ] = { "no mixing", "mixing", "CP violation in the mixing" };
+
+  for ( unsigned point = 0; point < 3; ++point )
+  {
+    setMixing( pdf, taus[ point ], xs[ point ], ys[ point ], qoverps[ point ] );
+
+    double norm = 0.0;
+    for ( unsigned evt = 0; evt < NNORM; ++evt )
+      norm += timeIntegral( pdf, m12s[ evt ], m13s[ evt ] ) * weight;
+
+    check.relative( "norm with " + names[ point ], norm, 1.0, 1e-8 );
+  }
+
+  // The nll with the amplitudes cached for every event agrees with the sum of
+  //    the pdf evaluated at each event.
+  Dataset data;
+  while ( data.size() < NEVT )
+  {
+    const double& m12 = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& m13 = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& m23 = ps.mSqSum() - m12 - m13;
+    if ( ! ps.contains( m12, m13, m23 ) )
+      continue;
+
+    entry[ "mSq12" ] = m12;
+    entry[ "mSq13" ] = m13;
+    entry[ "mSq23" ] = m23;
+    entry[ "t"     ] = stream.exponential( 1.0 / 0.41 );
+    data.push( entry );
+  }
+
+  Nll nll( pdf, data );
+
+  const std::vector< double >& dataM12 = data.values( "mSq12" );
+  const std::vector< double >& dataM13 = data.values( "mSq13" );
+  const std::vector< double >& dataT   = data.values( "t"     );
+
+  for ( unsigned point = 0; point < 3; ++point )
+  {
+    setMixing( pdf, taus[ point ], xs[ point ], ys[ point ], qoverps[ point ] );
+
+    // The nll adds twice the yield, one for a pdf that is not extended.
+    double sum = 2.0;
+    for ( unsigned evt = 0; evt < NEVT; ++evt )
+      sum -= 2.0 * std::log( pdf.evaluate( dataM12[ evt ], dataM13[ evt ], dataT[ evt ] ) );
+
+    // All the parameters, in alphabetical order.
+    std::vector< double > pars;
+    const std::map< std::string, Parameter >& parMap = pdf.getPars();
+    for ( std::map< std::string, Parameter >::const_iterator par = parMap.begin(); par != parMap.end(); ++par )
+      pars.push_back( par->second.value() );
+
+    check.relative( "cached nll with " + names[ point ], nll( pars ), sum, 1e-12 );
+  }
+
+  return check.summary( "DecayMixing3Body" );
+}
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/eventfile.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include "check.hh"
+
+#define PATH  ( "testEventFile.bin" )
+#define NCHK  ( 3    )
+#define NEVT  ( 1000 ) // Events in each chunk written by hand.
+#define NGEN  ( 5000 ) // Events generated from the pdf.
+#define SEED  ( 42   )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  std::vector< std::string > fields;
+  fields.push_back( "x" );
+  fields.push_back( "y" );
+
+  std::map< std::string, double > pars;
+  pars[ "mu"    ] = 0.5;
+  pars[ "sigma" ] = 1.5;
+
+  // Write a few chunks of random values, keeping them to compare.
+  RandomStream stream( SEED );
+  std::vector< std::vector< std::vector< double > > > chunks( NCHK );
+
+  EventWriter writer( PATH, "test", SEED, pars, fields );
+  for ( unsigned chunk = 0; chunk < NCHK; ++chunk )
+  {
+    chunks[ chunk ].assign( fields.size(), std::vector< double >( NEVT + chunk ) );
+    for ( unsigned field = 0; field < fields.size(); ++field )
+      stream.fillNormal( &chunks[ chunk ][ field ][ 0 ], &chunks[ chunk ][ field ][ 0 ] + NEVT + chunk );
+
+    writer.write( chunks[ chunk ] );
+  }
+  writer.close();
+
+  // Read them back, in place and as a dataset.
+  {
+    EventFile file( PATH );
+
+    check( "header", ( file.model() == "test" ) && ( file.seed() == SEED ) && ( file.pars() == pars ) && ( file.fields() == fields ) );
+    check( "sizes"  , ( file.nChunks() == NCHK ) && ( file.size() == NCHK * NEVT + NCHK * ( NCHK - 1 ) / 2 ) );
+
+    const Dataset& data = file.dataset();
+
+    bool        same  = true;
+    std::size_t entry = 0;
+    for ( unsigned chunk = 0; chunk < file.nChunks() && same; ++chunk )
+    {
+      same &= ( file.chunkSize( chunk ) == NEVT + chunk );
+
+      for ( unsigned field = 0; field < fields.size(); ++field )
+      {
+        const double*                values = file.column( chunk, fields[ field ] );
+        const std::vector< double >& column = data.values( fields[ field ] );
+
+        for ( std::size_t evt = 0; evt < file.chunkSize( chunk ); ++evt )
+          same &= ( values[ evt ] == chunks[ chunk ][ field ][ evt ] ) && ( column[ entry + evt ] == values[ evt ] );
+      }
+
+      entry += file.chunkSize( chunk );
+    }
+
+    check( "written chunks", same );
+  }
+
+  // Events generated from a pdf, with its parameters in the header.
+  Variable  x    ( "x"                );
+  Parameter mu   ( "mu"   , 0.5, 0.1  );
+  Parameter sigma( "sigma", 1.5, 0.1  );
+  Gauss     gauss( x, mu, sigma );
+
+  EventWriter::generate( gauss, NGEN, PATH, SEED, 1024 );
+
+  {
+    EventFile file( PATH );
+
+    check( "generated events", ( file.size() == NGEN ) && ( file.seed() == SEED ) && ( file.pars() == pars ) &&
+                               ( file.fields() == std::vector< std::string >( 1, "x" ) ) && ( file.dataset().size() == NGEN ) );
+  }
+
+  std::remove( PATH );
+
+  return check.summary( "Event file round trip" );
+}
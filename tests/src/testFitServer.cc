@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/fitserver.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include "check.hh"
+
+#define PATH  ( "testFitServer.sock" )
+#define NEVT  ( 5000 )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable  x    ( "x" );
+  Parameter mu   ( "mu"   , 0.5, 0.1 );
+  Parameter sigma( "sigma", 1.5, 0.1 );
+  Gauss     gauss( x, mu, sigma );
+
+  RandomStream stream( 3 );
+
+  Dataset data;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    data.push( "x", stream.normal( 0.2, 1.1 ) );
+
+  Nll nll( gauss, data );
+
+  // A regular file in the place of the socket is neither removed nor replaced.
+  {
+    std::ofstream( PATH ) << "not a socket" << std::endl;
+
+    FitServer server( nll, PATH );
+
+    bool thrown = false;
+    try
+    {
+      server.run();
+    }
+    catch ( MinimizerException& )
+    {
+      thrown = true;
+    }
+
+    std::string content;
+    std::getline( std::ifstream( PATH ), content );
+
+    check( "regular file kept", thrown && content == "not a socket" );
+    std::remove( PATH );
+  }
+
+  FitServer   server( nll, PATH );
+  std::thread serving( [ &server ]() { server.run(); } );
+
+  // Wait for the server to listen.
+  FitClient* client = 0;
+  while ( ! client )
+  {
+    try
+    {
+      client = new FitClient( PATH );
+    }
+    catch ( MinimizerException& )
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  // Every request starts from the parameters the server was made with, so
+  //    the same request gives the same result whatever came before it.
+  const std::vector< std::string >& first = client->request( "fit" );
+  const std::vector< std::string >& pars  = client->request( "pars" );
+
+  client->request( "scan mu -0.5 -0.3 3 set sigma 2.0" );
+  client->request( "fit fix sigma set mu 1.0" );
+
+  check( "same fit after a scan", client->request( "fit" ) == first );
+  check( "same parameters after a scan", client->request( "pars" ) == pars );
+  check( "valid fit", ! first.empty() && first.front() == "status valid" );
+
+  // Seeded toys are reproducible.
+  check( "same seeded toys", client->request( "toy 500 2 17" ) == client->request( "toy 500 2 17" ) );
+
+  // Connections are served one at a time, so the client leaves before the next one.
+  delete client;
+
+  // A request that never ends closes the connection instead of growing without limit.
+  {
+    FitClient flood( PATH );
+
+    bool thrown = false;
+    try
+    {
+      flood.request( std::string( 100000, 'x' ) );
+    }
+    catch ( MinimizerException& )
+    {
+      thrown = true;
+    }
+
+    check( "overlong request rejected", thrown );
+  }
+
+  FitClient( PATH ).request( "quit" );
+  serving.join();
+
+  check( "socket removed", std::ifstream( PATH ).fail() );
+
+  return check.summary( "Fit server" );
+}
@@ -0,0 +1,143 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/lbfgs.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FCNBase.h>
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserParameters.h>
+
+#include "check.hh"
+
+#define NPAR  ( 40    )
+#define NEVT  ( 10000 )
+
+
+// Sum of c_i ( x_i - a_i )^2, with curvatures spread over three orders of
+//    magnitude, counting its calls.
+class Quadratic : public FCNBase
+{
+private:
+  std::vector< double > _centers;
+  std::vector< double > _curvatures;
+
+public:
+  mutable unsigned calls;
+
+  Quadratic( const std::vector< double >& centers, const std::vector< double >& curvatures )
+    : _centers( centers ), _curvatures( curvatures ), calls( 0 )
+  {}
+
+  double up() const { return 1.0; }
+
+  double operator()( const std::vector< double >& x ) const
+  {
+    ++calls;
+
+    double f = 0.0;
+    for ( std::size_t par = 0; par < x.size(); ++par )
+      f += _curvatures[ par ] * std::pow( x[ par ] - _centers[ par ], 2 );
+
+    return f;
+  }
+};
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  // Every third center is outside the box [ -1, 1 ], so its minimum is on a
+  //    limit. The last parameter is fixed away from its center.
+  std::vector< double > centers;
+  std::vector< double > curvatures;
+  std::vector< double > expected;
+
+  MnUserParameters upar;
+  for ( unsigned par = 0; par < NPAR; ++par )
+  {
+    const std::string& name = "x" + std::to_string( par );
+
+    centers   .push_back( ( par % 3 ) ? 0.9 * std::sin( par ) : 1.5 * ( ( par % 2 ) ? 1.0 : -1.0 ) );
+    curvatures.push_back( std::pow( 10.0, 3.0 * par / ( NPAR - 1 ) ) );
+    expected  .push_back( std::min( std::max( centers.back(), -1.0 ), 1.0 ) );
+
+    upar.add( name.c_str(), 0.0, 0.1 );
+    upar.setLimits( name.c_str(), -1.0, 1.0 );
+  }
+
+  upar.fix( NPAR - 1 );
+  expected.back() = 0.0;
+
+  double fMin = 0.0;
+  for ( unsigned par = 0; par < NPAR; ++par )
+    fMin += curvatures[ par ] * std::pow( expected[ par ] - centers[ par ], 2 );
+
+  Quadratic quadratic( centers, curvatures );
+
+  Lbfgs lbfgs;
+  lbfgs.setTolerance( 1e-4 );
+
+  const LbfgsMinimum& min = lbfgs.minimize( quadratic, upar );
+
+  double maxDiff = 0.0;
+  for ( unsigned par = 0; par < NPAR; ++par )
+    maxDiff = std::max( maxDiff, std::fabs( min.userParameters().value( par ) - expected[ par ] ) );
+
+  check( "valid minimum", min.isValid() );
+  check.relative( "bounded quadratic minimum", min.fval(), fMin, 1e-8 );
+  check.absolute( "bounded quadratic parameters", maxDiff, 0.0, 1e-3 );
+  check( "fixed parameter untouched", min.userParameters().value( NPAR - 1 ) == 0.0 );
+
+  // Only the calls of L-BFGS-B itself are made.
+  check( "calls counted", min.nfcn() == quadratic.calls );
+
+  // The minimizers return the same minimum as Migrad, and the Migrad polish
+  //    is only done on request.
+  Variable  x    ( "x"               );
+  Parameter mu   ( "mu"   , 0.0, 0.1 );
+  Parameter sigma( "sigma", 1.0, 0.1 );
+  Gauss     gauss( x, mu, sigma );
+
+  RandomStream stream( 8 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal( 0.4, 1.3 );
+    data.push( entry );
+  }
+
+  Nll nll( gauss, data );
+
+  const FunctionMinimum& migrad = nll.minimize();
+  const LbfgsMinimum&    fit    = nll.minimize( Lbfgs() );
+
+  check( "valid nll minimum", fit.isValid() );
+  check.absolute( "nll minimum", fit.fval(), migrad.fval(), 1e-3 );
+  // Parameters within a percent of their errors.
+  const MnUserParameters& found = fit   .userParameters();
+  const MnUserParameters& ref   = migrad.userParameters();
+  check.absolute( "nll mu"   , found.value( "mu"    ), ref.value( "mu"    ), 1e-2 * ref.error( "mu"    ) );
+  check.absolute( "nll sigma", found.value( "sigma" ), ref.value( "sigma" ), 1e-2 * ref.error( "sigma" ) );
+
+  const FunctionMinimum& polished = fit.migrad( nll );
+
+  check( "valid polished minimum", polished.isValid() );
+  check.absolute( "polished minimum", polished.fval(), migrad.fval(), 1e-3 );
+  check.relative( "polished error", polished.userParameters().error( "mu" ), migrad.userParameters().error( "mu" ), 1e-2 );
+
+  return check.summary( "L-BFGS-B" );
+}
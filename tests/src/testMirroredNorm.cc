@@ -0,0 +1,166 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <complex>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/function.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/decaymixing3body.hh>
+
+#include "check.hh"
+
+#define NBIN  ( 150 )
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+
+
+// Integrals of |A|^2, |Abar|^2 and A* Abar times the efficiency 1 + slope
+//    mSq23, evaluating both amplitudes at every cell of the full grid, on the
+//    Dalitz plot or on the square one.
+void integrals( const Amplitude& amp, const PhaseSpace& ps, const bool& square, const double& slope,
+                double& iDir, double& iCnj, std::complex< double >& iXed )
+{
+  iDir = 0.0;
+  iCnj = 0.0;
+  iXed = 0.0;
+
+  const double& min  = ps.mSq12min();
+  const double& step = square ? 1.0 / NBIN : ( ps.mSq12max() - min ) / NBIN;
+
+  for ( unsigned binX = 0; binX < NBIN; ++binX )
+    for ( unsigned binY = 0; binY < NBIN; ++binY )
+    {
+      double mSq12  = min + step * ( binX + 0.5 );
+      double mSq13  = min + step * ( binY + 0.5 );
+      double weight = step * step;
+
+      if ( square )
+      {
+        ps.fromSquare( step * ( binX + 0.5 ), step * ( binY + 0.5 ), mSq12, mSq13 );
+        weight *= ps.squareJacobian( step * ( binX + 0.5 ), step * ( binY + 0.5 ) );
+      }
+
+      const double& mSq23 = ps.mSqSum() - mSq12 - mSq13;
+      if ( ! ps.contains( mSq12, mSq13, mSq23 ) )
+        continue;
+
+      weight *= 1.0 + slope * mSq23;
+
+      const std::complex< double >& ampDir = amp.evaluate( ps, mSq12, mSq13, mSq23 );
+      const std::complex< double >& ampCnj = amp.evaluate( ps, mSq13, mSq12, mSq23 );
+
+      iDir += std::norm( ampDir ) * weight;
+      iCnj += std::norm( ampCnj ) * weight;
+      iXed += std::conj( ampDir ) * ampCnj * weight;
+    }
+}
+
+
+// Compare the integrals of the model with those of the full grid.
+void compare( Check& check, const std::string& name, DecayMixing3Body pdf, const Amplitude& amp, const PhaseSpace& ps, const bool& square )
+{
+  pdf.setSquareNorm( square );
+  pdf.setNormBins( NBIN );
+  pdf.cache();
+
+  double                 iDir;
+  double                 iCnj;
+  std::complex< double > iXed;
+  integrals( amp, ps, square, 0.0, iDir, iCnj, iXed );
+
+  check.relative( name + " integral of |A|^2"   , pdf.iDir(), iDir, 1e-10 );
+  check.relative( name + " integral of |Abar|^2", pdf.iCnj(), iCnj, 1e-10 );
+  check.absolute( name + " integral of A* Abar" , std::abs( pdf.iXed() - iXed ), 0.0, 1e-10 * std::abs( iXed ) );
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+  Variable t    ( "t"     );
+
+  // A self-conjugate final state, whose Dalitz plot is symmetric.
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  Parameter mKst( "mKst", 0.8917 );
+  Parameter wKst( "wKst", 0.0508 );
+  Parameter mRho( "mRho", 0.7758 );
+  Parameter wRho( "wRho", 0.1464 );
+  Parameter r   ( "r"   , 1.5    );
+
+  Parameter reRho( "reRho", 0.8, 0.1 );
+  Parameter imRho( "imRho", 0.3, 0.1 );
+
+  mKst.fix();
+  wKst.fix();
+  mRho.fix();
+  wRho.fix();
+  r   .fix();
+
+  Parameter tau( "tau", 0.41  );
+  Parameter x  ( "x"  , 0.005 );
+  Parameter y  ( "y"  , 0.007 );
+
+  // The amplitude with floating coefficients, and the same one fixed.
+  Amplitude floating = RelBreitWigner( 1, 2, mKst, wKst, r, 1 ) + Coef( reRho, imRho ) * RelBreitWigner( 2, 3, mRho, wRho, r, 1 ) + 0.5;
+
+  reRho.fix();
+  imRho.fix();
+  Amplitude fixed    = RelBreitWigner( 1, 2, mKst, wKst, r, 1 ) + Coef( reRho, imRho ) * RelBreitWigner( 2, 3, mRho, wRho, r, 1 ) + 0.5;
+
+  DecayMixing3Body pdfFixed   ( mSq12, mSq13, mSq23, t, fixed   , tau, x, y, ps );
+  DecayMixing3Body pdfFloating( mSq12, mSq13, mSq23, t, floating, tau, x, y, ps );
+
+  // Half of the grid with the mirrored cells gives the integrals of the full grid.
+  compare( check, "fixed amplitude"   , pdfFixed   , fixed   , ps, false );
+  compare( check, "floating amplitude", pdfFloating, floating, ps, false );
+
+  // The square grid has no mirrored cells.
+  compare( check, "square grid"       , pdfFixed   , fixed   , ps, true  );
+
+  // On the symmetric Dalitz plot, the conjugated amplitude has the same
+  //    integral as the direct one.
+  pdfFixed.setNormBins( NBIN );
+  pdfFixed.cache();
+  check.relative( "symmetric integrals", pdfFixed.iCnj(), pdfFixed.iDir(), 1e-12 );
+
+  // With a floating efficiency, the integrals are recomputed from the
+  //    amplitudes kept on the grid.
+  Parameter slope( "slope", 0.1, 0.01 );
+
+  DecayMixing3Body pdfEff = pdfFixed * ( mSq23 * slope + 1.0 );
+
+  std::map< std::string, Parameter > pars = pdfEff.getPars();
+  for ( unsigned point = 0; point < 2; ++point )
+  {
+    pars[ "slope" ].set( 0.1 + 0.2 * point );
+    pdfEff.setPars( pars );
+    pdfEff.cache();
+
+    double                 iDir;
+    double                 iCnj;
+    std::complex< double > iXed;
+    integrals( fixed, ps, false, 0.1 + 0.2 * point, iDir, iCnj, iXed );
+
+    const std::string& name = "efficiency slope " + std::to_string( 0.1 + 0.2 * point );
+    check.relative( name + " integral of |A|^2"   , pdfEff.iDir(), iDir, 1e-10 );
+    check.relative( name + " integral of |Abar|^2", pdfEff.iCnj(), iCnj, 1e-10 );
+    check.absolute( name + " integral of A* Abar" , std::abs( pdfEff.iXed() - iXed ), 0.0, 1e-10 * std::abs( iXed ) );
+  }
+
+  return check.summary( "Mirrored norm" );
+}
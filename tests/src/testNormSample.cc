@@ -0,0 +1,126 @@
+#include <cmath>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/gounarissakurai.hh>
+#include <cfit/models/decay3body.hh>
+
+#include "check.hh"
+
+#define NEVT  ( 400000 )
+#define NBIN  ( 800    )
+#define PREC  ( 1e-2   ) // Relative agreement between the sample and the grid.
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+
+
+// Compare the values of a pdf normalized on the grid and on Monte Carlo
+//    samples: one flat in the Dalitz plot, and one flat in the square Dalitz
+//    plot that counts each event with the Jacobian of the square coordinates.
+void compare( Check& check, const std::string& name, Decay3Body pdf, const Dataset& flat, const Dataset& square )
+{
+  // The first events of the flat sample are points inside the phase space.
+  const std::vector< double >& mSq12 = flat.values( "mSq12" );
+  const std::vector< double >& mSq13 = flat.values( "mSq13" );
+
+  double values[ 3 ];
+
+  pdf.setNormBins( NBIN );
+  pdf.cache();
+  for ( unsigned point = 0; point < 3; ++point )
+    values[ point ] = pdf.evaluate( mSq12[ point ], mSq13[ point ] );
+
+  pdf.setNormSample( flat );
+  pdf.cache();
+  for ( unsigned point = 0; point < 3; ++point )
+    check.relative( name + " with a flat sample", pdf.evaluate( mSq12[ point ], mSq13[ point ] ), values[ point ], PREC );
+
+  pdf.setNormSample( square, "weight" );
+  pdf.cache();
+  for ( unsigned point = 0; point < 3; ++point )
+    check.relative( name + " with a weighted sample", pdf.evaluate( mSq12[ point ], mSq13[ point ] ), values[ point ], PREC );
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  // The area of the Dalitz plot against a plain integration over mSq12.
+  const unsigned nSteps = 100000;
+  const double&  step   = ( ps.mSq12max() - ps.mSq12min() ) / nSteps;
+
+  double area = 0.0;
+  for ( unsigned bin = 0; bin < nSteps; ++bin )
+  {
+    const double& mSq = ps.mSq12min() + step * ( bin + 0.5 );
+    area += ( ps.mSq13max( mSq ) - ps.mSq13min( mSq ) ) * step;
+  }
+  check.relative( "area", ps.area(), area, 1e-6 );
+
+  RandomStream stream( 11 );
+
+  Dataset flat;
+  Dataset square;
+  std::map< std::string, double > entry;
+  while ( flat.size() < NEVT )
+  {
+    const double& x = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& y = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    if ( ! ps.contains( x, y, ps.mSqSum() - x - y ) )
+      continue;
+
+    entry[ "mSq12" ] = x;
+    entry[ "mSq13" ] = y;
+    entry[ "mSq23" ] = ps.mSqSum() - x - y;
+    flat.push( entry );
+  }
+
+  while ( square.size() < NEVT )
+  {
+    const double& mPrime  = stream.uniform();
+    const double& thPrime = stream.uniform();
+
+    ps.fromSquare( mPrime, thPrime, entry[ "mSq12" ], entry[ "mSq13" ] );
+    entry[ "mSq23"  ] = ps.mSqSum() - entry[ "mSq12" ] - entry[ "mSq13" ];
+    entry[ "weight" ] = ps.squareJacobian( mPrime, thPrime );
+    square.push( entry );
+  }
+
+  Parameter mKst ( "mKst" , 0.8917, 0.01 );
+  Parameter wKst ( "wKst" , 0.0508 );
+  Parameter mRho ( "mRho" , 0.7758 );
+  Parameter wRho ( "wRho" , 0.1464 );
+  Parameter r    ( "r"    , 1.5    );
+  Parameter reKst( "reKst", 1.5, 0.1 );
+  Parameter imKst( "imKst", -0.5, 0.1 );
+
+  // With a floating mass, the norm is summed on the points.
+  Amplitude floating = Coef( reKst, imKst ) * RelBreitWigner( 1, 2, mKst, wKst, r, 1 ) + GounarisSakurai( 2, 3, mRho, wRho, r, 1 ) + 0.3;
+  compare( check, "floating lineshapes", Decay3Body( mSq12, mSq13, mSq23, floating, ps ), flat, square );
+
+  // With fixed lineshapes, from the products of the components.
+  mKst.fix();
+  Amplitude fixed = Coef( reKst, imKst ) * RelBreitWigner( 1, 2, mKst, wKst, r, 1 ) + GounarisSakurai( 2, 3, mRho, wRho, r, 1 ) + 0.3;
+  compare( check, "fixed lineshapes", Decay3Body( mSq12, mSq13, mSq23, fixed, ps ), flat, square );
+
+  return check.summary( "Norm on a sample" );
+}
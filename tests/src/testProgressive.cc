@@ -0,0 +1,98 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/progressive.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MinuitParameter.h>
+
+#include "check.hh"
+
+#define NEVT  ( 50000 )
+
+
+// Whether adding the stage to the strategy throws.
+const bool rejected( Progressive progressive, const double& fraction, const unsigned& normBins )
+{
+  try
+  {
+    progressive.addStage( fraction, normBins );
+  }
+  catch ( const MinimizerException& error )
+  {
+    return true;
+  }
+
+  return false;
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable  x    ( "x"               );
+  Parameter mu   ( "mu"   , 0.0, 0.1 );
+  Parameter sigma( "sigma", 1.0, 0.1 );
+  Gauss     gauss( x, mu, sigma );
+
+  RandomStream stream( 17 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal( 0.6, 1.4 );
+    data.push( entry );
+  }
+
+  Nll nll( gauss, data );
+
+  // Parameters in alphabetical order: mu, sigma.
+  std::vector< double > pars;
+  pars.push_back( 0.5 );
+  pars.push_back( 1.3 );
+  const double& before = nll( pars );
+
+  // Two coarse stages on nested subsamples, and the implicit full fit.
+  Progressive progressive;
+  progressive.addStage( 0.05, 20  );
+  progressive.addStage( 0.25, 100 );
+
+  const FunctionMinimum& minProgressive = nll.minimize( progressive );
+  const FunctionMinimum& minDirect      = nll.minimize();
+
+  check( "valid minimum", minProgressive.isValid() );
+  check.absolute( "minimum", minProgressive.fval(), minDirect.fval(), 1e-3 );
+
+  // Parameters and errors of the full fit, within a few percent of the errors.
+  const std::vector< MinuitParameter >& found = minProgressive.userParameters().parameters();
+  const std::vector< MinuitParameter >& ref   = minDirect     .userParameters().parameters();
+
+  check( "number of parameters", found.size() == ref.size() );
+  for ( std::size_t par = 0; par < std::min( found.size(), ref.size() ); ++par )
+  {
+    check.absolute( ref[ par ].name(), found[ par ].value(), ref[ par ].value(), 5e-2 * ref[ par ].error() );
+    check.relative( std::string( ref[ par ].name() ) + " error", found[ par ].error(), ref[ par ].error(), 5e-2 );
+  }
+
+  // The coarse stages fit copies, and leave the nll of the full data as it was.
+  check( "nll unchanged", nll( pars ) == before );
+
+  // Malformed stages are refused.
+  check( "fraction out of range", rejected( progressive, 1.5, 100 ) );
+  check( "decreasing fraction"  , rejected( progressive, 0.1, 100 ) );
+  check( "empty norm grid"      , rejected( progressive, 0.5, 0   ) );
+
+  return check.summary( "Progressive minimization" );
+}
@@ -0,0 +1,103 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/randomstream.hh>
+
+#include "check.hh"
+
+#define NEVT  ( 1000000 )
+#define NSIG  (       5.0 ) // Allowed deviation, in standard errors.
+
+
+// Mean and variance of a sample.
+template< class T >
+void moments( const std::vector< T >& values, double& mean, double& var )
+{
+  mean = 0.0;
+  var  = 0.0;
+
+  for ( typename std::vector< T >::const_iterator value = values.begin(); value != values.end(); ++value )
+    mean += *value;
+  mean /= values.size();
+
+  for ( typename std::vector< T >::const_iterator value = values.begin(); value != values.end(); ++value )
+    var += std::pow( *value - mean, 2 );
+  var /= values.size() - 1;
+}
+
+
+// Compare the mean and variance of a sample with the expected ones. The
+//    standard error of the variance is taken from the fourth central moment,
+//    which is passed as the excess kurtosis times the squared variance.
+template< class T >
+void compare( Check& check, const std::string& name, const std::vector< T >& values, const double& expMean, const double& expVar, const double& kurtosis )
+{
+  double mean;
+  double var;
+  moments( values, mean, var );
+
+  const double& n        = values.size();
+  const double& meanErr  = std::sqrt( expVar / n );
+  const double& varErr   = expVar * std::sqrt( ( kurtosis + 2.0 ) / n );
+
+  check.absolute( name + " mean"    , mean, expMean, NSIG * meanErr );
+  check.absolute( name + " variance", var , expVar , NSIG * varErr  );
+}
+
+
+
+int main( int argc, char** argv )
+{
+  RandomStream stream( 12345 );
+
+  Check check;
+
+  std::vector< double >   values( NEVT );
+  std::vector< unsigned > counts( NEVT );
+
+  // Single draws.
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    values[ evt ] = stream.normal( 1.0, 2.0 );
+  compare( check, "normal", values, 1.0, 4.0, 0.0 );
+
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    values[ evt ] = stream.exponential( 2.0 );
+  compare( check, "exponential", values, 0.5, 0.25, 6.0 );
+
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    counts[ evt ] = stream.poisson( 3.5 );
+  compare( check, "poisson (small mean)", counts, 3.5, 3.5, 1.0 / 3.5 );
+
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    counts[ evt ] = stream.poisson( 250.0 );
+  compare( check, "poisson (large mean)", counts, 250.0, 250.0, 1.0 / 250.0 );
+
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+    counts[ evt ] = stream.binomial( 40, 0.3 );
+  compare( check, "binomial", counts, 12.0, 8.4, ( 1.0 - 6.0 * 0.3 * 0.7 ) / 8.4 );
+
+  // Batch fills.
+  stream.fill( &values[ 0 ], &values[ 0 ] + NEVT, -1.0, 3.0 );
+  compare( check, "fill", values, 1.0, 16.0 / 12.0, -1.2 );
+
+  stream.fillNormal( &values[ 0 ], &values[ 0 ] + NEVT, -2.0, 0.5 );
+  compare( check, "fillNormal", values, -2.0, 0.25, 0.0 );
+
+  stream.fillExponential( &values[ 0 ], &values[ 0 ] + NEVT, 0.5 );
+  compare( check, "fillExponential", values, 2.0, 4.0, 6.0 );
+
+  stream.fillPoisson( &counts[ 0 ], &counts[ 0 ] + NEVT, 20.0 );
+  compare( check, "fillPoisson", counts, 20.0, 20.0, 1.0 / 20.0 );
+
+  // The same seed and stream give the same sequence.
+  RandomStream first ( 7, 3 );
+  RandomStream second( 7, 3 );
+  bool same = true;
+  for ( unsigned evt = 0; evt < 1000; ++evt )
+    same &= ( first() == second() );
+  check( "same sequence from the same seed", same );
+
+  return check.summary( "Samplers" );
+}
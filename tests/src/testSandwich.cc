@@ -0,0 +1,124 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/threads.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FunctionMinimum.h>
+#include <Minuit/MnUserCovariance.h>
+#include <Minuit/MnUserParameters.h>
+
+#include "check.hh"
+
+#define NEVT  ( 20000 )
+#define NTHR  ( 4     )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable  x    ( "x"               );
+  Parameter mu   ( "mu"   , 0.0, 0.1 );
+  Parameter sigma( "sigma", 1.0, 0.1 );
+  Gauss     gauss( x, mu, sigma );
+
+  // Events with random weights, and with the same weight for all of them.
+  RandomStream stream( 37 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x"    ] = stream.normal( 0.5, 1.5 );
+    entry[ "w"    ] = stream.uniform( 0.2, 1.8 );
+    entry[ "half" ] = 0.5;
+    data.push( entry );
+  }
+
+  const std::vector< double >& xs = data.values( "x" );
+  const std::vector< double >& ws = data.values( "w" );
+
+  Nll unweighted( gauss, data );
+  Nll weighted  ( gauss, data );
+  Nll half      ( gauss, data );
+
+  weighted.setWeights( "w"    );
+  half    .setWeights( "half" );
+
+  const FunctionMinimum& minUnweighted = unweighted.minimize();
+  const FunctionMinimum& minWeighted   = weighted  .minimize();
+  const FunctionMinimum& minHalf       = half      .minimize();
+
+  // Without weights, the sandwich is the covariance of the fit, up to
+  //    statistical fluctuations.
+  const MnUserCovariance& plain   = minUnweighted.userCovariance();
+  const MnUserCovariance& sandPln = unweighted.sandwich( minUnweighted );
+
+  check.relative( "unweighted mu variance"   , sandPln( 0, 0 ), plain( 0, 0 ), 5e-2 );
+  check.relative( "unweighted sigma variance", sandPln( 1, 1 ), plain( 1, 1 ), 5e-2 );
+
+  // Halving the weights doubles the naive covariance, but not the sandwich.
+  const MnUserCovariance& naiveHalf = minHalf.userCovariance();
+  const MnUserCovariance& sandHalf  = half.sandwich( minHalf );
+
+  check.relative( "naive covariance of half weights", naiveHalf( 0, 0 ), 2.0 * plain( 0, 0 ), 1e-2 );
+  check.relative( "sandwich of half weights"        , sandHalf ( 0, 0 ), sandPln( 0, 0 )    , 1e-2 );
+  check.relative( "sandwich of half weights sigma"  , sandHalf ( 1, 1 ), sandPln( 1, 1 )    , 1e-2 );
+
+  // With random weights, the sandwich agrees with the analytic gradients of
+  //    the logarithm of the gaussian at each event.
+  const MnUserParameters& upar = minWeighted.userParameters();
+  const MnUserCovariance& cov  = minWeighted.userCovariance();
+
+  const double& m = upar.value( "mu"    );
+  const double& s = upar.value( "sigma" );
+
+  double outer[ 2 ][ 2 ] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    const double& pull = ( xs[ evt ] - m ) / s;
+    const double  grad[ 2 ] = { pull / s, ( pull * pull - 1.0 ) / s };
+
+    for ( unsigned row = 0; row < 2; ++row )
+      for ( unsigned col = 0; col < 2; ++col )
+        outer[ row ][ col ] += ws[ evt ] * ws[ evt ] * grad[ row ] * grad[ col ];
+  }
+
+  double expected[ 2 ][ 2 ] = { { 0.0, 0.0 }, { 0.0, 0.0 } };
+  for ( unsigned row = 0; row < 2; ++row )
+    for ( unsigned col = 0; col < 2; ++col )
+      for ( unsigned k = 0; k < 2; ++k )
+        for ( unsigned l = 0; l < 2; ++l )
+          expected[ row ][ col ] += cov( row, k ) * outer[ k ][ l ] * cov( l, col );
+
+  const MnUserCovariance& sandwich = weighted.sandwich( minWeighted );
+
+  check.relative( "weighted mu variance"   , sandwich( 0, 0 ), expected[ 0 ][ 0 ], 1e-5 );
+  check.relative( "weighted sigma variance", sandwich( 1, 1 ), expected[ 1 ][ 1 ], 1e-5 );
+  check.absolute( "weighted covariance"    , sandwich( 0, 1 ), expected[ 0 ][ 1 ], 1e-5 * std::sqrt( expected[ 0 ][ 0 ] * expected[ 1 ][ 1 ] ) );
+
+  // The weights of varying size make the sandwich larger than the naive covariance.
+  check( "weighted variance larger than naive", sandwich( 0, 0 ) > cov( 0, 0 ) );
+
+  // The sum is done in a fixed order, whatever the number of threads.
+  const unsigned nThreads = Threads::nThreads();
+  Threads::setNThreads( NTHR );
+  const MnUserCovariance& threaded = weighted.sandwich( minWeighted );
+  Threads::setNThreads( nThreads );
+
+  check( "same sandwich with threads", threaded( 0, 0 ) == sandwich( 0, 0 ) &&
+                                       threaded( 0, 1 ) == sandwich( 0, 1 ) &&
+                                       threaded( 1, 1 ) == sandwich( 1, 1 ) );
+
+  return check.summary( "Sandwich covariance" );
+}
@@ -0,0 +1,134 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/minimizerexpr.hh>
+#include <cfit/simultaneousnll.hh>
+#include <cfit/cachemanager.hh>
+#include <cfit/threads.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include <Minuit/FunctionMinimum.h>
+
+#include "check.hh"
+
+#define NEVT  ( 30000 )
+#define NCAT  ( 3     )
+#define NTHR  ( 4     )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  // Categories 0 and 2 share the same pdf, and all the pdfs share the mean.
+  Variable  x    ( "x"               );
+  Parameter mu   ( "mu"    , 0.0, 0.1 );
+  Parameter sigA ( "sigA"  , 1.0, 0.1 );
+  Parameter sigB ( "sigB"  , 2.0, 0.1 );
+
+  Gauss gaussA( x, mu, sigA );
+  Gauss gaussB( x, mu, sigB );
+
+  std::map< unsigned, const PdfBase* > pdfs;
+  pdfs[ 0 ] = &gaussA;
+  pdfs[ 1 ] = &gaussB;
+  pdfs[ 2 ] = &gaussA;
+
+  // Events of the categories interleaved, with a weight for each of them.
+  RandomStream stream( 13 );
+
+  Dataset data;
+  Dataset split[ 2 ];
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    const unsigned cat = evt % NCAT;
+
+    entry[ "cat" ] = cat;
+    entry[ "x"   ] = stream.normal( 0.2, ( cat == 1 ) ? 1.8 : 1.1 );
+    entry[ "w"   ] = stream.uniform( 0.5, 1.5 );
+
+    data.push( entry );
+    split[ cat == 1 ].push( entry );
+  }
+  data.setCategory( "cat" );
+
+  // Parameters in alphabetical order: mu, sigA, sigB.
+  std::vector< double > pars;
+  pars.push_back( 0.15 );
+  pars.push_back( 1.05 );
+  pars.push_back( 1.9  );
+
+  // With the caches materialized, and with them recomputed when read.
+  const std::size_t budgets[ 2 ] = { std::numeric_limits< std::size_t >::max(), 1 };
+  const std::string names  [ 2 ] = { "materialized caches", "recomputed caches" };
+
+  // Summed by several threads, whatever the number of cores.
+  Threads::setNThreads( NTHR );
+
+  for ( unsigned budget = 0; budget < 2; ++budget )
+  {
+    CacheManager::setBudget( budgets[ budget ] );
+
+    SimultaneousNll simultaneous( data, pdfs );
+
+    Nll nllA( gaussA, split[ 0 ] );
+    Nll nllB( gaussB, split[ 1 ] );
+    MinimizerExpr expr = nllA + nllB;
+
+    check( names[ budget ] + " pdfs", simultaneous.nPdfs() == 2 );
+    check.relative( names[ budget ] + " nll", simultaneous( pars ), expr( pars ), 1e-12 );
+
+    // The sum does not depend on the number of threads but for rounding.
+    Threads::setNThreads( 1 );
+    check.relative( names[ budget ] + " nll with one thread", simultaneous( pars ), expr( pars ), 1e-12 );
+    Threads::setNThreads( NTHR );
+
+    // Weighted events, read in the order of the blocks.
+    simultaneous.setWeights( "w" );
+    nllA.setWeights( "w" );
+    nllB.setWeights( "w" );
+    MinimizerExpr weighted = nllA + nllB;
+
+    check.relative( names[ budget ] + " weighted nll", simultaneous( pars ), weighted( pars ), 1e-12 );
+
+    // The weights of appended events go at the end of their block.
+    Dataset more;
+    Dataset moreSplit[ 2 ];
+    for ( unsigned evt = 0; evt < NEVT / 10; ++evt )
+    {
+      const unsigned cat = ( 7 * evt ) % NCAT;
+
+      entry[ "cat" ] = cat;
+      entry[ "x"   ] = stream.normal( 0.2, ( cat == 1 ) ? 1.8 : 1.1 );
+      entry[ "w"   ] = stream.uniform( 0.5, 1.5 );
+
+      more.push( entry );
+      moreSplit[ cat == 1 ].push( entry );
+    }
+    more.setCategory( "cat" );
+
+    simultaneous.append( more );
+    weighted.append( 0, moreSplit[ 0 ] );
+    weighted.append( 1, moreSplit[ 1 ] );
+
+    check.relative( names[ budget ] + " appended weighted nll", simultaneous( pars ), weighted( pars ), 1e-12 );
+
+    const FunctionMinimum& minSimultaneous = simultaneous.minimize();
+    const FunctionMinimum& minExpr         = weighted    .minimize();
+
+    check.absolute( names[ budget ] + " minimum", minSimultaneous.fval(), minExpr.fval(), 1e-4 );
+  }
+
+  return check.summary( "Simultaneous nll" );
+}
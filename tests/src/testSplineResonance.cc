@@ -0,0 +1,216 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <complex>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/coef.hh>
+#include <cfit/amplitude.hh>
+#include <cfit/phasespace.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/relbreitwigner.hh>
+#include <cfit/models/splineresonance.hh>
+#include <cfit/models/decay3body.hh>
+
+#include "check.hh"
+
+#define NKNOT ( 10   )
+#define NBIN  ( 200  )
+#define NEVT  ( 5000 )
+
+#define MD0   ( 1.86484  )
+#define MKS   ( 0.497614 )
+#define MPI   ( 0.13957  )
+
+
+// Whether building a spline with the given knots and coefficients throws.
+const bool rejected( const std::vector< double >& knots, const std::vector< Coef >& coefs )
+{
+  try
+  {
+    SplineResonance spline( 2, 3, knots, coefs );
+  }
+  catch ( const PdfException& error )
+  {
+    return true;
+  }
+
+  return false;
+}
+
+
+// Sum of the pdf over the cells of its norm grid, times their area.
+double gridSum( const Decay3Body& pdf, const PhaseSpace& ps )
+{
+  const double& min  = ps.mSq12min();
+  const double& step = ( ps.mSq12max() - min ) / NBIN;
+
+  double sum = 0.0;
+  for ( unsigned binX = 0; binX < NBIN; ++binX )
+    for ( unsigned binY = 0; binY < NBIN; ++binY )
+    {
+      const double& mSq12 = min + step * ( binX + 0.5 );
+      const double& mSq13 = min + step * ( binY + 0.5 );
+      const double& mSq23 = ps.mSqSum() - mSq12 - mSq13;
+      if ( ps.contains( mSq12, mSq13, mSq23 ) )
+        sum += pdf.evaluate( mSq12, mSq13, mSq23 ) * step * step;
+    }
+
+  return sum;
+}
+
+
+// Set the knots to the given values, slope and offset, as functions of the
+//    position of the knot, in the parameters of the pdf.
+void setKnots( std::map< std::string, Parameter >& pars, const std::complex< double >& offset, const std::complex< double >& slope )
+{
+  for ( unsigned knot = 0; knot < NKNOT; ++knot )
+  {
+    const std::complex< double >& value = offset + slope * double( knot );
+    pars[ "re" + std::to_string( knot ) ].set( std::real( value ) );
+    pars[ "im" + std::to_string( knot ) ].set( std::imag( value ) );
+  }
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Variable mSq12( "mSq12" );
+  Variable mSq13( "mSq13" );
+  Variable mSq23( "mSq23" );
+
+  PhaseSpace ps( MD0, MKS, MPI, MPI );
+
+  // Knots unevenly spaced over the range of mSq23, with floating values.
+  std::vector< double    > knots;
+  std::vector< Parameter > parts;
+  std::vector< Coef      > coefs;
+  for ( unsigned knot = 0; knot < NKNOT; ++knot )
+  {
+    knots.push_back( 0.05 + 1.9 * std::pow( knot / double( NKNOT - 1 ), 1.3 ) );
+    parts.push_back( Parameter( "re" + std::to_string( knot ), 1.0 - 0.1 * knot, 0.1 ) );
+    parts.push_back( Parameter( "im" + std::to_string( knot ), 0.05 * knot     , 0.1 ) );
+    coefs.push_back( Coef( parts[ 2 * knot ], parts[ 2 * knot + 1 ] ) );
+  }
+
+  SplineResonance spline( 2, 3, knots, coefs );
+
+  // The spline goes through the knots, and is linear in the mass if the
+  //    knot values are. It vanishes outside the range of the knots.
+  bool throughKnots = true;
+  for ( unsigned knot = 0; knot < NKNOT; ++knot )
+    throughKnots &= std::abs( spline.propagator( ps, knots[ knot ] ) - spline.values()[ knot ] ) < 1e-14;
+  check( "values at the knots", throughKnots );
+
+  double maxLinear = 0.0;
+  double maxUnity  = 0.0;
+  for ( unsigned point = 0; point <= 1000; ++point )
+  {
+    const double& mSq = knots.front() + ( knots.back() - knots.front() ) * point / 1000.0;
+    const std::vector< double >& weights = spline.basis( mSq );
+
+    double sum    = 0.0;
+    double linear = 0.0;
+    for ( unsigned knot = 0; knot < NKNOT; ++knot )
+    {
+      sum    += weights[ knot ];
+      linear += weights[ knot ] * knots[ knot ];
+    }
+
+    maxUnity  = std::max( maxUnity , std::abs( sum    - 1.0 ) );
+    maxLinear = std::max( maxLinear, std::abs( linear - mSq ) );
+  }
+  check.absolute( "weights add up to one", maxUnity , 0.0, 1e-12 );
+  check.absolute( "linear values"        , maxLinear, 0.0, 1e-12 );
+  check( "zero outside the knots", spline.propagator( ps, 0.01 ) == 0.0 && spline.propagator( ps, 2.5 ) == 0.0 );
+
+  // Malformed knots are refused.
+  std::vector< double > unsorted = knots;
+  std::swap( unsorted[ 2 ], unsorted[ 3 ] );
+  check( "unsorted knots"   , rejected( unsorted, coefs ) );
+  check( "missing coefs"    , rejected( knots, std::vector< Coef >( coefs.begin(), coefs.end() - 1 ) ) );
+  check( "a single knot"    , rejected( std::vector< double >( 1, 0.5 ), std::vector< Coef >( 1, coefs[ 0 ] ) ) );
+
+  // A Dalitz plot model with the spline as S-wave, whose norm is a quadratic
+  //    form of the knot values, stays normalized when they float.
+  Parameter mKst( "mKst", 0.8917 );
+  Parameter wKst( "wKst", 0.0508 );
+  Parameter r   ( "r"   , 1.5    );
+
+  mKst.fix();
+  wKst.fix();
+  r   .fix();
+
+  Amplitude amp = RelBreitWigner( 1, 2, mKst, wKst, r, 1 ) + spline;
+
+  Decay3Body pdf( mSq12, mSq13, mSq23, amp, ps );
+  pdf.setNormBins( NBIN );
+
+  std::map< std::string, Parameter > pars = pdf.getPars();
+
+  const std::complex< double > offsets[ 2 ] = { std::complex< double >( 1.0, 0.0 ), std::complex< double >( -0.5, 2.0 ) };
+  const std::complex< double > slopes [ 2 ] = { std::complex< double >( -0.1, 0.05 ), std::complex< double >( 0.3, -0.2 ) };
+
+  for ( unsigned point = 0; point < 2; ++point )
+  {
+    setKnots( pars, offsets[ point ], slopes[ point ] );
+    pdf.setPars( pars );
+    pdf.cache();
+
+    check.relative( "norm at knots " + std::to_string( point ), gridSum( pdf, ps ), 1.0, 1e-10 );
+  }
+
+  // The nll with floating knots agrees with the sum of the pdf at the events.
+  RandomStream stream( 29 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  while ( data.size() < NEVT )
+  {
+    const double& m12 = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& m13 = stream.uniform( ps.mSq12min(), ps.mSq12max() );
+    const double& m23 = ps.mSqSum() - m12 - m13;
+    if ( ! ps.contains( m12, m13, m23 ) )
+      continue;
+
+    entry[ "mSq12" ] = m12;
+    entry[ "mSq13" ] = m13;
+    entry[ "mSq23" ] = m23;
+    data.push( entry );
+  }
+
+  Nll nll( pdf, data );
+
+  const std::vector< double >& m12s = data.values( "mSq12" );
+  const std::vector< double >& m13s = data.values( "mSq13" );
+  const std::vector< double >& m23s = data.values( "mSq23" );
+
+  for ( unsigned point = 0; point < 2; ++point )
+  {
+    setKnots( pars, offsets[ point ], slopes[ point ] );
+    pdf.setPars( pars );
+    pdf.cache();
+
+    // The nll adds twice the yield, one for a pdf that is not extended.
+    double sum = 2.0;
+    for ( unsigned evt = 0; evt < NEVT; ++evt )
+      sum -= 2.0 * std::log( pdf.evaluate( m12s[ evt ], m13s[ evt ], m23s[ evt ] ) );
+
+    // All the parameters, in alphabetical order.
+    std::vector< double > values;
+    for ( std::map< std::string, Parameter >::const_iterator par = pars.begin(); par != pars.end(); ++par )
+      values.push_back( par->second.value() );
+
+    check.relative( "nll at knots " + std::to_string( point ), nll( values ), sum, 1e-12 );
+  }
+
+  return check.summary( "Spline resonance" );
+}
@@ -0,0 +1,130 @@
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <cfit/parameter.hh>
+#include <cfit/variable.hh>
+#include <cfit/dataset.hh>
+#include <cfit/nll.hh>
+#include <cfit/threads.hh>
+#include <cfit/randomstream.hh>
+
+#include <cfit/models/gauss.hh>
+
+#include "check.hh"
+
+#define NTHR  ( 4     )
+#define NIDX  ( 1000  ) // Indices of each nested loop.
+#define NEVT  ( 20000 )
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  Threads::setNThreads( NTHR );
+
+  // Threads that ran any of the loops, and whether the nested loops ran on
+  //    the worker that started them, as a single chunk, in order.
+  std::mutex                     mutex;
+  std::set< std::thread::id >    ids;
+  std::vector< bool >            workers ( NTHR, false );
+  std::vector< bool >            serial  ( NTHR, false );
+  std::vector< unsigned long >   sums    ( NTHR, 0     );
+
+  Threads::chunks( NTHR, [ & ]( const std::size_t& first, const std::size_t& last, const unsigned& thread )
+  {
+    const std::thread::id& id = std::this_thread::get_id();
+
+    bool inside = Threads::inWorker() && ( Threads::nThreads() == 1 );
+    unsigned nChunks = 0;
+
+    Threads::chunks( NIDX, [ & ]( const std::size_t& begin, const std::size_t& end, const unsigned& chunk )
+    {
+      inside &= ( std::this_thread::get_id() == id ) && ( begin == 0 ) && ( end == NIDX ) && ( chunk == 0 );
+      ++nChunks;
+
+      for ( std::size_t index = begin; index < end; ++index )
+        sums[ thread ] += index;
+    } );
+
+    std::size_t expected = 0;
+    Threads::forEach( NIDX, [ & ]( const std::size_t& index, const unsigned& chunk )
+    {
+      inside &= ( std::this_thread::get_id() == id ) && ( index == expected++ ) && ( chunk == 0 );
+    } );
+
+    std::lock_guard< std::mutex > lock( mutex );
+    ids.insert( id );
+    workers[ thread ] = inside;
+    serial [ thread ] = ( nChunks == 1 ) && ( expected == NIDX );
+  } );
+
+  bool allWorkers = true;
+  bool allSerial  = true;
+  bool allSums    = true;
+  for ( unsigned thread = 0; thread < NTHR; ++thread )
+  {
+    allWorkers &= workers[ thread ];
+    allSerial  &= serial [ thread ];
+    allSums    &= ( sums[ thread ] == NIDX * ( NIDX - 1 ) / 2 );
+  }
+
+  check( "one thread per outer chunk", ids.size() == NTHR );
+  check( "nested loops run on their worker", allWorkers );
+  check( "nested loops run serially", allSerial );
+  check( "nested sums", allSums );
+  check( "main thread is not a worker", ! Threads::inWorker() && ( Threads::nThreads() == NTHR ) );
+
+  // Loops started again from the main thread still use every thread.
+  ids.clear();
+  Threads::forEach( 64, [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+    std::lock_guard< std::mutex > lock( mutex );
+    ids.insert( std::this_thread::get_id() );
+  } );
+  check( "parallel after nesting", ids.size() > 1 );
+
+  // The nll of each worker, as in the fits of a bootstrap, agrees with the
+  //    nll summed by all the threads.
+  Variable  x    ( "x"                );
+  Parameter mu   ( "mu"   , 0.0, 0.1  );
+  Parameter sigma( "sigma", 1.0, 0.1  );
+  Gauss     gauss( x, mu, sigma );
+
+  RandomStream stream( 3 );
+
+  Dataset data;
+  std::map< std::string, double > entry;
+  for ( unsigned evt = 0; evt < NEVT; ++evt )
+  {
+    entry[ "x" ] = stream.normal( 0.2, 1.1 );
+    data.push( entry );
+  }
+
+  std::vector< double > pars;
+  pars.push_back( 0.1 );
+  pars.push_back( 1.2 );
+
+  Nll nll( gauss, data );
+  const double& parallel = nll( pars );
+
+  std::vector< double > nested( NTHR, 0.0 );
+  Threads::forEach( NTHR, [ & ]( const std::size_t& index, const unsigned& thread )
+  {
+    Nll copy( gauss, data );
+    nested[ index ] = copy( pars );
+  } );
+
+  for ( unsigned index = 0; index < NTHR; ++index )
+    check.relative( "nested nll " + std::to_string( index ), nested[ index ], parallel, 1e-12 );
+
+  return check.summary( "Nested threads" );
+}
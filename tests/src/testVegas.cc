@@ -0,0 +1,77 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <iostream>
+
+#include <cfit/vegas.hh>
+#include <cfit/randomstream.hh>
+
+#include "check.hh"
+
+#define MEANX  ( 0.4  )
+#define MEANY  ( 0.6  )
+#define SIGMA  ( 0.05 )
+#define PREC   ( 1e-3 ) // Required relative precision.
+
+
+// Integral of a normal density over [ 0, 1 ].
+double normalIntegral( double mean, double sigma )
+{
+  return 0.5 * ( std::erf( ( 1.0 - mean ) / ( std::sqrt( 2.0 ) * sigma ) ) + std::erf( mean / ( std::sqrt( 2.0 ) * sigma ) ) );
+}
+
+
+// Compare an estimate with the exact value of an integral, which it has to
+//    reach with the required precision and within its error.
+void compare( Check& check, const std::string& name, const double& value, const double& error, const double& exact )
+{
+  check.relative( name, value, exact, PREC );
+  check.absolute( name + " within its error", value, exact, 5.0 * error );
+}
+
+
+
+int main( int argc, char** argv )
+{
+  Check check;
+
+  RandomStream stream( 2024 );
+
+  // Narrow two-dimensional normal density, which a flat sampling resolves poorly.
+  const Vegas::Integrand peak = []( const std::vector< double >& x )
+  {
+    return std::exp( - ( std::pow( x[ 0 ] - MEANX, 2 ) + std::pow( x[ 1 ] - MEANY, 2 ) ) / ( 2.0 * SIGMA * SIGMA ) ) /
+           ( 2.0 * M_PI * SIGMA * SIGMA );
+  };
+
+  const double& exactPeak = normalIntegral( MEANX, SIGMA ) * normalIntegral( MEANY, SIGMA );
+
+  Vegas vegas( 2 );
+  vegas.adapt( peak, 20000, 8, stream );
+  compare( check, "adapted estimate of the peak", vegas.integral(), vegas.error(), exactPeak );
+
+  // Frozen stratified sample of the adapted grid.
+  std::vector< std::vector< double > > points;
+  std::vector< double >                weights;
+  std::vector< unsigned >              strata;
+  std::vector< double >                values;
+
+  vegas.sample( 200000, stream, points, weights, strata );
+  Vegas::evaluate( peak, points, weights, values );
+
+  const double& sum = std::accumulate( values.begin(), values.end(), 0.0 );
+  compare( check, "sample of the peak", sum, Vegas::error( values, strata ), exactPeak );
+
+  // Smooth three-dimensional integrand, with integral 1.
+  const Vegas::Integrand cube = []( const std::vector< double >& x )
+  {
+    return 27.0 * std::pow( x[ 0 ] * x[ 1 ] * x[ 2 ], 2 );
+  };
+
+  Vegas vegas3( 3 );
+  vegas3.adapt( cube, 20000, 5, stream );
+  compare( check, "adapted estimate of the cube", vegas3.integral(), vegas3.error(), 1.0 );
+
+  return check.summary( "Integrals" );
+}
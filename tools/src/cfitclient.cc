@@ -0,0 +1,63 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cfit/fitserver.hh>
+
+
+// Command line client of the fit server. The request is either given in the
+//    command line, or read from the standard input, one request per line:
+//
+//    cfitclient /tmp/cfit.sock fit fix mass set width 0.01
+//    cfitclient /tmp/cfit.sock < requests.txt
+int main( int argc, char** argv )
+{
+  if ( argc < 2 )
+  {
+    std::cerr << "Usage: " << argv[ 0 ] << " <socket> [<request>...]" << std::endl;
+    return 2;
+  }
+
+  std::vector< std::string > requests;
+
+  if ( argc > 2 )
+  {
+    std::string request = argv[ 2 ];
+    for ( int arg = 3; arg < argc; ++arg )
+      request += std::string( " " ) + argv[ arg ];
+    requests.push_back( request );
+  }
+  else
+  {
+    std::string request;
+    while ( std::getline( std::cin, request ) )
+      if ( ! request.empty() )
+        requests.push_back( request );
+  }
+
+  bool failed = false;
+
+  try
+  {
+    FitClient client( argv[ 1 ] );
+
+    typedef std::vector< std::string >::const_iterator rIter;
+    for ( rIter request = requests.begin(); request != requests.end(); ++request )
+    {
+      const std::vector< std::string >& response = client.request( *request );
+
+      for ( rIter line = response.begin(); line != response.end(); ++line )
+      {
+        std::cout << *line << std::endl;
+        failed |= ( line->compare( 0, 6, "error " ) == 0 );
+      }
+    }
+  }
+  catch ( MinimizerException& error )
+  {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+
+  return failed ? 1 : 0;
+}